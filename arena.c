@@ -0,0 +1,162 @@
+/*******************************************************
+* arena.c -            bump allocator for compiler-lifetime
+*                      objects, and string interning
+* Language:            Micro
+*
+* Memory comes in chunks of ARENA_CHUNK bytes, and is
+* handed out by bumping a pointer; a request that does
+* not fit in the current chunk starts a new one (of its
+* own size if bigger). All chunks go back in one shot
+* with arena_release().
+********************************************************/
+
+#include "compiler.h"
+#include "arena.h"
+
+#define ARENA_ALIGN 16        // enough for any object we store
+#define INTERN_SIZE 1024      // buckets; a power of 2
+
+struct arenaChunk{
+    struct arenaChunk* next;
+    size_t size;              // usable bytes in data[]
+    size_t top;               // first free byte in data[]
+    char* data;
+};
+
+struct internNode{
+    struct internNode* next;
+    unsigned hash;
+    char s[];
+};
+
+arena compileArena;
+
+static struct internNode* internTab[INTERN_SIZE];
+
+static struct arenaChunk*
+newChunk(arena* a, size_t size)
+{
+    struct arenaChunk* c;
+    size_t hdr;
+
+    hdr = (sizeof(struct arenaChunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if ( (NULL == (c = malloc(hdr + size)) ) )
+	errExit(1, "...malloc()...");
+    a->mallocs++;
+
+    c->size = size;
+    c->top = 0;
+    c->data = (char*) c + hdr;
+    c->next = a->head;
+    a->head = c;
+
+    return c;
+}
+
+void*
+arena_alloc(arena* a, size_t size)
+{
+    struct arenaChunk* c;
+    void* p;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+    c = a->head;
+    if ( (NULL == c) || (c->size - c->top < size) )
+	c = newChunk(a, max(size, ARENA_CHUNK));
+
+    p = c->data + c->top;
+    c->top += size;
+    a->used += size;
+    if ( (a->used > a->peak) )
+	a->peak = a->used;
+
+    return p;
+}
+
+char*
+arena_strdup(arena* a, const char* s)
+{
+    size_t len;
+    char* p;
+
+    len = strlen(s) + 1;
+    p = arena_alloc(a, len);
+    memcpy(p, s, len);
+
+    return p;
+}
+
+// Returns: the one copy of s in compileArena; equal strings
+//          give equal pointers (until compileArena is released)
+const char*
+arena_intern(const char* s)
+{
+    struct internNode* np;
+    unsigned h;
+    size_t len;
+
+    for (h = 2166136261u, len = 0; s[len] != '\0'; len++) // FNV-1a
+	h = (h ^ (unsigned char) s[len]) * 16777619u;
+
+    for (np = internTab[h & (INTERN_SIZE - 1)]; NULL != np; np = np->next)
+	if ( (np->hash == h) && (0 == strcmp(np->s, s)) )
+	    return np->s;
+
+    np = arena_alloc(&compileArena, sizeof(struct internNode) + len + 1);
+    memcpy(np->s, s, len + 1);
+    np->hash = h;
+    np->next = internTab[h & (INTERN_SIZE - 1)];
+    internTab[h & (INTERN_SIZE - 1)] = np;
+
+    return np->s;
+}
+
+arenaMark
+arena_mark(const arena* a)
+{
+    arenaMark m;
+
+    m.chunk = a->head;
+    m.top = (a->head)? a->head->top : 0;
+    m.used = a->used;
+
+    return m;
+}
+
+// give back everything allocated since m was taken; chunks
+// started since then are freed
+void
+arena_reset(arena* a, arenaMark m)
+{
+    struct arenaChunk* c;
+
+    while ( (a->head != m.chunk) ){
+	c = a->head;
+	a->head = c->next;
+	free(c);
+    }
+    if (a->head)
+	a->head->top = m.top;
+    a->used = m.used;
+}
+
+void
+arena_release(arena* a)
+{
+    struct arenaChunk* c;
+
+    while ( (NULL != (c = a->head)) ){
+	a->head = c->next;
+	free(c);
+    }
+    a->used = 0;
+    if ( (&compileArena == a) )
+	memset(internTab, 0, sizeof(internTab));
+}
+
+void
+arena_printStats(FILE* out, const arena* a)
+{
+    fprintf(out, "arena: %ld malloc() calls, %zu bytes in use, "
+	    "%zu bytes peak\n", a->mallocs, a->used, a->peak);
+}
@@ -0,0 +1,51 @@
+/*******************************************************
+* arena.h -            header file for arena.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         p = arena_alloc(&compileArena, sizeof(*p));
+*         s = arena_strdup(&compileArena, name);
+*         s = arena_intern("placeholder");  // one copy only
+*         m = arena_mark(&compileArena); ...
+*         arena_reset(&compileArena, m);    // drop what followed
+*         arena_release(&compileArena);     // all of it
+* Nothing taken from an arena is freed on its own.
+********************************************************/
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define ARENA_CHUNK 65536   // bytes per chunk, unless more asked for
+
+struct arenaChunk;
+
+typedef struct arena{
+    struct arenaChunk* head;   // current chunk; older ones follow
+    size_t used;               // bytes handed out, not yet reset
+    size_t peak;               // high-water mark of used
+    long mallocs;              // malloc() calls made for chunks
+} arena;
+
+typedef struct arenaMark{
+    struct arenaChunk* chunk;
+    size_t top;
+    size_t used;
+} arenaMark;
+
+// owned by the compilation: symbols, strings, and other nodes
+// that live until the end of it
+extern arena compileArena;
+
+void* arena_alloc(arena* a, size_t size);
+char* arena_strdup(arena* a, const char* s);
+const char* arena_intern(const char* s);
+arenaMark arena_mark(const arena* a);
+void arena_reset(arena* a, arenaMark m);
+void arena_release(arena* a);
+void arena_printStats(FILE* out, const arena* a);
+
+#endif
@@ -0,0 +1,112 @@
+/*******************************************************
+* ast.c -              build the AST, and lay it out
+* Language:            Micro
+*
+* The parser builds a tree bottom-up: the nodes go into
+* a scratch buffer as their parse completes, each after
+* its children (postorder), so a parent spans the nodes
+* added since the mark taken where its first child began.
+* ast_close() copies the tree into astArena in preorder,
+* which code generation walks front to back, and sets
+* the types of the infixes in one pass from the back
+* (every node comes after its parent).
+********************************************************/
+
+#include <limits.h>
+#include "compiler.h"
+#include "ast.h"
+
+arena astArena;
+
+static astNode* build;       // the tree under way, in postorder
+static astIndex buildLen, buildCap;
+static astIndex* stack;      // ast_close(): subtrees to copy
+static astIndex stackCap;
+
+// Returns: where the subtree parsed next starts
+astIndex
+ast_mark(void) { return buildLen; }
+
+// kind: AST_XXX; its children are the subtrees added since from
+// Returns: the node, to be filled in before the next one is added
+astNode*
+ast_add(int kind, int type, astIndex from)
+{
+    astNode* n;
+
+    if ( (buildLen == buildCap) ){
+	if ( (INT_MAX / 2 < buildCap) )
+	    errExit(0, "statement too large");
+	buildCap = (buildCap)? 2 * buildCap : 256;
+	if ( (NULL == (build = realloc(build, buildCap * sizeof(astNode)))) )
+	    errExit(1, "...realloc()...");
+    }
+
+    n = &build[buildLen];
+    n->kind = kind;
+    n->type = type;
+    n->op = 0;
+    n->size = buildLen - from + 1;
+    n->val_int = 0;
+    buildLen++;
+
+    return n;
+}
+
+// the usual conventions (see checkCast()): int, long, float
+static int
+widerType(int a, int b) { return max(a, b); }
+
+// types of infixes, from those of their operands; these come after
+// them, so one pass from the back sees every operand first
+static void
+setTypes(astNode* t)
+{
+    astNode* n;
+    const astNode* lhs;
+    astIndex i;
+
+    for (i = t->size; i-- > 0; ){
+	n = &t[i];
+	if ( (AST_INFIX != n->kind) )
+	    continue;
+	lhs = n + 1;
+	n->type = widerType(lhs->type, (lhs + lhs->size)->type);
+    }
+}
+
+// Returns: the tree built since the last call, in preorder, in
+//          astArena; NULL if none was
+const astNode*
+ast_close(void)
+{
+    astNode* t;
+    astIndex n, c, sp, len;
+
+    if ( (0 == buildLen) )
+	return NULL;
+    if ( (build[buildLen - 1].size != buildLen) )
+	errExit(0, "ast: more than one tree under way");
+
+    if ( (stackCap < buildLen) ){
+	stackCap = buildLen;
+	if ( (NULL == (stack = realloc(stack, stackCap * sizeof(astIndex)))) )
+	    errExit(1, "...realloc()...");
+    }
+    t = arena_alloc(&astArena, buildLen * sizeof(astNode));
+
+    // a node, then its children; these end right before it, the
+    // last one first: pushed in that order, the first one is next
+    sp = len = 0;
+    stack[sp++] = buildLen - 1;
+    while ( (0 != sp) ){
+	n = stack[--sp];
+	t[len++] = build[n];
+	for (c = n; c > n + 1 - build[n].size; c -= build[c - 1].size)
+	    stack[sp++] = c - 1;
+    }
+
+    buildLen = 0;
+    setTypes(t);
+    return t;
+}
@@ -3,6 +3,12 @@
 * Language:        Micro
 *
 ****************************************************************
+* Usage:
+*         m = ast_mark();           // where a subtree starts
+*         ... parse its children ...
+*         n = ast_add(AST_INFIX, INVALID, m); n->op = MUL;
+*         t = ast_close();          // the tree, in preorder
+*         astgen_tree(t);           // its code (astgen.c)
 * Note:  as we can't use inheritance (->C++), we assign
 *        an "exprRecord" for all types of results, with the usual
 *        work-around of having a 'kind' enumeration.
@@ -11,8 +17,10 @@
 #ifndef AST_H_
 #define AST_H_
 
+#include <stdint.h>
 #include "hashtab.h"
 #include "compiler.h"
+#include "arena.h"
 
 typedef char stringID[MAX_ID_LEN+1];
 
@@ -32,11 +40,50 @@ enum types{ INVALID = 0, INTEGER = 1, LONG = 2, FLOAT =3, FCT_DECL = 4,
 typedef struct expression {
     enum expr kind;
     union {
-	stringID name;  // will hold its identifierStr, if any
+	int slot;          // EXPR_ID, EXPR_TMP: its storage (temp&slot)
 	long val_int;      // will hold its numValue, if any
 	double val_flt;    // will hold its fltVal, if any
     };
     enum types type; 
 } exprRecord;
 
+// A tree is an array of nodes in preorder: the children of node i
+// follow it, the first at i + 1, each next one past the subtree of
+// the one before (at c + c->size). Nodes refer to one another by
+// these 32-bit offsets only, never by pointers.
+typedef uint32_t astIndex;
+
+enum astKind { 
+    AST_ID, AST_INT, AST_FLT, AST_INFIX, AST_CALL,   // expressions
+    AST_DECL, AST_ASSIGN, AST_READ, AST_WRITE,       // statements
+    AST_BLOCK, AST_IF, AST_WHILE, AST_COND,
+    AST_FUNCTION, AST_PARAM, AST_RETURN };
+
+// children:  INFIX: LHS, RHS;  CALL: arguments;  DECL: initial
+//            value, if any;  ASSIGN: value;  READ: IDs;  WRITE:
+//            expressions;  BLOCK: statements;  IF: COND, BLOCK
+//            [, BLOCK];  WHILE: COND, BLOCK;  COND: LHS, RHS;
+//            FUNCTION: PARAMs, statements, RETURN;  RETURN: value
+typedef struct astNode{
+    unsigned char kind;    // enum astKind
+    unsigned char type;    // enum types: of its value (FUNCTION:
+			   // returned; DECL, PARAM: declared)
+    short op;              // INFIX: enum oper; COND: relation (token);
+			   // FUNCTION: linkage
+    astIndex size;         // nodes in its subtree, itself included
+    union {
+	struct nlist* sym;     // ID, DECL, PARAM, ASSIGN, CALL
+	const char* name;      // FUNCTION
+	long val_int;          // INT
+	double val_flt;        // FLT
+    };
+} astNode;
+
+// trees closed, with the names they hold
+extern arena astArena;
+
+astIndex ast_mark(void);
+astNode* ast_add(int kind, int type, astIndex from);
+const astNode* ast_close(void);
+
 #endif
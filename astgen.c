@@ -0,0 +1,241 @@
+/*******************************************************
+* astgen.c -           generate code for an AST
+* Language:            Micro
+*
+* One walk of a tree, front to back, in the order the
+* source gives: the code of each node is generated with
+* the wrappers of codegen.c, once those of its children
+* are. Variables get their storage, and loops and ifs
+* their labels, as the walk comes to them, so temps and
+* variables are numbered in the order of the source.
+********************************************************/
+
+#include "compiler.h"
+#include "ast.h"
+#include "codegen.h"
+#include "peval.h"
+
+static void genStatement(const astNode* n);
+
+// Returns: the first child of n (if it has any)
+static const astNode*
+child(const astNode* n) { return n + 1; }
+
+// Returns: the child of n's parent after n
+static const astNode*
+next(const astNode* n) { return n + n->size; }
+
+// Returns: one past the last child of n
+static const astNode*
+end(const astNode* n) { return n + n->size; }
+
+// Returns: the record of the value of n (dest: see generateInfix())
+// a + b + c is (a + b) + c: the infixes of such a chain each come
+// right before their left operand, so the walk goes down them in a
+// loop, and back up; it recurses for right operands only, which
+// nest no deeper than the source's parentheses (see parser.c)
+static exprRecord
+genExpression(const astNode* n, const exprRecord* dest)
+{
+    exprRecord args[MAX_PARAMS];
+    exprRecord LHS, RHS, res;
+    opRecord op;
+    const astNode* c;
+    int i;
+
+    switch(n->kind){
+    case AST_ID:
+	return makeIDRec(n->sym);
+
+    case AST_INT:
+	res.kind = EXPR_INT_LITERAL;
+	res.val_int = n->val_int;
+	res.type = INTEGER; // need to pick a default: if we see an int type,
+	return res;         // consider it to be an int (not a long, say)
+
+    case AST_FLT:
+	res.kind = EXPR_FLT_LITERAL;
+	res.val_flt = n->val_flt;
+	res.type = FLOAT;
+	return res;
+
+    case AST_INFIX:
+	for (c = n; AST_INFIX == child(c)->kind; c = child(c))
+	    ;
+	for (LHS = genExpression(child(c), NULL); ; c--){
+	    RHS = genExpression(next(child(c)), NULL);
+	    op.op = c->op;
+	    if ( (c == n) )
+		return generateInfix(LHS, op, RHS, dest);
+	    LHS = generateInfix(LHS, op, RHS, NULL);
+	}
+
+    case AST_CALL:
+	for (i = 0, c = child(n); c < end(n); c = next(c))
+	    args[i++] = genExpression(c, NULL);
+	return generateCall(n->sym, args, i);
+
+    default:
+	errExit(0, "ast: invalid expression (%d)", n->kind);
+	return res; // to suppress gcc warning
+    }
+}
+
+// n: the value assigned to LHS; LHS's storage and type are passed
+//    down, so that an infix of its type writes LHS last, and one of
+//    another type is converted right into it (no temp, no Assign)
+// type:  0 - assign; 1 - copy assignment
+static void
+assignTo(const exprRecord LHS, const astNode* n, int type)
+{
+    exprRecord RHS;
+
+    RHS = genExpression(n, &LHS);
+    if ( (EXPR_TMP == RHS.kind) && (RHS.slot == LHS.slot) )
+	return; // written already
+    codegen_ASSIGN(LHS, RHS, type); // casts RHS to type assigned to
+}
+
+// n: a COND; its code jumps to label when it does not hold
+static void
+genCondition(const astNode* n, int label)
+{
+    exprRecord LHS, RHS;
+    int t;
+
+    LHS = genExpression(child(n), NULL);
+    RHS = genExpression(next(child(n)), NULL);
+
+    if ( (1 == (t = checkCast(LHS, RHS)) ) )
+	LHS = castRecord(LHS, RHS.type);
+    else if ( (2 == t) )
+	RHS = castRecord(RHS, LHS.type);
+    codegen_UNLESS(n->op, LHS, RHS, label);
+}
+
+// the statements of n, a BLOCK: its variables then go out of scope
+static void
+genBlock(const astNode* n)
+{
+    const astNode* c;
+
+    for (c = child(n); c < end(n); c = next(c))
+	genStatement(c);
+    for (c = child(n); c < end(n); c = next(c))
+	if ( (AST_DECL == c->kind) )
+	    peval_dead(c->sym->slot);
+}
+
+static void
+genIf(const astNode* n)
+{
+    const astNode* then;
+    int elseLabel, endLabel;
+
+    then = next(child(n));
+    elseLabel = codegen_newLabel();
+    genCondition(child(n), elseLabel);
+    genBlock(then);
+    if ( (next(then) == end(n)) ){
+	codegen_LABEL(elseLabel);
+	return;
+    }
+
+    endLabel = codegen_newLabel();
+    codegen_JUMP(endLabel);
+    codegen_LABEL(elseLabel);
+    genBlock(next(then));
+    codegen_LABEL(endLabel);
+}
+
+static void
+genWhile(const astNode* n)
+{
+    int top, bottom;
+
+    top = codegen_newLabel();
+    bottom = codegen_newLabel();
+    codegen_WHILE(top);
+    genCondition(child(n), bottom);
+    genBlock(next(child(n)));
+    codegen_ENDWHILE(top, bottom);
+}
+
+static void
+genStatement(const astNode* n)
+{
+    exprRecord LHS;
+    const astNode* c;
+
+    switch(n->kind){
+    case AST_DECL:
+	LHS = codegen_DECLARE(n->sym);
+	if ( (1 < n->size) )
+	    assignTo(LHS, child(n), 1);
+	break;
+
+    case AST_ASSIGN:
+	// create a fake TMP object to handle processing more elegantly
+	LHS.slot = n->sym->slot;
+	LHS.kind = EXPR_TMP;
+	LHS.type = n->sym->type;
+	assignTo(LHS, child(n), 0);
+	break;
+
+    case AST_READ:
+	for (c = child(n); c < end(n); c = next(c))
+	    codegen_READ(makeIDRec(c->sym));
+	break;
+
+    case AST_WRITE:
+	for (c = child(n); c < end(n); c = next(c))
+	    codegen_WRITE(genExpression(c, NULL));
+	codegen_WRITELN();
+	break;
+
+    case AST_BLOCK:
+	genBlock(n);
+	break;
+
+    case AST_IF:
+	genIf(n);
+	break;
+
+    case AST_WHILE:
+	genWhile(n);
+	break;
+
+    default:
+	errExit(0, "ast: invalid statement (%d)", n->kind);
+	break;
+    }
+}
+
+// n: a FUNCTION
+static void
+genFunction(const astNode* n)
+{
+    const astNode* c;
+
+    beginFunction(n->name, n->type, n->op);
+    for (c = child(n); AST_PARAM == c->kind; c = next(c))
+	addParam(c->sym);
+    for ( ; AST_RETURN != c->kind; c = next(c))
+	genStatement(c);
+    endFunction(genExpression(child(c), NULL));
+}
+
+// t: a function definition, or a statement of the main program
+// (ast_close()); NULL: none (an import, say)
+// Note: only a function's tree stays in astArena; the driver drops
+//       those of the main program once they fill a chunk
+void
+astgen_tree(const astNode* t)
+{
+    if ( (NULL == t) )
+	return;
+    if ( (AST_FUNCTION == t->kind) )
+	genFunction(t);
+    else
+	genStatement(t);
+}
@@ -0,0 +1,20 @@
+/*******************************************************
+* astgen.h -           header file for astgen.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         Statement(fd, 0);         // or Definition(fd)
+*         astgen_tree(ast_close()); // its code
+* A tree may be compiled again, without parsing it again;
+* its variables then get storage of their own again.
+********************************************************/
+
+#ifndef ASTGEN_H_
+#define ASTGEN_H_
+
+#include "ast.h"
+
+void astgen_tree(const astNode* t);
+
+#endif
@@ -0,0 +1,138 @@
+/*******************************************************
+* backend.c -          backend registry and dispatch
+* Language:            Micro
+*
+********************************************************/
+
+#include "compiler.h"
+#include "backend.h"
+#include "pipeline.h"
+#include "slp.h"
+#include "sched.h"
+#include "frame.h"
+#include "phase.h"
+
+#define MAX_BACKENDS 8
+
+static const backend* registry[] = {
+    &irBackend, &binBackend, &noneBackend, &cBackend, &rtBackend,
+    &asmBackend, &objBackend, NULL };
+
+typedef struct attached{
+    const backend* be;
+    FILE* out;
+} attached;
+
+static attached active[MAX_BACKENDS];
+static int numActive;
+static int record;      // keep irProg, for backends or execution
+static const char* tuName = "";
+
+// spec: <name>[:<file>]; output goes to stdout if no file is given
+// Returns: 0 - attached; -1 - unknown backend, or too many
+int
+backend_attach(const char* spec)
+{
+    const backend** p;
+    const char* file;
+    size_t len;
+
+    if ( (MAX_BACKENDS == numActive) )
+	return -1;
+
+    file = strchr(spec, ':');
+    len = (file)? (size_t) (file - spec) : strlen(spec);
+
+    for (p = registry; NULL != *p; p++)
+	if ( (strlen((*p)->name) == len) && (0 == strncmp((*p)->name, spec, len)) )
+	    break;
+    if ( (NULL == *p) )
+	return -1;
+
+    active[numActive].be = *p;
+    if ( (NULL == file) )
+	active[numActive].out = stdout;
+    else if ( (NULL == (active[numActive].out = fopen(file + 1, "w")) ) )
+	errExit(1, "...fopen(%s)...", file + 1);
+    record |= (*p)->needsProgram;
+    numActive++;
+
+    return 0;
+}
+
+// execution needs the program even if no backend does
+void
+backend_recordProgram(void) { record = 1; }
+
+void
+backend_open(int fd, const char* srcName)
+{
+    int i;
+
+    tuName = srcName;
+    for (i = 0; i < numActive; i++)
+	if ( (NULL != active[i].be->open) )
+	    active[i].be->open(active[i].out, fd, srcName);
+}
+
+void
+backend_emit(const irInstr* ins)
+{
+    if (record)
+	ir_weigh();
+    if (pipelined)
+	pipeline_putInstr(ins); // the output thread will dispatch it
+    else
+	backend_dispatch(ins);
+}
+
+void
+backend_dispatch(const irInstr* ins)
+{
+    enum phase prev;
+    int i;
+
+    prev = phase_enter(PHASE_EMIT);
+    if (record)
+	ir_append(ins);
+    for (i = 0; i < numActive; i++)
+	if ( (NULL != active[i].be->instr) )
+	    active[i].be->instr(active[i].out, ins);
+    phase_leave(prev);
+}
+
+void
+backend_close(void)
+{
+    enum phase prev;
+    int i;
+
+    if (record){
+	prev = phase_enter(PHASE_SCHED);
+	sched_rebalance(&irProg);
+	slp_vectorize(&irProg);
+	sched_list(&irProg);
+	phase_enter(PHASE_PACK);
+	ir_packSlots(&irProg);
+	frame_layout(&irProg);
+	phase_leave(prev);
+    }
+    prev = phase_enter(PHASE_EMIT);
+    for (i = 0; i < numActive; i++){
+	if ( (NULL != active[i].be->close) )
+	    active[i].be->close(active[i].out, &irProg, tuName);
+	if ( (stdout == active[i].out) )
+	    fflush(stdout);
+	else if ( (0 != fclose(active[i].out)) )
+	    errExit(1, "...fclose()...");
+    }
+    phase_leave(prev);
+    numActive = 0;
+}
+
+/***************************************************
+* No-op backend: parse (and check) only
+*
+****************************************************/
+
+const backend noneBackend = { "none", 0, NULL, NULL, NULL };
@@ -0,0 +1,44 @@
+/*******************************************************
+* backend.h -          pluggable code generation backends
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         backend_attach("ir");             // text IR, stdout
+*         backend_attach("bin:prog.mir");   // binary IR, file
+*         codegen_TU(...); ... codegen_END(...);
+*         backend_close();
+* One parse feeds every attached backend. Streaming ones
+* see each instruction as it is generated; the others
+* (needsProgram) get the recorded irProg at the end.
+********************************************************/
+
+#ifndef BACKEND_H_
+#define BACKEND_H_
+
+#include "ir.h"
+
+typedef struct backend{
+    const char* name;
+    int needsProgram;   // 1: works off irProg in close()
+    void (*open)(FILE* out, int fd, const char* srcName);
+    void (*instr)(FILE* out, const irInstr* ins);
+    void (*close)(FILE* out, const irProgram* prog, const char* srcName);
+} backend;
+
+extern const backend irBackend;
+extern const backend binBackend;
+extern const backend noneBackend;
+extern const backend cBackend;
+extern const backend rtBackend;
+extern const backend asmBackend;
+extern const backend objBackend;
+
+int backend_attach(const char* spec);
+void backend_recordProgram(void);
+void backend_open(int fd, const char* srcName);
+void backend_emit(const irInstr* ins);
+void backend_dispatch(const irInstr* ins);
+void backend_close(void);
+
+#endif
@@ -0,0 +1,756 @@
+/*******************************************************
+* batch.c -            block-at-a-time (SoA) execution
+* Language:            Micro
+*
+* Runs one (straight-line) program over many input rows.
+* Every slot holds a column of BATCH_ROWS values of its
+* type, and each IR instruction is one loop over a block
+* of rows, so dispatch is paid per block, not per row.
+*
+* Input:  a row per line, holding the values consumed by
+*         the program's read()s, in order
+* Output: a row per line, holding the values produced by
+*         the program's write()s, in order
+*
+* batch_runOnce() runs the same engine on a single row,
+* with read()/write() streaming through rtio.c as the
+* program executes (one output line per write()).
+* A program that branches (if, while) runs the same way,
+* a row at a time, as its rows may take different paths
+* (and a loop may read() a different number of values).
+* Run a row at a time, columns hold one value each.
+*
+* Semantics (shared with every other execution path):
+*   int is 32 bit, long 64 bit, both wrap on overflow;
+*   float is a double; float -> int/long truncates, and
+*   yields the minimum value of the type when out of range;
+*   declared variables start out as 0 (for each row, and
+*   each call); a call runs as described in ir.h
+********************************************************/
+
+#include <limits.h>
+#include "compiler.h"
+#include "batch.h"
+#include "rtio.h"
+#include "strength.h"
+
+static rtIn rin;
+static rtOut rout;
+static long* counts;   // see batch_setCounts()
+
+typedef union column{
+    int* i;
+    long* l;
+    double* f;
+    void* p;
+} column;
+
+// private copy of the program: literal operands are replaced by
+// slots holding a column filled once with the literal (one column
+// per distinct literal)
+typedef struct batchProg{
+    irInstr* code;
+    int len;
+    int numSlots;
+    int* slotType;
+    column* cols;
+    int numReads;
+    int numWrites;
+    column* in;     // one column per read, in program order
+    column* out;    // one column per write, in program order
+    int* inType;
+    int* outType;
+    int* aux;       // FUNCTION: index of its END; CALL: of the callee;
+		    // JUMP, branches: of the label; vector ops: bit 0
+		    // (1) if a was a literal, bit 1 (2) if b was
+    int lanes;      // of the vector ops
+    int* litSlot;   // hash table of the constant columns (0: empty)
+    unsigned long* litKey;
+    int litCap;     // a power of 2
+    int r, w;       // reads and writes done in this block
+    int main;       // index of the main program's FUNCTION
+    int branches;   // 1: the program has jumps or branches
+    int scalar;     // 1: read()/write() go straight to rin/rout;
+		    // 2: the same, for a row (see runRows())
+    int rows;       // per column: 1 if the rows run one at a time,
+		    // else BATCH_ROWS
+} batchProg;
+
+static size_t
+typeSize(int type)
+{
+    switch(type){
+    case INTEGER: return sizeof(int);
+    case LONG: return sizeof(long);
+    case FLOAT: return sizeof(double);
+    default: errExit(0, "invalid type in execution (%d)", type);
+    }
+    return 0; // to suppress gcc warning
+}
+
+static void*
+allocColumn(const batchProg* bp, int type)
+{
+    void* p;
+
+    if ( (NULL == (p = calloc(bp->rows, typeSize(type))) ) )
+	errExit(1, "...calloc()...");
+    return p;
+}
+
+static void
+fillColumn(column c, const irOperand* lit, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	switch(lit->type){
+	case INTEGER: c.i[i] = (int) lit->val_int; break;
+	case LONG: c.l[i] = lit->val_int; break;
+	default: c.f[i] = (OPND_FLT == lit->kind)? lit->val_flt :
+		(double) lit->val_int; break;
+	}
+}
+
+// bits of a literal's value, in the type of its column
+static unsigned long
+litBits(const irOperand* lit)
+{
+    unsigned long key;
+    double x;
+
+    switch(lit->type){
+    case INTEGER: return (unsigned) (int) lit->val_int;
+    case LONG: return (unsigned long) lit->val_int;
+    default:
+	x = (OPND_FLT == lit->kind)? lit->val_flt : (double) lit->val_int;
+	memcpy(&key, &x, sizeof(key));
+	return key;
+    }
+}
+
+// literal operand -> slot of a constant column
+static void
+constSlot(batchProg* bp, irOperand* opnd)
+{
+    unsigned long key;
+    unsigned h;
+    int s;
+
+    if ( (OPND_INT != opnd->kind) && (OPND_FLT != opnd->kind) )
+	return;
+
+    key = litBits(opnd);
+    h = (unsigned) (((key ^ opnd->type) * 0x9e3779b97f4a7c15ul) >> 40);
+    for (h &= bp->litCap - 1; 0 != (s = bp->litSlot[h]); 
+	 h = (h + 1) & (bp->litCap - 1))
+	if ( (bp->slotType[s] == opnd->type) && (bp->litKey[h] == key) )
+	    break;
+
+    if ( (0 == s) ){
+	s = bp->numSlots++;
+	bp->slotType[s] = opnd->type;
+	bp->cols[s].p = allocColumn(bp, opnd->type);
+	fillColumn(bp->cols[s], opnd, bp->rows);
+	bp->litSlot[h] = s;
+	bp->litKey[h] = key;
+    }
+
+    opnd->kind = OPND_SLOT;
+    opnd->slot = s;
+}
+
+// the jumps and branches of the function from code[f] to its END
+// at code[end] get the index of their label in bp->aux
+static void
+linkLabels(batchProg* bp, int f, int end)
+{
+    const irInstr* ins;
+    int* at;
+    int i, maxLabel;
+
+    for (maxLabel = 0, i = f; i < end; i++)
+	if ( (IR_LABEL == bp->code[i].op) )
+	    maxLabel = max(maxLabel, bp->code[i].dest.val_int);
+    if ( (NULL == (at = calloc(maxLabel + 1, sizeof(int)))) )
+	errExit(1, "...calloc()...");
+    for (i = f; i < end; i++)
+	if ( (IR_LABEL == bp->code[i].op) )
+	    at[bp->code[i].dest.val_int] = i;
+
+    for (i = f; i < end; i++){
+	ins = &bp->code[i];
+	if ( (IR_JUMP > ins->op) )
+	    continue;
+	if ( (maxLabel < ins->dest.val_int) || (0 > ins->dest.val_int) ||
+	     (0 == at[ins->dest.val_int]) )
+	    errExit(0, "jump to a label not defined (L%ld in %s)",
+		    ins->dest.val_int, bp->code[f].name);
+	bp->aux[i] = at[ins->dest.val_int];
+	bp->branches = 1;
+    }
+    free(at);
+}
+
+// fill in bp->aux, and find the main program
+static void
+linkFunctions(batchProg* bp)
+{
+    int i, j, f;
+
+    bp->main = -1;
+    bp->branches = 0;
+    for (f = i = 0; i < bp->len; i++){
+	switch(bp->code[i].op){
+	case IR_FUNCTION:
+	    f = i;
+	    if ( (INVALID == bp->code[i].type) )
+		bp->main = i;
+	    break;
+	case IR_END:
+	    bp->aux[f] = i;
+	    linkLabels(bp, f, i);
+	    break;
+	case IR_CALL: // callees come first
+	    for (j = i - 1; j >= 0; j--)
+		if ( (IR_FUNCTION == bp->code[j].op) &&
+		     (0 == strcmp(bp->code[j].name, bp->code[i].name)) )
+		    break;
+	    if ( (0 > j) )
+		errExit(0, "call of undefined function (%s)", bp->code[i].name);
+	    bp->aux[i] = j;
+	    break;
+	default:
+	    break;
+	}
+    }
+    if ( (-1 == bp->main) )
+	errExit(0, "no main program to run");
+}
+
+static void
+prepare(batchProg* bp, const irProgram* prog)
+{
+    int i, numLits, r, w;
+    int* types;
+    irInstr* ins;
+
+    bp->len = prog->len;
+    if ( (NULL == (bp->code = malloc(prog->len * sizeof(irInstr) + 1)) ) )
+	errExit(1, "...malloc()...");
+    memcpy(bp->code, prog->code, prog->len * sizeof(irInstr));
+
+    numLits = bp->numReads = bp->numWrites = 0;
+    for (i = 0; i < bp->len; i++){
+	ins = &bp->code[i];
+	numLits += (OPND_INT == ins->a.kind) || (OPND_FLT == ins->a.kind);
+	numLits += (OPND_INT == ins->b.kind) || (OPND_FLT == ins->b.kind);
+	bp->numReads += (IR_READ == ins->op);
+	bp->numWrites += (IR_WRITE == ins->op);
+    }
+
+    types = ir_slotTypes(prog);
+    bp->numSlots = prog->numSlots;
+    bp->slotType = calloc(prog->numSlots + numLits + 1, sizeof(int));
+    bp->cols = calloc(prog->numSlots + numLits + 1, sizeof(column));
+    bp->in = calloc(bp->numReads + 1, sizeof(column));
+    bp->out = calloc(bp->numWrites + 1, sizeof(column));
+    bp->inType = calloc(bp->numReads + 1, sizeof(int));
+    bp->outType = calloc(bp->numWrites + 1, sizeof(int));
+    bp->aux = calloc(bp->len + 1, sizeof(int));
+    for (bp->litCap = 16; bp->litCap < 2 * numLits; bp->litCap *= 2)
+	;
+    bp->litSlot = calloc(bp->litCap, sizeof(int));
+    bp->litKey = calloc(bp->litCap, sizeof(unsigned long));
+    if ( (NULL == bp->slotType) || (NULL == bp->cols) || (NULL == bp->in) ||
+	 (NULL == bp->out) || (NULL == bp->inType) || (NULL == bp->outType) ||
+	 (NULL == bp->aux) || (NULL == bp->litSlot) || (NULL == bp->litKey) )
+	errExit(1, "...calloc()...");
+    linkFunctions(bp);
+    bp->rows = (bp->scalar || bp->branches)? 1 : BATCH_ROWS;
+
+    for (i = 1; i < prog->numSlots; i++)
+	if ( (INVALID != (bp->slotType[i] = types[i])) )
+	    bp->cols[i].p = allocColumn(bp, types[i]);
+    free(types);
+
+    bp->lanes = prog->lanes;
+    for (r = w = i = 0; i < bp->len; i++){
+	ins = &bp->code[i];
+	if ( ir_isVector(ins->op) )
+	    bp->aux[i] = (OPND_SLOT != ins->a.kind) |
+		( (OPND_INT == ins->b.kind) || (OPND_FLT == ins->b.kind) ) << 1;
+	constSlot(bp, &ins->a);
+	if ( (IR_SHL > ins->op) || (IR_MULHI < ins->op) ) // shift counts,
+	    constSlot(bp, &ins->b);                   // magic numbers stay
+	if ( (IR_READ == ins->op) ){
+	    bp->inType[r] = ins->type;
+	    bp->in[r++].p = allocColumn(bp, ins->type);
+	}
+	else if ( (IR_WRITE == ins->op) ){
+	    bp->outType[w] = ins->type;
+	    bp->out[w++].p = allocColumn(bp, ins->type);
+	}
+    }
+}
+
+static int
+fltToInt(double x)
+{
+    if ( !( (x > (double) INT_MIN - 1.0) && (x < (double) INT_MAX + 1.0) ) )
+	return INT_MIN;
+    return (int) x;
+}
+
+static long
+fltToLong(double x)
+{
+    if ( !( (x >= (double) LONG_MIN) && (x < -(double) LONG_MIN) ) )
+	return LONG_MIN;
+    return (long) x;
+}
+
+static void
+divZero(void)
+{
+    rt_fail("division by zero");
+}
+
+// all three operands are of the same type; the loops are kept free
+// of calls and branches (except where division forces a check)
+static void
+arith(const irInstr* ins, column d, column x, column y, int n)
+{
+    int i;
+
+    switch(ins->type){
+    case INTEGER:
+	switch(ins->op){
+	case IR_ADD:
+	    for (i = 0; i < n; i++)
+		d.i[i] = (int) ((unsigned) x.i[i] + (unsigned) y.i[i]);
+	    break;
+	case IR_SUB:
+	    for (i = 0; i < n; i++)
+		d.i[i] = (int) ((unsigned) x.i[i] - (unsigned) y.i[i]);
+	    break;
+	case IR_MUL:
+	    for (i = 0; i < n; i++)
+		d.i[i] = (int) ((unsigned) x.i[i] * (unsigned) y.i[i]);
+	    break;
+	default:
+	    for (i = 0; i < n; i++){
+		if ( (0 == y.i[i]) )
+		    divZero();
+		d.i[i] = (-1 == y.i[i])? (int) (0u - (unsigned) x.i[i]) :
+		    x.i[i] / y.i[i];
+	    }
+	    break;
+	}
+	break;
+
+    case LONG:
+	switch(ins->op){
+	case IR_ADD:
+	    for (i = 0; i < n; i++)
+		d.l[i] = (long) ((unsigned long) x.l[i] +
+				 (unsigned long) y.l[i]);
+	    break;
+	case IR_SUB:
+	    for (i = 0; i < n; i++)
+		d.l[i] = (long) ((unsigned long) x.l[i] -
+				 (unsigned long) y.l[i]);
+	    break;
+	case IR_MUL:
+	    for (i = 0; i < n; i++)
+		d.l[i] = (long) ((unsigned long) x.l[i] *
+				 (unsigned long) y.l[i]);
+	    break;
+	default:
+	    for (i = 0; i < n; i++){
+		if ( (0 == y.l[i]) )
+		    divZero();
+		d.l[i] = (-1 == y.l[i])? (long) (0ul - (unsigned long) x.l[i]) :
+		    x.l[i] / y.l[i];
+	    }
+	    break;
+	}
+	break;
+
+    default:
+	switch(ins->op){
+	case IR_ADD: for (i = 0; i < n; i++) d.f[i] = x.f[i] + y.f[i]; break;
+	case IR_SUB: for (i = 0; i < n; i++) d.f[i] = x.f[i] - y.f[i]; break;
+	case IR_MUL: for (i = 0; i < n; i++) d.f[i] = x.f[i] * y.f[i]; break;
+	default: for (i = 0; i < n; i++) d.f[i] = x.f[i] / y.f[i]; break;
+	}
+	break;
+    }
+}
+
+static void
+convert(int to, int from, column d, column x, int n)
+{
+    int i;
+
+    switch(to){
+    case INTEGER:
+	if ( (LONG == from) )
+	    for (i = 0; i < n; i++) d.i[i] = (int) x.l[i];
+	else if ( (FLOAT == from) )
+	    for (i = 0; i < n; i++) d.i[i] = fltToInt(x.f[i]);
+	else
+	    memcpy(d.i, x.i, n * sizeof(int));
+	break;
+    case LONG:
+	if ( (INTEGER == from) )
+	    for (i = 0; i < n; i++) d.l[i] = x.i[i];
+	else if ( (FLOAT == from) )
+	    for (i = 0; i < n; i++) d.l[i] = fltToLong(x.f[i]);
+	else
+	    memcpy(d.l, x.l, n * sizeof(long));
+	break;
+    default:
+	if ( (INTEGER == from) )
+	    for (i = 0; i < n; i++) d.f[i] = x.i[i];
+	else if ( (LONG == from) )
+	    for (i = 0; i < n; i++) d.f[i] = (double) x.l[i];
+	else
+	    memcpy(d.f, x.f, n * sizeof(double));
+	break;
+    }
+}
+
+/***************************************************
+* Row input/output
+*
+****************************************************/
+
+// Returns: 0 - value read into c[i]; -1 - none left
+static int
+readValue(int type, column c, int i)
+{
+    switch(type){
+    case INTEGER: return rt_readInt(&rin, &c.i[i]);
+    case LONG: return rt_readLong(&rin, &c.l[i]);
+    default: return rt_readFlt(&rin, &c.f[i]);
+    }
+}
+
+static void
+writeValue(int type, column c, int i)
+{
+    switch(type){
+    case INTEGER: rt_writeLong(&rout, c.i[i]); break;
+    case LONG: rt_writeLong(&rout, c.l[i]); break;
+    default: rt_writeFlt(&rout, c.f[i]); break;
+    }
+}
+
+// Returns: number of rows read into the input columns (< BATCH_ROWS
+//          only at end of input)
+static int
+readBlock(batchProg* bp)
+{
+    int n, r;
+
+    for (n = 0; n < BATCH_ROWS; n++){
+	if ( !rt_nextRow(&rin, (0 != bp->numReads)) )
+	    break;
+	for (r = 0; r < bp->numReads; r++)
+	    if ( (-1 == readValue(bp->inType[r], bp->in[r], n)) )
+		rt_fail("too few values in input line %ld",
+			rin.line);
+	rt_endRow(&rin);
+    }
+
+    return n;
+}
+
+static void
+writeBlock(batchProg* bp, int n)
+{
+    int i, w;
+
+    for (i = 0; i < n; i++){
+	for (w = 0; w < bp->numWrites; w++){
+	    if ( (0 != w) )
+		rt_putc(&rout, ' ');
+	    writeValue(bp->outType[w], bp->out[w], i);
+	}
+	rt_putc(&rout, '\n');
+    }
+}
+
+/***************************************************
+* Execution
+*
+****************************************************/
+
+static int execRange(batchProg* bp, int pc, int n);
+
+// ARGs come right before the CALL, PARAMs right after FUNCTION
+static void
+call(batchProg* bp, const irInstr* ins, int pc, int n)
+{
+    column* c;
+    const irInstr* param;
+    int f, np, ret;
+
+    c = bp->cols;
+    f = bp->aux[pc];
+    for (np = 0; IR_PARAM == bp->code[f + 1 + np].op; np++)
+	;
+    for (param = &bp->code[f + 1]; IR_PARAM == param->op; param++, np--)
+	memcpy(c[param->dest.slot].p, c[bp->code[pc - np].a.slot].p,
+	       n * typeSize(param->type));
+
+    ret = execRange(bp, f + 1, n);
+    memcpy(c[ins->dest.slot].p, c[ret].p, n * typeSize(ins->type));
+}
+
+// Returns: 1 if the condition of branch ins holds for row 0 (a
+//          program that branches runs a row at a time)
+static int
+holds(const irInstr* ins, column x, column y)
+{
+    int lt, eq, gt;
+
+    switch(ins->type){
+    case INTEGER:
+	lt = x.i[0] < y.i[0]; eq = x.i[0] == y.i[0]; gt = x.i[0] > y.i[0];
+	break;
+    case LONG:
+	lt = x.l[0] < y.l[0]; eq = x.l[0] == y.l[0]; gt = x.l[0] > y.l[0];
+	break;
+    default: // all 0 if one is NaN
+	lt = x.f[0] < y.f[0]; eq = x.f[0] == y.f[0]; gt = x.f[0] > y.f[0];
+	break;
+    }
+
+    switch(ins->op){
+    case IR_BEQ: return eq;
+    case IR_BNE: return !eq;
+    case IR_BLT: return lt;
+    case IR_BLE: return lt || eq;
+    case IR_BGT: return gt;
+    default: return gt || eq;
+    }
+}
+
+// run from pc to the end of its function
+// lane k of a vector op works on slots dest + k, a + k, b + k; a
+// literal's constant column (broadcast: see bp->aux) on every lane
+static void
+vector(batchProg* bp, const irInstr* ins, int broadcast, int n)
+{
+    irInstr lane;
+    column* c;
+    int k, x, y;
+
+    c = bp->cols;
+    lane = *ins;
+    lane.op = ins->op - IR_VASSIGN + IR_ASSIGN;
+    for (k = 0; k < bp->lanes; k++){
+	x = ins->a.slot + ( (broadcast & 1)? 0 : k );
+	y = ins->b.slot + ( (broadcast & 2)? 0 : k );
+	if ( (IR_VASSIGN == ins->op) )
+	    memcpy(c[ins->dest.slot + k].p, c[x].p, n * typeSize(ins->type));
+	else
+	    arith(&lane, c[ins->dest.slot + k], c[x], c[y], n);
+    }
+}
+
+// Returns: slot holding the value returned (0 for the main program)
+static int
+execRange(batchProg* bp, int pc, int n)
+{
+    const irInstr* ins;
+    column* c;
+
+    c = bp->cols;
+    for ( ; pc < bp->len; pc++){
+	ins = &bp->code[pc];
+	if ( (NULL != counts) )
+	    counts[pc] += n;
+	switch(ins->op){
+	case IR_DECLARE:
+	    memset(c[ins->dest.slot].p, 0, n * typeSize(ins->type));
+	    break;
+	case IR_ASSIGN:
+	    memcpy(c[ins->dest.slot].p, c[ins->a.slot].p,
+		   n * typeSize(ins->type));
+	    break;
+	case IR_ADD:
+	case IR_SUB:
+	case IR_MUL:
+	case IR_DIV:
+	    arith(ins, c[ins->dest.slot], c[ins->a.slot], c[ins->b.slot], n);
+	    break;
+	case IR_SHL:
+	case IR_SAR:
+	case IR_SHR:
+	case IR_MULHI:
+	    strength_apply(ins->op, ins->type, c[ins->dest.slot].p,
+			   c[ins->a.slot].p, ins->b.val_int, n);
+	    break;
+	case IR_PROMOTE:
+	case IR_CONVERT:
+	    convert(ins->type, ins->a.type, c[ins->dest.slot],
+		    c[ins->a.slot], n);
+	    break;
+	case IR_VASSIGN:
+	case IR_VADD:
+	case IR_VSUB:
+	case IR_VMUL:
+	    vector(bp, ins, bp->aux[pc], n);
+	    break;
+	case IR_READ:
+	    if ( !bp->scalar )
+		memcpy(c[ins->dest.slot].p, bp->in[bp->r++].p,
+		       n * typeSize(ins->type));
+	    else if ( (-1 == readValue(ins->type, c[ins->dest.slot], 0)) ){
+		if ( (2 == bp->scalar) )
+		    rt_fail("too few values in input line %ld", rin.line);
+		rt_fail("read() past end of input");
+	    }
+	    break;
+	case IR_WRITE:
+	    if ( !bp->scalar ){
+		memcpy(bp->out[bp->w++].p, c[ins->a.slot].p,
+		       n * typeSize(ins->type));
+		break;
+	    }
+	    if ( (0 != bp->w++) )
+		rt_putc(&rout, ' ');
+	    writeValue(ins->type, c[ins->a.slot], 0);
+	    break;
+	case IR_WRITELN: // with --batch, a row is one line
+	    if ( (1 == bp->scalar) ){
+		rt_putc(&rout, '\n');
+		bp->w = 0;
+	    }
+	    break;
+	case IR_CALL:
+	    call(bp, ins, pc, n);
+	    break;
+	case IR_JUMP:
+	    pc = bp->aux[pc]; // on to the instruction after the label
+	    break;
+	case IR_BEQ:
+	case IR_BNE:
+	case IR_BLT:
+	case IR_BLE:
+	case IR_BGT:
+	case IR_BGE:
+	    if ( holds(ins, c[ins->a.slot], c[ins->b.slot]) )
+		pc = bp->aux[pc];
+	    break;
+	case IR_RETURN:
+	    return ins->a.slot;
+	case IR_END:
+	    return 0;
+	default: // FUNCTION, PARAM, ARG, LABEL: nothing at run time
+	    break;
+	}
+    }
+
+    return 0;
+}
+
+static void
+execBlock(batchProg* bp, int n)
+{
+    bp->r = bp->w = 0;
+    execRange(bp, bp->main + 1, n);
+}
+
+static void
+release(batchProg* bp)
+{
+    int i;
+
+    for (i = 0; i < bp->numSlots; i++)
+	free(bp->cols[i].p);
+    for (i = 0; i < bp->numReads; i++)
+	free(bp->in[i].p);
+    for (i = 0; i < bp->numWrites; i++)
+	free(bp->out[i].p);
+    free(bp->cols);
+    free(bp->in);
+    free(bp->out);
+    free(bp->inType);
+    free(bp->outType);
+    free(bp->slotType);
+    free(bp->aux);
+    free(bp->litSlot);
+    free(bp->litKey);
+    free(bp->code);
+}
+
+// Returns: number of rows processed
+// from now on, counts[i] adds up the rows instruction i runs for
+// (counts: zeroed, one per instruction of the program run)
+void
+batch_setCounts(long* c) { counts = c; }
+
+// a program that branches: each row runs on its own, its read()s
+// and write()s going straight to rin/rout
+// Returns: number of rows processed
+static long
+runRows(batchProg* bp)
+{
+    long rows;
+
+    bp->scalar = 2;
+    for (rows = 0; rt_nextRow(&rin, (0 != bp->numReads)); rows++){
+	execBlock(bp, 1);
+	rt_endRow(&rin);
+	rt_putc(&rout, '\n');
+    }
+    return rows;
+}
+
+long
+batch_run(const irProgram* prog, int inFd, int outFd)
+{
+    batchProg bp;
+    long rows;
+    int n;
+
+    bp.scalar = 0;
+    prepare(&bp, prog);
+    rt_openIn(&rin, inFd, 1);
+    rt_openOut(&rout, outFd);
+
+    rows = 0;
+    if (bp.branches)
+	rows = runRows(&bp);
+    else while ( (0 < (n = readBlock(&bp)) ) ){
+	execBlock(&bp, n);
+	writeBlock(&bp, n);
+	rows += n;
+	if ( (n < BATCH_ROWS) )
+	    break;
+    }
+    rt_flush(&rout);
+
+    release(&bp);
+    return rows;
+}
+
+void
+batch_runOnce(const irProgram* prog, int inFd, int outFd)
+{
+    batchProg bp;
+
+    bp.scalar = 1;
+    prepare(&bp, prog);
+    rt_openIn(&rin, inFd, 0);
+    rt_openOut(&rout, outFd);
+
+    execBlock(&bp, 1);
+    rt_flush(&rout);
+
+    release(&bp);
+}
@@ -0,0 +1,18 @@
+/*******************************************************
+* batch.h -            header file for batch.c
+* Language:            Micro
+*
+********************************************************/
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include "ir.h"
+
+#define BATCH_ROWS 1024  // rows evaluated per pass over the IR
+
+long batch_run(const irProgram* prog, int inFd, int outFd);
+void batch_runOnce(const irProgram* prog, int inFd, int outFd);
+void batch_setCounts(long* counts);
+
+#endif
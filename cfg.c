@@ -0,0 +1,776 @@
+/*******************************************************
+* cfg.c -              control flow graph of a loop, and
+*                      loop-invariant code motion
+* Language:            Micro
+*
+* Codegen (codegen_ENDWHILE()) hands over the code of an
+* outermost while loop once it is complete, after partial
+* evaluation (peval.c). Its control flow graph has a
+* basic block per stretch of code between labels and
+* jumps or branches. Block d dominates block b if every
+* path from the entry to b passes through d (computed
+* as by Cooper, Harvey, and Kennedy: "A Simple, Fast
+* Dominance Algorithm"). An edge b -> h where h dominates
+* b is a back edge: its natural loop is h (the header)
+* and the blocks reaching b without passing through h.
+*
+* The graph, and its loops, are found once. The loops of
+* while and if nest: they are found innermost first, each
+* inner one then taken as its header only (as by Havlak:
+* "Nesting of Reducible and Irreducible Loops"), so each
+* block is looked at once, in the loop it is innermost in.
+*
+* Loops are taken innermost first. An instruction of one
+* is invariant if its operands are literals, slots the
+* loop never writes, or the dests of invariants; it is
+* moved in front of the header's label (its preheader:
+* while loops are entered by falling into it), in order,
+* if it also
+*   - computes (Assign, arithmetic, Promote, Convert),
+*     and cannot fail: an int or long Div does only by a
+*     literal not 0, or in the header, which runs, if the
+*     loop is reached, before anything else of it can;
+*   - writes a temp (not a variable) the loop writes
+*     nowhere else: temps are used only after their
+*     definition, by the statement defining them.
+* So repeated Promotes/Converts of variables the loop
+* does not change are done once; what an inner loop
+* hoists may be hoisted by an outer one, in turn. What
+* an inner loop keeps is not invariant in the outer ones
+* either (it depends on a slot the inner loop writes), so
+* a loop looks only at its own blocks, and at what its
+* inner loops hoisted; the code is moved once, at the end.
+********************************************************/
+
+#include "compiler.h"
+#include "cfg.h"
+
+static int enabled = 1;
+
+void
+cfg_setEnabled(int on) { enabled = on; }
+
+typedef struct block{
+    int from, to;       // code[from..to)
+    int succ[2];
+    int numSucc;
+    int idom;           // -1: not reached from the entry (block 0)
+    int order;          // in reverse postorder
+    int pre, last;      // in the dominator tree: its preorder number,
+			// and that of its last descendant
+    int loop;           // the innermost loop it is in (-1: none)
+} block;
+
+typedef struct loop{
+    int header;         // its block
+    int parent;         // the loop around it (-1: none)
+    int pre, last;      // in the tree of loops (as for blocks)
+    int* cand;          // instructions it looks at (see hoistLoop())
+    int numCand, capCand;
+} loop;
+
+typedef struct graph{
+    const irInstr* code;
+    int n;
+    block* b;
+    int numBlocks;
+    int* blockOf;       // per instruction
+    int* predStart;     // preds of b: pred[predStart[b]..predStart[b+1])
+    int* pred;
+    int* rpo;           // blocks reached, in reverse postorder
+    int numReached;
+    int* labelAt;       // per label: the block it starts (-1: none)
+    long maxLabel;
+    loop* l;            // innermost first
+    int numLoops;
+} graph;
+
+static int
+isBranch(enum irOp op)
+{
+    return (IR_BEQ <= op) && (IR_BGE >= op);
+}
+
+// Returns: the block starting with label (-1 if none)
+static int
+labelBlock(const graph* g, long label)
+{
+    if ( (0 > label) || (g->maxLabel < label) )
+	return -1;
+    return g->labelAt[label];
+}
+
+static void
+findBlocks(graph* g)
+{
+    const irInstr* ins;
+    block* b;
+    int i, t;
+
+    for (g->maxLabel = -1, i = 0; i < g->n; i++)
+	if ( (IR_LABEL == g->code[i].op) )
+	    g->maxLabel = max(g->maxLabel, g->code[i].dest.val_int);
+    if ( (NULL == (g->labelAt = malloc((g->maxLabel + 2) * sizeof(int)))) )
+	errExit(1, "...malloc()...");
+    for (i = 0; i <= g->maxLabel; i++)
+	g->labelAt[i] = -1;
+
+    for (g->numBlocks = i = 0; i < g->n; i++){
+	ins = &g->code[i];
+	if ( (0 == i) || (IR_LABEL == ins->op) ||
+	     (IR_JUMP == ins[-1].op) || isBranch(ins[-1].op) ){
+	    if ( (0 != g->numBlocks) )
+		g->b[g->numBlocks - 1].to = i;
+	    g->b[g->numBlocks++].from = i;
+	}
+	g->blockOf[i] = g->numBlocks - 1;
+	if ( (IR_LABEL == ins->op) && (0 <= ins->dest.val_int) &&
+	     (-1 == g->labelAt[ins->dest.val_int]) )
+	    g->labelAt[ins->dest.val_int] = g->numBlocks - 1;
+    }
+    g->b[g->numBlocks - 1].to = g->n;
+
+    for (i = 0; i < g->numBlocks; i++){
+	b = &g->b[i];
+	ins = &g->code[b->to - 1];
+	b->numSucc = 0;
+	b->loop = -1;
+	if ( (IR_JUMP == ins->op) || isBranch(ins->op) )
+	    if ( (-1 != (t = labelBlock(g, ins->dest.val_int))) )
+		b->succ[b->numSucc++] = t;
+	if ( (IR_JUMP != ins->op) && (i + 1 < g->numBlocks) )
+	    b->succ[b->numSucc++] = i + 1;
+    }
+}
+
+static void
+findPreds(graph* g)
+{
+    int i, j, s;
+    int* fill;
+
+    if ( (NULL == (fill = calloc(g->numBlocks + 1, sizeof(int)))) )
+	errExit(1, "...calloc()...");
+    for (i = 0; i < g->numBlocks; i++)
+	for (j = 0; j < g->b[i].numSucc; j++)
+	    fill[g->b[i].succ[j]]++;
+    for (g->predStart[0] = i = 0; i < g->numBlocks; i++){
+	g->predStart[i + 1] = g->predStart[i] + fill[i];
+	fill[i] = g->predStart[i];
+    }
+    for (i = 0; i < g->numBlocks; i++)
+	for (j = 0; j < g->b[i].numSucc; j++){
+	    s = g->b[i].succ[j];
+	    g->pred[fill[s]++] = i;
+	}
+    free(fill);
+}
+
+// depth-first from the entry; rpo[] is filled from its end
+static void
+orderBlocks(graph* g)
+{
+    int *stack, *next;
+    char* seen;
+    int sp, x, k;
+
+    stack = malloc(g->numBlocks * sizeof(int));
+    next = calloc(g->numBlocks, sizeof(int));
+    seen = calloc(g->numBlocks, 1);
+    if ( (NULL == stack) || (NULL == next) || (NULL == seen) )
+	errExit(1, "...malloc()...");
+
+    k = g->numBlocks;
+    stack[sp = 0] = 0;
+    seen[0] = 1;
+    while ( (0 <= sp) ){
+	x = stack[sp];
+	if ( (next[x] < g->b[x].numSucc) ){
+	    if ( !seen[g->b[x].succ[next[x]]] ){
+		seen[g->b[x].succ[next[x]]] = 1;
+		stack[++sp] = g->b[x].succ[next[x]];
+	    }
+	    next[x]++;
+	    continue;
+	}
+	g->rpo[--k] = x;
+	sp--;
+    }
+    g->numReached = g->numBlocks - k;
+    memmove(g->rpo, g->rpo + k, g->numReached * sizeof(int));
+    for (k = 0; k < g->numReached; k++)
+	g->b[g->rpo[k]].order = k;
+
+    free(stack);
+    free(next);
+    free(seen);
+}
+
+static int
+intersect(const graph* g, int x, int y)
+{
+    while ( (x != y) ){
+	while ( (g->b[x].order > g->b[y].order) )
+	    x = g->b[x].idom;
+	while ( (g->b[y].order > g->b[x].order) )
+	    y = g->b[y].idom;
+    }
+    return x;
+}
+
+static void
+findDominators(graph* g)
+{
+    int i, j, k, p, d, changed;
+
+    for (i = 0; i < g->numBlocks; i++)
+	g->b[i].idom = -1;
+    g->b[0].idom = 0;
+    do{
+	changed = 0;
+	for (k = 1; k < g->numReached; k++){
+	    i = g->rpo[k];
+	    d = -1;
+	    for (j = g->predStart[i]; j < g->predStart[i + 1]; j++){
+		if ( (-1 == g->b[p = g->pred[j]].idom) )
+		    continue; // not processed yet
+		d = (-1 == d)? p : intersect(g, p, d);
+	    }
+	    if ( (d != g->b[i].idom) ){
+		g->b[i].idom = d;
+		changed = 1;
+	    }
+	}
+    } while (changed);
+}
+
+// numbers the nodes of a tree (parent[x]: -1 for a root) in preorder:
+// pre[x], and last[x], the number of its last descendant
+// Note: the tree is walked with a stack of its own, as it may be deep
+static void
+numberTree(int num, int* parent, int* pre, int* last)
+{
+    int *first, *next, *stack;
+    int x, p, sp, k;
+
+    first = malloc((num + 1) * sizeof(int));
+    next = malloc((num + 1) * sizeof(int));
+    stack = malloc((num + 1) * sizeof(int));
+    if ( (NULL == first) || (NULL == next) || (NULL == stack) )
+	errExit(1, "...malloc()...");
+    for (x = 0; x < num; x++)
+	first[x] = -1;
+    for (x = num - 1; x >= 0; x--)
+	if ( (-1 != (p = parent[x])) ){
+	    next[x] = first[p];
+	    first[p] = x;
+	}
+
+    for (k = 0, x = 0; x < num; x++){
+	if ( (-1 != parent[x]) )
+	    continue;
+	stack[sp = 0] = x;
+	pre[x] = k++;
+	while ( (0 <= sp) ){  // first[]: the child to go to next
+	    p = stack[sp];
+	    if ( (-1 == first[p]) ){
+		last[p] = k - 1;
+		sp--;
+		continue;
+	    }
+	    stack[++sp] = first[p];
+	    pre[first[p]] = k++;
+	    first[p] = next[first[p]];
+	}
+    }
+
+    free(first);
+    free(next);
+    free(stack);
+}
+
+// the dominator tree, numbered (pre, last) for dominates()
+static void
+numberDominators(graph* g)
+{
+    int *parent, *pre, *last;
+    int i;
+
+    parent = malloc(g->numBlocks * sizeof(int));
+    pre = malloc(g->numBlocks * sizeof(int));
+    last = malloc(g->numBlocks * sizeof(int));
+    if ( (NULL == parent) || (NULL == pre) || (NULL == last) )
+	errExit(1, "...malloc()...");
+    for (i = 0; i < g->numBlocks; i++) // not reached: a tree of its own
+	parent[i] = (0 == i)? -1 : g->b[i].idom;
+    numberTree(g->numBlocks, parent, pre, last);
+    for (i = 0; i < g->numBlocks; i++){
+	g->b[i].pre = pre[i];
+	g->b[i].last = last[i];
+    }
+
+    free(parent);
+    free(pre);
+    free(last);
+}
+
+// Returns: 1 if block d dominates block x
+static int
+dominates(const graph* g, int d, int x)
+{
+    if ( (-1 == g->b[x].idom) || (-1 == g->b[d].idom) )
+	return 0;
+    return (g->b[d].pre <= g->b[x].pre) && (g->b[x].pre <= g->b[d].last);
+}
+
+// Returns: x's representative: the header of the outermost loop
+//          found so far that x is in (or x)
+static int
+find(int* rep, int x)
+{
+    int r, y;
+
+    for (r = x; rep[r] != r; r = rep[r])
+	;
+    for ( ; rep[x] != r; x = y){
+	y = rep[x];
+	rep[x] = r;
+    }
+    return r;
+}
+
+// g->l[]: the loops, innermost first: headers are taken last in
+// reverse postorder first (a loop's header dominates those of the
+// loops in it); the blocks reaching a back edge without passing
+// the header are collected, each inner loop as its header
+static void
+findLoops(graph* g)
+{
+    loop* l;
+    int *rep, *stamp, *stack, *parent;
+    int k, h, i, x, y, sp, back;
+
+    rep = malloc(g->numBlocks * sizeof(int));
+    stamp = malloc(g->numBlocks * sizeof(int));
+    stack = malloc(g->numBlocks * sizeof(int));
+    g->l = malloc(g->numBlocks * sizeof(loop));
+    if ( (NULL == rep) || (NULL == stamp) || (NULL == stack) ||
+	 (NULL == g->l) )
+	errExit(1, "...malloc()...");
+    for (i = 0; i < g->numBlocks; i++){
+	rep[i] = i;
+	stamp[i] = -1;
+    }
+
+    g->numLoops = 0;
+    for (k = g->numReached - 1; k >= 0; k--){
+	h = g->rpo[k];
+	if ( (IR_LABEL != g->code[g->b[h].from].op) )
+	    continue;
+	for (sp = back = 0, i = g->predStart[h]; i < g->predStart[h + 1]; i++){
+	    if ( !dominates(g, h, x = g->pred[i]) )
+		continue;
+	    back = 1;
+	    if ( (h != (x = find(rep, x))) && (h != stamp[x]) ){
+		stamp[x] = h;
+		stack[sp++] = x;
+	    }
+	}
+	if ( !back )
+	    continue;
+
+	l = &g->l[g->numLoops];
+	l->header = h;
+	l->parent = -1;
+	l->cand = NULL;
+	l->numCand = l->capCand = 0;
+	g->b[h].loop = g->numLoops;
+	while ( (0 < sp) ){
+	    x = stack[--sp];
+	    if ( (-1 == g->b[x].loop) )
+		g->b[x].loop = g->numLoops;
+	    else if ( (x == g->l[g->b[x].loop].header) )
+		g->l[g->b[x].loop].parent = g->numLoops;
+	    rep[x] = h;
+	    for (i = g->predStart[x]; i < g->predStart[x + 1]; i++){
+		if ( !dominates(g, h, y = g->pred[i]) )
+		    continue; // not reached, or entering it
+		if ( (h != (y = find(rep, y))) && (h != stamp[y]) ){
+		    stamp[y] = h;
+		    stack[sp++] = y;
+		}
+	    }
+	}
+	g->numLoops++;
+    }
+
+    // numbered, for inLoop()
+    parent = malloc((g->numLoops + 1) * sizeof(int));
+    if ( (NULL == parent) )
+	errExit(1, "...malloc()...");
+    for (i = 0; i < g->numLoops; i++)
+	parent[i] = g->l[i].parent;
+    numberTree(g->numLoops, parent, stack, rep);
+    for (i = 0; i < g->numLoops; i++){
+	g->l[i].pre = stack[i];
+	g->l[i].last = rep[i];
+    }
+
+    free(parent);
+    free(rep);
+    free(stamp);
+    free(stack);
+}
+
+static void
+build(graph* g, const irInstr* code, int n)
+{
+    g->code = code;
+    g->n = n;
+    g->b = malloc(n * sizeof(block));
+    g->blockOf = malloc(n * sizeof(int));
+    g->predStart = malloc((n + 1) * sizeof(int));
+    g->pred = malloc(2 * n * sizeof(int));
+    g->rpo = malloc(n * sizeof(int));
+    if ( (NULL == g->b) || (NULL == g->blockOf) || (NULL == g->predStart) ||
+	 (NULL == g->pred) || (NULL == g->rpo) )
+	errExit(1, "...malloc()...");
+
+    findBlocks(g);
+    findPreds(g);
+    orderBlocks(g);
+    findDominators(g);
+    numberDominators(g);
+    findLoops(g);
+}
+
+static void
+release(graph* g)
+{
+    int i;
+
+    for (i = 0; i < g->numLoops; i++)
+	free(g->l[i].cand);
+    free(g->l);
+    free(g->b);
+    free(g->blockOf);
+    free(g->predStart);
+    free(g->pred);
+    free(g->rpo);
+    free(g->labelAt);
+}
+
+// Returns: 1 if block x is in loop k
+static int
+inLoop(const graph* g, int x, int k)
+{
+    int m;
+
+    if ( (-1 == x) || (-1 == (m = g->b[x].loop)) )
+	return 0;
+    return (g->l[k].pre <= g->l[m].pre) && (g->l[m].pre <= g->l[k].last);
+}
+
+static void
+addCand(loop* l, int i)
+{
+    if ( (l->numCand == l->capCand) ){
+	l->capCand = (l->capCand)? 2 * l->capCand : 8;
+	if ( (NULL == (l->cand = realloc(l->cand, l->capCand * sizeof(int)))) )
+	    errExit(1, "...realloc()...");
+    }
+    l->cand[l->numCand++] = i;
+}
+
+/***************************************************
+* Hoisting
+*
+****************************************************/
+
+typedef struct hoist{
+    irInstr* code;
+    int n;
+    int (*isVar)(int);
+    long* key;          // per instruction: where it is, in code order
+			// (see moveKey())
+    int* blockAt;       // per instruction: the block it is in
+    char* afterBranch;  // per instruction: 1 if it was moved right
+			// after a branch (a block of its own)
+    char* moved;
+    char* mark;
+    int* inv;           // per slot: the loop (+ 1) an invariant of
+			// which writes it
+    int* defStart;      // per slot s: the loops (pre) its writers are
+    int* defPre;        // in, defPre[defStart[s]..defStart[s+1]),
+} hoist;                // in order
+
+// Returns: the key of instruction i where it was, or, moved in front
+//          of the label at at, as the rank-th of those
+static long
+moveKey(const hoist* hs, int at, int rank)
+{
+    return (long) at * (hs->n + 1) + rank;
+}
+
+static const long* sortKey;
+
+static int
+byKey(const void* x, const void* y)
+{
+    long s, t;
+
+    s = sortKey[*(const int*) x];
+    t = sortKey[*(const int*) y];
+    return (s < t)? -1 : (s > t);
+}
+
+static int
+byInt(const void* x, const void* y)
+{
+    return *(const int*) x - *(const int*) y;
+}
+
+// Returns: the number of instructions of loop k writing slot (it is
+//          as it was before anything was moved: nothing moves out of
+//          a loop before the loop itself is taken)
+static int
+writesIn(const graph* g, const hoist* hs, int slot, int k)
+{
+    int lo, hi, a, b, mid;
+
+    a = hs->defStart[slot];
+    b = hs->defStart[slot + 1];
+    for (lo = a, hi = b; lo < hi; ){ // first pre >= l[k].pre
+	mid = (lo + hi) / 2;
+	if ( (hs->defPre[mid] < g->l[k].pre) )
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    for (a = lo, hi = b; lo < hi; ){ // first pre > l[k].last
+	mid = (lo + hi) / 2;
+	if ( (hs->defPre[mid] <= g->l[k].last) )
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo - a;
+}
+
+// the loops the writers of each slot are in, by slot
+static void
+findWriters(const graph* g, hoist* hs)
+{
+    const irInstr* ins;
+    int i, s, maxSlot, m;
+    int* fill;
+
+    for (maxSlot = i = 0; i < hs->n; i++){
+	ins = &hs->code[i];
+	if ( (OPND_SLOT == ins->dest.kind) )
+	    maxSlot = max(maxSlot, ins->dest.slot);
+	if ( (OPND_SLOT == ins->a.kind) )
+	    maxSlot = max(maxSlot, ins->a.slot);
+	if ( (OPND_SLOT == ins->b.kind) )
+	    maxSlot = max(maxSlot, ins->b.slot);
+    }
+    hs->defStart = calloc(maxSlot + 2, sizeof(int));
+    hs->defPre = malloc((hs->n + 1) * sizeof(int));
+    hs->inv = calloc(maxSlot + 1, sizeof(int));
+    fill = calloc(maxSlot + 2, sizeof(int));
+    if ( (NULL == hs->defStart) || (NULL == hs->defPre) ||
+	 (NULL == hs->inv) || (NULL == fill) )
+	errExit(1, "...calloc()...");
+
+    for (i = 0; i < hs->n; i++)
+	if ( (OPND_SLOT == hs->code[i].dest.kind) &&
+	     (-1 != g->b[g->blockOf[i]].loop) )
+	    fill[hs->code[i].dest.slot + 1]++;
+    for (s = 1; s <= maxSlot + 1; s++)
+	fill[s] += fill[s - 1];
+    memcpy(hs->defStart, fill, (maxSlot + 2) * sizeof(int));
+    for (i = 0; i < hs->n; i++)
+	if ( (OPND_SLOT == hs->code[i].dest.kind) &&
+	     (-1 != (m = g->b[g->blockOf[i]].loop)) )
+	    hs->defPre[fill[hs->code[i].dest.slot]++] = g->l[m].pre;
+    for (s = 0; s <= maxSlot; s++)
+	qsort(&hs->defPre[hs->defStart[s]], hs->defStart[s + 1] -
+	      hs->defStart[s], sizeof(int), byInt);
+
+    free(fill);
+}
+
+static int
+isTemp(const irOperand* o, int (*isVar)(int))
+{
+    return (OPND_SLOT == o->kind) && !isVar(o->slot);
+}
+
+// Returns: 1 if ins, in loop k, is invariant, and can be moved
+static int
+movable(const graph* g, const hoist* hs, const irInstr* ins, int inHeader,
+	int k)
+{
+    const irOperand* o[2];
+    int j;
+
+    switch(ins->op){
+    case IR_ASSIGN: case IR_ADD: case IR_SUB: case IR_MUL:
+    case IR_PROMOTE: case IR_CONVERT:
+    case IR_SHL: case IR_SAR: case IR_SHR: case IR_MULHI:
+	break;
+    case IR_DIV:
+	if ( (FLOAT == ins->type) || inHeader ||
+	     ( (OPND_INT == ins->b.kind) && (0 != ins->b.val_int) ) )
+	    break;
+	return 0;
+    default:
+	return 0;
+    }
+    if ( !isTemp(&ins->dest, hs->isVar) ||
+	 (1 != writesIn(g, hs, ins->dest.slot, k)) )
+	return 0;
+
+    o[0] = &ins->a; o[1] = &ins->b;
+    for (j = 0; j < 2; j++)
+	if ( (OPND_SLOT == o[j]->kind) && (k + 1 != hs->inv[o[j]->slot]) &&
+	     (0 != writesIn(g, hs, o[j]->slot, k)) )
+	    return 0;
+    return 1;
+}
+
+// moves the invariants of loop k (among l->cand[]: its instructions
+// not in its inner loops, and what those hoisted) in front of its
+// label; they become candidates of the loop they are then in, as
+// does all of a loop that cannot be hoisted out of
+static void
+hoistLoop(graph* g, hoist* hs, int k)
+{
+    loop* l;
+    const irInstr* ins;
+    int h, at, i, j, c, x, to, rank, changed;
+    long label, start;
+
+    l = &g->l[k];
+    h = l->header;
+    at = g->b[h].from;
+    label = hs->code[at].dest.val_int;
+    for (j = at - 1; (0 <= j) && hs->moved[j]; j--) // what falls into it
+	;
+
+    // entered by falling into it only
+    for (i = g->predStart[h]; i < g->predStart[h + 1]; i++){
+	ins = &hs->code[g->b[x = g->pred[i]].to - 1];
+	if ( ( (IR_JUMP == ins->op) || isBranch(ins->op) ) &&
+	     (label == ins->dest.val_int) && !inLoop(g, x, k) )
+	    break;
+    }
+    if ( (i < g->predStart[h + 1]) || ( (0 <= j) &&
+					(IR_JUMP == hs->code[j].op) ) ){
+	if ( (-1 != l->parent) )
+	    for (c = 0; c < l->numCand; c++)
+		addCand(&g->l[l->parent], l->cand[c]);
+	return;
+    }
+
+    sortKey = hs->key;
+    qsort(l->cand, l->numCand, sizeof(int), byKey);
+    start = hs->key[at];
+    do{
+	changed = 0;
+	for (c = 0; c < l->numCand; c++){
+	    i = l->cand[c];
+	    if ( hs->mark[i] || (hs->key[i] <= start) ||
+		 !movable(g, hs, &hs->code[i], (h == hs->blockAt[i]) &&
+			  !hs->afterBranch[i], k) )
+		continue;
+	    hs->mark[i] = 1;
+	    hs->inv[hs->code[i].dest.slot] = k + 1;
+	    changed = 1;
+	}
+    } while (changed);
+
+    // where they go: in the block of what falls into the label
+    x = (0 <= j)? hs->blockAt[j] : -1;
+    to = (-1 != x)? g->b[x].loop : -1;
+    for (rank = c = 0; c < l->numCand; c++){
+	i = l->cand[c];
+	if ( hs->mark[i] ){
+	    hs->mark[i] = 0;
+	    hs->moved[i] = 1;
+	    hs->key[i] = moveKey(hs, at, rank++);
+	    hs->blockAt[i] = x;
+	    hs->afterBranch[i] = (0 <= j) && isBranch(hs->code[j].op);
+	    if ( (-1 != to) && (k != to) )
+		addCand(&g->l[to], i);
+	}
+	else if ( (hs->key[i] <= start) && (-1 != l->parent) )
+	    addCand(&g->l[l->parent], i); // not looked at here
+    }
+}
+
+// code[0..n): see cfg.h
+void
+cfg_hoist(irInstr* code, int n, int (*isVar)(int slot))
+{
+    graph g;
+    hoist hs;
+    irInstr* copy;
+    int* order;
+    int i, k;
+
+    if ( !enabled || (0 == n) )
+	return;
+    build(&g, code, n);
+    if ( (0 == g.numLoops) ){
+	release(&g);
+	return;
+    }
+
+    hs.code = code;
+    hs.n = n;
+    hs.isVar = isVar;
+    hs.key = malloc(n * sizeof(long));
+    hs.blockAt = malloc(n * sizeof(int));
+    hs.afterBranch = calloc(n, 1);
+    hs.moved = calloc(n, 1);
+    hs.mark = calloc(n, 1);
+    if ( (NULL == hs.key) || (NULL == hs.blockAt) ||
+	 (NULL == hs.afterBranch) || (NULL == hs.moved) || (NULL == hs.mark) )
+	errExit(1, "...malloc()...");
+    findWriters(&g, &hs);
+    for (i = 0; i < n; i++){
+	hs.key[i] = moveKey(&hs, i, n);
+	hs.blockAt[i] = g.blockOf[i];
+	if ( (-1 != (k = g.b[g.blockOf[i]].loop)) )
+	    addCand(&g.l[k], i);
+    }
+
+    for (k = 0; k < g.numLoops; k++)
+	hoistLoop(&g, &hs, k);
+
+    // the code, in the order of the keys
+    order = malloc(n * sizeof(int));
+    copy = malloc(n * sizeof(irInstr));
+    if ( (NULL == order) || (NULL == copy) )
+	errExit(1, "...malloc()...");
+    for (i = 0; i < n; i++)
+	order[i] = i;
+    sortKey = hs.key;
+    qsort(order, n, sizeof(int), byKey);
+    memcpy(copy, code, n * sizeof(irInstr));
+    for (i = 0; i < n; i++)
+	code[i] = copy[order[i]];
+
+    free(order);
+    free(copy);
+    free(hs.key);
+    free(hs.blockAt);
+    free(hs.afterBranch);
+    free(hs.moved);
+    free(hs.mark);
+    free(hs.defStart);
+    free(hs.defPre);
+    free(hs.inv);
+    release(&g);
+}
@@ -0,0 +1,21 @@
+/*******************************************************
+* cfg.h -              header file for cfg.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         // code[0..n): a loop, complete (with what leads
+*         // up to it); isVar(slot): 1 for the variables
+*         cfg_hoist(code, n, isVar);  // reorders code
+*         cfg_setEnabled(0);          // --no-hoist
+********************************************************/
+
+#ifndef CFG_H_
+#define CFG_H_
+
+#include "ir.h"
+
+void cfg_setEnabled(int on);
+void cfg_hoist(irInstr* code, int n, int (*isVar)(int slot));
+
+#endif
@@ -19,14 +19,22 @@
 * add tmp%5, tmp%4, tmp%2
 * promote tmp%6, tmp%5, float
 * assign tmp%3, tmp%6
-* TO DO: scope
-*        store as struct {char* TU, char* withinTU} scope
-*        if global, scope.TU = "all", scope.withinTU = "na"
-*        globals: GLOBALS [functDec | varDec]* END_GLOBALS
+* Scope: an integer ID per scope opened (0: global);
+*        see enterScope()/exitScope()
+* TO DO: globals: GLOBALS [functDec | varDec]* END_GLOBALS
 ********************************************************/
 
+#include <limits.h>
 #include "compiler.h"
 #include "codegen.h"
+#include "ir.h"
+#include "backend.h"
+#include "arena.h"
+#include "strength.h"
+#include "profile.h"
+#include "peval.h"
+#include "cfg.h"
+#include "phase.h"
 
 /***************************************************
 * Symbol Table management
@@ -34,7 +42,24 @@
 ****************************************************/
 
 // associative array <name> <-> <type> <scope> <storage> 
-struct nlist* symbolTable[HASHSIZE];
+hashTable symbolTable;
+
+// Scopes nest: a declaration binds its name in the innermost one,
+// hiding any outer binding of it. Every binding is also appended to
+// an undo log; a scope remembers where the log stood when it was
+// entered, and leaving it unbinds everything logged since, latest
+// first (each one is then the head of its chain).
+static struct nlist** undoLog;
+static int undoLen, undoCap;
+
+typedef struct scopeRec{
+    int id;
+    int kind;         // SCOPE_XXX
+    int undoMark;     // undoLen on entry
+} scopeRec;
+
+static scopeRec* scopes;  // scopes[0]: global scope
+static int scopeDepth, scopeCap, lastScopeID;
 
 // promotion and conversion priority
 static int promotionPriority[MAX_TYPES][2];
@@ -43,9 +68,10 @@ static int promotionPriority[MAX_TYPES][2];
 void 
 createSymbolTable(void)
 {
-    int i;
-    for (i = 0; i < HASHSIZE; i++)
-	symbolTable[i] = NULL;
+    hash_clear(&symbolTable);
+
+    undoLen = scopeDepth = lastScopeID = 0;
+    enterScope(SCOPE_GLOBAL);
 
     // define "the usual conventions"
     promotionPriority[1][0] = INTEGER;
@@ -58,32 +84,93 @@ createSymbolTable(void)
     promotionPriority[3][1] = 1000;
 }
 
-// static allocation of storage so caller can safely access
-static char*
-assignNewTemp()
+static int numTemps;   // slots handed out so far
+static char* varSlot;  // per slot: 1 - a variable (or parameter)
+static int varCap;
+
+// Returns: slot N of the new temp (printed as temp&N by the backends)
+int
+assignNewTemp(void)
+{
+    if ( (INT_MAX == numTemps) )
+	errExit(0, "too many temporaries");
+    return ++numTemps;
+}
+
+// Returns: ID of the new, now innermost, scope
+int
+enterScope(int kind)
+{
+    if ( (scopeDepth == scopeCap) ){
+	scopeCap = (scopeCap)? 2 * scopeCap : 16;
+	if ( (NULL == (scopes = realloc(scopes, scopeCap * sizeof(scopeRec)))) )
+	    errExit(1, "...realloc()...");
+    }
+
+    scopes[scopeDepth].id = (scopeDepth)? ++lastScopeID : 0;
+    scopes[scopeDepth].kind = kind;
+    scopes[scopeDepth].undoMark = undoLen;
+
+    return scopes[scopeDepth++].id;
+}
+
+// undo the bindings of the innermost scope
+void
+exitScope(void)
 {
-    static char storage[10];
-    static int i = 0;
+    scopeRec* sp;
 
-    i++;
-    sprintf(storage, "temp&%d", i);
+    if ( (1 >= scopeDepth) )
+	errExit(0, "cannot leave the global scope");
+    sp = &scopes[--scopeDepth];
 
-    return storage;
+    while ( (undoLen > sp->undoMark) )
+	unbind(&symbolTable, undoLog[--undoLen]);
 }
 
-// Returns: pointer to node inserted 
-//          (statically allocated; caller to save)
-// Error:   returns NULL (attempt to redefine variable/function)
+int
+currentScope(void) { return scopes[scopeDepth - 1].id; }
+
+// Returns: pointer to node inserted (in the current scope); its
+//          storage is handed out once its code is (see newVariable())
+// Error:   returns NULL (name already declared in this scope)
 struct nlist*
-writeSymbolTable(int exprType, char* name, int type, char* scope)
+writeSymbolTable(int exprType, char* name, int type)
 {
-    char storage[MAGIC];
+    struct nlist* np;
 
-    if ( !( NULL == lookup(symbolTable, name)) ) // can't redefine 
+    if ( (NULL != (np = lookup(&symbolTable, name)) ) &&
+	 (currentScope() == np->scope) ) // can't redefine 
 	return NULL;
-    strcpy(storage, assignNewTemp());
 
-    return install(symbolTable, name, type, NULL, storage);
+    if ( (undoLen == undoCap) ){
+	undoCap = (undoCap)? 2 * undoCap : 256;
+	if ( (NULL == (undoLog = realloc(undoLog, 
+					 undoCap * sizeof(struct nlist*)))) )
+	    errExit(1, "...realloc()...");
+    }
+    np = bind(&symbolTable, name, type, currentScope(), 0);
+    undoLog[undoLen++] = np;
+
+    return np;
+}
+
+// np: a variable (or parameter), as its declaration is compiled:
+// its storage comes next to the temps around it
+static void
+newVariable(struct nlist* np)
+{
+    int cap;
+
+    np->slot = assignNewTemp();
+    if ( (np->slot >= varCap) ){
+	cap = max(2 * varCap, np->slot + 256);
+	if ( (NULL == (varSlot = realloc(varSlot, cap))) )
+	    errExit(1, "...realloc()...");
+	memset(varSlot + varCap, 0, cap - varCap);
+	varCap = cap;
+    }
+    varSlot[np->slot] = 1;
 }
 
 // Returns: pointer to node if already in symbol table
@@ -94,7 +181,7 @@ writeSymbolTable(int exprType, char* name, int type, char* scope)
 struct nlist*
 readSymbolTable(const char* name)
 {
-    return lookup(symbolTable, name);
+    return lookup(&symbolTable, name);
 }
 
 /***************************************************
@@ -128,225 +215,469 @@ makeOpRec(token tok)
     return res;
 }
 
-// make an EXPR_ID from <name> already in Symbol Table
+// make an EXPR_ID from the variable np (once its storage is known)
 exprRecord 
-makeIDRec(const char* name)
+makeIDRec(const struct nlist* np)
 {
     exprRecord res;
-    struct nlist* pList;
-
-    if ( (NULL == (pList = readSymbolTable(name)) ) )
-	errExit(0, "attempting to access undeclared ID (%s)", identifierStr);
 
     res.kind = EXPR_ID;
-    strcpy(res.name, pList->name);
-    res.type = pList->type;
+    res.slot = np->slot;
+    res.type = np->type;
 
     return res;
 }
 
-// assumes call when intVal/fltVal contains the literal
-exprRecord 
-makeLiteralRec(token tok)
-{
-    exprRecord res;
+/***************************************************
+* Code generation wrappers
+*
+* Each wrapper turns its records into one irInstr and
+* hands it to the attached backends (backend.c)
+****************************************************/
 
-    switch(tok){
-    case tok_INT_LITERAL:
-	res.kind = EXPR_INT_LITERAL;
-	res.val_int = intVal;
-	res.type = INTEGER; // need to pick a default: if we see an int type,
-	break;              // consider it to be an int (not a long, say)
-    case tok_FLT_LITERAL:
-	res.kind = EXPR_FLT_LITERAL;
-	res.val_flt = fltVal;
-	res.type = FLOAT; // same about defaults as above, if also double exists
+static irOperand
+makeOperand(const exprRecord rec)
+{
+    irOperand res;
+
+    res.type = rec.type;
+    switch(rec.kind){
+    case EXPR_ID:
+    case EXPR_TMP:
+	res.kind = OPND_SLOT;
+	res.slot = rec.slot;
+	break;
+    case EXPR_INT_LITERAL:
+    case EXPR_LONG_LITERAL:
+	res.kind = OPND_INT;
+	res.val_int = rec.val_int;
+	break;
+    case EXPR_FLT_LITERAL:
+	res.kind = OPND_FLT;
+	res.val_flt = rec.val_flt;
 	break;
     default:
-	errExit(0, "invalid token for processing as literal expression");
+	errExit(0, "invalid expression type (%d)", rec.kind);
 	break;
     }
 
     return res;
 }
 
-/***************************************************
-* Code generation wrappers
-*
-****************************************************/
-void
-codegen_DECLARE(const exprRecord rec)
+// definition under way, if any: its body is kept for inlining
+static fctRecord* curFct;
+static const fctRecord* lastFct;  // latest defined
+static int keepMain;              // see codegen_keepMain()
+static fctRecord* mainFct;        // main program, while it is kept
+static const fctRecord* keptMain; // once complete
+static irInstr* fctBody;     // scratch: body of curFct, so far
+static int fctBodyLen, fctBodyCap;
+static int numLabels;        // of the function under way
+
+static void
+record(const irInstr* ins)
 {
+    if (curFct || mainFct){
+	if ( (fctBodyLen == fctBodyCap) ){
+	    fctBodyCap = (fctBodyCap)? 2*fctBodyCap : 64;
+	    fctBody = realloc(fctBody, fctBodyCap * sizeof(irInstr));
+	    if ( (NULL == fctBody) )
+		errExit(1, "...realloc()...");
+	}
+	fctBody[fctBodyLen++] = *ins;
+    }
 
-    char typeStr[MAX_TOK_LEN], commandStr[MAGIC];
-    struct nlist* recNL;
-    int t;
+    backend_emit(ins);
+}
 
-    if ( (NULL == (recNL = readSymbolTable(rec.name)) ) )
-	errExit(0, "cannot find name in Symbol Table (%s)", rec.name);
+// a while loop under way: its code waits in loopBuf until the
+// outermost one is complete (see codegen_ENDWHILE())
+static int loopDepth;
+static irInstr* loopBuf;
+static int loopLen, loopCap;
 
-    if ( (INTEGER == (t = recNL->type)) )
-	strcpy(typeStr, "int");
-    else if ( (LONG == t) )
-	strcpy(typeStr, "long");
-    else if ( (FLOAT == t) )
-	strcpy(typeStr, "float");
-    else
-	errExit(0, "in ST, invalid type entry (%d) for ID (%s)", t, rec.name);  
+static void
+keepIR(const irInstr* ins)
+{
+    if ( (0 == loopDepth) ){
+	record(ins);
+	return;
+    }
+    if ( (loopLen == loopCap) ){
+	loopCap = (loopCap)? 2*loopCap : 64;
+	if ( (NULL == (loopBuf = realloc(loopBuf, loopCap * sizeof(irInstr)))) )
+	    errExit(1, "...realloc()...");
+    }
+    loopBuf[loopLen++] = *ins;
+}
 
-    sprintf(commandStr, "%s", "Declare:");
-    printf("%-8s %s, %s, %s\n", commandStr, rec.name, recNL->storage, typeStr);
+// ins goes through partial evaluation (peval.c) first
+static void
+emitIR(const irInstr* ins)
+{
+    const irInstr* res;
+    enum phase prev;
+    int i, n;
+
+    prev = phase_enter(PHASE_PEVAL);
+    n = peval_instr(ins, &res);
+    phase_leave(prev);
+    for (i = 0; i < n; i++)
+	keepIR(&res[i]);
 }
 
-static char*
-storageFromName(const char* name)
+static void
+generate(enum irOp op, int type, const exprRecord* dest, 
+	 const exprRecord* a, const exprRecord* b, const char* name)
+{
+    irInstr ins;
+
+    ins.op = op;
+    ins.type = type;
+    ins.dest.kind = ins.a.kind = ins.b.kind = OPND_NONE;
+    if ( (NULL != dest) )
+	ins.dest = makeOperand(*dest);
+    if ( (NULL != a) )
+	ins.a = makeOperand(*a);
+    if ( (NULL != b) )
+	ins.b = makeOperand(*b);
+    ins.name = name;
+
+    emitIR(&ins);
+}
+
+// np: a variable bound by writeSymbolTable()
+// Returns: its record
+exprRecord
+codegen_DECLARE(struct nlist* np)
 {
-    struct nlist* pNL;
+    exprRecord rec;
+    int t;
+
+    t = np->type;
+    if ( (INTEGER != t) && (LONG != t) && (FLOAT != t) )
+	errExit(0, "in ST, invalid type entry (%d) for ID (%s)", t, np->name);  
 
-    if ( (NULL == (pNL = readSymbolTable(name)) ) )
-	errExit(0, "unable to find (%s) in symbol table", name);
+    newVariable(np);
+    rec = makeIDRec(np);
+    generate(IR_DECLARE, t, &rec, NULL, NULL, np->name);
 
-    return pNL->storage;
+    return rec;
 }
 
 // int kind: 0 - assignment; 1 - copy assignment
-// LHS should be be a fake tmpExpr (0) (name == storage), or EXPR_ID (1) 
-// RHS could be anything
+// LHS should be be a fake tmpExpr (0) (slot: its storage), or EXPR_ID (1) 
+// RHS could be anything; if of another type, it is converted right
+// into LHS (no temp in between)
 void
 codegen_ASSIGN(const exprRecord LHS, const exprRecord RHS, int kind)
 {
-    char strL[MAGIC], strR[MAGIC], commandStr[MAGIC];
+    enum irOp op;
 
-    if ( (0 == kind) )
-	strcpy(strL, LHS.name);
-    else if ( (1 == kind) )
-	strcpy(strL, storageFromName(LHS.name));
-    else
+    if ( (0 != kind) && (1 != kind) )
 	errExit(0, "invalid call of codegen_Assign (type = %d)", kind);
 
-    if ( (EXPR_INT_LITERAL == RHS.kind) || (EXPR_LONG_LITERAL == RHS.kind) )
-	sprintf(strR, "%ld", RHS.val_int);
-    else if ( (EXPR_FLT_LITERAL == RHS.kind) )
-	sprintf(strR, "%g", RHS.val_flt);
-    else if ( (EXPR_ID == RHS.kind) )
-	sprintf(strR, "%s", storageFromName(RHS.name));
-    else if ( (EXPR_TMP == RHS.kind) ) // name == storage location
-	sprintf(strR, "%s", RHS.name);
-    else
-	errExit(0, "invalid assignment");
-
-    sprintf(commandStr, "%s", "Assign:");
-    printf("%-8s %s, %s\n", commandStr, strL, strR);
+    op = IR_ASSIGN;
+    if ( (LHS.type != RHS.type) )
+	op = ( (LONG == LHS.type) && (INTEGER == RHS.type) )?
+	    IR_PROMOTE : IR_CONVERT;
+    generate(op, LHS.type, &LHS, &RHS, NULL, NULL);
 }
 
-// res will be EXPR_TMP (name == storage); LHS/RHS could be anything
-static void
-codegen_INFIX(const exprRecord res, const exprRecord LHS, 
-	      const opRecord op, const exprRecord RHS)
+// int literal last promoted to long (operands are cast to a temp
+// before an infix sees them)
+// Note: slot and value are fields of their own; in an irOperand they
+//       share a union
+static struct{
+    int slot;            // the temp promoted to (0: none)
+    long val;
+} lastCast;
+
+// Returns: 1 if rec is an integer constant (put in *c)
+static int
+constValue(const exprRecord rec, long* c)
 {
-	// should be max MAX_LIT_LEN and MAX_ID_LEN
-    char opStr[MAGIC], strL[MAGIC], strR[MAGIC];
-    int tL, tR;
+    irOperand o;
 
-    switch(op.op){
-    case PLUS: strcpy(opStr, "Add:"); break;
-    case MINUS: strcpy(opStr, "Sub:"); break;
-    case MUL: strcpy(opStr, "Mul:"); break;
-    case DIV: strcpy(opStr, "Div:"); break;
-    default: errExit(0, "illegal operation in infix expression"); break;
+    if ( (EXPR_INT_LITERAL == rec.kind) || (EXPR_LONG_LITERAL == rec.kind) ){
+	*c = rec.val_int;
+	return 1;
     }
+    o = makeOperand(rec);
+    if ( peval_value(&o) && (OPND_INT == o.kind) ){
+	*c = o.val_int;
+	return 1;
+    }
+    if ( (EXPR_TMP == rec.kind) && (0 != lastCast.slot) &&
+	 (rec.slot == lastCast.slot) ){
+	*c = lastCast.val;
+	return 1;
+    }
+    return 0;
+}
 
-    // prepare what to print depending on expr type of LHS and RHS
-    if ( (EXPR_ID == (tL = LHS.kind)) )
-	strcpy(strL, storageFromName(LHS.name));
-    else if ( (EXPR_TMP == tL) )
-	strcpy(strL, LHS.name);  // name == storage
-    else if ( (EXPR_INT_LITERAL == tL) || (EXPR_LONG_LITERAL == tL) )
-	sprintf(strL, "%ld", LHS.val_int);
-    else if ( (EXPR_FLT_LITERAL == tL) )
-	sprintf(strL, "%g", LHS.val_flt);
-    else
-	errExit(0, "invalid expression type (%d)", tL);
-
-    if ( (EXPR_ID == (tR = RHS.kind)) )
-	strcpy(strR, storageFromName(RHS.name));
-    else if ( (EXPR_TMP == tR) )
-	strcpy(strR, RHS.name);  // name == storage
-    else if ( (EXPR_INT_LITERAL == tR) || (EXPR_LONG_LITERAL == tR) )
-	sprintf(strR, "%ld", RHS.val_int);
-    else if ( (EXPR_FLT_LITERAL == tR) )
-	sprintf(strR, "%g", RHS.val_flt);
+// x * c, c * x, x / c (c a constant): emit strength_reduce()'s
+// cheaper sequence, if there is one
+// Returns: 1 if it was emitted
+static int
+reduceStrength(enum irOp op, const exprRecord res, 
+	       const exprRecord LHS, const exprRecord RHS)
+{
+    irInstr seq[STRENGTH_MAX];
+    irOperand x, tmp[STRENGTH_MAX + 1];
+    irOperand* o[3];
+    long c, other;
+    int n, i, j;
+
+    if ( constValue(RHS, &c) && !constValue(LHS, &other) )
+	x = makeOperand(LHS);
+    else if ( (IR_MUL == op) && constValue(LHS, &c) &&
+	      !constValue(RHS, &other) )
+	x = makeOperand(RHS);
     else
-	errExit(0, "invalid expression type (%d)", tR);
+	return 0;
+
+    if ( (0 == (n = strength_reduce(op, res.type, c, seq)) ) )
+	return 0;
 
-    // for res, name == storage
-    printf("%-8s %s, %s, %s\n", opStr, res.name, strL, strR);		
+    for (i = 1; i < n; i++){
+	tmp[i] = makeOperand(res);
+	tmp[i].slot = ++numTemps;
+    }
+    tmp[n] = makeOperand(res);
+
+    for (i = 0; i < n; i++){
+	o[0] = &seq[i].dest; o[1] = &seq[i].a; o[2] = &seq[i].b;
+	for (j = 0; j < 3; j++)
+	    if ( (OPND_SLOT == o[j]->kind) )
+		*o[j] = (STRENGTH_X == o[j]->slot)? x : tmp[o[j]->slot];
+	emitIR(&seq[i]);
+    }
+
+    return 1;
 }
 
-static char*
-typeToStr(int type)
+// res will be EXPR_TMP (slot: a temp, or a variable's storage);
+// LHS/RHS could be anything
+static void
+codegen_INFIX(const exprRecord res, const exprRecord LHS, 
+	      const opRecord op, const exprRecord RHS)
 {
-    static char typeStr[MAX_TOK_LEN + 1];
+    enum irOp irOp;
 
-    switch(type){
-    case INTEGER: strcpy(typeStr, "int"); break;
-    case LONG: strcpy(typeStr, "long"); break;
-    case FLOAT: strcpy(typeStr, "float"); break;
-    default: errExit(0, "invalid type %d", type);
+    switch(op.op){
+    case PLUS: irOp = IR_ADD; break;
+    case MINUS: irOp = IR_SUB; break;
+    case MUL: irOp = IR_MUL; break;
+    case DIV: irOp = IR_DIV; break;
+    default: errExit(0, "illegal operation in infix expression"); break;
     }
 
-    return typeStr;
+    if ( (IR_MUL == irOp) || (IR_DIV == irOp) )
+	if ( reduceStrength(irOp, res, LHS, RHS) )
+	    return;
+
+    generate(irOp, res.type, &res, &LHS, &RHS, NULL);
 }
 
 // at call, dest should be an EXPR_TMP; from could be any type of expr
 static void
 codegen_CONVERT(const exprRecord dest, const exprRecord from, int to)
 {
-    char convType[MAGIC], typeStr[MAX_TOK_LEN + 1], fromStr[MAGIC];
-    int t;
+    if ( (EXPR_INT_LITERAL == from.kind) && (LONG == to) ){
+	lastCast.slot = dest.slot;
+	lastCast.val = (int) from.val_int;
+    }
 
     if ( (LONG == to) && (INTEGER == from.type) )
-	strcpy(convType, "Promote:");
-    else
-	strcpy(convType, "Convert:");
-
-    strcpy(typeStr, typeToStr(to));
-
-    if ( (EXPR_ID == (t = from.kind) ) )
-	sprintf(fromStr, "%s", storageFromName(from.name));
-    else if ( (EXPR_TMP == t) )
-	sprintf(fromStr, "%s", from.name); // name == storage for tmp
-    else if ( (EXPR_INT_LITERAL == t) || (EXPR_LONG_LITERAL == t) )
-	sprintf(fromStr, "%ld", from.val_int);
-    else if ( (EXPR_FLT_LITERAL == t) )
-	sprintf(fromStr, "%g", from.val_flt);
+	generate(IR_PROMOTE, to, &dest, &from, NULL, NULL);
     else
-	errExit(0, "in conversion, invalid expression type (%d)", from.kind);
+	generate(IR_CONVERT, to, &dest, &from, NULL, NULL);
+}
 
-    printf("%-8s %s, %s, %s\n", convType, dest.name, fromStr, typeStr);
+// rec is an EXPR_ID; its value is taken from program input
+void
+codegen_READ(const exprRecord rec)
+{
+    if (curFct)
+	errExit(0, "read() is not allowed in a function (%s)", curFct->name);
+    generate(IR_READ, rec.type, &rec, NULL, NULL, NULL);
+}
+
+// rec could be any type of expr; codegen_WRITELN() ends the list
+void
+codegen_WRITE(const exprRecord rec)
+{
+    if (curFct)
+	errExit(0, "write() is not allowed in a function (%s)", curFct->name);
+    generate(IR_WRITE, rec.type, NULL, &rec, NULL, NULL);
+}
+
+void
+codegen_WRITELN(void)
+{
+    generate(IR_WRITELN, INVALID, NULL, NULL, NULL, NULL);
 }
 
 // adjust once we process args
 void 
 codegen_FUNCTION(const char* name)
 {	
-    printf("Function: %s\n", name);
-    puts("----------------------------------------------");
+    if (profiled)
+	ir_setWeight(profile_entries(name));
+    generate(IR_FUNCTION, INVALID, NULL, NULL, NULL, name);
+    numLabels = 0;
+
+    if (keepMain){
+	mainFct = arena_alloc(&compileArena, sizeof(fctRecord));
+	mainFct->name = arena_strdup(&compileArena, name);
+	mainFct->linkage = LINK_MAIN;
+	mainFct->retType = INVALID;
+	mainFct->numParams = 0;
+	mainFct->slotLo = numTemps + 1;
+	fctBodyLen = 0;
+    }
 }
 
 void 
 codegen_END(const char* name)
 {
-    puts("----------------------------------------------");
-    printf("End function: %s\n\n", name);
+    if (mainFct){
+	mainFct->slotHi = numTemps;
+	mainFct->len = fctBodyLen;
+	mainFct->body = arena_alloc(&compileArena,
+				    mainFct->len * sizeof(irInstr) + 1);
+	memcpy(mainFct->body, fctBody, mainFct->len * sizeof(irInstr));
+	mainFct->cost = 0;
+	mainFct->prev = NULL;
+	keptMain = mainFct;
+	mainFct = NULL;
+    }
+    generate(IR_END, INVALID, NULL, NULL, NULL, name);
 }
 
+// keep the body of the main program, as it is emitted (for a unit:
+// see globals.c)
+void
+codegen_keepMain(void) { keepMain = 1; }
+
+// Returns: the main program kept, once it is complete; or NULL
+const fctRecord*
+codegen_mainFunction(void) { return keptMain; }
+
 void
 codegen_TU(int fd, const char* name)
 {
-    puts("----------------------------------------------");
-    printf("code generated for %s\n", (fd)?name:"stdin");
-    puts("----------------------------------------------\n");
+    backend_open(fd, name);
+}
+
+/***************************************************
+* Control flow
+*
+* Labels are numbered from 1 within each function.
+* A condition (a rel b) is lowered to a branch on the
+* opposite relation, taken when it does not hold; for
+* floats, <, <=, >, >= have no opposite (NaN compares
+* false either way): the branch on rel jumps over a Jump
+* taken when it does not hold.
+****************************************************/
+
+// Returns: a new label of the current function
+int
+codegen_newLabel(void) { return ++numLabels; }
+
+// op: IR_LABEL, IR_JUMP, or a branch (comparing a to b)
+static void
+generateFlow(enum irOp op, int label, const exprRecord* a,
+	     const exprRecord* b)
+{
+    irInstr ins;
+
+    ins.op = op;
+    ins.type = (NULL != a)? a->type : INVALID;
+    ins.dest.kind = OPND_INT;
+    ins.dest.type = INTEGER;
+    ins.dest.val_int = label;
+    ins.a.kind = ins.b.kind = OPND_NONE;
+    if ( (NULL != a) )
+	ins.a = makeOperand(*a);
+    if ( (NULL != b) )
+	ins.b = makeOperand(*b);
+    ins.name = NULL;
+
+    emitIR(&ins);
+}
+
+void
+codegen_LABEL(int label) { generateFlow(IR_LABEL, label, NULL, NULL); }
+
+void
+codegen_JUMP(int label) { generateFlow(IR_JUMP, label, NULL, NULL); }
+
+// rel: tok_EQ, tok_NE, tok_LT, tok_LE, tok_GT, or tok_GE
+// LHS, RHS: of the same type
+// jump to label unless (LHS rel RHS)
+void
+codegen_UNLESS(token rel, const exprRecord LHS, const exprRecord RHS,
+	       int label)
+{
+    enum irOp op, opposite;
+    int taken;
+
+    switch(rel){
+    case tok_EQ: op = IR_BEQ; opposite = IR_BNE; break;
+    case tok_NE: op = IR_BNE; opposite = IR_BEQ; break;
+    case tok_LT: op = IR_BLT; opposite = IR_BGE; break;
+    case tok_LE: op = IR_BLE; opposite = IR_BGT; break;
+    case tok_GT: op = IR_BGT; opposite = IR_BLE; break;
+    case tok_GE: op = IR_BGE; opposite = IR_BLT; break;
+    default: errExit(0, "invalid comparison in condition"); return;
+    }
+    if ( (LHS.type != RHS.type) )
+	errExit(0, "comparison of different types");
+
+    if ( (FLOAT != LHS.type) || (IR_BEQ == op) || (IR_BNE == op) ){
+	generateFlow(opposite, label, &LHS, &RHS);
+	return;
+    }
+    taken = codegen_newLabel();
+    generateFlow(op, taken, &LHS, &RHS);
+    generateFlow(IR_JUMP, label, NULL, NULL);
+    generateFlow(IR_LABEL, taken, NULL, NULL);
+}
+
+// Returns: 1 if slot is a declared variable or a parameter
+static int
+isVariable(int slot)
+{
+    return (slot < varCap) && varSlot[slot];
+}
+
+// top: label of the loop, ahead of its condition
+void
+codegen_WHILE(int top)
+{
+    loopDepth++;
+    codegen_LABEL(top);
+}
+
+// end: label the condition jumps to when it fails
+// Once the outermost loop is complete, its invariant computations
+// are hoisted out of each loop of it (cfg.c)
+void
+codegen_ENDWHILE(int top, int end)
+{
+    int i;
+
+    codegen_JUMP(top);
+    codegen_LABEL(end);
+    if ( (0 != --loopDepth) )
+	return;
+
+    cfg_hoist(loopBuf, loopLen, isVariable);
+    for (i = 0; i < loopLen; i++)
+	record(&loopBuf[i]);
+    loopLen = 0;
 }
 
 /***************************************************
@@ -354,6 +685,497 @@ codegen_TU(int fd, const char* name)
 *
 ****************************************************/
 
+/***************************************************
+* User functions: definition, calls, and inlining
+*
+* A function's name is bound (in the global scope) only
+* once its definition is complete, so it can call only
+* functions defined before it - there is no recursion.
+****************************************************/
+
+static int inlineBudget = INLINE_BUDGET;
+
+void
+codegen_setInlineBudget(int budget) { inlineBudget = budget; }
+
+// rough cost of executing ins, in units of an add
+static int
+instrCost(const irInstr* ins)
+{
+    switch(ins->op){
+    case IR_DECLARE:
+    case IR_PARAM:
+    case IR_RETURN:
+    case IR_ARG:      // counted with the CALL
+	return 0;
+    case IR_MUL:
+	return (FLOAT == ins->type)? 4 : 3;
+    case IR_MULHI:
+	return 3;
+    case IR_DIV:
+	return (FLOAT == ins->type)? 14 : 24;
+    case IR_CONVERT:
+	return 2;
+    case IR_CALL:
+	return CALL_COST; // callee cost is not known here; it is not small
+    default:
+	return 1;
+    }
+}
+
+// what a call costs on top of the body: passing arguments,
+// jumping there and back, and fetching the result
+static int
+callCost(const fctRecord* f)
+{
+    return CALL_COST + f->numParams;
+}
+
+// linkage: LINK_LOCAL, or LINK_EXPORT (visible to other units)
+// Note: the parser has checked that name is not defined yet, and
+//       bound the parameters in a scope of their own
+void
+beginFunction(const char* name, int retType, int linkage)
+{
+    curFct = arena_alloc(&compileArena, sizeof(fctRecord));
+    curFct->name = arena_strdup(&compileArena, name);
+    curFct->linkage = linkage;
+    curFct->retType = retType;
+    curFct->numParams = 0;
+    curFct->slotLo = numTemps + 1;
+
+    fctBodyLen = 0;
+    if (profiled)
+	ir_setWeight(profile_entries(name));
+    generate(IR_FUNCTION, retType, NULL, NULL, NULL, curFct->name);
+    fctBodyLen = 0; // the body starts after FUNCTION
+    numLabels = 0;
+}
+
+// np: the parameter, bound by writeSymbolTable()
+void
+addParam(struct nlist* np)
+{
+    exprRecord rec;
+
+    if ( (MAX_PARAMS == curFct->numParams) )
+	errExit(0, "too many parameters (%d allowed) in %s", MAX_PARAMS,
+		curFct->name);
+
+    curFct->paramType[curFct->numParams++] = np->type;
+    newVariable(np);
+    rec = makeIDRec(np);
+    generate(IR_PARAM, np->type, &rec, NULL, NULL, np->name);
+}
+
+// ret: value of the return statement ending the body
+void
+endFunction(exprRecord ret)
+{
+    fctRecord* f;
+    struct nlist* np;
+    int i;
+
+    f = curFct;
+    if ( (f->retType != ret.type) )
+	ret = castRecord(ret, f->retType);
+    generate(IR_RETURN, f->retType, NULL, &ret, NULL, NULL);
+
+    f->slotHi = numTemps;
+    f->len = fctBodyLen;
+    f->body = arena_alloc(&compileArena, f->len * sizeof(irInstr) + 1);
+    memcpy(f->body, fctBody, f->len * sizeof(irInstr));
+    for (f->cost = i = 0; i < f->len; i++)
+	f->cost += instrCost(&f->body[i]);
+
+    curFct = NULL;
+    generate(IR_END, f->retType, NULL, NULL, NULL, f->name);
+    f->prev = lastFct;
+    lastFct = f;
+
+    np = bind(&symbolTable, f->name, FCT_IMPL, 0, 0);
+    np->fct = f;
+}
+
+static exprRecord
+recordFromOperand(const irOperand* opnd)
+{
+    exprRecord res;
+
+    res.type = opnd->type;
+    switch(opnd->kind){
+    case OPND_SLOT:
+	res.kind = EXPR_TMP;
+	res.slot = opnd->slot;
+	break;
+    case OPND_INT:
+	res.kind = EXPR_INT_LITERAL;
+	res.val_int = opnd->val_int;
+	break;
+    default:
+	res.kind = EXPR_FLT_LITERAL;
+	res.val_flt = opnd->val_flt;
+	break;
+    }
+
+    return res;
+}
+
+// a function defined in another unit: calls of it are left to the
+// linker (--link), never inlined
+void
+importFunction(const char* name, int retType, const int* paramType,
+	       int numParams)
+{
+    struct nlist* np;
+    fctRecord* f;
+    int i;
+
+    if ( (NULL != (np = lookup(&symbolTable, name)) ) && (0 == np->scope) )
+	errExit(0, "attempting to re-define function (%s)", name);
+    if ( (MAX_PARAMS < numParams) )
+	errExit(0, "too many parameters (%d allowed) in %s", MAX_PARAMS,
+		name);
+
+    f = arena_alloc(&compileArena, sizeof(fctRecord));
+    f->name = arena_strdup(&compileArena, name);
+    f->linkage = LINK_IMPORT;
+    f->retType = retType;
+    f->numParams = numParams;
+    for (i = 0; i < numParams; i++)
+	f->paramType[i] = paramType[i];
+    f->body = NULL;
+    f->len = 0;
+    f->slotLo = numTemps + 1;
+    f->slotHi = numTemps;
+    f->cost = 0;
+
+    np = bind(&symbolTable, f->name, FCT_DECL, 0, 0);
+    np->fct = f;
+    f->prev = lastFct;
+    lastFct = f;
+}
+
+// Returns: slots handed out so far
+int
+codegen_numTemps(void) { return numTemps; }
+
+// Returns: the function defined last (the others: ->prev), or NULL
+const fctRecord*
+codegen_lastFunction(void) { return lastFct; }
+
+// f: a complete definition, compiled elsewhere (globals.c), whose
+// slots come after those handed out so far: bind it as if it had
+// just been parsed, and hand its IR to the backends
+void
+codegen_addFunction(fctRecord* f)
+{
+    struct nlist* np;
+    int i;
+
+    if ( (NULL != (np = lookup(&symbolTable, f->name)) ) && (0 == np->scope) )
+	errExit(0, "attempting to re-define function (%s)", f->name);
+    if ( (f->slotLo <= numTemps) )
+	errExit(0, "slots of %s are taken", f->name);
+    numTemps = max(numTemps, f->slotHi);
+
+    if (profiled)
+	ir_setWeight(profile_entries(f->name));
+    generate(IR_FUNCTION, f->retType, NULL, NULL, NULL, f->name);
+    for (i = 0; i < f->len; i++) // as emitted when f was compiled
+	backend_emit(&f->body[i]);
+    generate(IR_END, f->retType, NULL, NULL, NULL, f->name);
+
+    np = bind(&symbolTable, f->name, FCT_IMPL, 0, 0);
+    np->fct = f;
+    f->prev = lastFct;
+    lastFct = f;
+}
+
+/***************************************************
+* Calls of known arguments
+*
+* A function that does not branch is straight-line code,
+* and cannot read(), so a call whose arguments are all
+* known (peval.c) has a known value: it is run at compile
+* time, with the semantics of the IR, unless that fails
+* (division by 0, a float not finite), or takes more than
+* EVAL_BUDGET instructions in all.
+****************************************************/
+
+static long evalSteps;  // instructions run for the current call site
+
+// Returns: 1 if the body of f has labels (a loop, an if): it is
+//          always called, never copied in or run at compile time
+static int
+branches(const fctRecord* f)
+{
+    int i;
+
+    for (i = 0; i < f->len; i++)
+	if ( (IR_LABEL == f->body[i].op) )
+	    return 1;
+    return 0;
+}
+
+// Returns: the function the CALL of name calls
+static const fctRecord*
+calledFunction(const char* name)
+{
+    const fctRecord* f;
+
+    for (f = lastFct; NULL != f; f = f->prev)
+	if ( (0 == strcmp(f->name, name)) )
+	    return f;
+    errExit(0, "call of undefined function (%s)", name);
+    return NULL; // to suppress gcc warning
+}
+
+// Returns: 1 if the value of f(args) is known (put in *res)
+static int
+evalCall(const fctRecord* f, const irOperand* args, irOperand* res)
+{
+    arenaMark m;
+    irOperand* val;      // slot of f - slotLo -> its value
+    irOperand callArgs[MAX_PARAMS], x, y;
+    const irInstr* ins;
+    irOperand* o[2];
+    int i, j, param, numArgs, ok;
+
+    if ( branches(f) )
+	return 0;
+    m = arena_mark(&compileArena);
+    val = arena_alloc(&compileArena,
+		      (f->slotHi - f->slotLo + 1) * sizeof(irOperand));
+
+    ok = 0;
+    for (param = numArgs = i = 0; i < f->len; i++){
+	ins = &f->body[i];
+	if ( (EVAL_BUDGET < ++evalSteps) )
+	    break;
+
+	x = ins->a;
+	y = ins->b;
+	o[0] = &x; o[1] = &y;
+	for (j = 0; j < 2; j++)
+	    if ( (OPND_SLOT == o[j]->kind) )
+		*o[j] = val[o[j]->slot - f->slotLo];
+
+	if ( (IR_RETURN == ins->op) ){
+	    *res = x;
+	    ok = 1;
+	    break;
+	}
+	if ( (IR_ARG == ins->op) ){
+	    callArgs[numArgs++] = x;
+	    continue;
+	}
+
+	j = ins->dest.slot - f->slotLo;
+	if ( (IR_PARAM == ins->op) )
+	    val[j] = args[param++];
+	else if ( (IR_DECLARE == ins->op) ){
+	    val[j].kind = (FLOAT == ins->type)? OPND_FLT : OPND_INT;
+	    val[j].type = ins->type;
+	    val[j].val_int = 0;
+	    if ( (FLOAT == ins->type) )
+		val[j].val_flt = 0.0;
+	}
+	else if ( (IR_CALL == ins->op) ){
+	    numArgs = 0;
+	    if ( !evalCall(calledFunction(ins->name), callArgs, &val[j]) )
+		break;
+	}
+	else if ( (IR_ASSIGN == ins->op) ){ // as Convert, to wrap ints
+	    if ( !peval_fold(IR_CONVERT, ins->type, &x, NULL, &val[j]) )
+		break;
+	}
+	else if ( !peval_fold(ins->op, ins->type, &x, &y, &val[j]) )
+	    break;
+    }
+
+    arena_reset(&compileArena, m);
+    return ok;
+}
+
+// args: the operands of a call of f; known ones are replaced by
+// their values
+// Returns: 1 if the value of the call is known (put in *res)
+static int
+knownCall(const fctRecord* f, irOperand* args, int numArgs, irOperand* res)
+{
+    int i, known;
+
+    if ( !peval_enabled() || (LINK_IMPORT == f->linkage) )
+	return 0;
+    for (known = 1, i = 0; i < numArgs; i++)
+	known &= peval_value(&args[i]);
+    if ( !known )
+	return 0;
+
+    evalSteps = 0;
+    return evalCall(f, args, res);
+}
+
+/***************************************************
+* End calls of known arguments
+*
+****************************************************/
+
+// Copy the body of f, with its slots renamed to fresh ones. A
+// parameter the body never assigns to is replaced by its argument;
+// Returns: the value returned
+static exprRecord
+inlineCall(const fctRecord* f, const irOperand* args)
+{
+    arenaMark m;
+    irOperand* map;     // slot of f - slotLo -> operand at the call site
+    int* assigned;
+    irInstr ins;
+    irInstr argIns[MAX_PARAMS];
+    irOperand* o[3];
+    irOperand callArgs[MAX_PARAMS], v;
+    int i, j, n, param, numArgs;
+    exprRecord res;
+
+    n = f->slotHi - f->slotLo + 1;
+    m = arena_mark(&compileArena);
+    map = arena_alloc(&compileArena, n * sizeof(irOperand));
+    assigned = arena_alloc(&compileArena, n * sizeof(int));
+    memset(assigned, 0, n * sizeof(int));
+    for (i = 0; i < f->len; i++)
+	if ( (IR_PARAM != f->body[i].op) && (OPND_SLOT == f->body[i].dest.kind) )
+	    assigned[f->body[i].dest.slot - f->slotLo] = 1;
+
+    for (param = numArgs = i = 0; i < f->len; i++){
+	ins = f->body[i];
+	o[0] = &ins.dest; o[1] = &ins.a; o[2] = &ins.b;
+
+	// operands read: rename
+	for (j = 1; j < 3; j++)
+	    if ( (OPND_SLOT == o[j]->kind) && (o[j]->slot >= f->slotLo) )
+		*o[j] = map[o[j]->slot - f->slotLo];
+
+	if ( (IR_RETURN == ins.op) ){
+	    res = recordFromOperand(&ins.a);
+	    break;
+	}
+
+	// a call's ARGs wait for it: its value may be known
+	if ( (IR_ARG == ins.op) ){
+	    argIns[numArgs++] = ins;
+	    continue;
+	}
+	if ( (IR_CALL == ins.op) ){
+	    for (j = 0; j < numArgs; j++)
+		callArgs[j] = argIns[j].a;
+	    if ( knownCall(calledFunction(ins.name), callArgs, numArgs, &v) ){
+		map[ins.dest.slot - f->slotLo] = v;
+		numArgs = 0;
+		continue;
+	    }
+	    for (j = 0; j < numArgs; j++)
+		emitIR(&argIns[j]);
+	    numArgs = 0;
+	}
+
+	if ( (IR_PARAM == ins.op) ){
+	    j = ins.dest.slot - f->slotLo;
+	    if ( !assigned[j] ){
+		map[j] = args[param++];
+		continue;
+	    }
+	    ins.op = IR_ASSIGN;
+	    ins.a = args[param++];
+	    ins.name = NULL;
+	}
+
+	// operand written: a fresh slot
+	if ( (OPND_SLOT == ins.dest.kind) ){
+	    j = ins.dest.slot - f->slotLo;
+	    map[j] = ins.dest;
+	    map[j].slot = ++numTemps;
+	    ins.dest = map[j];
+	}
+	emitIR(&ins);
+    }
+
+    arena_reset(&compileArena, m);
+    return res;
+}
+
+// With a profile (--profile-use), call sites never reached are not
+// inlined, and those reached once per row or more may cost up to
+// HOT_INLINE_BUDGET more than the call
+// count: times the call site was reached (-1: no profile)
+// Returns: the inline budget for the call site
+static int
+siteBudget(long count)
+{
+    if ( (-1 == count) )
+	return inlineBudget;
+    if ( (NO_INLINE == inlineBudget) || (0 == count) )
+	return NO_INLINE;
+    if ( (count >= profile_entries("begin")) )
+	return max(inlineBudget, HOT_INLINE_BUDGET);
+    return inlineBudget;
+}
+
+// args: the call's arguments, as parsed; converted here to the
+// parameter types
+exprRecord
+generateCall(const struct nlist* fct, exprRecord* args, int numArgs)
+{
+    const fctRecord* f;
+    irOperand opnds[MAX_PARAMS], v;
+    exprRecord res;
+    const char* caller;
+    long count;
+    int i;
+
+    f = fct->fct;
+    if ( (numArgs != f->numParams) )
+	errExit(0, "%s takes %d arguments, not %d", f->name, f->numParams,
+		numArgs);
+
+    for (i = 0; i < numArgs; i++){
+	if ( (f->paramType[i] != args[i].type) )
+	    args[i] = castRecord(args[i], f->paramType[i]);
+	opnds[i] = makeOperand(args[i]);
+    }
+    if ( knownCall(f, opnds, numArgs, &v) )
+	return recordFromOperand(&v);
+
+    // small bodies cost little more than the call: copy them in; the
+    // copy runs as often as the call site
+    caller = (curFct)? curFct->name : "begin";
+    count = (profiled)? profile_callSite(caller, f->name) : -1;
+    if ( (LINK_IMPORT != f->linkage) && !branches(f) &&
+	 (f->cost <= callCost(f) + siteBudget(count)) ){
+	if (profiled)
+	    ir_setWeight(count);
+	res = inlineCall(f, opnds);
+	if (profiled)
+	    ir_setWeight(profile_entries(caller));
+	return res;
+    }
+
+    for (i = 0; i < numArgs; i++)
+	generate(IR_ARG, f->paramType[i], NULL, &args[i], NULL, NULL);
+
+    res.kind = EXPR_TMP;
+    res.type = f->retType;
+    res.slot = assignNewTemp();
+    generate(IR_CALL, f->retType, &res, NULL, NULL, f->name);
+
+    return res;
+}
+
+/***************************************************
+* End user functions
+*
+****************************************************/
+
 /***************************************************
 * Conversion and promotion for binary expressions
 * (infixes), assignments, and return values
@@ -383,7 +1205,7 @@ castRecord(const exprRecord old, int newType)
 
     res.kind = EXPR_TMP;
     res.type = newType;
-    strcpy(res.name, assignNewTemp());
+    res.slot = assignNewTemp();
 
     codegen_CONVERT(res, old, newType);
 
@@ -400,8 +1222,12 @@ castRecord(const exprRecord old, int newType)
 *
 ****************************************************/
 
+// dest: where the value is to go (NULL: anywhere); if it is of the
+//       infix's type, the infix's last instruction writes it
+// Returns: the record of the value (dest's slot, if written)
 exprRecord
-generateInfix(exprRecord LHS, opRecord op, exprRecord RHS)
+generateInfix(exprRecord LHS, opRecord op, exprRecord RHS,
+	      const exprRecord* dest)
 {
     exprRecord res;
     int t;
@@ -419,7 +1245,10 @@ generateInfix(exprRecord LHS, opRecord op, exprRecord RHS)
 	res.type = LHS.type;
 
     res.kind = EXPR_TMP;
-    strcpy(res.name, assignNewTemp());
+    if ( (NULL != dest) && (dest->type == res.type) )
+	res.slot = dest->slot;
+    else
+	res.slot = assignNewTemp();
 
     codegen_INFIX(res, LHS, op, RHS);
 
@@ -463,7 +1292,7 @@ allocateRegister(char* name)
     for (i = 1; i < NUMREGS+1; i++){
 	if ( (regFree[i][1] == 1) ){
 	    sprintf(reg, "$%d", i);
-	    if ( (NULL == install(symbolTable, name, reg)) )
+	    if ( (NULL == install(&symbolTable, name, reg)) )
 		errExit(0, "installing %s into symbol table", name);
 	    regFree[i][1] = 0;
 	    return reg;
@@ -480,13 +1309,13 @@ deAllocateRegister(char* name)
     struct nlist* p;
     int tmpNumber;
     char tmpChar[5], errMsg[100];
-    if ( ( NULL != (p = lookup(symbolTable, name)) ) ){
+    if ( ( NULL != (p = lookup(&symbolTable, name)) ) ){
 	strcpy(tmpChar, &((p->storage)[1]) ); // assumes reg. adjust later
 	tmpNumber = atoi(tmpChar);  // we won't free memory within a fct.
 	regFree[tmpNumber][1] = 1;  // so probably "if reg" type test enough
     }
 
-    if ( (-1 == undef(symbolTable, name)) ){
+    if ( (-1 == undef(&symbolTable, name)) ){
 	sprintf(errMsg, "%s", "trying to de-allocate non-existing identifier");
 	strcat(errMsg, " from symbol table");
 	errExit(0, errMsg);
@@ -10,29 +10,88 @@
 #include "hashtab.h"
 #include "ast.h"
 #include "lexer.h"
+#include "ir.h"
 
 #define NUMREGS 12 // relocate to interpreter
 
-extern struct nlist* symbolTable[HASHSIZE];
+#define MAX_PARAMS 16
+#define CALL_COST 4       // call and return, on top of the arguments
+#define INLINE_BUDGET 12  // inline bodies costing up to this much more
+			  // than the call (see instrCost())
+#define NO_INLINE -1000000
+#define HOT_INLINE_BUDGET 48  // for call sites reached once per row or
+			      // more (--profile-use)
+#define EVAL_BUDGET 100000    // instructions run at compile time, at
+			      // most, for a call of known arguments
+
+// LINK_IMPORT: defined in another unit (no body); LINK_MAIN: the
+// main program, kept for a unit (see codegen_keepMain())
+enum linkage { LINK_LOCAL, LINK_EXPORT, LINK_IMPORT, LINK_MAIN };
+
+typedef struct fctRecord{
+    const char* name;
+    int linkage;
+    int retType;
+    int numParams;
+    int paramType[MAX_PARAMS];
+    irInstr* body;        // PARAMs ... RETURN (no FUNCTION/END)
+    int len;
+    int slotLo, slotHi;   // slots the body defines
+    int cost;             // estimated, per call
+    const struct fctRecord* prev;  // defined before it (NULL: none)
+} fctRecord;
+
+extern hashTable symbolTable;
+
+enum scopeKinds { SCOPE_GLOBAL, SCOPE_FUNCTION, SCOPE_BLOCK };
 
 void createSymbolTable(void);
-struct nlist* writeSymbolTable(int exprType, char* name, int type, char* scope);
+int enterScope(int kind);
+void exitScope(void);
+int currentScope(void);
+int assignNewTemp(void);
+struct nlist* writeSymbolTable(int exprType, char* name, int type);
 struct nlist* readSymbolTable(const char* name);
 
 opRecord makeOpRec(token tok);
-exprRecord makeIDRec(const char* name);
-exprRecord makeLiteralRec(token tok);
-exprRecord generateInfix(const exprRecord LHS, 
-			 const opRecord op, const exprRecord RHS);
+exprRecord makeIDRec(const struct nlist* np);
+exprRecord generateInfix(const exprRecord LHS, const opRecord op,
+			 const exprRecord RHS, const exprRecord* dest);
 
 int checkCast(const exprRecord LHS, const exprRecord RHS);
 exprRecord castRecord(const exprRecord rec, int to);
 
-void codegen_DECLARE(const exprRecord);
-// kind: 0 - assignment (name == storage); 1 - copy assignment
+exprRecord codegen_DECLARE(struct nlist* np);
+// kind: 0 - assignment (LHS.slot: storage); 1 - copy assignment;
+// RHS of another type is converted into LHS
 void codegen_ASSIGN(const exprRecord LHS, const exprRecord RHS, int kind);
+void codegen_READ(const exprRecord);
+void codegen_WRITE(const exprRecord);
+void codegen_WRITELN(void);
 void codegen_FUNCTION(const char* name);
 void codegen_END(const char*);
 void codegen_TU(int fd, const char*);
 
+int codegen_newLabel(void);
+void codegen_LABEL(int label);
+void codegen_JUMP(int label);
+void codegen_UNLESS(token rel, const exprRecord LHS, const exprRecord RHS,
+		    int label);
+void codegen_WHILE(int top);
+void codegen_ENDWHILE(int top, int end);
+
+void codegen_setInlineBudget(int budget);
+void beginFunction(const char* name, int retType, int linkage);
+void addParam(struct nlist* np);
+void endFunction(exprRecord ret);
+exprRecord generateCall(const struct nlist* fct, exprRecord* args, 
+			int numArgs);
+int codegen_numTemps(void);
+const fctRecord* codegen_lastFunction(void);
+void codegen_addFunction(fctRecord* f);
+void importFunction(const char* name, int retType, const int* paramType,
+		    int numParams);
+void codegen_keepMain(void);
+const fctRecord* codegen_mainFunction(void);
+
 #endif
@@ -11,48 +11,318 @@
 #include "lexer.h"
 #include "parser.h"
 #include "codegen.h"
+#include "batch.h"
+#include "backend.h"
+#include "arena.h"
+#include "pipeline.h"
+#include "profile.h"
+#include "peval.h"
+#include "globals.h"
+#include "link.h"
+#include "cfg.h"
+#include "slp.h"
+#include "sched.h"
+#include "ast.h"
+#include "astgen.h"
+#include "phase.h"
 
-extern char identifierStr[];
-extern int numVal;
+static void
+usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [--emit=<backend>[:file][,...]]"
+	    " [--run[=input] | --batch[=input]] [--alloc-stats]"
+	    " [--time-phases]"
+	    " [--pipeline] [--inline=N | --no-inline] [--no-fold]"
+	    " [--no-hoist] [--no-slp | --avx2] [--no-sched] [--fast-math]"
+	    " [--profile-gen=file] [--profile-use=file]"
+	    " [--precompile=file | --compile=file] [--use-globals=file]"
+	    " [source]\n", prog);
+    fprintf(stderr, "       %s --link [--emit=...] [--run[=input] |"
+	    " --batch[=input]] unit...\n", prog);
+    fprintf(stderr, "  (no option)     print the IR of source (default: stdin)\n");
+    fprintf(stderr, "  --emit=...      feed one parse to each backend listed,\n");
+    fprintf(stderr, "                  writing to file (default: stdout):\n");
+    fprintf(stderr, "                  ir   - text IR\n");
+    fprintf(stderr, "                  bin  - binary IR\n");
+    fprintf(stderr, "                  none - nothing (parse only)\n");
+    fprintf(stderr, "                  c    - C source\n");
+    fprintf(stderr, "                  rt   - run-time support, as C source,"
+	    " for asm and obj\n");
+    fprintf(stderr, "                  asm  - x86-64 assembly\n");
+    fprintf(stderr, "                  obj  - x86-64 ELF object\n");
+    fprintf(stderr, "  --run[=input]   run the program, reading from input\n");
+    fprintf(stderr, "                  (default: stdin)\n");
+    fprintf(stderr, "  --batch[=input] run the program once per row of input\n");
+    fprintf(stderr, "                  (default: stdin), in blocks of %d rows\n",
+	    BATCH_ROWS);
+    fprintf(stderr, "  --alloc-stats   report compiler memory use on stderr\n");
+    fprintf(stderr, "  --time-phases   report the compile time of each phase"
+	    "\n                  on stderr (see phase.c)\n");
+    fprintf(stderr, "  --pipeline      lex, parse, and emit on three threads\n");
+    fprintf(stderr, "  --inline=N      inline functions costing up to N more than"
+	    " a call\n                  (default: %d)\n", INLINE_BUDGET);
+    fprintf(stderr, "  --no-inline     call every function\n");
+    fprintf(stderr, "  --no-fold       emit the computations of known values"
+	    " too\n                  (see peval.c)\n");
+    fprintf(stderr, "  --no-hoist      leave loop-invariant code in its loop"
+	    "\n                  (see cfg.c)\n");
+    fprintf(stderr, "  --no-slp        leave alike statements scalar"
+	    " (see slp.c)\n");
+    fprintf(stderr, "  --avx2          vectorize for AVX2, %d lanes (default:"
+	    " SSE2, %d)\n", SLP_AVX2_LANES, SLP_LANES);
+    fprintf(stderr, "  --no-sched      keep the order of the IR"
+	    " (see sched.c)\n");
+    fprintf(stderr, "  --fast-math     reassociate float sums and products"
+	    " too\n");
+    fprintf(stderr, "  --profile-gen=file  with --run or --batch: write how\n"
+	    "                  often the program's parts ran to file\n");
+    fprintf(stderr, "  --profile-use=file  compile for the profile in file\n");
+    fprintf(stderr, "  --precompile=file   source is a prelude (functions\n"
+	    "                  only): write its globals to file\n");
+    fprintf(stderr, "  --use-globals=file  start with the globals in file\n");
+    fprintf(stderr, "  --compile=file  write the unit of source to file,"
+	    " for --link\n");
+    fprintf(stderr, "  --link          link the units given into one"
+	    " program\n");
+    exit(EXIT_FAILURE);
+}
 
-int 
-main(int argc, char* argv[])
+// list: <backend>[:file][,<backend>[:file]]*
+static void
+attachBackends(char* list, const char* prog)
 {
-    int fd, openFlags, endSeen;
-    endSeen = 0;
+    char* spec;
 
-    if (argc > 1){
-	openFlags = O_RDONLY;
-	fd = open(argv[1], openFlags);
-	if (fd == -1)
-	    errExit(1, " ...open()...");
-    }
-    else
-	fd = 0;
+    for (spec = strtok(list, ","); NULL != spec; spec = strtok(NULL, ","))
+	if ( (-1 == backend_attach(spec)) ){
+	    fprintf(stderr, "unknown backend, or too many (%s)\n", spec);
+	    usage(prog);
+	}
+}
+
+static arenaMark mainTrees;  // astArena, where the main program began
+
+// generate the code of the tree just parsed, if any; those of the
+// statements of the main program are dropped once they fill a chunk
+static void
+generateTree(int keep)
+{
+    astgen_tree(ast_close());
+    if ( !keep && (astArena.used - mainTrees.used > ARENA_CHUNK) )
+	arena_reset(&astArena, mainTrees);
+}
 
+// parse and compile source (on fd); unit: where its unit is to be
+// written, if anywhere (prelude: then it must not have a main program)
+static void
+compile(int fd, const char* srcName, const char* useGlobals,
+	const char* unit, int prelude, int pipe)
+{
+    int endSeen;
+
+    endSeen = 0;
     createSymbolTable();
+    if (pipe)
+	pipeline_start(fd);
+    if (unit)
+	codegen_keepMain();
 
-    codegen_TU(fd, (argc >1)?argv[1]:"");
+    codegen_TU(fd, (srcName)?srcName:"");
+    if (useGlobals)
+	globals_load(useGlobals);
 
-    // needs to be redone when doing scope
-    match(1, fd, tok_BEGIN, 0);
+    // functions, if any, come before the main program
+    while ( Definition(fd) )
+	generateTree(1);
+    if ( (tok_EOF == curTok) && unit )
+	return; // a unit of functions only
+    if (prelude)
+	errExit(0, "a prelude holds function definitions only");
+    match(0, fd, tok_BEGIN, 0);
+    mainTrees = arena_mark(&astArena);
     codegen_FUNCTION("begin");
+    enterScope(SCOPE_FUNCTION);
 
     while ( getNextToken(fd) != EOF){
 	if ( (curTok == tok_END) ) { endSeen = 1; break;}
 	if ( (curTok == tok_SEMICOLON) ) continue; // allow empty statement
 	// Note: consider letting regular descent handle it - it should
 	Statement(fd, 0);
+	generateTree(0);
     }
 
-    if (endSeen)  // make sure we saw END before EOF
+    if (endSeen){  // make sure we saw END before EOF
+	exitScope();
 	codegen_END("begin");
+    }
     else
 	errExit(0, "syntax error: program must end with token END");
+}
+
+int 
+main(int argc, char* argv[])
+{
+    int fd, inFd, openFlags, batch, run, emit, allocStats, pipe, link, i;
+    int numUnits, timePhases;
+    const char* srcName;
+    const char* runIn;
+    const char* profGen;
+    const char* profUse;
+    const char* precomp;
+    const char* unitOut;
+    const char* useGlobals;
+    const char** units;
+    long* counts;
+    long rows;
+    batch = run = emit = allocStats = pipe = link = numUnits = 0;
+    timePhases = 0;
+    srcName = runIn = profGen = profUse = precomp = unitOut = NULL;
+    useGlobals = NULL;
+    if ( (NULL == (units = malloc(argc * sizeof(char*)))) )
+	errExit(1, "...malloc()...");
+
+    for (i = 1; i < argc; i++){
+	if ( (0 == strcmp(argv[i], "--alloc-stats")) )
+	    allocStats = 1;
+	else if ( (0 == strcmp(argv[i], "--avx2")) )
+	    slp_setLanes(SLP_AVX2_LANES);
+	else if ( (0 == strcmp(argv[i], "--batch")) )
+	    batch = 1;
+	else if ( (0 == strncmp(argv[i], "--batch=", 8)) ){
+	    batch = 1;
+	    runIn = argv[i] + 8;
+	}
+	else if ( (0 == strncmp(argv[i], "--compile=", 10)) )
+	    unitOut = argv[i] + 10;
+	else if ( (0 == strncmp(argv[i], "--emit=", 7)) ){
+	    emit = 1;
+	    attachBackends(argv[i] + 7, argv[0]);
+	}
+	else if ( (0 == strcmp(argv[i], "--fast-math")) )
+	    sched_setFastMath(1);
+	else if ( (0 == strncmp(argv[i], "--inline=", 9)) )
+	    codegen_setInlineBudget(atoi(argv[i] + 9));
+	else if ( (0 == strcmp(argv[i], "--link")) )
+	    link = 1;
+	else if ( (0 == strcmp(argv[i], "--no-inline")) )
+	    codegen_setInlineBudget(NO_INLINE);
+	else if ( (0 == strcmp(argv[i], "--no-fold")) )
+	    peval_setEnabled(0);
+	else if ( (0 == strcmp(argv[i], "--no-hoist")) )
+	    cfg_setEnabled(0);
+	else if ( (0 == strcmp(argv[i], "--no-sched")) )
+	    sched_setEnabled(0);
+	else if ( (0 == strcmp(argv[i], "--no-slp")) )
+	    slp_setEnabled(0);
+	else if ( (0 == strcmp(argv[i], "--pipeline")) )
+	    pipe = 1;
+	else if ( (0 == strncmp(argv[i], "--precompile=", 13)) )
+	    precomp = argv[i] + 13;
+	else if ( (0 == strncmp(argv[i], "--profile-gen=", 14)) )
+	    profGen = argv[i] + 14;
+	else if ( (0 == strncmp(argv[i], "--profile-use=", 14)) )
+	    profUse = argv[i] + 14;
+	else if ( (0 == strcmp(argv[i], "--run")) )
+	    run = 1;
+	else if ( (0 == strncmp(argv[i], "--run=", 6)) ){
+	    run = 1;
+	    runIn = argv[i] + 6;
+	}
+	else if ( (0 == strcmp(argv[i], "--time-phases")) )
+	    timePhases = 1;
+	else if ( (0 == strncmp(argv[i], "--use-globals=", 14)) )
+	    useGlobals = argv[i] + 14;
+	else if ( ('-' == argv[i][0]) )
+	    usage(argv[0]);
+	else
+	    units[numUnits++] = argv[i];
+    }
+
+    if ( (batch && run) || (precomp && unitOut) || (timePhases && pipe) ||
+	 ( (precomp || unitOut) && (batch || run) ) )
+	usage(argv[0]);
+    if (link){
+	if ( (0 == numUnits) || precomp || unitOut || useGlobals || profGen ||
+	     profUse || pipe )
+	    usage(argv[0]);
+	fd = -1;
+    }
+    else if ( (1 < numUnits) )
+	usage(argv[0]);
+    else if ( (1 == numUnits) ){
+	srcName = units[0];
+	openFlags = O_RDONLY;
+	fd = open(srcName, openFlags);
+	if (fd == -1)
+	    errExit(1, " ...open()...");
+    }
+    else
+	fd = 0;
+
+    if ( (batch || run) && (NULL == runIn) && (0 == fd) )
+	errExit(0, "program and its input cannot both come from stdin");
+    if ( (NULL != profGen) && !(batch || run) )
+	errExit(0, "--profile-gen needs --run or --batch");
+    if ( (NULL != profGen) ){
+	codegen_setInlineBudget(NO_INLINE); // so that every call shows
+	slp_setEnabled(0);                  // and every variable
+    }
+    if ( (NULL != profUse) )
+	profile_load(profUse, srcName);
+    if (batch || run)
+	backend_recordProgram();
+    else if ( !emit && !precomp && !unitOut )
+	backend_attach("ir");
+
+    if (timePhases)
+	phase_start();
+    if (link)
+	link_units(units, numUnits);
+    else{
+	compile(fd, srcName, useGlobals, (precomp)? precomp : unitOut,
+		NULL != precomp, pipe);
+	if (srcName)
+	    if (close(fd) == -1)
+		errExit(1, "...close()...");
+    }
+
+    pipeline_finish();
+    backend_close();
+    phase_stop();
+    if (precomp || unitOut)
+	globals_write((precomp)? precomp : unitOut);
+
+    if (batch || run){
+	if ( (NULL == runIn) )
+	    inFd = 0;
+	else if ( (-1 == (inFd = open(runIn, O_RDONLY)) ) )
+	    errExit(1, "...open(%s)...", runIn);
+	counts = NULL;
+	if ( (NULL != profGen) ){
+	    if ( (NULL == (counts = calloc(irProg.len + 1, sizeof(long)))) )
+		errExit(1, "...calloc()...");
+	    batch_setCounts(counts);
+	}
+	rows = 1;
+	if (batch)
+	    rows = batch_run(&irProg, inFd, 1);
+	else
+	    batch_runOnce(&irProg, inFd, 1);
+	if ( (NULL != profGen) ){
+	    profile_write(profGen, srcName, &irProg, counts, rows);
+	    free(counts);
+	}
+	if ( (0 != inFd) )
+	    close(inFd);
+    }
 
-    if (argc > 1)
-	if (close(fd) == -1)
-	    errExit(1, "...close()...");
+    if (allocStats)
+	arena_printStats(stderr, &compileArena);
+    if (timePhases)
+	phase_print(stderr);
+    arena_release(&compileArena);
+    arena_release(&astArena);
+    free(units);
 
     exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,211 @@
+/*******************************************************
+* emitasm.c -          x86-64 assembly backend (--emit=asm)
+* Language:            Micro
+*
+* Prints the instructions x86.c selects for the recorded
+* IR as AT&T syntax GNU assembly:
+*     micro --emit=asm:prog.s,rt:rt.c prog.mic
+* The frame is .Lframe in .bss, FRAME_LINE aligned; the
+* labels of x86.c are .LN, and float literals go to
+* .rodata as .LCN. The m_*() routines it calls come with
+* --emit=rt:
+*     cc prog.s rt.c -lm
+********************************************************/
+
+#include "compiler.h"
+#include "backend.h"
+#include "frame.h"
+#include "x86.h"
+
+static FILE* out;
+static double* consts;   // float literals, .LCN being consts[N]
+static int numConsts, constsCap;
+
+static const char* reg32[] = { "%eax", "%ecx", "%edx", "%ebx", "%esp",
+			       "%ebp", "%esi", "%edi" };
+static const char* reg64[] = { "%rax", "%rcx", "%rdx", "%rbx", "%rsp",
+			       "%rbp", "%rsi", "%rdi" };
+static const char* cond[] = { "e", "ne", "l", "le", "g", "ge", "a", "ae",
+			      "p" };
+
+// per xOp, to X_VZEROUPPER; integer ones take a suffix
+static const char* mnemonic[] = { "mov", "movslq", "lea", "add", "sub",
+    "cmp", "xor", "test", "imul", "imul", "neg", "idiv", "", "shl", "sar",
+    "shr", "push", "pop", "call", "ret", "jmp", "j", "movsd", "addsd",
+    "subsd", "mulsd", "divsd", "ucomisd", "cvtsi2sd", "cvttsd2si", "movq",
+    "unpcklpd", "punpcklqdq", "broadcastsd", "pbroadcastq", "movupd",
+    "movdqu", "addpd", "subpd", "mulpd", "paddq", "psubq", "pmuludq",
+    "vzeroupper" };
+
+static int
+floatConst(double val)
+{
+    double* p;
+
+    if ( (numConsts == constsCap) ){
+	constsCap = (constsCap)? 2*constsCap : 16;
+	if ( (NULL == (p = realloc(consts, constsCap*sizeof(double)))) )
+	    errExit(1, "...realloc()...");
+	consts = p;
+    }
+    consts[numConsts] = val;
+
+    return numConsts++;
+}
+
+// o as an AT&T operand; w64: a register is 64 bit; ymm: an
+// SSE register is %ymm
+static char*
+asmOperand(const xOpnd* o, int w64, int ymm)
+{
+    static char buf[2][MAGIC + 16];
+    static int which = 0;
+    char* s;
+
+    s = buf[which ^= 1];
+    switch(o->kind){
+    case XO_REG:
+	strcpy(s, (w64)? reg64[o->n] : reg32[o->n]);
+	break;
+    case XO_XMM:
+	sprintf(s, "%%%cmm%ld", (ymm)? 'y' : 'x', o->n);
+	break;
+    case XO_IMM:
+	sprintf(s, "$%ld", o->n);
+	break;
+    case XO_SLOT:
+	sprintf(s, "-%ld(%%rbx)", o->n);
+	break;
+    case XO_FLT:
+	sprintf(s, ".LC%d(%%rip)", floatConst(o->f));
+	break;
+    case XO_FRAME:
+	sprintf(s, ".Lframe+%ld(%%rip)", o->n);
+	break;
+    case XO_LABEL:
+	sprintf(s, ".L%ld", o->n);
+	break;
+    case XO_EXT:
+	sprintf(s, "%s@PLT", x86_extern[o->n]);
+	break;
+    default:
+	errExit(0, "invalid operand in assembly backend");
+	break;
+    }
+
+    return s;
+}
+
+static void
+printIns(const xIns* ins)
+{
+    const char* sfx;
+    const char* name;
+    int w64, yd, ys;
+
+    switch(ins->op){
+    case X_LABEL:
+	fprintf(out, ".L%ld:\n", ins->d.n);
+	return;
+    case X_FUNCTION:
+	fprintf(out, "\n# function %s\n\t.text\n", ins->name);
+	if (ins->w)
+	    fprintf(out, "\t.globl\tmain\n\t.type\tmain, @function\nmain:\n");
+	else
+	    fprintf(out, ".L%ld:\n", ins->d.n);
+	return;
+    case X_END:
+	fprintf(out, "\t.size\tmain, .-main\n");
+	return;
+    case X_JCC:
+	fprintf(out, "\tj%s\t%s\n", cond[ins->cc], asmOperand(&ins->d, 0, 0));
+	return;
+    case X_CDQ:
+	fprintf(out, "\t%s\n", (ins->w)? "cqto" : "cltd");
+	return;
+    case X_VZEROUPPER:
+	fprintf(out, "\tvzeroupper\n");
+	return;
+    default:
+	break;
+    }
+
+    // the suffix of the name, and the width of the registers
+    name = mnemonic[ins->op];
+    sfx = "";
+    w64 = yd = ys = 0;
+    if ( (X_POP >= ins->op) || (X_CVTSI2SD == ins->op) ||
+	 (X_CVTTSD2SI == ins->op) ){
+	w64 = ins->w;
+	if ( (X_MOVSX != ins->op) )
+	    sfx = (ins->w)? "q" : "l";
+	if ( (X_MOV == ins->op) && (XO_IMM == ins->s.kind) && ins->w &&
+	     ( (ins->s.n < -2147483648L) || (ins->s.n > 2147483647L) ) )
+	    name = "movabs";
+    }
+    else if ( (X_MOVQ == ins->op) )
+	w64 = 1;
+    else if ( (X_MOVQ < ins->op) ){
+	yd = ins->w;
+	ys = (X_PBROADCASTQ != ins->op) && ins->w;
+    }
+
+    if ( (X_MOVQ <= ins->op) && ins->w ){
+	if ( (X_ADDPD <= ins->op) ){ // three operands
+	    fprintf(out, "\tv%s\t%s, ", name, asmOperand(&ins->s, 0, ys));
+	    fprintf(out, "%s, %s\n", asmOperand(&ins->d, 0, yd),
+		    asmOperand(&ins->d, 0, yd));
+	    return;
+	}
+	fprintf(out, "\tv");
+    }
+    else
+	fputc('\t', out);
+
+    if ( (XO_NONE == ins->d.kind) )
+	fprintf(out, "%s%s\n", name, sfx);
+    else if ( (XO_NONE == ins->s.kind) )
+	fprintf(out, "%s%s\t%s\n", name, sfx, asmOperand(&ins->d, w64, yd));
+    else{
+	fprintf(out, "%s%s\t%s, ", name, sfx, asmOperand(&ins->s, w64, ys));
+	fprintf(out, "%s", asmOperand(&ins->d, w64, yd));
+	fprintf(out, (NULL != ins->name)? "\t# %s\n" : "\n", ins->name);
+    }
+}
+
+// .rodata: the float literals; .bss: the frame
+static void
+emitData(const irProgram* prog)
+{
+    union { double d; unsigned long u; } bits;
+    int i;
+
+    if ( (0 != numConsts) )
+	fprintf(out, "\n\t.section\t.rodata\n\t.align\t8\n");
+    for (i = 0; i < numConsts; i++){
+	bits.d = consts[i];
+	fprintf(out, ".LC%d:\t.quad\t0x%lx\t# %g\n", i, bits.u, consts[i]);
+    }
+
+    fprintf(out, "\n\t.bss\n\t.align\t%d\n", FRAME_LINE);
+    fprintf(out, ".Lframe:\t.zero\t%d\n", max(prog->frameSize, 1));
+}
+
+static void
+emitAsm(FILE* outFile, const irProgram* prog, const char* srcName)
+{
+    out = outFile;
+    numConsts = 0;
+
+    fprintf(out, "# generated by micro from %s\n",
+	    (*srcName)? srcName : "stdin");
+    x86_select(prog, printIns);
+    emitData(prog);
+    fprintf(out, "\t.section\t.note.GNU-stack,\"\",@progbits\n");
+
+    free(consts);
+    consts = NULL;
+    constsCap = 0;
+}
+
+const backend asmBackend = { "asm", 1, NULL, NULL, emitAsm };
@@ -0,0 +1,367 @@
+/*******************************************************
+* emitc.c -            C source backends: program (c) and
+*                      run-time support (rt)
+* Language:            Micro
+*
+* --emit=c lowers the recorded IR to one self-contained C
+* translation unit, for the system C compiler to optimize:
+*     micro --emit=c prog.mic > prog.c && cc -O2 prog.c -lm
+* Every slot becomes a typed local sN (int, long, double)
+* of its function; user function f becomes u_f();
+* the helpers emitted up front pin down the semantics the
+* other execution paths share (see batch.c): wrapping int
+* and long arithmetic, and truncating float conversions
+* that yield the type's minimum when out of range.
+* Labels become C labels LN of their function, jumps and
+* branches gotos.
+* read() and write() go through rtio.c, as with --run:
+* its source (rtsrc.c.inc, made by rtsrc.sh) comes first.
+* --emit=rt writes that source by itself, for programs
+* of the native backends to be linked with:
+*     micro --emit=asm:prog.s,rt:rt.c prog.mic
+*     cc prog.s rt.c -lm
+********************************************************/
+
+#include <limits.h>
+#include "compiler.h"
+#include "backend.h"
+#include "strength.h"
+#include "rtsrc.c.inc"
+
+static const char* prelude =
+    "\n"
+    "#include <limits.h>\n"
+    "\n"
+    "static inline int m_f2i(double x)\n"
+    "{\n"
+    "    return (x > INT_MIN - 1.0 && x < INT_MAX + 1.0)? (int) x : INT_MIN;\n"
+    "}\n"
+    "static inline long m_f2l(double x)\n"
+    "{\n"
+    "    return (x >= (double) LONG_MIN && x < -(double) LONG_MIN)?\n"
+    "        (long) x : LONG_MIN;\n"
+    "}\n"
+    "static inline int m_idiv(int x, int y)\n"
+    "{\n"
+    "    if (y == 0) m_divzero();\n"
+    "    return (y == -1)? (int) (0u - (unsigned) x) : x / y;\n"
+    "}\n"
+    "static inline long m_ldiv(long x, long y)\n"
+    "{\n"
+    "    if (y == 0) m_divzero();\n"
+    "    return (y == -1)? (long) (0ul - (unsigned long) x) : x / y;\n"
+    "}\n"
+    "\n";
+
+static const char*
+cType(int type)
+{
+    switch(type){
+    case INTEGER: return "int";
+    case LONG: return "long";
+    case FLOAT: return "double";
+    default: errExit(0, "invalid type in C backend (%d)", type);
+    }
+    return NULL; // to suppress gcc warning
+}
+
+// operand as a C expression, in its own type
+static char*
+cOperand(const irOperand* opnd)
+{
+    static char buf[2][MAGIC + 8];
+    static int which = 0;
+    char* s;
+
+    s = buf[which ^= 1]; // two operands per instruction
+    switch(opnd->kind){
+    case OPND_SLOT:
+	sprintf(s, "s%d", opnd->slot);
+	break;
+    case OPND_INT:
+	if ( (LONG == opnd->type) )
+	    sprintf(s, "%ldL", opnd->val_int);
+	else if ( (opnd->val_int > INT_MAX) ) // int literals wrap, as in batch.c
+	    sprintf(s, "((int) %ldL)", opnd->val_int);
+	else
+	    sprintf(s, "%ld", opnd->val_int);
+	break;
+    case OPND_FLT:
+	sprintf(s, "%.17g", opnd->val_flt);
+	if ( (NULL == strpbrk(s, ".eEn")) )
+	    strcat(s, ".0");
+	break;
+    default:
+	errExit(0, "invalid operand in C backend");
+	break;
+    }
+
+    return s;
+}
+
+static void
+emitArith(FILE* out, const irInstr* ins)
+{
+    const char* x;
+    const char* y;
+    static const char opChar[] = "+-*/";
+    int op;
+
+    x = cOperand(&ins->a);
+    y = cOperand(&ins->b);
+    op = ins->op - IR_ADD;
+
+    if ( (FLOAT == ins->type) )
+	fprintf(out, "    s%d = %s %c %s;\n", ins->dest.slot, x, opChar[op], y);
+    else if ( (IR_DIV == ins->op) )
+	fprintf(out, "    s%d = %s(%s, %s);\n", ins->dest.slot,
+		(INTEGER == ins->type)? "m_idiv" : "m_ldiv", x, y);
+    else if ( (INTEGER == ins->type) )
+	fprintf(out, "    s%d = (int) ((unsigned) %s %c (unsigned) %s);\n",
+		ins->dest.slot, x, opChar[op], y);
+    else
+	fprintf(out, "    s%d = (long) ((unsigned long) %s %c "
+		"(unsigned long) %s);\n", ins->dest.slot, x, opChar[op], y);
+}
+
+// the operations of strength.c: b is a literal
+static void
+emitShift(FILE* out, const irInstr* ins)
+{
+    fprintf(out, "    s%d = ", ins->dest.slot);
+    fprintf(out, strength_cExpr(ins->op, ins->type), cOperand(&ins->a),
+	    ins->b.val_int);
+    fprintf(out, ";\n");
+}
+
+static void
+emitConvert(FILE* out, const irInstr* ins)
+{
+    const char* x;
+
+    x = cOperand(&ins->a);
+    if ( (FLOAT == ins->a.type) && (INTEGER == ins->type) )
+	fprintf(out, "    s%d = m_f2i(%s);\n", ins->dest.slot, x);
+    else if ( (FLOAT == ins->a.type) && (LONG == ins->type) )
+	fprintf(out, "    s%d = m_f2l(%s);\n", ins->dest.slot, x);
+    else
+	fprintf(out, "    s%d = (%s) %s;\n", ins->dest.slot,
+		cType(ins->type), x);
+}
+
+// the slots of the function from code[from] (FUNCTION) to its END
+// are declared up front, save its parameters: declared variables
+// start out as 0
+static void
+emitLocals(FILE* out, const irProgram* prog, const int* types, int from)
+{
+    const char** names;
+    const irInstr* ins;
+    int* own;
+    int i, k, to;
+
+    names = calloc(prog->numSlots + 1, sizeof(char*));
+    own = calloc(prog->numSlots + 1, sizeof(int));
+    if ( (NULL == names) || (NULL == own) )
+	errExit(1, "...calloc()...");
+    for (to = from + 1; IR_END != prog->code[to].op; to++){
+	ins = &prog->code[to];
+	if ( (OPND_SLOT == ins->dest.kind) && (-1 != own[ins->dest.slot]) )
+	    own[ins->dest.slot] = (IR_PARAM == ins->op)? -1 : 1;
+	if ( ir_isVector(ins->op) )
+	    for (k = 1; k < prog->lanes; k++)
+		if ( (-1 != own[ins->dest.slot + k]) )
+		    own[ins->dest.slot + k] = 1;
+	if ( (IR_DECLARE == ins->op) )
+	    names[ins->dest.slot] = ins->name;
+    }
+    for (to = from + 1; IR_END != prog->code[to].op; to++){
+	ins = &prog->code[to];
+	if ( ((OPND_SLOT == ins->a.kind) && (0 == own[ins->a.slot])) ||
+	     ((OPND_SLOT == ins->b.kind) && (0 == own[ins->b.slot])) )
+	    errExit(0, "slot read but never defined in C backend (%d)",
+		    (OPND_SLOT == ins->a.kind) && (0 == own[ins->a.slot])?
+		    ins->a.slot : ins->b.slot);
+    }
+
+    for (i = 1; i < prog->numSlots; i++){
+	if ( (1 != own[i]) )
+	    continue;
+	if ( (NULL != names[i]) )
+	    fprintf(out, "    %s s%d = 0; /* %s */\n", cType(types[i]), i,
+		    names[i]);
+	else
+	    fprintf(out, "    %s s%d;\n", cType(types[i]), i);
+    }
+    fputc('\n', out);
+
+    free(names);
+    free(own);
+}
+
+// user function f becomes static C function u_f
+static void
+emitHeader(FILE* out, const irProgram* prog, int from)
+{
+    const irInstr* ins;
+    int i;
+
+    ins = &prog->code[from];
+    if ( (INVALID == ins->type) ){
+	fprintf(out, "/* function %s */\nint\nmain(void)\n{\n", ins->name);
+	fprintf(out, "    m_start();\n");
+	return;
+    }
+
+    fprintf(out, "static %s\nu_%s(", cType(ins->type), ins->name);
+    for (i = from + 1; IR_PARAM == prog->code[i].op; i++)
+	fprintf(out, "%s%s s%d", (i == from + 1)? "" : ", ",
+		cType(prog->code[i].type), prog->code[i].dest.slot);
+    fprintf(out, "%s)\n{\n", (i == from + 1)? "void" : "");
+}
+
+// the run-time support (rtio.c), as C source
+static void
+emitRt(FILE* out, const irProgram* prog, const char* srcName)
+{
+    const char** line;
+
+    for (line = rtSource; NULL != *line; line++){
+	fputs(*line, out);
+	fputc('\n', out);
+    }
+}
+
+static void
+emitC(FILE* out, const irProgram* prog, const char* srcName)
+{
+    static const char* rel[] = { "==", "!=", "<", "<=", ">", ">=" };
+    const irInstr* ins;
+    irInstr lane;
+    int* types;
+    int* linked;
+    int i, j, w, numArgs;
+
+    fprintf(out, "/* generated by micro from %s */\n",
+	    (*srcName)? srcName : "stdin");
+    emitRt(out, prog, srcName);
+    fputs(prelude, out);
+
+    types = ir_slotTypes(prog);
+    linked = ir_linkCalls(prog);
+    w = numArgs = 0;
+    for (i = 0; i < prog->len; i++){
+	ins = &prog->code[i];
+	switch(ins->op){
+	case IR_FUNCTION:
+	    if ( (INVALID != ins->type) && (-1 == linked[i]) ){
+		while ( (IR_END != prog->code[i].op) ) // all inlined
+		    i++;
+		break;
+	    }
+	    emitHeader(out, prog, i);
+	    emitLocals(out, prog, types, i);
+	    break;
+	case IR_END:
+	    if ( (INVALID == ins->type) )
+		fprintf(out, "    m_flush();\n    return 0;\n}\n");
+	    else
+		fprintf(out, "}\n\n");
+	    break;
+	case IR_DECLARE: // in a loop, it runs again (see emitLocals())
+	    fprintf(out, "    s%d = 0;\n", ins->dest.slot);
+	    break;
+	case IR_PARAM:   // see emitHeader()
+	    break;
+	case IR_LABEL:
+	    fprintf(out, "L%ld: ;\n", ins->dest.val_int);
+	    break;
+	case IR_JUMP:
+	    fprintf(out, "    goto L%ld;\n", ins->dest.val_int);
+	    break;
+	case IR_BEQ:
+	case IR_BNE:
+	case IR_BLT:
+	case IR_BLE:
+	case IR_BGT:
+	case IR_BGE:
+	    fprintf(out, "    if (%s %s ", cOperand(&ins->a), rel[ins->op - IR_BEQ]);
+	    fprintf(out, "%s) goto L%ld;\n", cOperand(&ins->b), ins->dest.val_int);
+	    break;
+	case IR_RETURN:
+	    fprintf(out, "    return %s;\n", cOperand(&ins->a));
+	    break;
+	case IR_ARG:     // see IR_CALL
+	    numArgs++;
+	    break;
+	case IR_CALL:
+	    if ( (-1 == linked[i]) ) // an import not linked
+		errExit(0, "call of undefined function (%s)", ins->name);
+	    fprintf(out, "    s%d = u_%s(", ins->dest.slot, ins->name);
+	    for (j = i - numArgs; j < i; j++)
+		fprintf(out, "%s%s", (j == i - numArgs)? "" : ", ",
+			cOperand(&prog->code[j].a));
+	    fprintf(out, ");\n");
+	    numArgs = 0;
+	    break;
+	case IR_ASSIGN:
+	    fprintf(out, "    s%d = %s;\n", ins->dest.slot, cOperand(&ins->a));
+	    break;
+	case IR_ADD:
+	case IR_SUB:
+	case IR_MUL:
+	case IR_DIV:
+	    emitArith(out, ins);
+	    break;
+	case IR_SHL:
+	case IR_SAR:
+	case IR_SHR:
+	case IR_MULHI:
+	    emitShift(out, ins);
+	    break;
+	case IR_VASSIGN: // lane by lane: the C compiler may vectorize
+	case IR_VADD:
+	case IR_VSUB:
+	case IR_VMUL:
+	    for (j = 0; j < prog->lanes; j++){
+		lane = ir_lane(ins, j);
+		if ( (IR_ASSIGN == lane.op) )
+		    fprintf(out, "    s%d = %s;\n", lane.dest.slot,
+			    cOperand(&lane.a));
+		else
+		    emitArith(out, &lane);
+	    }
+	    break;
+	case IR_PROMOTE:
+	case IR_CONVERT:
+	    emitConvert(out, ins);
+	    break;
+	case IR_READ:
+	    fprintf(out, "    s%d = %s();\n", ins->dest.slot,
+		    (INTEGER == ins->type)? "m_readi" :
+		    (LONG == ins->type)? "m_readl" : "m_readf");
+	    break;
+	case IR_WRITE:
+	    if ( (0 != w++) )
+		fprintf(out, "    m_putc(' ');\n");
+	    fprintf(out, "    %s(%s);\n",
+		    (INTEGER == ins->type)? "m_writei" :
+		    (LONG == ins->type)? "m_writel" : "m_writef",
+		    cOperand(&ins->a));
+	    break;
+	case IR_WRITELN:
+	    fprintf(out, "    m_putc('\\n');\n");
+	    w = 0;
+	    break;
+	default:
+	    errExit(0, "invalid IR instruction (%d) in C backend", ins->op);
+	    break;
+	}
+    }
+
+    free(types);
+    free(linked);
+}
+
+const backend cBackend = { "c", 1, NULL, NULL, emitC };
+const backend rtBackend = { "rt", 0, NULL, NULL, emitRt };
@@ -0,0 +1,223 @@
+/*******************************************************
+* emitir.c -           IR backends: text (ir) and binary (bin)
+* Language:            Micro
+*
+* Text IR (--emit=ir, the default):
+*   Declare: a, temp&1, int
+*   Add:     temp&3, temp&1, 15
+*   Sar:     temp&4, temp&3, 2
+*   Blt:     L2, temp&4, 10, int
+* Binary IR (--emit=bin:<file>), in host byte order:
+*   header:  "MICROIR\0", int32 version
+*   record:  uint8 op, uint8 type, then for dest, a, b:
+*            uint8 kind, followed by int32 slot (OPND_SLOT),
+*            int64 value (OPND_INT), or double (OPND_FLT);
+*            DECLARE, PARAM, FUNCTION, END, and CALL add
+*            uint16 length and the bytes of their name
+********************************************************/
+
+#include <stdint.h>
+#include "compiler.h"
+#include "backend.h"
+
+#define BIN_IR_VERSION 5
+
+/***************************************************
+* Text IR
+*
+****************************************************/
+
+static const char*
+typeStr(int type)
+{
+    switch(type){
+    case INTEGER: return "int";
+    case LONG: return "long";
+    case FLOAT: return "float";
+    default: errExit(0, "invalid type %d", type);
+    }
+    return NULL; // to suppress gcc warning
+}
+
+static char*
+opndStr(const irOperand* opnd)
+{
+    static char buf[2][MAGIC];
+    static int which = 0;
+    char* s;
+
+    s = buf[which ^= 1];
+    switch(opnd->kind){
+    case OPND_SLOT: sprintf(s, "temp&%d", opnd->slot); break;
+    case OPND_INT: sprintf(s, "%ld", opnd->val_int); break;
+    case OPND_FLT: sprintf(s, "%g", opnd->val_flt); break;
+    default: errExit(0, "invalid operand in IR"); break;
+    }
+
+    return s;
+}
+
+static void
+irOpen(FILE* out, int fd, const char* srcName)
+{
+    fputs("----------------------------------------------\n", out);
+    fprintf(out, "code generated for %s\n", (fd)? srcName : "stdin");
+    fputs("----------------------------------------------\n\n", out);
+}
+
+static void
+irInstrText(FILE* out, const irInstr* ins)
+{
+    static const char* arith[] = { "Add:", "Sub:", "Mul:", "Div:" };
+    static const char* shift[] = { "Shl:", "Sar:", "Shr:", "MulHi:" };
+    static const char* branch[] = { "Beq:", "Bne:", "Blt:", "Ble:", "Bgt:",
+				    "Bge:" };
+
+    switch(ins->op){
+    case IR_DECLARE:
+	fprintf(out, "%-8s %s, %s, %s\n", "Declare:", ins->name,
+		opndStr(&ins->dest), typeStr(ins->type));
+	break;
+    case IR_ASSIGN:
+	fprintf(out, "%-8s %s, %s\n", "Assign:", opndStr(&ins->dest),
+		opndStr(&ins->a));
+	break;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+	fprintf(out, "%-8s %s, ", arith[ins->op - IR_ADD], opndStr(&ins->dest));
+	fprintf(out, "%s, %s\n", opndStr(&ins->a), opndStr(&ins->b));
+	break;
+    case IR_SHL:
+    case IR_SAR:
+    case IR_SHR:
+    case IR_MULHI:
+	fprintf(out, "%-8s %s, ", shift[ins->op - IR_SHL], opndStr(&ins->dest));
+	fprintf(out, "%s, %s\n", opndStr(&ins->a), opndStr(&ins->b));
+	break;
+    case IR_PROMOTE:
+    case IR_CONVERT:
+	fprintf(out, "%-8s %s, %s, %s\n",
+		(IR_PROMOTE == ins->op)? "Promote:" : "Convert:",
+		opndStr(&ins->dest), opndStr(&ins->a), typeStr(ins->type));
+	break;
+    case IR_READ:
+	fprintf(out, "%-8s %s, %s\n", "Read:", opndStr(&ins->dest),
+		typeStr(ins->type));
+	break;
+    case IR_WRITE:
+	fprintf(out, "%-8s %s, %s\n", "Write:", opndStr(&ins->a),
+		typeStr(ins->type));
+	break;
+    case IR_WRITELN:
+	fputs("WriteLn:\n", out);
+	break;
+    case IR_FUNCTION:
+	if ( (INVALID == ins->type) ) // main program
+	    fprintf(out, "Function: %s\n", ins->name);
+	else
+	    fprintf(out, "Function: %s, %s\n", ins->name, typeStr(ins->type));
+	fputs("----------------------------------------------\n", out);
+	break;
+    case IR_END:
+	fputs("----------------------------------------------\n", out);
+	fprintf(out, "End function: %s\n\n", ins->name);
+	break;
+    case IR_PARAM:
+	fprintf(out, "%-8s %s, %s, %s\n", "Param:", ins->name,
+		opndStr(&ins->dest), typeStr(ins->type));
+	break;
+    case IR_RETURN:
+    case IR_ARG:
+	fprintf(out, "%-8s %s, %s\n", (IR_RETURN == ins->op)? "Return:" : "Arg:",
+		opndStr(&ins->a), typeStr(ins->type));
+	break;
+    case IR_CALL:
+	fprintf(out, "%-8s %s, %s, %s\n", "Call:", opndStr(&ins->dest),
+		ins->name, typeStr(ins->type));
+	break;
+    case IR_LABEL:
+    case IR_JUMP:
+	fprintf(out, "%-8s L%ld\n", (IR_LABEL == ins->op)? "Label:" : "Jump:",
+		ins->dest.val_int);
+	break;
+    case IR_BEQ:
+    case IR_BNE:
+    case IR_BLT:
+    case IR_BLE:
+    case IR_BGT:
+    case IR_BGE:
+	fprintf(out, "%-8s L%ld, ", branch[ins->op - IR_BEQ], ins->dest.val_int);
+	fprintf(out, "%s, %s, %s\n", opndStr(&ins->a), opndStr(&ins->b),
+		typeStr(ins->type));
+	break;
+    default:
+	errExit(0, "invalid IR instruction (%d)", ins->op);
+	break;
+    }
+}
+
+const backend irBackend = { "ir", 0, irOpen, irInstrText, NULL };
+
+/***************************************************
+* Binary IR
+*
+****************************************************/
+
+static void
+binOpen(FILE* out, int fd, const char* srcName)
+{
+    int32_t version;
+
+    version = BIN_IR_VERSION;
+    fwrite("MICROIR", 1, 8, out);
+    fwrite(&version, sizeof(version), 1, out);
+}
+
+static void
+binOperand(FILE* out, const irOperand* opnd)
+{
+    uint8_t kind;
+    int32_t slot;
+    int64_t val;
+
+    kind = opnd->kind;
+    putc(kind, out);
+    switch(opnd->kind){
+    case OPND_SLOT:
+	slot = opnd->slot;
+	fwrite(&slot, sizeof(slot), 1, out);
+	break;
+    case OPND_INT:
+	val = opnd->val_int;
+	fwrite(&val, sizeof(val), 1, out);
+	break;
+    case OPND_FLT:
+	fwrite(&opnd->val_flt, sizeof(double), 1, out);
+	break;
+    default:
+	break;
+    }
+}
+
+static void
+binInstr(FILE* out, const irInstr* ins)
+{
+    uint16_t len;
+
+    putc(ins->op, out);
+    putc(ins->type, out);
+    binOperand(out, &ins->dest);
+    binOperand(out, &ins->a);
+    binOperand(out, &ins->b);
+
+    if ( (IR_DECLARE == ins->op) || (IR_FUNCTION == ins->op) ||
+	 (IR_END == ins->op) || (IR_PARAM == ins->op) || (IR_CALL == ins->op) ){
+	len = strlen(ins->name);
+	fwrite(&len, sizeof(len), 1, out);
+	fwrite(ins->name, 1, len, out);
+    }
+}
+
+const backend binBackend = { "bin", 0, binOpen, binInstr, NULL };
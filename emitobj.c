@@ -0,0 +1,653 @@
+/*******************************************************
+* emitobj.c -          x86-64 ELF64 object backend
+*                      (--emit=obj:file)
+* Language:            Micro
+*
+* Encodes the instructions x86.c selects (as the
+* assembly backend, emitasm.c, prints them) directly,
+* and writes a relocatable object, with no assembler
+* involved:
+*     micro --emit=obj:prog.o,rt:rt.c prog.mic
+*     cc prog.o rt.c -lm
+* Sections: .text (the functions, then main()), .rodata
+* (float literals), .bss (the frame),
+* .rela.text, .symtab, .strtab, .shstrtab, and an empty
+* .note.GNU-stack.
+* Jumps within .text are resolved here (all rel32);
+* references to .rodata and .bss are R_X86_64_PC32
+* relocations against their section symbols, and calls
+* of the run-time support (rtio.c, see --emit=rt)
+* R_X86_64_PLT32 ones against undefined globals.
+* Only %rax-%rdi and %xmm0/%xmm1 (%ymm0/%ymm1 for AVX2
+* vector ops) are used: REX is 0x48 or none, and VEX
+* takes its two byte form where it can.
+********************************************************/
+
+#include <stdint.h>
+#include <elf.h>
+#include "compiler.h"
+#include "backend.h"
+#include "frame.h"
+#include "x86.h"
+
+// symbols: null, file, .text, .rodata, .bss, then globals: main,
+// the run-time functions (x86_extern[])
+#define SYM_RODATA 3
+#define SYM_BSS 4
+#define SYM_MAIN 5
+#define SYM_EXT 6
+#define NUM_LOCAL_SYMS 5
+
+typedef struct objBuf{
+    unsigned char* p;
+    size_t len, cap;
+} objBuf;
+
+typedef struct fixup{      // rel32 at pos in .text, to label
+    size_t pos;
+    int label;
+} fixup;
+
+typedef struct rmOpnd{     // the r/m operand of an instruction
+    enum { RM_REG, RM_FRAME, RM_RODATA, RM_BSS } kind;
+    int n;                 // register; offset from %rbx; in .rodata
+			   // or .bss
+} rmOpnd;
+
+static objBuf text, rodata, strtab;
+static Elf64_Rela* relas;
+static int numRelas, capRelas;
+static long* labelAt;      // offset in .text; -1: not placed yet
+static int capLabels;
+static fixup* fixups;
+static int numFixups, capFixups;
+
+static size_t mainAt, mainEnd;
+
+/***************************************************
+* Buffers, labels, relocations
+*
+****************************************************/
+
+static void
+put(objBuf* b, const void* p, size_t n)
+{
+    if ( (b->len + n > b->cap) ){
+	b->cap = max(2 * b->cap, b->len + n + 256);
+	if ( (NULL == (b->p = realloc(b->p, b->cap))) )
+	    errExit(1, "...realloc()...");
+    }
+    memcpy(b->p + b->len, p, n);
+    b->len += n;
+}
+
+static void
+byte(int x)
+{
+    unsigned char c;
+
+    c = x;
+    put(&text, &c, 1);
+}
+
+static void
+dword(int32_t x) { put(&text, &x, 4); }
+
+static void
+align(objBuf* b, size_t a)
+{
+    static const unsigned char zeros[16];
+
+    put(b, zeros, (a - b->len % a) % a);
+}
+
+// Returns: offset of s (with its '\0') in b
+static size_t
+putString(objBuf* b, const char* s)
+{
+    size_t off;
+
+    off = b->len;
+    put(b, s, strlen(s) + 1);
+    return off;
+}
+
+// make room for label, unplaced labels being -1
+static void
+growLabels(int label)
+{
+    int cap;
+
+    if ( (label < capLabels) )
+	return;
+    cap = max(2 * capLabels, label + 64);
+    if ( (NULL == (labelAt = realloc(labelAt, cap * sizeof(long)))) )
+	errExit(1, "...realloc()...");
+    while ( (capLabels < cap) )
+	labelAt[capLabels++] = -1;
+}
+
+// label, which x86.c numbers from 0, placed where .text ends
+static void
+place(int label)
+{
+    growLabels(label);
+    labelAt[label] = text.len;
+}
+
+// a rel32 to label, resolved in resolve()
+static void
+rel32(int label)
+{
+    if ( (numFixups == capFixups) ){
+	capFixups = (capFixups)? 2 * capFixups : 64;
+	if ( (NULL == (fixups = realloc(fixups, capFixups * sizeof(fixup)))) )
+	    errExit(1, "...realloc()...");
+    }
+    growLabels(label);
+    fixups[numFixups].pos = text.len;
+    fixups[numFixups++].label = label;
+    dword(0);
+}
+
+static void
+resolve(void)
+{
+    int32_t d;
+    int i;
+
+    for (i = 0; i < numFixups; i++){
+	if ( (-1 == labelAt[fixups[i].label]) )
+	    errExit(0, "jump to a label not defined in object backend");
+	d = labelAt[fixups[i].label] - (long) (fixups[i].pos + 4);
+	memcpy(text.p + fixups[i].pos, &d, 4);
+    }
+}
+
+// a 32 bit field at the end of .text, to be relocated
+static void
+reloc(int sym, int type, long addend)
+{
+    if ( (numRelas == capRelas) ){
+	capRelas = (capRelas)? 2 * capRelas : 64;
+	if ( (NULL == (relas = realloc(relas, capRelas * sizeof(Elf64_Rela)))) )
+	    errExit(1, "...realloc()...");
+    }
+    relas[numRelas].r_offset = text.len;
+    relas[numRelas].r_info = ELF64_R_INFO(sym, type);
+    relas[numRelas++].r_addend = addend;
+    dword(0);
+}
+
+/***************************************************
+* Encoding
+*
+****************************************************/
+
+static rmOpnd
+reg(int r)
+{
+    rmOpnd o;
+
+    o.kind = RM_REG;
+    o.n = r;
+    return o;
+}
+
+// a float literal, put in .rodata (once per use)
+static rmOpnd
+floatConst(double val)
+{
+    rmOpnd o;
+
+    align(&rodata, 8);
+    o.kind = RM_RODATA;
+    o.n = rodata.len;
+    put(&rodata, &val, sizeof(double));
+    return o;
+}
+
+// the r/m operand o (a register, or memory)
+static rmOpnd
+rmOf(const xOpnd* o)
+{
+    rmOpnd rm;
+
+    switch(o->kind){
+    case XO_REG:
+    case XO_XMM:
+	return reg(o->n);
+    case XO_SLOT:
+	rm.kind = RM_FRAME;
+	rm.n = -o->n;
+	return rm;
+    case XO_FLT:
+	return floatConst(o->f);
+    case XO_FRAME:
+	rm.kind = RM_BSS;
+	rm.n = o->n;
+	return rm;
+    default:
+	errExit(0, "invalid operand in object backend");
+    }
+}
+
+// ModRM (and displacement) of r, rm; immSize: bytes of an immediate
+// following (a RIP-relative displacement is relative to its end)
+static void
+modrm(int r, rmOpnd rm, int immSize)
+{
+    switch(rm.kind){
+    case RM_REG:
+	byte(0xC0 | (r << 3) | rm.n);
+	break;
+    case RM_FRAME:
+	if ( (-128 <= rm.n) ){
+	    byte(0x40 | (r << 3) | X_RBX);
+	    byte(rm.n);
+	}
+	else{
+	    byte(0x80 | (r << 3) | X_RBX);
+	    dword(rm.n);
+	}
+	break;
+    default:
+	byte((r << 3) | 5);
+	reloc((RM_BSS == rm.kind)? SYM_BSS : SYM_RODATA, R_X86_64_PC32,
+	      rm.n - 4 - immSize);
+	break;
+    }
+}
+
+// [prefix] [REX.W] opcode (0x0Fxx: two bytes) ModRM
+// w: 1 - 64 bit operands
+static void
+op(int prefix, int w, int opc, int r, rmOpnd rm, int immSize)
+{
+    if (prefix)
+	byte(prefix);
+    if (w)
+	byte(0x48);
+    if ( (0xFF < opc) )
+	byte(opc >> 8);
+    byte(opc & 0xFF);
+    modrm(r, rm, immSize);
+}
+
+// VEX.L.pp.map.W opcode ModRM, with vvvv the second source
+// pp: 0 - none, 1 - 0x66, 2 - 0xF3, 3 - 0xF2; map: 1 - 0x0F,
+// 2 - 0x0F38; l: 1 - 256 bit; vvvv: 0 also if there is none
+static void
+vex(int pp, int map, int w, int l, int vvvv, int opc, int r, rmOpnd rm)
+{
+    int last;
+
+    last = ((~vvvv & 0xF) << 3) | (l << 2) | pp;
+    if ( (1 == map) && !w ){
+	byte(0xC5);
+	byte(0x80 | last);
+    }
+    else{
+	byte(0xC4);
+	byte(0xE0 | map);
+	byte((w << 7) | last);
+    }
+    byte(opc);
+    modrm(r, rm, 0);
+}
+
+static int
+fits8(long n) { return (-128 <= n) && (127 >= n); }
+
+// mov: to a register, from one, or an immediate
+static void
+mov(const xIns* ins)
+{
+    if ( (XO_IMM != ins->s.kind) ){
+	if ( (XO_REG == ins->d.kind) && (XO_REG != ins->s.kind) )
+	    op(0, ins->w, 0x8B, ins->d.n, rmOf(&ins->s), 0);
+	else
+	    op(0, ins->w, 0x89, ins->s.n, rmOf(&ins->d), 0);
+    }
+    else if ( (XO_REG != ins->d.kind) ){
+	op(0, ins->w, 0xC7, 0, rmOf(&ins->d), 4);       // mov $imm, mem
+	dword(ins->s.n);
+    }
+    else if ( !ins->w ){
+	byte(0xB8 + ins->d.n);                          // movl $imm
+	dword(ins->s.n);
+    }
+    else if ( (ins->s.n < INT32_MIN) || (ins->s.n > INT32_MAX) ){
+	byte(0x48);                                     // movabsq
+	byte(0xB8 + ins->d.n);
+	put(&text, &ins->s.n, 8);
+    }
+    else{
+	op(0, 1, 0xC7, 0, reg(ins->d.n), 4);            // movq $imm (sign-ext.)
+	dword(ins->s.n);
+    }
+}
+
+// add (ext 0), sub (5), cmp (7), xor (6): opc is the r, r/m form
+static void
+alu(const xIns* ins, int opc, int ext)
+{
+    if ( (XO_IMM != ins->s.kind) )
+	op(0, ins->w, opc, ins->d.n, rmOf(&ins->s), 0);
+    else if ( fits8(ins->s.n) ){
+	op(0, ins->w, 0x83, ext, rmOf(&ins->d), 1);
+	byte(ins->s.n);
+    }
+    else{
+	op(0, ins->w, 0x81, ext, rmOf(&ins->d), 4);
+	dword(ins->s.n);
+    }
+}
+
+static void
+imul(const xIns* ins)
+{
+    if ( (XO_IMM != ins->s.kind) )
+	op(0, ins->w, 0x0FAF, ins->d.n, rmOf(&ins->s), 0);
+    else if ( fits8(ins->s.n) ){
+	op(0, ins->w, 0x6B, ins->d.n, rmOf(&ins->d), 1);
+	byte(ins->s.n);
+    }
+    else{
+	op(0, ins->w, 0x69, ins->d.n, rmOf(&ins->d), 4);
+	dword(ins->s.n);
+    }
+}
+
+// a vector op, SSE2 (prefix 0x66, or 0xF3 for movdqu) or AVX2;
+// a move loads into a register, or stores from one
+static void
+vector(const xIns* ins, int opc)
+{
+    const xOpnd* r;
+    const xOpnd* rm;
+    int pp;
+
+    r = &ins->d;
+    rm = &ins->s;
+    pp = (X_MOVDQU == ins->op)? 2 : 1;
+    if ( (XO_XMM != ins->d.kind) ){
+	r = &ins->s;
+	rm = &ins->d;
+	opc = (X_MOVDQU == ins->op)? 0x7F : 0x11;
+    }
+    if (ins->w)
+	vex(pp, 1, 0, 1, (X_ADDPD <= ins->op)? r->n : 0, opc, r->n, rmOf(rm));
+    else
+	op((2 == pp)? 0xF3 : 0x66, 0, 0x0F00 | opc, r->n, rmOf(rm), 0);
+}
+
+static void
+encode(const xIns* ins)
+{
+    static const int cc[] = { 0x4, 0x5, 0xC, 0xE, 0xF, 0xD, 0x7, 0x3, 0xA };
+    static const int shift[] = { 4, 7, 5 };          // shl, sar, shr
+    static const int sse[] = { 0x58, 0x5C, 0x59, 0x5E }; // addsd ...
+
+    switch(ins->op){
+    case X_MOV: mov(ins); break;
+    case X_MOVSX: op(0, 1, 0x63, ins->d.n, rmOf(&ins->s), 0); break;
+    case X_LEA: op(0, 1, 0x8D, ins->d.n, rmOf(&ins->s), 0); break;
+    case X_ADD: alu(ins, 0x03, 0); break;
+    case X_SUB: alu(ins, 0x2B, 5); break;
+    case X_CMP: alu(ins, 0x3B, 7); break;
+    case X_XOR: alu(ins, 0x33, 6); break;
+    case X_TEST: op(0, ins->w, 0x85, ins->s.n, rmOf(&ins->d), 0); break;
+    case X_IMUL: imul(ins); break;
+    case X_IMUL1: op(0, ins->w, 0xF7, 5, rmOf(&ins->d), 0); break;
+    case X_NEG: op(0, ins->w, 0xF7, 3, rmOf(&ins->d), 0); break;
+    case X_IDIV: op(0, ins->w, 0xF7, 7, rmOf(&ins->d), 0); break;
+    case X_CDQ:                                     // cltd / cqto
+	if (ins->w)
+	    byte(0x48);
+	byte(0x99);
+	break;
+    case X_SHL: case X_SAR: case X_SHR:
+	op(0, ins->w, 0xC1, shift[ins->op - X_SHL], rmOf(&ins->d), 1);
+	byte(ins->s.n);
+	break;
+    case X_PUSH: byte(0x50 + ins->d.n); break;
+    case X_POP: byte(0x58 + ins->d.n); break;
+    case X_CALL:
+	byte(0xE8);
+	if ( (XO_EXT == ins->d.kind) )
+	    reloc(SYM_EXT + ins->d.n, R_X86_64_PLT32, -4);
+	else
+	    rel32(ins->d.n);
+	break;
+    case X_RET: byte(0xC3); break;
+    case X_JMP:
+	byte(0xE9);
+	rel32(ins->d.n);
+	break;
+    case X_JCC:
+	byte(0x0F);
+	byte(0x80 | cc[ins->cc]);
+	rel32(ins->d.n);
+	break;
+    case X_MOVSD:
+	if ( (XO_XMM == ins->d.kind) )
+	    op(0xF2, 0, 0x0F10, ins->d.n, rmOf(&ins->s), 0);
+	else
+	    op(0xF2, 0, 0x0F11, ins->s.n, rmOf(&ins->d), 0);
+	break;
+    case X_ADDSD: case X_SUBSD: case X_MULSD: case X_DIVSD:
+	op(0xF2, 0, 0x0F00 | sse[ins->op - X_ADDSD], ins->d.n,
+	   rmOf(&ins->s), 0);
+	break;
+    case X_UCOMISD: op(0x66, 0, 0x0F2E, ins->d.n, rmOf(&ins->s), 0); break;
+    case X_CVTSI2SD: op(0xF2, ins->w, 0x0F2A, ins->d.n, rmOf(&ins->s), 0); break;
+    case X_CVTTSD2SI: op(0xF2, ins->w, 0x0F2C, ins->d.n, rmOf(&ins->s), 0); break;
+    case X_MOVQ:
+	if (ins->w)
+	    vex(1, 1, 1, 0, 0, 0x6E, ins->d.n, rmOf(&ins->s));
+	else
+	    op(0x66, 1, 0x0F6E, ins->d.n, rmOf(&ins->s), 0);
+	break;
+    case X_UNPCKLPD: op(0x66, 0, 0x0F14, ins->d.n, rmOf(&ins->s), 0); break;
+    case X_PUNPCKLQDQ: op(0x66, 0, 0x0F6C, ins->d.n, rmOf(&ins->s), 0); break;
+    case X_BROADCASTSD: vex(1, 2, 0, 1, 0, 0x19, ins->d.n, rmOf(&ins->s)); break;
+    case X_PBROADCASTQ: vex(1, 2, 0, 1, 0, 0x59, ins->d.n, rmOf(&ins->s)); break;
+    case X_MOVUPD: vector(ins, 0x10); break;
+    case X_MOVDQU: vector(ins, 0x6F); break;
+    case X_ADDPD: vector(ins, 0x58); break;
+    case X_SUBPD: vector(ins, 0x5C); break;
+    case X_MULPD: vector(ins, 0x59); break;
+    case X_PADDQ: vector(ins, 0xD4); break;
+    case X_PSUBQ: vector(ins, 0xFB); break;
+    case X_PMULUDQ: vector(ins, 0xF4); break;
+    case X_VZEROUPPER:
+	byte(0xC5);
+	byte(0xF8);
+	byte(0x77);
+	break;
+    case X_LABEL: place(ins->d.n); break;
+    case X_FUNCTION:
+	align(&text, 16);
+	place(ins->d.n);
+	if (ins->w)
+	    mainAt = text.len;
+	break;
+    case X_END: mainEnd = text.len; break;
+    default:
+	errExit(0, "invalid instruction (%d) in object backend", ins->op);
+	break;
+    }
+}
+
+/***************************************************
+* ELF
+*
+****************************************************/
+
+enum { SEC_TEXT = 1, SEC_RODATA, SEC_BSS, SEC_RELA, SEC_SYMTAB,
+       SEC_STRTAB, SEC_SHSTRTAB, SEC_NOTE, NUM_SECS };
+
+static void
+symbol(objBuf* syms, const char* name, int info, int shndx, size_t value,
+       size_t size)
+{
+    Elf64_Sym s;
+
+    memset(&s, 0, sizeof(s));
+    s.st_name = (NULL == name)? 0 : putString(&strtab, name);
+    s.st_info = info;
+    s.st_shndx = shndx;
+    s.st_value = value;
+    s.st_size = size;
+    put(syms, &s, sizeof(s));
+}
+
+static void
+section(Elf64_Shdr* sh, size_t name, int type, int flags, size_t off,
+	size_t size, int link, int info, int align, int entsize)
+{
+    sh->sh_name = name;
+    sh->sh_type = type;
+    sh->sh_flags = flags;
+    sh->sh_addr = 0;
+    sh->sh_offset = off;
+    sh->sh_size = size;
+    sh->sh_link = link;
+    sh->sh_info = info;
+    sh->sh_addralign = align;
+    sh->sh_entsize = entsize;
+}
+
+static void
+writeObject(FILE* out, const char* srcName, int frameSize)
+{
+    static const char* secName[NUM_SECS] = { "", ".text", ".rodata",
+	".bss", ".rela.text", ".symtab", ".strtab", ".shstrtab", ".note.GNU-stack" };
+    Elf64_Ehdr eh;
+    Elf64_Shdr sh[NUM_SECS];
+    objBuf syms, shstrtab, file;
+    size_t name[NUM_SECS], off[NUM_SECS];
+    int i;
+
+    memset(&syms, 0, sizeof(syms));
+    memset(&shstrtab, 0, sizeof(shstrtab));
+    memset(&file, 0, sizeof(file));
+    putString(&strtab, "");
+    for (i = 0; i < NUM_SECS; i++)
+	name[i] = putString(&shstrtab, secName[i]);
+
+    symbol(&syms, NULL, 0, SHN_UNDEF, 0, 0);
+    symbol(&syms, (*srcName)? srcName : "stdin",
+	   ELF64_ST_INFO(STB_LOCAL, STT_FILE), SHN_ABS, 0, 0);
+    symbol(&syms, NULL, ELF64_ST_INFO(STB_LOCAL, STT_SECTION), SEC_TEXT, 0, 0);
+    symbol(&syms, NULL, ELF64_ST_INFO(STB_LOCAL, STT_SECTION), SEC_RODATA,
+	   0, 0);
+    symbol(&syms, NULL, ELF64_ST_INFO(STB_LOCAL, STT_SECTION), SEC_BSS, 0, 0);
+    symbol(&syms, "main", ELF64_ST_INFO(STB_GLOBAL, STT_FUNC), SEC_TEXT,
+	   mainAt, mainEnd - mainAt);
+    for (i = 0; i < XE_NUM; i++)
+	symbol(&syms, x86_extern[i], ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE),
+	       SHN_UNDEF, 0, 0);
+
+    // header, then the sections' contents, then their headers
+    memset(&eh, 0, sizeof(eh));
+    put(&file, &eh, sizeof(eh));
+    align(&file, 16);
+    off[SEC_TEXT] = file.len;
+    put(&file, text.p, text.len);
+    align(&file, 8);
+    off[SEC_RODATA] = file.len;
+    put(&file, rodata.p, rodata.len);
+    align(&file, 8);
+    off[SEC_BSS] = file.len;    // takes no space in the file
+    off[SEC_RELA] = file.len;
+    put(&file, relas, numRelas * sizeof(Elf64_Rela));
+    off[SEC_SYMTAB] = file.len;
+    put(&file, syms.p, syms.len);
+    off[SEC_STRTAB] = file.len;
+    put(&file, strtab.p, strtab.len);
+    off[SEC_SHSTRTAB] = file.len;
+    put(&file, shstrtab.p, shstrtab.len);
+    off[SEC_NOTE] = file.len;
+    align(&file, 8);
+
+    memset(sh, 0, sizeof(sh));
+    section(&sh[SEC_TEXT], name[SEC_TEXT], SHT_PROGBITS,
+	    SHF_ALLOC | SHF_EXECINSTR, off[SEC_TEXT], text.len, 0, 0, 16, 0);
+    section(&sh[SEC_RODATA], name[SEC_RODATA], SHT_PROGBITS, SHF_ALLOC,
+	    off[SEC_RODATA], rodata.len, 0, 0, 8, 0);
+    section(&sh[SEC_BSS], name[SEC_BSS], SHT_NOBITS, SHF_ALLOC | SHF_WRITE,
+	    off[SEC_BSS], max(frameSize, 1), 0, 0, FRAME_LINE, 0);
+    section(&sh[SEC_RELA], name[SEC_RELA], SHT_RELA, SHF_INFO_LINK,
+	    off[SEC_RELA], numRelas * sizeof(Elf64_Rela), SEC_SYMTAB,
+	    SEC_TEXT, 8, sizeof(Elf64_Rela));
+    section(&sh[SEC_SYMTAB], name[SEC_SYMTAB], SHT_SYMTAB, 0,
+	    off[SEC_SYMTAB], syms.len, SEC_STRTAB, NUM_LOCAL_SYMS, 8,
+	    sizeof(Elf64_Sym));
+    section(&sh[SEC_STRTAB], name[SEC_STRTAB], SHT_STRTAB, 0,
+	    off[SEC_STRTAB], strtab.len, 0, 0, 1, 0);
+    section(&sh[SEC_SHSTRTAB], name[SEC_SHSTRTAB], SHT_STRTAB, 0,
+	    off[SEC_SHSTRTAB], shstrtab.len, 0, 0, 1, 0);
+    section(&sh[SEC_NOTE], name[SEC_NOTE], SHT_PROGBITS, 0, off[SEC_NOTE],
+	    0, 0, 0, 1, 0);
+
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    eh.e_type = ET_REL;
+    eh.e_machine = EM_X86_64;
+    eh.e_version = EV_CURRENT;
+    eh.e_shoff = file.len;
+    eh.e_ehsize = sizeof(Elf64_Ehdr);
+    eh.e_shentsize = sizeof(Elf64_Shdr);
+    eh.e_shnum = NUM_SECS;
+    eh.e_shstrndx = SEC_SHSTRTAB;
+    memcpy(file.p, &eh, sizeof(eh));
+    put(&file, sh, sizeof(sh));
+
+    if ( (1 != fwrite(file.p, file.len, 1, out)) )
+	errExit(1, "...fwrite()...");
+
+    free(syms.p);
+    free(shstrtab.p);
+    free(file.p);
+}
+
+/***************************************************
+* Backend
+*
+****************************************************/
+
+static void
+release(void)
+{
+    free(text.p);
+    free(rodata.p);
+    free(strtab.p);
+    memset(&text, 0, sizeof(objBuf));
+    memset(&rodata, 0, sizeof(objBuf));
+    memset(&strtab, 0, sizeof(objBuf));
+    free(relas);
+    free(labelAt);
+    free(fixups);
+    relas = NULL;
+    labelAt = NULL;
+    fixups = NULL;
+    numRelas = capRelas = capLabels = 0;
+    numFixups = capFixups = 0;
+}
+
+static void
+emitObj(FILE* out, const irProgram* prog, const char* srcName)
+{
+    mainAt = mainEnd = 0;
+    x86_select(prog, encode);
+    resolve();
+    writeObject(out, srcName, prog->frameSize);
+    release();
+}
+
+const backend objBackend = { "obj", 1, NULL, NULL, emitObj };
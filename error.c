@@ -7,6 +7,13 @@
 #include "compiler.h"
 #include "ename.c.inc"
 
+static void (*cleanup)(void);
+
+// fn runs (once) before errExit() reports; e.g., to flush output
+// still held by other threads
+void
+errSetCleanup(void (*fn)(void)) { cleanup = fn; }
+
 #ifdef __GNUC__
 __attribute__ ((__noreturn__)) // in case of being called from
 #endif                        // non-void function
@@ -17,6 +24,15 @@ errExit(int pError, const char* format, ...)
     va_list arglist;
     char usrMsg[MAX_ERR_LEN+1], errMsg[MAX_ERR_LEN+1], str[MAX_ERR_LEN+1];
     char err[MAX_ERR_LEN];
+    void (*fn)(void);
+    int savedErrno;
+
+    if ( (NULL != (fn = cleanup)) ){
+	savedErrno = errno;
+	cleanup = NULL;
+	fn();
+	errno = savedErrno;
+    }
 
     va_start(arglist, format);
     vsnprintf(usrMsg, MAX_ERR_LEN, format, arglist);
@@ -27,13 +43,13 @@ errExit(int pError, const char* format, ...)
 	    strcpy(err, ename[errno]);
 	else
 	    strcpy(err, "???");
-	snprintf(errMsg, MAX_ERR_LEN, "%s %s", err, strerror(errno));
+	snprintf(errMsg, MAX_ERR_LEN, " %s %s", err, strerror(errno));
     }
     else
-	strcpy(errMsg, " ");
+	errMsg[0] = '\0';
 
     // could be too long for str; ignored
-    snprintf(str, MAX_ERR_LEN, "ERROR: %s %s\n", usrMsg, errMsg);
+    snprintf(str, MAX_ERR_LEN, "ERROR: %s%s\n", usrMsg, errMsg);
 
     fflush(stdout);
     fputs(str, stderr);
@@ -16,6 +16,10 @@
 #define MAX_ERR_LEN 100
 #endif
 
+#ifdef __GNUC__
+__attribute__ ((__noreturn__)) // so callers' switches need no value
+#endif                         // on the path that fails
 void errExit(int pError, const char* msg, ...);
+void errSetCleanup(void (*fn)(void));
 
 #endif
@@ -0,0 +1,318 @@
+/*******************************************************
+* frame.c -            frame layout
+* Language:            Micro
+*
+* Lays out the slots of the whole program (after
+* ir_packSlots()) in one frame, by cache lines of
+* FRAME_LINE bytes. A unit is a slot, or the lanes of a
+* vector operand (slp.c), which stay together: an int
+* takes 4 bytes, a long or float 8, and a vector 8 per
+* lane.
+*
+* Each instruction weighs what the profile says it runs
+* (ir_setWeight()), or else FRAME_LOOP per loop around
+* it (a jump back to a label). A unit is as hot as the
+* weights of its uses; two are as close as the weights
+* of the times one is used right after the other, in
+* the order the code uses them (a, b, dest).
+*
+* Lines are filled one after the other: each starts with
+* the hottest unit left, and takes the unit left closest
+* to those in it, while one fits; then the hottest that
+* fits. Within a line units go by size, the largest at
+* its lowest address, so none needs padding, and the
+* hottest lines come first: the offsets of the first two
+* fit in a byte (see x86.c).
+********************************************************/
+
+#include "compiler.h"
+#include "frame.h"
+
+typedef struct graph{      // of the units: the neighbours of u are
+    int* first;            // to[first[u]] .. to[end[u] - 1], as
+    int* end;              // close as w[] says
+    int* to;
+    long* w;
+} graph;
+
+static const long* sortHeat;
+
+static int
+byHeat(const void* x, const void* y)
+{
+    int s, t;
+
+    s = *(const int*) x;
+    t = *(const int*) y;
+    if ( (sortHeat[s] != sortHeat[t]) )
+	return (sortHeat[s] > sortHeat[t])? -1 : 1;
+    return s - t;
+}
+
+static const int* sortSize;
+
+static int
+bySize(const void* x, const void* y)
+{
+    int s, t;
+
+    s = *(const int*) x;
+    t = *(const int*) y;
+    if ( (sortSize[s] != sortSize[t]) )
+	return sortSize[t] - sortSize[s];
+    return s - t;
+}
+
+// Returns: malloc'd array, per instruction of prog: its weight
+static long*
+weigh(const irProgram* prog)
+{
+    const irInstr* ins;
+    long* w;
+    int *labelAt, *labelFct, *depth;
+    int i, d, f, maxLabel;
+
+    if ( (NULL == (w = malloc((prog->len + 1) * sizeof(long)))) )
+	errExit(1, "...malloc()...");
+    if ( (NULL != prog->weight) ){
+	for (i = 0; i < prog->len; i++)
+	    w[i] = prog->weight[i];
+	return w;
+    }
+
+    for (maxLabel = i = 0; i < prog->len; i++)
+	if ( (IR_LABEL == prog->code[i].op) )
+	    maxLabel = max(maxLabel, (int) prog->code[i].dest.val_int);
+    labelAt = calloc(maxLabel + 1, sizeof(int));
+    labelFct = calloc(maxLabel + 1, sizeof(int));
+    depth = calloc(prog->len + 1, sizeof(int));
+    if ( (NULL == labelAt) || (NULL == labelFct) || (NULL == depth) )
+	errExit(1, "...calloc()...");
+
+    // a jump back at i to a label at h: h..i run once more per pass
+    for (f = i = 0; i < prog->len; i++){
+	ins = &prog->code[i];
+	if ( (IR_FUNCTION == ins->op) )
+	    f = i + 1;
+	if ( (IR_LABEL == ins->op) ){
+	    labelAt[ins->dest.val_int] = i;
+	    labelFct[ins->dest.val_int] = f;
+	}
+	if ( (IR_JUMP > ins->op) || (maxLabel < ins->dest.val_int) ||
+	     (f != labelFct[ins->dest.val_int]) )
+	    continue;
+	depth[labelAt[ins->dest.val_int]]++;
+	depth[i + 1]--;
+    }
+
+    for (d = i = 0; i < prog->len; i++){
+	d += depth[i];
+	for (w[i] = 1, f = 0; (f < d) && (f < FRAME_DEPTH); f++)
+	    w[i] *= FRAME_LOOP;
+    }
+
+    free(labelAt);
+    free(labelFct);
+    free(depth);
+    return w;
+}
+
+// g: the units used one right after the other, with the sum of the
+//    weights of the times they are, each pair once, both ways round
+// unit: per slot, its unit (0: none); heat: per unit, += its weight
+static void
+adjacency(const irProgram* prog, const long* w, const int* unit,
+	  long* heat, graph* g)
+{
+    const irOperand* o[3];
+    int *at, *seen;
+    int i, j, k, u, v, n, prev, pass;
+
+    n = prog->numSlots;
+    g->first = calloc(n + 2, sizeof(int));
+    g->end = at = calloc(n + 1, sizeof(int));
+    g->to = NULL;   // allocated once counted
+    g->w = NULL;
+    seen = calloc(n + 1, sizeof(int));
+    if ( (NULL == g->first) || (NULL == at) || (NULL == seen) )
+	errExit(1, "...calloc()...");
+
+    // count them, then put them in place
+    for (pass = 0; pass < 2; pass++){
+	for (prev = i = 0; i < prog->len; i++){
+	    o[0] = &prog->code[i].a; o[1] = &prog->code[i].b;
+	    o[2] = &prog->code[i].dest;
+	    for (j = 0; j < 3; j++){
+		if ( (OPND_SLOT != o[j]->kind) ||
+		     (0 == (u = unit[o[j]->slot])) )
+		    continue;
+		if ( (0 == pass) )
+		    heat[u] += w[i];
+		if ( (0 != prev) && (prev != u) && (0 == pass) ){
+		    g->first[prev + 1]++;
+		    g->first[u + 1]++;
+		}
+		else if ( (0 != prev) && (prev != u) ){
+		    g->to[at[prev]] = u; g->w[at[prev]++] = w[i];
+		    g->to[at[u]] = prev; g->w[at[u]++] = w[i];
+		}
+		prev = u;
+	    }
+	}
+	if ( (0 != pass) )
+	    break;
+	for (u = 1; u <= n; u++)
+	    g->first[u] += g->first[u - 1];
+	for (u = 0; u < n; u++)
+	    at[u] = g->first[u];
+	g->to = malloc((g->first[n] + 1) * sizeof(int));
+	g->w = malloc((g->first[n] + 1) * sizeof(long));
+	if ( (NULL == g->to) || (NULL == g->w) )
+	    errExit(1, "...malloc()...");
+    }
+
+    // a neighbour met again adds to where it was first (seen: + 1)
+    for (u = 1; u < n; u++){
+	for (k = i = g->first[u]; i < at[u]; i++){
+	    v = g->to[i];
+	    if ( (seen[v] > g->first[u]) ){
+		g->w[seen[v] - 1] += g->w[i];
+		continue;
+	    }
+	    g->to[k] = v;
+	    g->w[k] = g->w[i];
+	    seen[v] = ++k;
+	}
+	at[u] = k;
+    }
+
+    free(seen);
+}
+
+// sets prog->frame[] and prog->frameSize (see frame.h)
+void
+frame_layout(irProgram* prog)
+{
+    graph g;
+    long *w, *heat, *score;
+    int *lead, *types, *unit, *size, *order, *line, *touched;
+    char* placed;
+    int n, m, numLines, numLine, numTouched;
+    int i, j, k, s, u, v, best, pos, top, room, end, lanes;
+
+    n = prog->numSlots;
+    lanes = prog->lanes;
+    lead = ir_vectorLanes(prog);
+    types = ir_slotTypes(prog);
+    unit = calloc(n + 1, sizeof(int));
+    size = calloc(n + 1, sizeof(int));
+    heat = calloc(n + 1, sizeof(long));
+    score = calloc(n + 1, sizeof(long));
+    order = malloc((n + 1) * sizeof(int));
+    line = malloc((n + 1) * sizeof(int));
+    touched = malloc((n + 1) * sizeof(int));
+    placed = calloc(n + 1, sizeof(char));
+    prog->frame = realloc(prog->frame, (n + 1) * sizeof(int));
+    if ( (NULL == unit) || (NULL == size) || (NULL == heat) ||
+	 (NULL == score) || (NULL == order) ||
+	 (NULL == line) || (NULL == touched) || (NULL == placed) ||
+	 (NULL == prog->frame) )
+	errExit(1, "...calloc()...");
+
+    // a unit is its first slot
+    for (m = 0, s = 1; s < n; s++){
+	if ( (0 != lead[s]) && (s != lead[s]) )
+	    unit[s] = lead[s];
+	else
+	    order[m++] = unit[s] = s;
+	if ( (0 != lead[s]) )
+	    size[unit[s]] += 8;
+	else
+	    size[s] = (INTEGER == types[s])? 4 : 8;
+    }
+
+    w = weigh(prog);
+    adjacency(prog, w, unit, heat, &g);
+
+    sortHeat = heat;
+    qsort(order, m, sizeof(int), byHeat);
+
+    for (numLines = k = 0; k < m; numLines++){
+	while ( (k < m) && placed[order[k]] )
+	    k++;
+	if ( (k == m) )
+	    break;
+
+	numLine = numTouched = 0;
+	room = FRAME_LINE;
+	for (u = order[k]; 0 != u; ){
+	    placed[u] = 1;
+	    line[numLine++] = u;
+	    room -= size[u];
+	    for (i = g.first[u]; i < g.end[u]; i++){
+		v = g.to[i];
+		if ( placed[v] )
+		    continue;
+		if ( (0 == score[v]) )
+		    touched[numTouched++] = v;
+		score[v] += g.w[i] + 1; // cold ones, too
+	    }
+
+	    // the closest neighbour that fits, else the hottest
+	    for (best = 0, j = i = 0; i < numTouched; i++){
+		v = touched[i];
+		if ( placed[v] ){ // done with it
+		    score[v] = 0;
+		    continue;
+		}
+		touched[j++] = v;
+		if ( (size[v] > room) )
+		    continue;
+		if ( (0 == best) || (score[v] > score[best]) ||
+		     ( (score[v] == score[best]) && (0 > byHeat(&v, &best)) ) )
+		    best = v;
+	    }
+	    numTouched = j;
+	    end = min(m, k + FRAME_SCAN);
+	    for (j = k; (0 == best) && (j < end); j++)
+		if ( !placed[order[j]] && (size[order[j]] <= room) )
+		    best = order[j];
+	    u = best;
+	}
+	for (i = 0; i < numTouched; i++)
+	    score[touched[i]] = 0;
+
+	// by size, from the line's lowest address up
+	sortSize = size;
+	qsort(line, numLine, sizeof(int), bySize);
+	for (pos = i = 0; i < numLine; i++){
+	    u = line[i];
+	    top = FRAME_LINE * (numLines + 1) - pos; // its lowest byte
+	    if ( (0 == lead[u]) )
+		prog->frame[u] = top;
+	    else // a vector's last lane is lowest
+		for (j = 0; j < lanes; j++)
+		    prog->frame[u + j] = top - 8 * (lanes - 1 - j);
+	    pos += size[u];
+	}
+    }
+
+    prog->frameSize = FRAME_LINE * numLines;
+    prog->frame[0] = 0;
+
+    free(g.first);
+    free(g.end);
+    free(g.to);
+    free(g.w);
+    free(w);
+    free(lead);
+    free(types);
+    free(unit);
+    free(size);
+    free(heat);
+    free(score);
+    free(order);
+    free(line);
+    free(touched);
+    free(placed);
+}
@@ -0,0 +1,28 @@
+/*******************************************************
+* frame.h -            header file for frame.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         ir_packSlots(&irProg);
+*         frame_layout(&irProg);   // irProg.frame[], and
+*                                  // irProg.frameSize
+* The native backends (x86.c) address slot s at
+* -irProg.frame[s] from a FRAME_LINE aligned base, the
+* top of the frame in .bss.
+********************************************************/
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include "ir.h"
+
+#define FRAME_LINE 64        // bytes of a cache line
+#define FRAME_LOOP 8         // times a loop is taken to run, unprofiled
+#define FRAME_DEPTH 4        // loops nested deeper weigh the same
+#define FRAME_SCAN 64        // units tried to fill a line, if no
+			     // neighbour fits
+
+void frame_layout(irProgram* prog);
+
+#endif
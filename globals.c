@@ -0,0 +1,329 @@
+/*******************************************************
+* globals.c -          units: compiled functions (and the
+*                      main program) in a file, written
+*                      once and mapped by later compiles
+* Language:            Micro
+*
+* --compile=<file> writes the unit of its source: every
+* function, with its linkage (export, import, or local)
+* and the IR of its body, the main program, if any, and
+* the count of slots handed out. --link (link.c) merges
+* units into one program.
+*
+* A prelude is a unit of function definitions only: its
+* functions are the globals of the programs compiled with
+* --use-globals=<file>, which maps the file and installs
+* them, as if the prelude had been parsed in front of the
+* program; their IR goes to the backends as compiled.
+* --precompile=<file> is --compile, for a prelude.
+*
+* The file is position independent: it holds no pointers,
+* only offsets from its start, and slots counted from 1,
+* so it is used straight from the mapping (names stay in
+* it), and its slots are moved past those already taken.
+* Layout, in host byte order (see globals.h):
+*   header:    globalsHeader
+*   functions: numFcts globalsFct, in definition order
+*              (imports, too); the main program last
+*   code:      numInstrs globalsInstr, the bodies
+*   strings:   the names, each ending in '\0'; offset 0
+*              is "" (no name)
+********************************************************/
+
+#include <limits.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "compiler.h"
+#include "globals.h"
+#include "codegen.h"
+#include "arena.h"
+
+/***************************************************
+* Writing (--compile, --precompile)
+*
+****************************************************/
+
+typedef struct strTable{
+    char* s;
+    size_t len, cap;
+} strTable;
+
+// Returns: offset of name in t, added
+static uint32_t
+addString(strTable* t, const char* name)
+{
+    size_t n, off;
+
+    if ( (NULL == name) )
+	return 0;
+    n = strlen(name) + 1;
+    if ( (t->len + n > t->cap) ){
+	t->cap = max(2 * t->cap, t->len + n);
+	if ( (NULL == (t->s = realloc(t->s, t->cap))) )
+	    errExit(1, "...realloc()...");
+    }
+    off = t->len;
+    memcpy(t->s + off, name, n);
+    t->len += n;
+    return (uint32_t) off;
+}
+
+static globalsOpnd
+packOperand(const irOperand* o)
+{
+    globalsOpnd res;
+
+    res.kind = o->kind;
+    res.type = o->type;
+    res.val = 0;
+    if ( (OPND_SLOT == o->kind) )
+	res.val = o->slot;
+    else if ( (OPND_INT == o->kind) )
+	res.val = o->val_int;
+    else if ( (OPND_FLT == o->kind) )
+	memcpy(&res.val, &o->val_flt, sizeof(double));
+    return res;
+}
+
+static void
+writeAll(int fd, const void* buf, size_t n, const char* file)
+{
+    if ( (n != (size_t) write(fd, buf, n)) )
+	errExit(1, "...write(%s)...", file);
+}
+
+// the functions defined or imported, and the main program kept
+// (codegen_keepMain()), if any
+void
+globals_write(const char* file)
+{
+    const fctRecord* f;
+    const fctRecord** fcts;
+    globalsHeader h;
+    globalsFct* gf;
+    globalsInstr* gi;
+    strTable strs;
+    const irInstr* ins;
+    int numFcts, numInstrs, i, j, k, fd;
+
+    f = codegen_mainFunction();
+    numFcts = (NULL != f);
+    numInstrs = (NULL != f)? f->len : 0;
+    for (f = codegen_lastFunction(); NULL != f; f = f->prev, numFcts++)
+	numInstrs += f->len;
+    fcts = malloc((numFcts + 1) * sizeof(fctRecord*));
+    gf = calloc(numFcts + 1, sizeof(globalsFct));
+    gi = calloc(numInstrs + 1, sizeof(globalsInstr));
+    if ( (NULL == fcts) || (NULL == gf) || (NULL == gi) )
+	errExit(1, "...malloc()...");
+    i = numFcts;
+    if ( (NULL != codegen_mainFunction()) )
+	fcts[--i] = codegen_mainFunction();
+    for (f = codegen_lastFunction(); NULL != f; f = f->prev)
+	fcts[--i] = f;
+
+    strs.s = NULL;
+    strs.len = strs.cap = 0;
+    addString(&strs, "");
+    for (k = i = 0; i < numFcts; i++){
+	f = fcts[i];
+	gf[i].name = addString(&strs, f->name);
+	gf[i].linkage = f->linkage;
+	gf[i].retType = f->retType;
+	gf[i].numParams = f->numParams;
+	for (j = 0; j < f->numParams; j++)
+	    gf[i].paramType[j] = f->paramType[j];
+	gf[i].body = k;
+	gf[i].len = f->len;
+	gf[i].slotLo = f->slotLo;
+	gf[i].slotHi = f->slotHi;
+	gf[i].cost = f->cost;
+	for (j = 0; j < f->len; j++, k++){
+	    ins = &f->body[j];
+	    gi[k].op = ins->op;
+	    gi[k].type = ins->type;
+	    gi[k].dest = packOperand(&ins->dest);
+	    gi[k].a = packOperand(&ins->a);
+	    gi[k].b = packOperand(&ins->b);
+	    gi[k].name = addString(&strs, ins->name);
+	}
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, GLOBALS_MAGIC, sizeof(GLOBALS_MAGIC));
+    h.version = GLOBALS_VERSION;
+    h.numTemps = codegen_numTemps();
+    h.numFcts = numFcts;
+    h.numInstrs = numInstrs;
+    h.fctOff = sizeof(h);
+    h.codeOff = h.fctOff + numFcts * sizeof(globalsFct);
+    h.strOff = h.codeOff + numInstrs * sizeof(globalsInstr);
+    h.size = h.strOff + strs.len;
+
+    if ( (-1 == (fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644))) )
+	errExit(1, "...open(%s)...", file);
+    writeAll(fd, &h, sizeof(h), file);
+    writeAll(fd, gf, numFcts * sizeof(globalsFct), file);
+    writeAll(fd, gi, numInstrs * sizeof(globalsInstr), file);
+    writeAll(fd, strs.s, strs.len, file);
+    if ( (-1 == close(fd)) )
+	errExit(1, "...close(%s)...", file);
+
+    free(strs.s);
+    free(gi);
+    free(gf);
+    free(fcts);
+}
+
+/***************************************************
+* Reading (--use-globals, --link)
+*
+****************************************************/
+
+// Returns: the name at off (NULL for offset 0)
+const char*
+globals_name(const globalsMap* m, uint32_t off)
+{
+    if ( (off >= m->strLen) )
+	errExit(0, "%s: invalid name offset", m->file);
+    return (0 == off)? NULL : m->strs + off;
+}
+
+// base: slots taken before the unit's
+static irOperand
+unpackOperand(const globalsMap* m, const globalsOpnd* g, int base)
+{
+    irOperand res;
+
+    res.kind = g->kind;
+    res.type = g->type;
+    switch(g->kind){
+    case OPND_SLOT:
+	if ( (1 > g->val) || (m->h->numTemps < g->val) )
+	    errExit(0, "%s: invalid slot", m->file);
+	res.slot = (int) g->val + base;
+	break;
+    case OPND_INT:
+	res.val_int = g->val;
+	break;
+    case OPND_FLT:
+	memcpy(&res.val_flt, &g->val, sizeof(double));
+	break;
+    case OPND_NONE:
+	break;
+    default:
+	errExit(0, "%s: invalid operand", m->file);
+	break;
+    }
+    return res;
+}
+
+// Returns: gi, with its slots moved up by base
+irInstr
+globals_instr(const globalsMap* m, const globalsInstr* gi, int base)
+{
+    irInstr res;
+
+    res.op = gi->op;
+    res.type = gi->type;
+    res.dest = unpackOperand(m, &gi->dest, base);
+    res.a = unpackOperand(m, &gi->a, base);
+    res.b = unpackOperand(m, &gi->b, base);
+    res.name = globals_name(m, gi->name);
+    return res;
+}
+
+static fctRecord*
+unpackFunction(const globalsMap* m, const globalsFct* g, int base)
+{
+    fctRecord* f;
+    int i;
+
+    f = arena_alloc(&compileArena, sizeof(fctRecord));
+    f->name = globals_name(m, g->name);
+    f->linkage = g->linkage;
+    f->retType = g->retType;
+    f->numParams = g->numParams;
+    for (i = 0; i < f->numParams; i++)
+	f->paramType[i] = g->paramType[i];
+    f->len = g->len;
+    f->slotLo = g->slotLo + base;
+    f->slotHi = g->slotHi + base;
+    f->cost = g->cost;
+
+    f->body = arena_alloc(&compileArena, f->len * sizeof(irInstr) + 1);
+    for (i = 0; i < f->len; i++)
+	f->body[i] = globals_instr(m, &m->code[g->body + i], base);
+
+    return f;
+}
+
+// the file stays mapped until the compiler exits: names point into it
+void
+globals_map(const char* file, globalsMap* m)
+{
+    struct stat st;
+    const globalsFct* g;
+    const char* p;
+    uint32_t i;
+    int fd;
+
+    if ( (-1 == (fd = open(file, O_RDONLY))) )
+	errExit(1, "...open(%s)...", file);
+    if ( (-1 == fstat(fd, &st)) )
+	errExit(1, "...fstat(%s)...", file);
+    if ( ((size_t) st.st_size < sizeof(globalsHeader)) )
+	errExit(0, "%s is not a unit", file);
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if ( (MAP_FAILED == p) )
+	errExit(1, "...mmap(%s)...", file);
+    close(fd);
+
+    m->file = file;
+    m->h = (const globalsHeader*) p;
+    if ( (0 != memcmp(m->h->magic, GLOBALS_MAGIC, sizeof(GLOBALS_MAGIC))) ||
+	 (GLOBALS_VERSION != m->h->version) )
+	errExit(0, "%s is not a unit (version %d)", file, GLOBALS_VERSION);
+    if ( (m->h->size != (uint64_t) st.st_size) ||
+	 (m->h->fctOff + m->h->numFcts * sizeof(globalsFct) > m->h->codeOff) ||
+	 (m->h->codeOff + m->h->numInstrs * sizeof(globalsInstr) >
+	  m->h->strOff) ||
+	 (m->h->strOff >= m->h->size) || ('\0' != p[m->h->size - 1]) ||
+	 (0 > m->h->numTemps) )
+	errExit(0, "%s is damaged", file);
+    m->fcts = (const globalsFct*) (p + m->h->fctOff);
+    m->code = (const globalsInstr*) (p + m->h->codeOff);
+    m->strs = p + m->h->strOff;
+    m->strLen = m->h->size - m->h->strOff;
+
+    for (i = 0; i < m->h->numFcts; i++){
+	g = &m->fcts[i];
+	if ( (MAX_PARAMS < g->numParams) || (0 > g->numParams) ||
+	     (0 > g->len) || ((uint64_t) g->body + g->len > m->h->numInstrs) ||
+	     (LINK_LOCAL > g->linkage) || (LINK_MAIN < g->linkage) ||
+	     (NULL == globals_name(m, g->name)) )
+	    errExit(0, "%s: invalid function entry", file);
+    }
+}
+
+void
+globals_load(const char* file)
+{
+    globalsMap m;
+    uint32_t i;
+    int base;
+
+    globals_map(file, &m);
+    for (i = 0; i < m.h->numFcts; i++)
+	if ( (LINK_IMPORT == m.fcts[i].linkage) ||
+	     (LINK_MAIN == m.fcts[i].linkage) )
+	    errExit(0, "%s is not a prelude (it has imports, or a main "
+		    "program): --link it", file);
+
+    base = codegen_numTemps();
+    if ( (INT_MAX - base < m.h->numTemps) )
+	errExit(0, "too many temporaries");
+    for (i = 0; i < m.h->numFcts; i++)
+	codegen_addFunction(unpackFunction(&m, &m.fcts[i], base));
+}
@@ -0,0 +1,79 @@
+/*******************************************************
+* globals.h -          header file for globals.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         // --compile=<file>: codegen_keepMain() before
+*         // parsing, then, after it
+*         globals_write(file);
+*         // --use-globals=<file>: before parsing anything
+*         globals_load(file);
+*         // --link (link.c)
+*         globals_map(file, &m);
+*         ins = globals_instr(&m, &m.code[i], base);
+********************************************************/
+
+#ifndef GLOBALS_H_
+#define GLOBALS_H_
+
+#include <stdint.h>
+#include "codegen.h"
+
+#define GLOBALS_VERSION 3
+#define GLOBALS_MAGIC "MICROGL"
+
+typedef struct globalsHeader{
+    char magic[8];
+    int32_t version;
+    int32_t numTemps;     // slots of the unit: 1..numTemps
+    uint32_t numFcts;
+    uint32_t numInstrs;
+    uint64_t fctOff;
+    uint64_t codeOff;
+    uint64_t strOff;
+    uint64_t size;        // of the whole file
+} globalsHeader;
+
+typedef struct globalsFct{
+    uint32_t name;        // offset into the strings
+    int32_t linkage;      // LINK_XXX (codegen.h)
+    int32_t retType;
+    int32_t numParams;
+    int32_t paramType[MAX_PARAMS];
+    uint32_t body;        // index of the first instruction
+    int32_t len;
+    int32_t slotLo, slotHi;
+    int32_t cost;
+} globalsFct;
+
+typedef struct globalsOpnd{
+    int32_t kind;
+    int32_t type;
+    int64_t val;          // slot, value, or the bits of a double
+} globalsOpnd;
+
+typedef struct globalsInstr{
+    int32_t op;
+    int32_t type;
+    globalsOpnd dest, a, b;
+    uint32_t name;        // offset into the strings (0: none)
+} globalsInstr;
+
+// a unit mapped, and where its parts start
+typedef struct globalsMap{
+    const char* file;
+    const globalsHeader* h;
+    const globalsFct* fcts;
+    const globalsInstr* code;
+    const char* strs;
+    size_t strLen;
+} globalsMap;
+
+void globals_write(const char* file);
+void globals_load(const char* file);
+void globals_map(const char* file, globalsMap* m);
+const char* globals_name(const globalsMap* m, uint32_t off);
+irInstr globals_instr(const globalsMap* m, const globalsInstr* gi, int base);
+
+#endif
@@ -2,39 +2,111 @@
 * hashtab.c -          hash table for use in symbol table
 * Language:            Micro
 *
+* Entries and their strings live in compileArena: they
+* are never freed one by one, undef() merely unlinks
+*
+* A source may be written so that its names all share
+* one chain of a fixed hash: each lookup would then go
+* over all of them. The hash is keyed by a seed drawn
+* once per run, and a table doubles once it holds as
+* many entries as it has buckets.
 **************************************************************/
 
+#include <time.h>
 #include "hashtab.h"
+#include "arena.h"
+
+static unsigned long seed;
+
+// FNV-1a from a seed, and a final mix (of MurmurHash3) so that the
+// low bits depend on all of them
+static unsigned long
+hashOf(const char* s)
+{
+    unsigned long h;
+
+    if ( (0 == seed) )
+	seed = ( (unsigned long) time(NULL) << 20 ) ^ (unsigned long) getpid() ^
+	    (unsigned long) &seed ^ 0xcbf29ce484222325UL;
+    for (h = seed; *s != '\0'; s++)
+	h = (h ^ (unsigned char) *s) * 0x100000001b3UL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+
+    return h;
+}
 
 static unsigned 
-hash(const char* s)
+hash(const hashTable* t, const char* s)
 {
-    unsigned hashval;
+    return hashOf(s) & (t->size - 1);
+}
 
-    for (hashval = 0; *s != '\0'; s++)
-	hashval = *s + 31*hashval;
+// twice the buckets: each chain is split in two, its entries in the
+// order they were (a later binding still hides an earlier one)
+static void
+grow(hashTable* t)
+{
+    struct nlist** bucket;
+    struct nlist** tail;
+    struct nlist* np;
+    struct nlist* next;
+    unsigned i, h, size;
+
+    size = (t->size)? 2 * t->size : HASHSIZE;
+    bucket = calloc(size, sizeof(struct nlist*));
+    tail = calloc(size, sizeof(struct nlist*));
+    if ( (NULL == bucket) || (NULL == tail) )
+	errExit(1, "...calloc()...");
+
+    for (i = 0; i < t->size; i++)
+	for (np = t->bucket[i]; NULL != np; np = next){
+	    next = np->next;
+	    np->next = NULL;
+	    h = hashOf(np->name) & (size - 1);
+	    if ( (NULL == tail[h]) )
+		bucket[h] = np;
+	    else
+		tail[h]->next = np;
+	    tail[h] = np;
+	}
 
-    return hashval%HASHSIZE;
+    free(t->bucket);
+    free(tail);
+    t->bucket = bucket;
+    t->size = size;
 }
 
-static char* 
-mystrdup(const char* s)
+// a new entry goes first in its chain
+static void
+chain(hashTable* t, struct nlist* np)
 {
-    char* p;
+    unsigned hashval;
 
-    p = malloc(strlen(s)+1);
-    if (p != NULL)
-	strcpy(p, s);
-    return p;
+    if ( (t->count == t->size) )
+	grow(t);
+    hashval = hash(t, np->name);
+    np->next = t->bucket[hashval];
+    t->bucket[hashval] = np;
+    t->count++;
+}
+
+void
+hash_clear(hashTable* t)
+{
+    free(t->bucket);
+    t->bucket = NULL;
+    t->size = t->count = 0;
 }
 
 static struct nlist* 
-findprior(struct nlist** hashtab, const char* s)
+findprior(hashTable* t, const char* s)
 {
     struct nlist* np;
     struct nlist* np_prior;
 
-    for (np_prior = np = hashtab[hash(s)]; np != NULL; np = np->next){
+    for (np_prior = np = t->bucket[hash(t, s)]; np != NULL; np = np->next){
 	if (strcmp(s, np->name) == 0)
 	    return np_prior;
 	np_prior = np;
@@ -44,11 +116,13 @@ findprior(struct nlist** hashtab, const char* s)
 }
 
 struct nlist* 
-lookup(struct nlist** hashtab, const char* s)
+lookup(const hashTable* t, const char* s)
 {
     struct nlist* np;
 
-    for (np = hashtab[hash(s)]; np != NULL; np = np->next)
+    if ( (0 == t->size) )
+	return NULL;
+    for (np = t->bucket[hash(t, s)]; np != NULL; np = np->next)
 	if (strcmp(s, np->name) == 0)
 	    return np;
 
@@ -58,67 +132,81 @@ lookup(struct nlist** hashtab, const char* s)
 // in linked list rooted at hash(name), find nlist* of same hash value, 
 // if any, preceding the name to be undefined; then re-link properly
 int 
-undef(struct nlist** hashtab, const char* name)
+undef(hashTable* t, const char* name)
 {
     struct nlist* p;
     struct nlist* p_prior;
 
-    p = lookup(hashtab, name);
+    p = lookup(t, name);
     if (p == NULL)
 	return -1;
-    p_prior = findprior(hashtab, name);
+    p_prior = findprior(t, name);
 
     if (!(p_prior == p))
 	p_prior->next = p->next;
     else
-	hashtab[hash(name)] = NULL;
-
-    free ( (void*) p->name);
-    free ( (void*) p->type);
-    free ( (void*) p->scope);
-    free ( (void*) p->storage);
+	t->bucket[hash(t, name)] = p->next;
+    t->count--;
 
     return 0;
 }
 
 struct nlist* 
-install(struct nlist** hashtab, char* name, int type, 
-	char* scope, char* storage)
+install(hashTable* t, char* name, int type, 
+	int scope, int slot)
 {
     struct nlist* np;
-    unsigned hashval;
-    const char* pH = "placeholder";
-
-    if ( (np = lookup(hashtab, name)) == NULL){
-	np = (struct nlist*) malloc(sizeof(struct nlist));
-	if (np == NULL || (np->name = mystrdup(name)) == NULL)
-	    return NULL;
-	hashval = hash(name);
-	np->next = hashtab[hashval];
-	hashtab[hashval] = np;
-    }
-    else{
-	free ( (void*) np->type);
-	free ( (void*) np->scope);
-	free ( (void*) np->storage);
+
+    if ( (np = lookup(t, name)) == NULL){
+	np = arena_alloc(&compileArena, sizeof(struct nlist));
+	np->name = arena_strdup(&compileArena, name);
+	np->fct = NULL;
+	chain(t, np);
     }
 
     if ( (INTEGER != type) && (LONG != type) && (FLOAT != type) && 
 	 (FCT_DECL != type) && (FCT_IMPL != type) )
 	type = INVALID;
-    if ( NULL == scope )
-	scope = (char*) pH;	
-    if ( NULL == storage )
-	storage = (char*) pH;	
+    np->type = type;
+    np->scope = scope;
+    np->slot = slot;
 
+    return np;
+}
+
+// unlike install(), always adds a new entry: it comes first in its
+// chain, hiding (shadowing) any earlier one of the same name
+struct nlist* 
+bind(hashTable* t, const char* name, int type, 
+     int scope, int slot)
+{
+    struct nlist* np;
+
+    np = arena_alloc(&compileArena, sizeof(struct nlist));
+    np->name = arena_strdup(&compileArena, name);
     np->type = type;
-    if( (NULL == (np->scope = mystrdup(scope)) ) || 
-	(NULL == (np->storage = mystrdup(storage)) ) )
-	return NULL;
+    np->scope = scope;
+    np->slot = slot;
+    np->fct = NULL;
+    chain(t, np);
 
     return np;
 }
 
+// np must be the latest binding of its chain (bindings are undone in
+// reverse order): removing it takes no search
+void
+unbind(hashTable* t, struct nlist* np)
+{
+    unsigned hashval;
+
+    hashval = hash(t, np->name);
+    if ( (t->bucket[hashval] != np) )
+	errExit(0, "unbinding %s out of order", np->name);
+    t->bucket[hashval] = np->next;
+    t->count--;
+}
+
 static char*
 charType(int type)
 {
@@ -128,6 +216,8 @@ charType(int type)
     case INTEGER: strcpy(chType, "int"); break;
     case LONG: strcpy(chType, "long"); break;
     case FLOAT: strcpy(chType, "float"); break;
+    case FCT_DECL:
+    case FCT_IMPL: strcpy(chType, "function"); break;
     default: errExit(0, "illegal type in declaration"); break;
     }
 
@@ -135,15 +225,19 @@ charType(int type)
 }
 
 void
-printHashTable(struct nlist** hashtab)
+printHashTable(const hashTable* t)
 {
     struct nlist* np;
-    int i;
+    unsigned i;
     char chType[MAX_ID_LEN + 1];
 
-    for (i = 0; i< HASHSIZE; i++)
-	for (np = hashtab[i]; np!= NULL; np = np->next){
+    for (i = 0; i < t->size; i++)
+	for (np = t->bucket[i]; np!= NULL; np = np->next){
 	    strcpy(chType, charType(np->type));
-	    printf("%s = %s, %s, %s\n", np->name, chType, np->scope, np->storage);
+	    if ( (FCT_IMPL == np->type) || (FCT_DECL == np->type) )
+		printf("%s = %s, %d, %s\n", np->name, chType, np->scope, np->name);
+	    else
+		printf("%s = %s, %d, temp&%d\n", np->name, chType, np->scope,
+		       np->slot);
 	}
 }
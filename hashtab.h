@@ -9,11 +9,16 @@
 *     char* defn; };
 **************************************************************
 * Usage: 
-*         install(<hashtab>, "test", "1");
-*         struct nlist* p; p = lookup(<hashtab>, "name");
-*                          p= undef(<hashtab>, "name");
-*         don't forget to initialize table:
-*         for (i = 0; i < HASHSIZE; i++) (hashtab[i] = NULL);
+*         hashTable t = { NULL, 0, 0 };  // (or static)
+*         install(&t, "test", INTEGER, 0, 1);
+*         np = bind(&t, "test", INTEGER, 2, 2);
+*         unbind(&t, np);          // only the latest binding
+*         struct nlist* p; p = lookup(&t, "name");
+*                          p= undef(&t, "name");
+*         hash_clear(&t);          // empty again
+* The table doubles as it fills, so a chain holds about
+* one entry; its hash is keyed anew each run, so which
+* names share a chain cannot be told from the source.
 *************************************************************/
 
 #ifndef HASHTAB_H_
@@ -21,23 +26,36 @@
 
 #include "ast.h"
 
-#define HASHSIZE 101
+#define HASHSIZE 128      // buckets of a table at first (a power of 2)
 
 // type is actually 'enum types'. To avoid 'incomplete type' error,
 // would need to put 'enum types' definition in joint header file.
 // preferred to keep in ast.h for easy access
+struct fctRecord;
+
 struct nlist{
     struct nlist* next;
     char* name;
     int type;
-    char* scope;
-    char* storage; 
+    int scope;           // scope ID; 0: global
+    int slot;            // storage: temp&slot (0: none)
+    struct fctRecord* fct;   // FCT_IMPL: its definition (codegen.c)
 };
 
-struct nlist* lookup(struct nlist**, const char*);
-struct nlist* install(struct nlist**, char* name, int type, 
-		      char* scope, char* storage);
-int undef(struct nlist**, const char*);
-void printHashTable(struct nlist**);
+typedef struct hashTable{
+    struct nlist** bucket;
+    unsigned size;       // buckets; 0: none yet
+    unsigned count;      // entries
+} hashTable;
+
+struct nlist* lookup(const hashTable*, const char*);
+struct nlist* install(hashTable*, char* name, int type, 
+		      int scope, int slot);
+struct nlist* bind(hashTable*, const char* name, int type, 
+		   int scope, int slot);
+void unbind(hashTable*, struct nlist*);
+int undef(hashTable*, const char*);
+void hash_clear(hashTable*);
+void printHashTable(const hashTable*);
 
 #endif
@@ -0,0 +1,435 @@
+/*******************************************************
+* ir.c -               in-memory IR buffer
+* Language:            Micro
+*
+********************************************************/
+
+#include "compiler.h"
+#include "ir.h"
+
+irProgram irProg;
+
+static int weighted;     // 1: keep irProg.weight
+static long curWeight;
+static int weightCap;
+
+// instructions generated from now on run weight times
+void
+ir_setWeight(long weight)
+{
+    weighted = 1;
+    curWeight = weight;
+}
+
+// called for each instruction recorded, on the thread generating it
+// (with --pipeline, ir_append() runs on another one)
+void
+ir_weigh(void)
+{
+    static int numWeights;
+    long* w;
+
+    if ( !weighted )
+	return;
+    if ( (numWeights == weightCap) ){
+	weightCap = (weightCap)? 2*weightCap : 256;
+	if ( (NULL == (w = realloc(irProg.weight, weightCap * sizeof(long)))) )
+	    errExit(1, "...realloc()...");
+	irProg.weight = w;
+    }
+    irProg.weight[numWeights++] = curWeight;
+}
+
+void
+ir_append(const irInstr* ins)
+{
+    irInstr* p;
+
+    if ( (irProg.len == irProg.cap) ){
+	irProg.cap = (irProg.cap)? 2*irProg.cap : 256;
+	p = realloc(irProg.code, irProg.cap * sizeof(irInstr));
+	if ( (NULL == p) )
+	    errExit(1, "...realloc()...");
+	irProg.code = p;
+    }
+    irProg.code[irProg.len++] = *ins;
+
+    if ( (OPND_SLOT == ins->dest.kind) &&
+	 (ins->dest.slot >= irProg.numSlots) )
+	irProg.numSlots = ins->dest.slot + 1;
+}
+
+int
+ir_isVector(enum irOp op)
+{
+    return (IR_VASSIGN <= op) && (IR_VMUL >= op);
+}
+
+// Returns: the scalar instruction lane k of vector instruction v
+//          does (see ir.h)
+irInstr
+ir_lane(const irInstr* v, int k)
+{
+    irInstr ins;
+
+    ins = *v;
+    ins.op = v->op - IR_VASSIGN + IR_ASSIGN;
+    ins.dest.slot += k;
+    if ( (OPND_SLOT == ins.a.kind) )
+	ins.a.slot += k;
+    if ( (OPND_SLOT == ins.b.kind) )
+	ins.b.slot += k;
+    return ins;
+}
+
+static const irInstr* byNameCode;
+
+// by name, and in order
+static int
+byName(const void* x, const void* y)
+{
+    int cmp;
+
+    cmp = strcmp(byNameCode[*(const int*) x].name,
+		 byNameCode[*(const int*) y].name);
+    return (cmp)? cmp : *(const int*) x - *(const int*) y;
+}
+
+// Returns: malloc'd array, indexed by instruction: for a CALL, the
+//          FUNCTION it calls (the last one of its name before it);
+//          for a FUNCTION, a CALL of it; -1 if there is none
+// Note:    the FUNCTIONs and CALLs are sorted by name, and matched in
+//          one pass, so the backends need not search the program for
+//          each of them
+int*
+ir_linkCalls(const irProgram* prog)
+{
+    const char* name;
+    int *link, *fct, *call;
+    int i, j, k, numFct, numCall, cmp;
+
+    link = malloc((prog->len + 1) * sizeof(int));
+    fct = malloc((prog->len + 1) * sizeof(int));
+    call = malloc((prog->len + 1) * sizeof(int));
+    if ( (NULL == link) || (NULL == fct) || (NULL == call) )
+	errExit(1, "...malloc()...");
+
+    for (numFct = numCall = i = 0; i < prog->len; i++){
+	link[i] = -1;
+	if ( (IR_FUNCTION == prog->code[i].op) )
+	    fct[numFct++] = i;
+	else if ( (IR_CALL == prog->code[i].op) )
+	    call[numCall++] = i;
+    }
+    byNameCode = prog->code;
+    qsort(fct, numFct, sizeof(int), byName);
+    qsort(call, numCall, sizeof(int), byName);
+
+    for (i = j = 0; (i < numFct) && (j < numCall); ){
+	cmp = strcmp(prog->code[fct[i]].name, prog->code[call[j]].name);
+	if ( (0 > cmp) ){
+	    i++;
+	    continue;
+	}
+	if ( (0 < cmp) ){
+	    j++;
+	    continue;
+	}
+	name = prog->code[call[j]].name;
+	for (k = -1; (j < numCall) &&
+		 (0 == strcmp(prog->code[call[j]].name, name)); j++){
+	    while ( (i < numFct) && (fct[i] < call[j]) &&
+		    (0 == strcmp(prog->code[fct[i]].name, name)) )
+		k = fct[i++]; // the last one before it
+	    if ( (-1 != k) ){
+		link[call[j]] = k;
+		link[k] = call[j];
+	    }
+	}
+    }
+
+    free(fct);
+    free(call);
+    return link;
+}
+
+// Returns: malloc'd array, indexed by slot, of the type every slot
+//          is defined with (INVALID for slots never defined)
+// Note:    in SSA form a slot is only ever written with one type
+int*
+ir_slotTypes(const irProgram* prog)
+{
+    const irInstr* ins;
+    int* types;
+    int i, k;
+
+    if ( (NULL == (types = calloc(prog->numSlots + 1, sizeof(int))) ) )
+	errExit(1, "...calloc()...");
+
+    for (i = 0; i < prog->len; i++){
+	ins = &prog->code[i];
+	if ( (OPND_SLOT != ins->dest.kind) )
+	    continue;
+	types[ins->dest.slot] = ins->type;
+	if ( ir_isVector(ins->op) )
+	    for (k = 1; k < prog->lanes; k++)
+		types[ins->dest.slot + k] = ins->type;
+    }
+
+    return types;
+}
+
+// Returns: malloc'd array, indexed by slot: for each slot of
+//          the lanes of a vector operand, the first one (0 for
+//          the others)
+int*
+ir_vectorLanes(const irProgram* prog)
+{
+    const irOperand* o[3];
+    int* lead;
+    int i, j, k;
+
+    if ( (NULL == (lead = calloc(prog->numSlots + 1, sizeof(int))) ) )
+	errExit(1, "...calloc()...");
+
+    for (i = 0; i < prog->len; i++){
+	if ( !ir_isVector(prog->code[i].op) )
+	    continue;
+	o[0] = &prog->code[i].dest; o[1] = &prog->code[i].a;
+	o[2] = &prog->code[i].b;
+	for (j = 0; j < 3; j++)
+	    if ( (OPND_SLOT == o[j]->kind) )
+		for (k = 0; k < prog->lanes; k++)
+		    lead[o[j]->slot + k] = o[j]->slot;
+    }
+
+    return lead;
+}
+
+/***************************************************
+* Slot packing
+*
+* Codegen hands out a new slot for every temp, so the
+* slots of a program grow with its number of
+* expressions. A temp is defined once and is dead after
+* its last use; from there its slot can be handed to
+* the next temp of the same type. Packed, a function
+* needs as many slots as it has values live at once,
+* plus one per variable.
+****************************************************/
+
+// hand slot s (a temp's, renumbered) to the next temp of type t
+static void
+release(int** freeSlots, int* numFree, int t, int s, int cap)
+{
+    if ( (NULL == freeSlots[t]) &&
+	 (NULL == (freeSlots[t] = malloc(cap * sizeof(int))) ) )
+	errExit(1, "...malloc()...");
+    freeSlots[t][numFree[t]++] = s;
+}
+
+// Returns: the greatest of far[lo..hi], far being the leaves of
+//          tree (a max segment tree of n leaves); -1 if lo > hi
+static int
+farthest(const int* tree, int n, int lo, int hi)
+{
+    int m;
+
+    m = -1;
+    for (lo += n, hi += n + 1; lo < hi; lo /= 2, hi /= 2){
+	if ( (lo & 1) ){
+	    m = max(m, tree[lo]);
+	    lo++;
+	}
+	if ( (hi & 1) ){
+	    hi--;
+	    m = max(m, tree[hi]);
+	}
+    }
+    return m;
+}
+
+// last: per slot, index of its last use; def: of its definition
+// A loop (a jump or branch at j back to a label at h) uses every
+// temp it uses that is defined ahead of it on every pass: such a
+// temp lives to j at least. A use at k of a temp defined at d so
+// lives to the farthest jump back to a label in (d, k]: one query
+// of a segment tree per use, however deep the loops nest
+static void
+extendLoops(const irProgram* prog, int* last, const int* def)
+{
+    const irInstr* ins;
+    const irOperand* o[2];
+    int *labelAt, *labelFct, *tree;
+    int i, j, k, s, f, n, maxLabel;
+
+    for (maxLabel = i = 0; i < prog->len; i++)
+	if ( (IR_LABEL == prog->code[i].op) )
+	    maxLabel = max(maxLabel, (int) prog->code[i].dest.val_int);
+    n = max(prog->len, 1);
+    labelAt = calloc(maxLabel + 1, sizeof(int));
+    labelFct = calloc(maxLabel + 1, sizeof(int));
+    tree = calloc(2 * n, sizeof(int));
+    if ( (NULL == labelAt) || (NULL == labelFct) || (NULL == tree) )
+	errExit(1, "...calloc()...");
+
+    // the leaves: per label's index, the farthest jump back to it
+    for (i = 0; i < n; i++)
+	tree[n + i] = -1;
+    for (f = j = 0; j < prog->len; j++){
+	ins = &prog->code[j];
+	if ( (IR_FUNCTION == ins->op) )
+	    f = j + 1;
+	if ( (IR_LABEL == ins->op) ){
+	    labelAt[ins->dest.val_int] = j;
+	    labelFct[ins->dest.val_int] = f;
+	}
+	if ( (IR_JUMP > ins->op) || (maxLabel < ins->dest.val_int) ||
+	     (f != labelFct[ins->dest.val_int]) )
+	    continue; // not a jump back (the label is not seen yet)
+	tree[n + labelAt[ins->dest.val_int]] = j;
+    }
+    for (i = n - 1; i > 0; i--)
+	tree[i] = max(tree[2*i], tree[2*i + 1]);
+
+    // a jump back at or before k cannot raise last[s] (k at most)
+    for (k = 0; k < prog->len; k++){
+	o[0] = &prog->code[k].a; o[1] = &prog->code[k].b;
+	for (i = 0; i < 2; i++){
+	    s = o[i]->slot;
+	    if ( (OPND_SLOT == o[i]->kind) && (def[s] < k) )
+		last[s] = max(last[s], farthest(tree, n, def[s] + 1, k));
+	}
+    }
+
+    free(labelAt);
+    free(labelFct);
+    free(tree);
+}
+
+// Returns: 1 if slot s lives on, unused, up to code[i] (a jump
+//          back: see extendLoops())
+static int
+endsAt(const irInstr* ins, int s)
+{
+    return (IR_JUMP <= ins->op) &&
+	!( (OPND_SLOT == ins->a.kind) && (s == ins->a.slot) ) &&
+	!( (OPND_SLOT == ins->b.kind) && (s == ins->b.slot) );
+}
+
+// renumber the slots of prog, reusing those of dead temps
+// Note: slots defined more than once, or by DECLARE or PARAM, keep
+//       their own; so do the slots of each function, as a caller's
+//       temps stay live across its calls, and the lanes of vector
+//       operands, which stay next to each other. A temp lives from its
+//       definition to its last use in program order, or to the
+//       end of the outermost loop using it that it was defined
+//       ahead of (see extendLoops())
+void
+ir_packSlots(irProgram* prog)
+{
+    int *defs, *last, *def, *ends, *nextEnd, *map, *types, *lead;
+    int *freeSlots[MAX_TYPES];
+    int numFree[MAX_TYPES];
+    irInstr* ins;
+    int i, k, s, t, a, b, next;
+
+    types = ir_slotTypes(prog);
+    lead = ir_vectorLanes(prog);
+    defs = calloc(prog->numSlots + 1, sizeof(int));
+    last = calloc(prog->numSlots + 1, sizeof(int));
+    map = calloc(prog->numSlots + 1, sizeof(int));
+    def = calloc(prog->numSlots + 1, sizeof(int));
+    nextEnd = calloc(prog->numSlots + 1, sizeof(int));
+    ends = calloc(prog->len + 1, sizeof(int));
+    if ( (NULL == defs) || (NULL == last) || (NULL == map) ||
+	 (NULL == def) || (NULL == nextEnd) || (NULL == ends) )
+	errExit(1, "...calloc()...");
+    for (t = 0; t < MAX_TYPES; t++){
+	numFree[t] = 0;
+	freeSlots[t] = NULL;
+    }
+
+    // defs: number of definitions (-1: DECLARE or PARAM);
+    // last: index of the last use (-1: none); def: of the first
+    // definition
+    for (i = 0; i < prog->numSlots; i++)
+	last[i] = -1;
+    for (i = 0; i < prog->len; i++){
+	ins = &prog->code[i];
+	if ( (OPND_SLOT == ins->dest.kind) ){
+	    s = ins->dest.slot;
+	    if ( (0 == defs[s]) )
+		def[s] = i;
+	    if ( (IR_DECLARE == ins->op) || (IR_PARAM == ins->op) ||
+		 (0 != lead[s]) )
+		defs[s] = -1;
+	    else if ( (-1 != defs[s]) )
+		defs[s]++;
+	}
+	if ( (OPND_SLOT == ins->a.kind) )
+	    last[ins->a.slot] = i;
+	if ( (OPND_SLOT == ins->b.kind) )
+	    last[ins->b.slot] = i;
+    }
+    // ends: per index, the first slot to release there that it
+    // does not use (each list: nextEnd; 0 ends it)
+    extendLoops(prog, last, def);
+    for (s = 1; s < prog->numSlots; s++)
+	if ( (1 == defs[s]) && (-1 != last[s]) &&
+	     endsAt(&prog->code[last[s]], s) ){
+	    nextEnd[s] = ends[last[s]];
+	    ends[last[s]] = s;
+	}
+
+    for (next = 1, i = 0; i < prog->len; i++){
+	ins = &prog->code[i];
+	if ( (IR_FUNCTION == ins->op) )
+	    for (t = 0; t < MAX_TYPES; t++)
+		numFree[t] = 0;
+
+	a = (OPND_SLOT == ins->a.kind)? ins->a.slot : 0;
+	b = (OPND_SLOT == ins->b.kind)? ins->b.slot : 0;
+	if ( ((0 != a) && (0 == map[a])) || ((0 != b) && (0 == map[b])) )
+	    errExit(0, "slot read but never defined (%d)",
+		    ((0 != a) && (0 == map[a]))? a : b);
+	if ( (0 != a) )
+	    ins->a.slot = map[a];
+	if ( (0 != b) )
+	    ins->b.slot = map[b];
+
+	// the dest is numbered before the operands' slots are released:
+	// it never shares one with them
+	if ( (OPND_SLOT == ins->dest.kind) ){
+	    s = ins->dest.slot;
+	    t = types[s];
+	    if ( (0 == map[s]) && (0 != lead[s]) )
+		for (k = 0; k < prog->lanes; k++)
+		    map[lead[s] + k] = next++;
+	    if ( (0 == map[s]) )
+		map[s] = ( (1 == defs[s]) && (0 < numFree[t]) )?
+		    freeSlots[t][--numFree[t]] : next++;
+	    ins->dest.slot = map[s];
+	    if ( (1 == defs[s]) && (-1 == last[s]) ) // never used
+		release(freeSlots, numFree, t, map[s], prog->numSlots);
+	}
+	if ( (0 != a) && (1 == defs[a]) && (i == last[a]) )
+	    release(freeSlots, numFree, types[a], map[a], prog->numSlots);
+	if ( (0 != b) && (b != a) && (1 == defs[b]) && (i == last[b]) )
+	    release(freeSlots, numFree, types[b], map[b], prog->numSlots);
+	for (s = ends[i]; 0 != s; s = nextEnd[s])
+	    release(freeSlots, numFree, types[s], map[s], prog->numSlots);
+    }
+    prog->numSlots = next;
+
+    for (t = 0; t < MAX_TYPES; t++)
+	free(freeSlots[t]);
+    free(types);
+    free(defs);
+    free(last);
+    free(def);
+    free(ends);
+    free(nextEnd);
+    free(map);
+    free(lead);
+}
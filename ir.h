@@ -0,0 +1,105 @@
+/*******************************************************
+* ir.h -               in-memory form of the IR
+* Language:            Micro
+*
+********************************************************
+* Every codegen_XXX() wrapper hands one irInstr to the
+* backends (backend.c), which may also keep them in irProg.
+* The execution paths (batch.c) work off this array rather
+* than re-parsing the printed text.
+*
+* Storage: temp&N is slot N (1-based); slot 0 is unused.
+*          Slots are numbered across the whole program.
+*          Codegen gives every temp a slot of its own;
+*          ir_packSlots() then lets temps whose lives do
+*          not overlap share one (see ir.c)
+*
+* Functions: user functions come first, each bracketed by
+*          FUNCTION (type: return type) and END; the main
+*          program is the bracket with type INVALID.
+*          A call is its arguments' ARGs, right before the
+*          CALL. A function cannot call itself, or any one
+*          defined after it, so each of its slots has one
+*          value at a time: a call copies the ARGs into the
+*          PARAMs, runs the body up to RETURN, and copies
+*          the value returned into the CALL's dest. Declared
+*          variables start out as 0 in every call
+*
+* Control flow: LABEL marks its place; JUMP goes there,
+*          and a branch (BEQ, ..., BGE) goes there if
+*          a = b (<>, <, <=, >, >=), type being that of
+*          a and b. The label is their dest, an OPND_INT
+*          numbered within the function. A DECLARE in a
+*          loop zeroes its variable on every pass
+*
+* Vectors: VASSIGN, VADD, VSUB, VMUL (see slp.c) do what
+*          ASSIGN ... MUL do, on prog->lanes lanes at once:
+*          lane k of a slot operand is slot + k, and a
+*          literal stands for itself in every lane (see
+*          ir_lane())
+********************************************************/
+
+#ifndef IR_H_
+#define IR_H_
+
+#include "ast.h"
+
+enum irOp { IR_DECLARE, IR_ASSIGN, IR_ADD, IR_SUB, IR_MUL, IR_DIV,
+	    IR_PROMOTE, IR_CONVERT, IR_READ, IR_WRITE, IR_WRITELN,
+	    IR_FUNCTION, IR_END, IR_PARAM, IR_RETURN, IR_ARG, IR_CALL,
+	    IR_SHL, IR_SAR, IR_SHR, IR_MULHI,  // see strength.c
+	    IR_VASSIGN, IR_VADD, IR_VSUB, IR_VMUL,  // see slp.c
+	    IR_LABEL, IR_JUMP, IR_BEQ, IR_BNE, IR_BLT, IR_BLE, IR_BGT,
+	    IR_BGE };
+
+typedef struct irOperand{
+    enum irOpnd { OPND_NONE, OPND_SLOT, OPND_INT, OPND_FLT } kind;
+    enum types type;
+    union {
+	int slot;          // OPND_SLOT
+	long val_int;      // OPND_INT
+	double val_flt;    // OPND_FLT
+    };
+} irOperand;
+
+// type: type of the result (DECLARE, READ: of the variable;
+//       WRITE: of the value written; branches: of the values
+//       compared)
+// name: source name for DECLARE, PARAM, FUNCTION/END, and of the
+//       function called by CALL (owned by the symbol table or the
+//       caller; never freed)
+typedef struct irInstr{
+    enum irOp op;
+    enum types type;
+    irOperand dest;
+    irOperand a;
+    irOperand b;
+    const char* name;
+} irInstr;
+
+typedef struct irProgram{
+    irInstr* code;
+    int len;
+    int cap;
+    int numSlots;     // highest slot used + 1
+    int lanes;        // of the vector instructions; 0: there are none
+    long* weight;     // per instruction: times it runs, per the
+		      // profile (see ir_setWeight()); or NULL
+    int* frame;       // per slot: its offset below the top of
+		      // the frame (see frame.c); or NULL
+    int frameSize;    // bytes, a multiple of FRAME_LINE
+} irProgram;
+
+extern irProgram irProg;
+
+void ir_append(const irInstr* ins);
+int ir_isVector(enum irOp op);
+irInstr ir_lane(const irInstr* v, int k);
+int* ir_linkCalls(const irProgram* prog);
+int* ir_slotTypes(const irProgram* prog);
+int* ir_vectorLanes(const irProgram* prog);
+void ir_packSlots(irProgram* prog);
+void ir_setWeight(long weight);
+void ir_weigh(void);
+
+#endif
@@ -7,19 +7,73 @@
 *                      - max digits literals: MAX_LIT_LEN (20)
 ****************************************************************/
 
+#include <stdarg.h>
 #include "compiler.h"
 #include "lexer.h"
 
+#define LEX_BUFSIZE 65536
+
+// a lexer running on its own thread must not exit the program: the
+// parser might not have caught up yet. Its (only) error is kept in
+// its source until the parser reaches it, and lexer_raise() reports it
+static void (*handOverError)(void);
+
+// the source tokenize() reads: fd, through buf
+static unsigned char buf[LEX_BUFSIZE];
+static lexSource fdSrc = { .text = buf, .lastChar = ' ' };
+
+static void lexer_raiseFrom(const lexSource* src);
+static int lexer_next(lexSource* src, tokRecord* rec);
+
 static void
-next_char(int fd, int* last_char)
+lexError(lexSource* src, int pError, const char* format, ...)
+{
+    va_list arglist;
+    int savedErrno;
+
+    savedErrno = errno;
+    va_start(arglist, format);
+    vsnprintf(src->errMsg, MAX_ERR_LEN, format, arglist);
+    va_end(arglist);
+    src->errP = pError;
+    src->errNo = savedErrno;
+
+    if ( (NULL != handOverError) )
+	handOverError(); // does not return
+    lexer_raiseFrom(src);
+}
+
+// handOver: called in place of exiting; must not return
+void
+lexer_deferErrors(void (*handOver)(void)) { handOverError = handOver; }
+
+static void
+lexer_raiseFrom(const lexSource* src)
+{
+    errno = src->errNo;
+    errExit(src->errP, "%s", src->errMsg);
+}
+
+void
+lexer_raise(void) { lexer_raiseFrom(&fdSrc); }
+
+static void
+next_char(lexSource* src)
 {
     ssize_t numRead;
 
-    numRead = read(fd, last_char, 1);
-    if (numRead == -1)
-	errExit(1, "...int read()...");
-    else if (numRead == 0)
-	*last_char = EOF;
+    if ( (src->pos == src->len) ){
+	numRead = read(src->fd, buf, LEX_BUFSIZE);
+	if (numRead == -1)
+	    lexError(src, 1, "...int read()...");
+	else if (numRead == 0){
+	    src->lastChar = EOF;
+	    return;
+	}
+	src->pos = 0;
+	src->len = numRead;
+    }
+    src->lastChar = src->text[src->pos++];
 }
 
 // validity check of possible identifier
@@ -43,128 +97,171 @@ check_reserved(char* word)
 	return tok_DEC_LONG;
     if ( (0 == strcmp(word, "float")) )
 	return tok_DEC_FLT;
+    if ( (0 == strcmp(word, "return")) )
+	return tok_RETURN;
+    if ( (0 == strcmp(word, "export")) )
+	return tok_EXPORT;
+    if ( (0 == strcmp(word, "import")) )
+	return tok_IMPORT;
+    if ( (0 == strcmp(word, "if")) )
+	return tok_IF;
+    if ( (0 == strcmp(word, "then")) )
+	return tok_THEN;
+    if ( (0 == strcmp(word, "else")) )
+	return tok_ELSE;
+    if ( (0 == strcmp(word, "while")) )
+	return tok_WHILE;
+    if ( (0 == strcmp(word, "do")) )
+	return tok_DO;
 
     return tok_ID; // not a reserved keyword (tok_xxx is numbered 1 and higher)
 }
 
-// note how last_char look-ahead invariant is preserved by each possible
+// note how lastChar look-ahead invariant is preserved by each possible
 // sub case (where it is not explicitly invoked, a comment explains why)
-int 
-tokenize(int fd)
+int
+tokenize(int fd, tokRecord* rec)
+{
+    fdSrc.fd = fd;
+    return lexer_next(&fdSrc, rec);
+}
+
+static int
+lexer_next(lexSource* src, tokRecord* rec)
 {
-    static int last_char = ' ';
     int i;
     char numStr[MAX_LIT_LEN+1];
 
-    while (isspace(last_char))
-	next_char(fd, &last_char);
+    // white space, and comments (-- to the end of the line), however
+    // many follow each other, in one loop
+    for (;;){
+	while (isspace(src->lastChar))
+	    next_char(src);
+	if (src->lastChar != '-')
+	    break;
+	next_char(src);
+	if (src->lastChar != '-') // the look-ahead invariant holds
+	    return tok_OP_MINUS;
+	while ( (src->lastChar != '\n') && (src->lastChar != EOF) )
+	    next_char(src);
+    }
 
     // case identifier ([a-zA-z][a-zA-z0-9_]*)
-    // returns tok_BEGIN, tok_END, tok_READ, tok_WRITE, tok_ID, respectively
+    // returns tok_BEGIN, tok_END, tok_READ, tok_WRITE, ..., tok_ID, respectively
     i = 0;
-    if ( isalpha(last_char) ){
-	while ( isalnum(last_char) || ('_' == last_char) ){
+    if ( isalpha(src->lastChar) ){
+	while ( isalnum(src->lastChar) || ('_' == src->lastChar) ){
 	    if ( (MAX_ID_LEN == i) ){
-		identifierStr[0] = '\0'; // keep in clean slate
-		errExit(0, "...invalid lenght of identifier: %d (%d allowed)...", i, MAX_ID_LEN);
+		rec->id[0] = '\0'; // keep in clean slate
+		lexError(src, 0, "...invalid lenght of identifier: %d (%d allowed)...", i, MAX_ID_LEN);
 	    }
-	    identifierStr[i++] = last_char;
-	    next_char(fd, &last_char);
+	    rec->id[i++] = src->lastChar;
+	    next_char(src);
 	}
-	identifierStr[i] = '\0'; // note: last_char already looks ahead as we
-	                         //       read one char ahead
+	rec->id[i] = '\0'; // note: src->lastChar already looks ahead as we
+			   //       read one char ahead
 
-	return check_reserved(identifierStr);
+	return check_reserved(rec->id);
     }
 
     // numeric literal
     i = 0;
-    if ( isdigit(last_char) ){
-	while ( isdigit(last_char) ){
+    if ( isdigit(src->lastChar) ){
+	while ( isdigit(src->lastChar) ){
 	    if ( (MAX_LIT_LEN == i) ){
 		numStr[0] = '\0'; // clean up
-		errExit(0, "...invalid number of digits of int type: %d (%d allowed)", i, MAX_LIT_LEN);
+		lexError(src, 0, "...invalid number of digits of int type: %d (%d allowed)", i, MAX_LIT_LEN);
 	    }
-	    numStr[i++] = last_char;
-	    next_char(fd, &last_char);
+	    numStr[i++] = src->lastChar;
+	    next_char(src);
 	}
 
 	// case: int or long. default to int; handle promotion elsewhere
-	if ( '.' != last_char){
+	if ( '.' != src->lastChar){
 	    numStr[i] = '\0';
       
 	    errno = 0;   // as 0 can be returned legitimetely
-	    intVal = atol(numStr);
+	    rec->val_int = atol(numStr);
 	    if (errno != 0) // overflow? 
-		errExit(1, "...atoi(%s)...",  numStr);
+		lexError(src, 1, "...atoi(%s)...",  numStr);
 
 	    return tok_INT_LITERAL;
 	}
 
 	// case: float
-	numStr[i++] = last_char;
-	next_char(fd, &last_char);
+	numStr[i++] = src->lastChar;
+	next_char(src);
 
-	while ( isdigit(last_char) ){
+	while ( isdigit(src->lastChar) ){
 	    if ( (MAX_LIT_LEN == i) ){
 		numStr[0] = '\0'; // clean up
-		errExit(0, "...invalid number of digits of int type: %d (%d allowed)", i, MAX_LIT_LEN);
+		lexError(src, 0, "...invalid number of digits of int type: %d (%d allowed)", i, MAX_LIT_LEN);
 	    }
-	    numStr[i++] = last_char;
-	    next_char(fd, &last_char);
+	    numStr[i++] = src->lastChar;
+	    next_char(src);
 	}
 
 	numStr[i] = '\0';
 	errno = 0;   // as 0 can be returned legitimetely
-	fltVal = atof(numStr);
+	rec->val_flt = atof(numStr);
 	if (errno != 0) // overflow? 
-	    errExit(1, "...atoi(%s)...",  numStr);
+	    lexError(src, 1, "...atoi(%s)...",  numStr);
 
 	return tok_FLT_LITERAL;
     } //end case numeric literal
 
     // assignment
-    if ( (':' == last_char) ){
-	next_char(fd, &last_char);
-	if ( ('=' == last_char) ){
-	    next_char(fd, &last_char);
+    if ( (':' == src->lastChar) ){
+	next_char(src);
+	if ( ('=' == src->lastChar) ){
+	    next_char(src);
 	    return tok_ASSIGN;
 	}
 	else
-	    errExit(0, "...invalid syntax: : not followed by =");
+	    lexError(src, 0, "...invalid syntax: : not followed by =");
     }
 
-    // single token literals following (also EOF)
-    switch(last_char){
-    case '(': next_char(fd, &last_char); return tok_LPAREN; break;
-    case ')': next_char(fd, &last_char); return tok_RPAREN; break;
-    case ';': next_char(fd, &last_char); return tok_SEMICOLON; break;
-    case ',': next_char(fd, &last_char); return tok_COMMA; break;
-    case '+': next_char(fd, &last_char); return tok_OP_PLUS; break;
-    case '*': next_char(fd, &last_char); return tok_OP_MUL; break;
-    case '/': next_char(fd, &last_char); return tok_OP_DIV; break;	
-    default: break;
+    // relational operators: <, <=, <>, >, >=
+    if ( ('<' == src->lastChar) ){
+	next_char(src);
+	if ( ('=' == src->lastChar) ){
+	    next_char(src);
+	    return tok_LE;
+	}
+	if ( ('>' == src->lastChar) ){
+	    next_char(src);
+	    return tok_NE;
+	}
+	return tok_LT; // src->lastChar already looks ahead
     }
-
-    // case comment and op_minus
-    if (last_char == '-'){
-	next_char(fd, &last_char);
-	if (last_char == '-'){ // the lookahead check already re-fille last_char
-	    while ( (last_char != '\n') && (last_char != EOF) )
-		next_char(fd, &last_char);
-	    if ( (last_char == '\n') )
-		return tokenize(fd);
+    if ( ('>' == src->lastChar) ){
+	next_char(src);
+	if ( ('=' == src->lastChar) ){
+	    next_char(src);
+	    return tok_GE;
 	}
-	else // see above comment: look-ahead invariant in last_char already ok
-	    return tok_OP_MINUS;
+	return tok_GT;
+    }
+
+    // single token literals following (also EOF)
+    switch(src->lastChar){
+    case '(': next_char(src); return tok_LPAREN; break;
+    case ')': next_char(src); return tok_RPAREN; break;
+    case ';': next_char(src); return tok_SEMICOLON; break;
+    case ',': next_char(src); return tok_COMMA; break;
+    case '+': next_char(src); return tok_OP_PLUS; break;
+    case '*': next_char(src); return tok_OP_MUL; break;
+    case '/': next_char(src); return tok_OP_DIV; break;	
+    case '=': next_char(src); return tok_EQ; break;
+    default: break;
     }
 
     // case EOF
-    if ( (tok_EOF == last_char) )
+    if ( (tok_EOF == src->lastChar) )
 	return tok_EOF;
 
     // if we come here, we fell through: illegal terminal/token
-    errExit(0, "...illegal token %c", last_char);
+    lexError(src, 0, "...illegal token %c", src->lastChar);
 
     return -1; // to suppress gcc no return value warning
 }
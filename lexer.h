@@ -9,20 +9,44 @@
 
 #include "compiler.h"
 
-// int literals and identifiers need not only a token to say what they are,
-// but also a buffer to store their value/representation
-char identifierStr[MAX_ID_LEN + 1]; // string value of identifier
-long intVal;   // value of number, if found
-double fltVal;
-
 typedef enum token_types{
     tok_EOF = -1, tok_BEGIN=-2 , tok_END = -3, tok_READ = -4, tok_WRITE = -5, 
     tok_ID = -6, tok_INT_LITERAL = -7, tok_FLT_LITERAL= -8, tok_ASSIGN = -9, 
     tok_DEC_INT = -10, tok_DEC_LONG = -11, tok_DEC_FLT = -12,
+    tok_ERROR = -13,     // pipelined lexer failed: see lexer_raise()
+    tok_RETURN = -14, tok_EXPORT = -15, tok_IMPORT = -16,
+    tok_IF = -17, tok_THEN = -18, tok_ELSE = -19, tok_WHILE = -20, tok_DO = -21,
+    tok_NE = -22, tok_LE = -23, tok_GE = -24,   // <>, <=, >=
     tok_OP_PLUS = '+', tok_OP_MINUS = '-', tok_OP_MUL = '*', tok_OP_DIV = '/',
     tok_LPAREN = '(', tok_RPAREN = ')', tok_COMMA = ',', tok_SEMICOLON = ';',
+    tok_EQ = '=', tok_LT = '<', tok_GT = '>',
 } token;
 
-extern int tokenize(int);
+// int literals and identifiers need not only a token to say what they are,
+// but also their value/representation: each token is self-contained, so
+// it can be handed on (e.g., to another thread) as is
+typedef struct tokRecord{
+    int tok;
+    union {
+	char id[MAX_ID_LEN + 1];  // tok_ID: string value of identifier
+	long val_int;             // tok_INT_LITERAL
+	double val_flt;           // tok_FLT_LITERAL
+    };
+} tokRecord;
+
+// what the lexer reads: a file descriptor (tokenize()), through a
+// buffer, with its look-ahead
+typedef struct lexSource{
+    int fd;
+    const unsigned char* text;
+    size_t pos, len;
+    int lastChar;                // the look-ahead
+    char errMsg[MAX_ERR_LEN + 1];// its error, for lexer_raise()
+    int errP, errNo;
+} lexSource;
+
+extern int tokenize(int fd, tokRecord* rec);
+void lexer_deferErrors(void (*handOver)(void));
+void lexer_raise(void);
 
 #endif
@@ -0,0 +1,422 @@
+/*******************************************************
+* link.c -             linker: units (globals.c) merged
+*                      into one program (--link)
+* Language:            Micro
+*
+* Every function of a unit is local (its name is known
+* to the unit only), exported, or imported (a signature
+* only: the function is defined, and exported, by some
+* other unit). Exactly one of the units has the main
+* program. Linking
+*   - resolves every import to the one export of that
+*     name, whose signature it must match;
+*   - renames local functions whose name is taken by a
+*     function of another unit (f becomes f_<unit>);
+*   - moves each unit's slots past those of the units
+*     before it, so that no two units share one; the
+*     units are unpacked, and their calls renamed, on up
+*     to LINK_THREADS threads, each taking the next unit
+*     not taken yet;
+*   - hands the functions to the backends callees first
+*     (so none calls one defined after it: ir.h), and the
+*     main program last. Recursion across units is an
+*     error, as it is within one.
+* Nothing is inlined or evaluated across units: calls of
+* imports stay calls.
+********************************************************/
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "compiler.h"
+#include "link.h"
+#include "globals.h"
+#include "backend.h"
+#include "arena.h"
+
+typedef struct linkFct{
+    const char* name;      // in the program linked
+    const globalsFct* g;
+    int unit;
+    irInstr* body;         // unpacked: slots moved, calls renamed
+    int state;             // ordering: 0 - not yet; 1 - on the
+			   // path of calls; 2 - handed out
+} linkFct;
+
+typedef struct linkName{   // a function, by the name its unit knows
+    const char* name;
+    linkFct* f;
+} linkName;
+
+typedef struct linkUnit{
+    globalsMap m;
+    int base;              // slots of the units before it
+    linkName* names;       // sorted by name; imports resolved
+    int numNames;
+    linkFct* fcts;         // its definitions (main included)
+    int numFcts;
+} linkUnit;
+
+static linkUnit* units;
+static int numUnits;
+static linkName* byName;   // every function but main, by its new name
+static int numByName;
+static atomic_int nextUnit;
+
+static int
+cmpName(const void* x, const void* y)
+{
+    return strcmp(((const linkName*) x)->name, ((const linkName*) y)->name);
+}
+
+static linkFct*
+findName(const linkName* names, int n, const char* name)
+{
+    linkName key, * res;
+
+    key.name = name;
+    res = bsearch(&key, names, n, sizeof(linkName), cmpName);
+    return (NULL == res)? NULL : res->f;
+}
+
+/***************************************************
+* Symbols
+*
+****************************************************/
+
+// Returns: 1 if import g can be of export e
+static int
+sameSignature(const globalsFct* g, const globalsFct* e)
+{
+    int i;
+
+    if ( (g->retType != e->retType) || (g->numParams != e->numParams) )
+	return 0;
+    for (i = 0; i < g->numParams; i++)
+	if ( (g->paramType[i] != e->paramType[i]) )
+	    return 0;
+    return 1;
+}
+
+// every local function gets a name of its own: its name, unless
+// another function has it (names: every definition, sorted)
+static void
+nameLocals(const linkName* names, int numNames)
+{
+    const char** renamed;
+    const linkName* lo, * hi;
+    linkFct* f;
+    char* s;
+    int numRenamed, u, i, k, clash;
+
+    renamed = malloc((numNames + 1) * sizeof(char*));
+    if ( (NULL == renamed) )
+	errExit(1, "...malloc()...");
+    numRenamed = 0;
+
+    for (lo = names; lo < names + numNames; lo = hi){
+	for (hi = lo + 1; hi < names + numNames; hi++)
+	    if ( (0 != strcmp(lo->name, hi->name)) )
+		break;
+	if ( (1 == hi - lo) )
+	    continue;
+	for ( ; lo < hi; lo++){
+	    f = lo->f;
+	    if ( (LINK_LOCAL != f->g->linkage) )
+		continue;
+	    u = f->unit + 1;
+	    s = arena_alloc(&compileArena, strlen(f->name) + 32);
+	    sprintf(s, "%s_%d", f->name, u);
+	    // until it is nobody's name (a rare loop)
+	    for (k = 2; ; k++){
+		clash = (NULL != findName(names, numNames, s));
+		for (i = 0; !clash && (i < numRenamed); i++)
+		    clash = (0 == strcmp(renamed[i], s));
+		if ( !clash )
+		    break;
+		sprintf(s, "%s_%d_%d", f->name, u, k);
+	    }
+	    f->name = renamed[numRenamed++] = s;
+	}
+    }
+
+    free(renamed);
+}
+
+// Returns: the main program
+static linkFct*
+resolve(void)
+{
+    linkName* exports, * all;
+    linkFct* main, * f, * e;
+    const globalsFct* g;
+    linkUnit* u;
+    int numExports, numAll, numDefs, i, j;
+
+    for (numDefs = i = 0; i < numUnits; i++)
+	numDefs += units[i].numFcts;
+    exports = malloc((numDefs + 1) * sizeof(linkName));
+    all = malloc((numDefs + 1) * sizeof(linkName));
+    if ( (NULL == exports) || (NULL == all) )
+	errExit(1, "...malloc()...");
+
+    main = NULL;
+    numExports = numAll = 0;
+    for (i = 0; i < numUnits; i++)
+	for (j = 0; j < units[i].numFcts; j++){
+	    f = &units[i].fcts[j];
+	    if ( (LINK_MAIN == f->g->linkage) ){
+		if ( (NULL != main) )
+		    errExit(0, "%s and %s both have a main program",
+			    units[main->unit].m.file, units[i].m.file);
+		main = f;
+		continue;
+	    }
+	    all[numAll].name = f->name;
+	    all[numAll++].f = f;
+	    if ( (LINK_EXPORT == f->g->linkage) ){
+		exports[numExports].name = f->name;
+		exports[numExports++].f = f;
+	    }
+	}
+    if ( (NULL == main) )
+	errExit(0, "no unit has a main program");
+
+    qsort(exports, numExports, sizeof(linkName), cmpName);
+    for (i = 1; i < numExports; i++)
+	if ( (0 == strcmp(exports[i - 1].name, exports[i].name)) )
+	    errExit(0, "%s is exported by both %s and %s", exports[i].name,
+		    units[exports[i - 1].f->unit].m.file,
+		    units[exports[i].f->unit].m.file);
+    qsort(all, numAll, sizeof(linkName), cmpName);
+    nameLocals(all, numAll);
+
+    // what each unit's names stand for
+    for (i = 0; i < numUnits; i++){
+	u = &units[i];
+	u->names = malloc((u->m.h->numFcts + 1) * sizeof(linkName));
+	if ( (NULL == u->names) )
+	    errExit(1, "...malloc()...");
+	for (u->numNames = j = 0; j < u->numFcts; j++)
+	    if ( (LINK_MAIN != u->fcts[j].g->linkage) ){
+		u->names[u->numNames].name = globals_name(&u->m,
+							  u->fcts[j].g->name);
+		u->names[u->numNames++].f = &u->fcts[j];
+	    }
+	for (j = 0; j < (int) u->m.h->numFcts; j++){
+	    g = &u->m.fcts[j];
+	    if ( (LINK_IMPORT != g->linkage) )
+		continue;
+	    e = findName(exports, numExports, globals_name(&u->m, g->name));
+	    if ( (NULL == e) )
+		errExit(0, "%s: unresolved import (%s)", u->m.file,
+			globals_name(&u->m, g->name));
+	    if ( !sameSignature(g, e->g) )
+		errExit(0, "%s: import of %s does not match its export in %s",
+			u->m.file, e->name, units[e->unit].m.file);
+	    u->names[u->numNames].name = e->name;
+	    u->names[u->numNames++].f = e;
+	}
+	qsort(u->names, u->numNames, sizeof(linkName), cmpName);
+    }
+
+    for (i = 0; i < numAll; i++)
+	all[i].name = all[i].f->name;
+    qsort(all, numAll, sizeof(linkName), cmpName);
+    byName = all;
+    numByName = numAll;
+
+    free(exports);
+    return main;
+}
+
+/***************************************************
+* Unpacking (in parallel)
+*
+****************************************************/
+
+static void
+unpackUnit(linkUnit* u)
+{
+    linkFct* f, * callee;
+    irInstr* ins;
+    int i, j;
+
+    for (i = 0; i < u->numFcts; i++){
+	f = &u->fcts[i];
+	for (j = 0; j < f->g->len; j++){
+	    ins = &f->body[j];
+	    *ins = globals_instr(&u->m, &u->m.code[f->g->body + j], u->base);
+	    if ( (IR_CALL != ins->op) )
+		continue;
+	    callee = (NULL == ins->name)? NULL :
+		findName(u->names, u->numNames, ins->name);
+	    if ( (NULL == callee) )
+		errExit(0, "%s: call of undefined function (%s)", u->m.file,
+			(ins->name)? ins->name : "");
+	    ins->name = callee->name;
+	}
+    }
+}
+
+static void*
+unpackMain(void* arg)
+{
+    int i;
+
+    while ( (numUnits > (i = atomic_fetch_add(&nextUnit, 1))) )
+	unpackUnit(&units[i]);
+    return NULL;
+}
+
+static void
+unpackAll(void)
+{
+    pthread_t threads[LINK_THREADS];
+    int numThreads, i, s;
+
+    atomic_init(&nextUnit, 0);
+    numThreads = min(numUnits, LINK_THREADS);
+    for (i = 1; i < numThreads; i++)
+	if ( (0 != (s = pthread_create(&threads[i], NULL, unpackMain,
+				       NULL)) ) ){
+	    errno = s;
+	    errExit(1, "...pthread_create()...");
+	}
+    unpackMain(NULL); // this thread is one of them
+    for (i = 1; i < numThreads; i++)
+	if ( (0 != (s = pthread_join(threads[i], NULL)) ) ){
+	    errno = s;
+	    errExit(1, "...pthread_join()...");
+	}
+}
+
+/***************************************************
+* Output: callees first
+*
+****************************************************/
+
+static void
+emitFunction(const linkFct* f)
+{
+    irInstr ins;
+    int i;
+
+    ins.op = IR_FUNCTION;
+    ins.type = f->g->retType;
+    ins.dest.kind = ins.a.kind = ins.b.kind = OPND_NONE;
+    ins.name = f->name;
+    backend_emit(&ins);
+    for (i = 0; i < f->g->len; i++)
+	backend_emit(&f->body[i]);
+    ins.op = IR_END;
+    backend_emit(&ins);
+}
+
+// f, after every function it calls (depth first, on a stack of
+// (function, instruction to look at next): calls may run deep)
+static void
+emitAfterCallees(linkFct* f, linkFct** stack, int* next)
+{
+    linkFct* callee;
+    const irInstr* ins;
+    int top;
+
+    top = 0;
+    stack[0] = f;
+    next[0] = 0;
+    f->state = 1;
+    while ( (0 <= top) ){
+	f = stack[top];
+	if ( (next[top] == f->g->len) ){
+	    emitFunction(f);
+	    f->state = 2;
+	    top--;
+	    continue;
+	}
+	ins = &f->body[next[top]++];
+	if ( (IR_CALL != ins->op) )
+	    continue;
+	callee = findName(byName, numByName, ins->name);
+	if ( (1 == callee->state) )
+	    errExit(0, "recursion through %s (%s)", callee->name,
+		    units[callee->unit].m.file);
+	if ( (2 == callee->state) )
+	    continue;
+	callee->state = 1;
+	stack[++top] = callee;
+	next[top] = 0;
+    }
+}
+
+void
+link_units(const char** files, int n)
+{
+    linkUnit* u;
+    linkFct* main, ** stack;
+    const globalsFct* g;
+    irInstr* code;
+    char* srcName;
+    size_t len;
+    long numInstrs;
+    int* next;
+    int i, j, k;
+
+    numUnits = n;
+    if ( (NULL == (units = calloc(n, sizeof(linkUnit)))) )
+	errExit(1, "...calloc()...");
+    len = 1;
+    for (numInstrs = i = 0; i < n; i++){
+	u = &units[i];
+	globals_map(files[i], &u->m);
+	u->base = (0 == i)? 0 : units[i - 1].base + units[i - 1].m.h->numTemps;
+	if ( (INT_MAX - u->base < u->m.h->numTemps) )
+	    errExit(0, "too many temporaries");
+	u->fcts = calloc(u->m.h->numFcts + 1, sizeof(linkFct));
+	if ( (NULL == u->fcts) )
+	    errExit(1, "...calloc()...");
+	for (j = 0; j < (int) u->m.h->numFcts; j++){
+	    g = &u->m.fcts[j];
+	    if ( (LINK_IMPORT == g->linkage) )
+		continue;
+	    u->fcts[u->numFcts].name = globals_name(&u->m, g->name);
+	    u->fcts[u->numFcts].g = g;
+	    u->fcts[u->numFcts++].unit = i;
+	    numInstrs += g->len;
+	}
+	len += strlen(files[i]) + 2;
+    }
+
+    main = resolve();
+
+    code = malloc((numInstrs + 1) * sizeof(irInstr));
+    stack = malloc((numByName + 1) * sizeof(linkFct*));
+    next = malloc((numByName + 1) * sizeof(int));
+    if ( (NULL == code) || (NULL == stack) || (NULL == next) )
+	errExit(1, "...malloc()...");
+    for (k = i = 0; i < n; i++)
+	for (j = 0; j < units[i].numFcts; j++){
+	    units[i].fcts[j].body = code + k;
+	    k += units[i].fcts[j].g->len;
+	}
+    unpackAll();
+
+    srcName = arena_alloc(&compileArena, len);
+    srcName[0] = '\0';
+    for (i = 0; i < n; i++){
+	strcat(srcName, files[i]);
+	if ( (i + 1 < n) )
+	    strcat(srcName, ", ");
+    }
+    backend_open(1, srcName);
+    for (i = 0; i < n; i++)
+	for (j = 0; j < units[i].numFcts; j++)
+	    if ( (0 == units[i].fcts[j].state) && (main != &units[i].fcts[j]) )
+		emitAfterCallees(&units[i].fcts[j], stack, next);
+    emitFunction(main);
+
+    // Note: the backends may hold on to the names (in the units) and
+    //       the instructions, until they are closed; so all stays
+    free(next);
+    free(stack);
+}
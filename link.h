@@ -0,0 +1,20 @@
+/*******************************************************
+* link.h -             header file for link.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         // micro --compile=a.u a.mic; ... (per unit)
+*         backend_attach(...);    // or backend_recordProgram()
+*         link_units(files, n);   // instead of parsing
+*         backend_close();
+********************************************************/
+
+#ifndef LINK_H_
+#define LINK_H_
+
+#define LINK_THREADS 8    // most units unpacked at the same time
+
+void link_units(const char** files, int n);
+
+#endif
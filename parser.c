@@ -2,21 +2,57 @@
 * parser.c -          Recursive Descent Parser 
 * Language:           Micro
 *
+* The parser binds names, and checks what it can as it
+* goes; it builds the tree of each definition, and of
+* each statement of the main program (ast.c), which
+* the driver then hands to code generation (astgen.c).
 *****************************************************/
 
 #include "lexer.h"
 #include "error.h"
 #include "ast.h"
 #include "codegen.h"
+#include "pipeline.h"
+#include "phase.h"
+#include "parser.h"
 
 int curTok;
+tokRecord curRec;   // curTok, with its identifier or literal value
+
+static const char* fctName;  // of the definition under way, if any
+static int nesting;          // parentheses, calls, and blocks open
+
+// by: 1 - one more is open; -1 - it is closed
+// The descent (and astgen.c) recurses once per level: bounding
+// them bounds its depth, whatever the source
+static void
+nest(int by)
+{
+    if ( (MAX_NESTING < (nesting += by)) )
+	errExit(0, "nested too deeply (%d levels allowed)", MAX_NESTING);
+}
 
 //*****************************************************
 // helper routines / interface to driver.c and lexer.c
 //*****************************************************
 
 int
-getNextToken(int fd) { return (curTok = tokenize(fd)); }
+getNextToken(int fd)
+{
+    enum phase prev;
+
+    if (pipelined)
+	pipeline_getToken(&curRec);
+    else{
+	prev = phase_enter(PHASE_LEX);
+	curRec.tok = tokenize(fd, &curRec);
+	phase_leave(prev);
+    }
+    if ( (tok_ERROR == curRec.tok) )
+	lexer_raise();
+
+    return (curTok = curRec.tok);
+}
 
 // update = 0: curTok needs no updating before processing
 //        = 1: curTok needs updating
@@ -42,10 +78,18 @@ match(int update, int fd, token tok, int readAhead)
 //**********************************************************
 
 void Statement(int, int);
-exprRecord Declaration(int, int);
-exprRecord Expression(int, int);
-exprRecord Term(int, int);
-exprRecord Primary(int, int);
+void Block(int);
+int Statements(int);
+void If(int);
+void While(int);
+void Condition(int);
+void FunctionDef(int, int, int);
+void Import(int);
+void Call(int, struct nlist*);
+void Declaration(int, int);
+void Expression(int, int);
+void Term(int, int);
+void Primary(int, int);
 void expressionList(int, int);
 void idList(int, int);
 
@@ -55,36 +99,32 @@ void idList(int, int);
 //    program -> BEGIN statement-list END
 //    statement-list -> statement [statement]* (add back for functions)
 
-// type:  0 - assign; 1 - copy assignment
-static void
-castAndAssign(const exprRecord LHS, const exprRecord RHS, int type)
-{
-    exprRecord tmpRecord;
-
-    if ( (0 != checkCast(LHS, RHS)) ){  // cast RHS to type assigned to
-	tmpRecord = castRecord(RHS, LHS.type);
-	codegen_ASSIGN(LHS, tmpRecord, type);
-    }
-    else // LHS.type = RHS.type
-	codegen_ASSIGN(LHS, RHS, type);
-}
-
 // statement -> declaration
+//              BEGIN statement-list END  // nested block
 //              ID := expession;  // ID must be first declared
 //              read( id-list);
 //              write( expr-list);
+//              if
+//              while
 //
 // Upon starting the descent from driver.c, getNextToken() has been
 // called already; so curTok points to the right token.
 // Note:   function leaves 'clean', pointing to last processed token
+// Each statement is one node (AST_XXX), over those of its parts
 void
 Statement(int fd, int readToken)
 {
-    exprRecord LHS, RHS;
     struct nlist* pNL;
+    astIndex from;
+
+    from = ast_mark();
 
     switch(curTok){
 
+    case tok_BEGIN:
+	Block(fd);
+	break;
+
     case tok_DEC_INT:
 	Declaration(fd, INTEGER);
 	break;
@@ -99,126 +139,367 @@ Statement(int fd, int readToken)
 
     case tok_ID: // note: ID found has already been entered into the ast
 		 // and ST with a call to makeIDRec when first encountered
-	if ( (NULL == (pNL = lookup(symbolTable, identifierStr)) ) )
+	if ( (NULL == (pNL = lookup(&symbolTable, curRec.id)) ) )
 	    errExit(0, "cannot assign to undeclared identifier (%s)", 
-		    identifierStr);
-
-	// create a fake TMP object to handle processing more elegantly
-	strcpy(LHS.name, pNL->storage); 
-	LHS.kind = EXPR_TMP;
-	LHS.type = pNL->type;
+		    curRec.id);
+	if ( (FCT_IMPL == pNL->type) || (FCT_DECL == pNL->type) )
+	    errExit(0, "cannot assign to function (%s)", curRec.id);
 
 	match(1, fd, tok_ASSIGN, 0);
-	RHS = Expression(fd, 1);
-	castAndAssign(LHS, RHS, 0);
+	Expression(fd, 1);
+	ast_add(AST_ASSIGN, pNL->type, from)->sym = pNL;
 	match(0, fd, tok_SEMICOLON, 0);
 	break;
 
     case tok_READ:
-	puts("  successfully processed a function-statment: READ");
 	match(1, fd, tok_LPAREN, 0);
-	puts("  found primary: LPAREN");
 	idList(fd, 0);
 	match(0, fd, tok_RPAREN, 0);  // upon returning, idList looks ahead
-	puts("  found primary: RPAREN");
 	match(1, fd, tok_SEMICOLON, 0);
-	puts("  found primary: SEMICOLON");
+	ast_add(AST_READ, INVALID, from);
 	break;
 
     case tok_WRITE:
-	puts("  successfully processed a function-statment: WRITE");
 	match(1, fd, tok_LPAREN, 0);
-	puts("  found primary: LPAREN");
-	expressionList(fd, 0); /// CONFIRM
+	expressionList(fd, 0);
 	match(0, fd, tok_RPAREN, 0);  // see below
-	puts("  found primary: RPAREN");
 	match(1, fd, tok_SEMICOLON, 0);
-	puts("  found primary: SEMICOLON");
+	ast_add(AST_WRITE, INVALID, from);
+	break;
+
+    case tok_IF:
+	If(fd);
+	break;
+
+    case tok_WHILE:
+	While(fd);
+	break;
+
+    case tok_RETURN:
+	errExit(0, "return must be the last statement of a function");
 	break;
 
     default: errExit(0, "illegal expression"); break;
     } // end switch
 }
 
+// block -> BEGIN statement-list END
+//
+// Declarations in a block are local to it; they may hide outer ones.
+// Note: curTok points to BEGIN on entry, and to END when done
+void
+Block(int fd)
+{
+    astIndex from;
+
+    from = ast_mark();
+    nest(1);
+    enterScope(SCOPE_BLOCK);
+
+    while ( (tok_END != getNextToken(fd)) ){
+	if ( (tok_EOF == curTok) )
+	    errExit(0, "syntax error: block must end with token END");
+	if ( (tok_SEMICOLON == curTok) )
+	    continue; // allow empty statement
+	Statement(fd, 0);
+    }
+
+    exitScope();
+    nest(-1);
+    ast_add(AST_BLOCK, INVALID, from);
+}
+
+// statement-list, up to END or ELSE, in a block scope of its own
+// (an AST_BLOCK)
+//
+// Note: curTok points to the token before it on entry
+// Returns: the token ending it (curTok)
+int
+Statements(int fd)
+{
+    astIndex from;
+
+    from = ast_mark();
+    nest(1);
+    enterScope(SCOPE_BLOCK);
+
+    while ( (tok_END != getNextToken(fd)) && (tok_ELSE != curTok) ){
+	if ( (tok_EOF == curTok) )
+	    errExit(0, "syntax error: if and while must end with token END");
+	if ( (tok_SEMICOLON == curTok) )
+	    continue; // allow empty statement
+	Statement(fd, 0);
+    }
+
+    exitScope();
+    nest(-1);
+    ast_add(AST_BLOCK, INVALID, from);
+    return curTok;
+}
+
+// if -> IF condition THEN statement-list [ELSE statement-list] END
+//
+// Note: curTok points to IF on entry, and to END when done
+void
+If(int fd)
+{
+    astIndex from;
+
+    from = ast_mark();
+    Condition(fd);
+    match(0, fd, tok_THEN, 0);
+    if ( (tok_ELSE == Statements(fd)) && (tok_END != Statements(fd)) )
+	errExit(0, "syntax error: if has one else at most");
+    ast_add(AST_IF, INVALID, from);
+}
+
+// while -> WHILE condition DO statement-list END
+//
+// Note: curTok points to WHILE on entry, and to END when done
+void
+While(int fd)
+{
+    astIndex from;
+
+    from = ast_mark();
+    Condition(fd);
+    match(0, fd, tok_DO, 0);
+    if ( (tok_END != Statements(fd)) )
+	errExit(0, "syntax error: else without if");
+    ast_add(AST_WHILE, INVALID, from);
+}
+
+// condition -> expression [= | <> | < | <= | > | >=] expression
+//
+// Note: curTok points to the token before it on entry, and 1
+//       ahead when done
+void
+Condition(int fd)
+{
+    astIndex from;
+    int rel;
+
+    from = ast_mark();
+    Expression(fd, 1);
+    rel = curTok;
+    if ( (tok_EQ != rel) && (tok_NE != rel) && (tok_LT != rel) &&
+	 (tok_LE != rel) && (tok_GT != rel) && (tok_GE != rel) )
+	errExit(0, "syntax error: comparison expected in condition");
+    Expression(fd, 1);
+    ast_add(AST_COND, INVALID, from)->op = rel;
+}
+
+// Returns: type declared by tok; INVALID if it is not a type
+int
+declType(int tok)
+{
+    switch(tok){
+    case tok_DEC_INT: return INTEGER;
+    case tok_DEC_LONG: return LONG;
+    case tok_DEC_FLT: return FLOAT;
+    default: return INVALID;
+    }
+}
+
+// definition -> [EXPORT] function
+//               import
+//
+// Note: reads its first token; curTok points to the last one when done
+// Returns: 0 if that token does not start a definition (curTok)
+int
+Definition(int fd)
+{
+    int type;
+
+    switch(getNextToken(fd)){
+    case tok_EXPORT:
+	if ( (INVALID == (type = declType(getNextToken(fd))) ) )
+	    errExit(0, "syntax error: function expected after export");
+	FunctionDef(fd, type, LINK_EXPORT);
+	return 1;
+    case tok_IMPORT:
+	Import(fd);
+	return 1;
+    default:
+	if ( (INVALID == (type = declType(curTok))) )
+	    return 0;
+	FunctionDef(fd, type, LINK_LOCAL);
+	return 1;
+    }
+}
+
+// import -> IMPORT type ID ( [type ID [, type ID]*] ) ;
+//
+// a function defined (and exported) by another unit; the parameter
+// names are for the reader only
+// Note: curTok points to IMPORT on entry, to ; when done
+void
+Import(int fd)
+{
+    stringID name;
+    int paramType[MAX_PARAMS + 1];
+    int type, n;
+
+    if ( (INVALID == (type = declType(getNextToken(fd))) ) )
+	errExit(0, "syntax error: return type expected after import");
+    match(1, fd, tok_ID, 0);
+    strcpy(name, curRec.id);
+
+    match(1, fd, tok_LPAREN, 1);
+    for (n = 0; tok_RPAREN != curTok; n++){
+	if ( (MAX_PARAMS == n) )
+	    errExit(0, "too many parameters (%d allowed) in %s", MAX_PARAMS,
+		    name);
+	if ( (INVALID == (paramType[n] = declType(curTok)) ) )
+	    errExit(0, "syntax error: parameter type expected");
+	match(1, fd, tok_ID, 0);
+	if ( (tok_COMMA == getNextToken(fd)) && 
+	     (tok_RPAREN == getNextToken(fd)) )
+	    errExit(0, "syntax error: parameter type expected");
+    }
+    match(1, fd, tok_SEMICOLON, 0);
+
+    importFunction(name, type, paramType, n);
+}
+
+// function -> type ID ( [type ID [, type ID]*] )
+//             BEGIN statement-list RETURN expression; END
+//
+// linkage: LINK_LOCAL, or LINK_EXPORT
+// Note: curTok points to the return type on entry, to END when done
+// The parameters are bound in the function's scope; the function
+// itself is bound once its code is generated (endFunction())
+void
+FunctionDef(int fd, int type, int linkage)
+{
+    struct nlist* np;
+    astNode* n;
+    astIndex from, ret;
+    int paramType, numParams;
+
+    from = ast_mark();
+    match(1, fd, tok_ID, 0);
+    if ( (NULL != (np = lookup(&symbolTable, curRec.id)) ) &&
+	 (0 == np->scope) )
+	errExit(0, "attempting to re-define function (%s)", curRec.id);
+    fctName = arena_strdup(&astArena, curRec.id);
+    enterScope(SCOPE_FUNCTION);
+
+    match(1, fd, tok_LPAREN, 1);
+    numParams = 0;
+    while ( (tok_RPAREN != curTok) ){
+	if ( (INVALID == (paramType = declType(curTok)) ) )
+	    errExit(0, "syntax error: parameter type expected");
+	match(1, fd, tok_ID, 0);
+	if ( (MAX_PARAMS == numParams++) )
+	    errExit(0, "too many parameters (%d allowed) in %s", MAX_PARAMS,
+		    fctName);
+	if ( (NULL == (np = writeSymbolTable(EXPR_ID, curRec.id, 
+					     paramType)) ) )
+	    errExit(0, "duplicate parameter (%s) in %s", curRec.id, fctName);
+	ast_add(AST_PARAM, paramType, ast_mark())->sym = np;
+	if ( (tok_COMMA == getNextToken(fd)) && 
+	     (tok_RPAREN == getNextToken(fd)) )
+	    errExit(0, "syntax error: parameter type expected");
+    }
+
+    match(1, fd, tok_BEGIN, 0);
+    while ( (tok_RETURN != getNextToken(fd)) ){
+	if ( (tok_END == curTok) || (tok_EOF == curTok) )
+	    errExit(0, "syntax error: function must end with a return "
+		    "statement");
+	if ( (tok_SEMICOLON == curTok) )
+	    continue; // allow empty statement
+	Statement(fd, 0);
+    }
+
+    ret = ast_mark();
+    Expression(fd, 1);
+    ast_add(AST_RETURN, INVALID, ret);
+    match(0, fd, tok_SEMICOLON, 0);
+    match(1, fd, tok_END, 0);
+    exitScope();
+
+    n = ast_add(AST_FUNCTION, type, from);
+    n->name = fctName;
+    n->op = linkage;
+    fctName = NULL;
+}
+
 // declaration -> type id;
 //                type id = expr;
 //     (type in {int, long, float})
 // Note: when arriving here, type has already been found
-exprRecord
+void
 Declaration(int fd, int type)
 {
-    exprRecord LHS, RHS;
     struct nlist* LHS_S;
-    char tmpScope[15];
-    strcpy(tmpScope, "placeholder");
+    astIndex from;
 
     match(1, fd, tok_ID, 1);
 
-    if ( (NULL != readSymbolTable(identifierStr) ) )
-	errExit(0, "attempting to re-declare identifier (%s)", identifierStr);
+    // an outer one of the same name is hidden from here on
+    if ( (NULL != (LHS_S = readSymbolTable(curRec.id)) ) &&
+	 (currentScope() == LHS_S->scope) )
+	errExit(0, "attempting to re-declare identifier (%s)", curRec.id);
 
     // recall that we read one token ahead
     if ( !( (tok_SEMICOLON == curTok) || (tok_ASSIGN == curTok) ) )
 	errExit(0, "invalid symbol after declaration (%d)", curTok);
 
-    LHS_S = writeSymbolTable(EXPR_ID, identifierStr, type, tmpScope);
+    LHS_S = writeSymbolTable(EXPR_ID, curRec.id, type);
     if ( (NULL == LHS_S) )
-	errExit(0, "error inserting %s into symbol table", identifierStr);
-
-    LHS = makeIDRec(identifierStr);
-    codegen_DECLARE(LHS);
+	errExit(0, "error inserting %s into symbol table", curRec.id);
 
+    from = ast_mark();
     switch (curTok){
     case tok_SEMICOLON:  // declaration case 
 	break;
     case tok_ASSIGN:  // copy assignment case
-	RHS = Expression(fd, 1);
-	castAndAssign(LHS, RHS, 1);
+	Expression(fd, 1);
 	match(0, fd, tok_SEMICOLON, 0);
 	break;
     default: errExit(0, "illegal syntax in declaration"); break;
     }
-
-    return LHS;
+    ast_add(AST_DECL, type, from)->sym = LHS_S;
 }
 
 // expression -> term [ [PLUS|MINUS] term]*
 //
-exprRecord
+// An infix spans the one before it: (a + b) + c
+void
 Expression(int fd, int readToken)
 {
-    exprRecord LHS, RHS;
     opRecord opRec;
+    astIndex from;
 
-    LHS = Term(fd, readToken);
+    from = ast_mark();
+    Term(fd, readToken);
 
     while ( (curTok == tok_OP_PLUS)  || (curTok == tok_OP_MINUS) ){
 	opRec = makeOpRec(curTok);
-	RHS = Term(fd, 1);
-	LHS = generateInfix(LHS, opRec, RHS);
+	Term(fd, 1);
+	ast_add(AST_INFIX, INVALID, from)->op = opRec.op;
     }
     // at this point, curTok points ahead (e.g., to a ';')
-
-    return LHS;
 }
 
 // term -> primary [ [MUL|DIV] primary ]*
 //
-exprRecord
+void
 Term(int fd, int readToken)
 {
-    exprRecord LHS, RHS;
     opRecord opRec;
+    astIndex from;
 
-    LHS = Primary(fd, readToken);
+    from = ast_mark();
+    Primary(fd, readToken);
     while ( (curTok == tok_OP_MUL)  || (curTok == tok_OP_DIV) ){
 	opRec = makeOpRec(curTok);
-	RHS = Primary(fd, 1); // treat 'div by 0' as a run-time error; 
-	LHS = generateInfix(LHS, opRec, RHS);
+	Primary(fd, 1); // treat 'div by 0' as a run-time error; 
+	ast_add(AST_INFIX, INVALID, from)->op = opRec.op;
     }
     // at this point, curTok points ahead (e.g., to a ';')
-
-    return LHS;
 }
 
 
@@ -229,31 +510,41 @@ Term(int fd, int readToken)
 //            OP_PLUS
 //            OP_MINUS
 // Note: fct returns with curTok pointing 1 ahead
-exprRecord
+void
 Primary(int fd, int readToken)
 {
-    exprRecord ret;
+    struct nlist* pNL;
 
     if (readToken) getNextToken(fd);
 
     switch(curTok){
     case tok_LPAREN:
-	ret = Expression(fd, 1); 
+	nest(1);
+	Expression(fd, 1); 
 	match(0, fd, tok_RPAREN, 1); // Expression() reads ahead
+	nest(-1);
 	break;
 
     case tok_ID: 
 	// we cannot declare when we come here - done before
-	if ( (NULL == readSymbolTable(identifierStr)) )
+	if ( (NULL == (pNL = readSymbolTable(curRec.id)) ) )
 	    errExit(0, "illegal use of undeclared identifier (%s)", 
-		    identifierStr);
-	ret = makeIDRec(identifierStr);
+		    curRec.id);
+	if ( (FCT_IMPL == pNL->type) || (FCT_DECL == pNL->type) ){
+	    Call(fd, pNL);
+	    break;
+	}
+	ast_add(AST_ID, pNL->type, ast_mark())->sym = pNL;
+	getNextToken(fd);
+	break;
+
+    case tok_INT_LITERAL: // an int (not a long, say), unless converted
+	ast_add(AST_INT, INTEGER, ast_mark())->val_int = curRec.val_int;
 	getNextToken(fd);
 	break;
 
-    case tok_INT_LITERAL:
     case tok_FLT_LITERAL:
-	ret = makeLiteralRec(curTok);
+	ast_add(AST_FLT, FLOAT, ast_mark())->val_flt = curRec.val_flt;
 	getNextToken(fd);
 	break;
 	/*case tok_OP_MINUS:
@@ -263,8 +554,37 @@ Primary(int fd, int readToken)
 		*/
     default: errExit(0, "invalid primary"); break;
     }
+}
+
+// call -> ID ( [expression [, expression]*] )
+//
+// Note: curTok points to ID on entry, and 1 ahead when done
+void
+Call(int fd, struct nlist* fct)
+{
+    const fctRecord* f;
+    astIndex from;
+    int n;
+
+    from = ast_mark();
+    nest(1);
+    match(1, fd, tok_LPAREN, 1);
+    n = 0;
+    if ( (tok_RPAREN != curTok) ){
+	do{
+	    if ( (MAX_PARAMS == n) )
+		errExit(0, "too many arguments in call of %s", fct->name);
+	    Expression(fd, (0 != n));
+	    n++;
+	} while ( (tok_COMMA == curTok) );
+    }
+    match(0, fd, tok_RPAREN, 1);
+    nest(-1);
 
-    return ret;
+    f = fct->fct;
+    if ( (n != f->numParams) )
+	errExit(0, "%s takes %d arguments, not %d", f->name, f->numParams, n);
+    ast_add(AST_CALL, f->retType, from)->sym = fct;
 }
 
 //*************************************************************
@@ -282,36 +602,35 @@ Primary(int fd, int readToken)
 // Note: we enter having not yet confirmed any id
 // Note2: curTok should not point ahead upon entry
 // Note3: when done, curTok points ahead
+// Each id is read into, in order
 void
 idList(int fd, int readToken)
 {
-    puts("    checking for id-list");
-
-    match(1, fd, tok_ID, 0);
-    printf("      matched one ID - %s\n", identifierStr);
+    struct nlist* pNL;
 
-    while ( (tok_COMMA == getNextToken(fd)) ){
+    do{
 	match(1, fd, tok_ID, 0);
-	printf("      matched one ID - %s\n", identifierStr);
-    }
-
-    puts("    successfully matched an id-list");
+	if ( (NULL == (pNL = readSymbolTable(curRec.id)) ) )
+	    errExit(0, "cannot read into undeclared identifier (%s)", 
+		    curRec.id);
+	if ( (FCT_IMPL == pNL->type) || (FCT_DECL == pNL->type) )
+	    errExit(0, "cannot read into function (%s)", curRec.id);
+	if (fctName)
+	    errExit(0, "read() is not allowed in a function (%s)", fctName);
+	ast_add(AST_ID, pNL->type, ast_mark())->sym = pNL;
+    } while ( (tok_COMMA == getNextToken(fd)) );
 }
 
 // expression-list -> expression [, expression]*
 //
 // Note:     we enter having not yet confirmed any expression
 // Note 2:   when done, curTok points ahead
+// Each expression is written, in order
 void expressionList(int fd, int readToken)
 {
-    puts("  checking for expression-list");
-
     Expression(fd, 1);  // recall: we point ahead after
+    if (fctName)
+	errExit(0, "write() is not allowed in a function (%s)", fctName);
     while ( (tok_COMMA == curTok) )
 	Expression(fd, 1);  /// again, we'll point ahead 
-
-    puts("  successfully matched an expression-list");
 }
-
-
-
@@ -7,9 +7,15 @@
 #ifndef PARSER_H_
 #define PARSER_H_
 
+#define MAX_NESTING 4096 // of parentheses, calls, and blocks
+
 extern int curTok;
+extern tokRecord curRec;
 
 void Statement(int fd, int readToken);
+int Definition(int fd);
+void FunctionDef(int fd, int type, int linkage);
+int declType(int tok);
 int match(int update, int fd, token, int readAhead);
 int getNextToken(int);
 
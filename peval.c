@@ -0,0 +1,990 @@
+/*******************************************************
+* peval.c -            partial evaluation of the IR, as
+*                      codegen emits it
+* Language:            Micro
+*
+* Every slot is either known (a value fixed at compile
+* time) or not. A Declare makes its variable known (0);
+* an instruction whose operands are all known computes a
+* known value, and is dropped. Operands known are
+* replaced by their values, so that what is emitted is
+* the part of the program that depends on read() (and on
+* the parameters, in a function), or fails at run time.
+*
+* A declared variable is emitted (its Declare, deferred
+* until then) only once it takes a value not known. Its
+* later assignments of known values are dropped as well:
+* the code is straight-line, so every use after them is
+* rewritten.
+*
+* Values are computed with the semantics of batch.c.
+* Left to run time: integer division by 0 (an error),
+* and float results that are not finite (they have no
+* literal in the C backend).
+*
+* Slots not known have a range: the interval of values
+* they may take (int, long), seeded by the literals and
+* by their types (read(), parameters and calls: the whole
+* type), and carried through the arithmetic. With it,
+* conversions of an int (Promote to long, Convert to
+* float) wait until their value is used:
+*   - a long Add/Sub/Mul/Div, or a float Add/Sub/Mul,
+*     whose operands are ints so converted (or literals
+*     that are) is done as an int one when its range
+*     says it cannot overflow, and its result is the
+*     conversion, waiting in turn;
+*   - a conversion of one composes with it: int to long
+*     (or float) and back is the int itself (a copy:
+*     uses read the int); int to long to float is int
+*     to float;
+*   - an Assign of one to a variable converts into it;
+*   - any other use emits the conversion first, as does
+*     a change of the int converted; the ARGs of a call
+*     are held until its CALL, so that what their uses
+*     emit comes ahead of them all (see ir.h).
+* Conversions never used are never emitted. Float
+* results are exact: |values| < 2^53, and no -0.
+*
+* Control flow: values flow along the code as written up
+* to a branch or jump, where every variable known gets
+* its value stored (its Declare, and an Assign of what
+* was dropped since), as the code jumped to reads it from
+* the slot. A label, where paths join, forgets all that
+* is known of the variables, and what waits. A branch of
+* known operands is a Jump, or nothing.
+********************************************************/
+
+#include <limits.h>
+#include <math.h>
+#include "compiler.h"
+#include "peval.h"
+#include "codegen.h"
+#include "strength.h"
+
+static int enabled = 1;
+
+typedef struct range{
+    long lo, hi;
+    int set;              // 0: the whole type
+} range;
+
+static irOperand* value;  // per slot: OPND_NONE - not known
+static irInstr* decl;     // per slot: its Declare, not emitted yet
+			  // (name: NULL if none)
+static irInstr* conv;     // per slot: its conversion of an int slot
+			  // (a), not emitted yet (dest: OPND_NONE if
+			  // none; IR_ASSIGN: a copy)
+static range* ranges;     // per slot, if not known
+static int numSlots;
+
+static int* pending;      // slots that may have a conversion waiting
+static int numPending, capPending;
+
+static irInstr* out;      // peval_instr()'s instructions to emit
+static int numOut, capOut;
+
+static irInstr* args;     // the ARGs of the call under way, held
+static int numArgs, capArgs; // until its CALL (see hold())
+
+static char* isVar;       // per slot: 1 - a variable in scope
+static char* unsaved;     // per slot: 1 - its value known was not
+			  // stored (its Assigns were dropped)
+static int* vars;         // variables of the function, so far
+static int numVars, capVars;
+static char* isDirty;     // per slot: 1 - in dirty
+static int* dirty;        // variables written since the last label:
+static int numDirty, capDirty; // the others are not known
+static int fallsThrough = 1;  // 0: what was put last is a Jump
+
+void
+peval_setEnabled(int on) { enabled = on; }
+
+int
+peval_enabled(void) { return enabled; }
+
+static void
+grow(int slot)
+{
+    int n;
+
+    if ( (slot < numSlots) )
+	return;
+    for (n = (numSlots)? numSlots : 256; n <= slot; n *= 2)
+	;
+    if ( (NULL == (value = realloc(value, n * sizeof(irOperand)))) ||
+	 (NULL == (decl = realloc(decl, n * sizeof(irInstr)))) ||
+	 (NULL == (conv = realloc(conv, n * sizeof(irInstr)))) ||
+	 (NULL == (ranges = realloc(ranges, n * sizeof(range)))) ||
+	 (NULL == (isVar = realloc(isVar, n))) ||
+	 (NULL == (unsaved = realloc(unsaved, n))) ||
+	 (NULL == (isDirty = realloc(isDirty, n))) )
+	errExit(1, "...realloc()...");
+    memset(value + numSlots, 0, (n - numSlots) * sizeof(irOperand));
+    memset(decl + numSlots, 0, (n - numSlots) * sizeof(irInstr));
+    memset(conv + numSlots, 0, (n - numSlots) * sizeof(irInstr));
+    memset(ranges + numSlots, 0, (n - numSlots) * sizeof(range));
+    memset(isVar + numSlots, 0, n - numSlots);
+    memset(unsaved + numSlots, 0, n - numSlots);
+    memset(isDirty + numSlots, 0, n - numSlots);
+    numSlots = n;
+}
+
+static void
+put(const irInstr* ins)
+{
+    if ( (numOut == capOut) ){
+	capOut = (capOut)? 2 * capOut : 16;
+	if ( (NULL == (out = realloc(out, capOut * sizeof(irInstr)))) )
+	    errExit(1, "...realloc()...");
+    }
+    out[numOut++] = *ins;
+    fallsThrough = (IR_JUMP != ins->op);
+}
+
+// ins: an ARG; the ARGs of a call go right before it (ir.h), with
+// whatever conversions of their values waited put ahead of them all
+static void
+hold(const irInstr* ins)
+{
+    if ( (numArgs == capArgs) ){
+	capArgs = (capArgs)? 2 * capArgs : 16;
+	if ( (NULL == (args = realloc(args, capArgs * sizeof(irInstr)))) )
+	    errExit(1, "...realloc()...");
+    }
+    args[numArgs++] = *ins;
+}
+
+// ahead of a CALL: the ARGs held for it
+static void
+putArgs(void)
+{
+    int i;
+
+    for (i = 0; i < numArgs; i++)
+	put(&args[i]);
+    numArgs = 0;
+}
+
+static int
+isLiteral(const irOperand* o)
+{
+    return (OPND_INT == o->kind) || (OPND_FLT == o->kind);
+}
+
+/***************************************************
+* Folding
+*
+****************************************************/
+
+static long
+intOf(const irOperand* o)
+{
+    return (OPND_FLT == o->kind)? (long) o->val_flt : o->val_int;
+}
+
+static double
+fltOf(const irOperand* o)
+{
+    return (OPND_FLT == o->kind)? o->val_flt : (double) o->val_int;
+}
+
+static int
+fltToInt(double x)
+{
+    if ( !( (x > (double) INT_MIN - 1.0) && (x < (double) INT_MAX + 1.0) ) )
+	return INT_MIN;
+    return (int) x;
+}
+
+static long
+fltToLong(double x)
+{
+    if ( !( (x >= (double) LONG_MIN) && (x < -(double) LONG_MIN) ) )
+	return LONG_MIN;
+    return (long) x;
+}
+
+static int
+foldInt(enum irOp op, int x, int y, int* r)
+{
+    switch(op){
+    case IR_ADD: *r = (int) ((unsigned) x + (unsigned) y); break;
+    case IR_SUB: *r = (int) ((unsigned) x - (unsigned) y); break;
+    case IR_MUL: *r = (int) ((unsigned) x * (unsigned) y); break;
+    case IR_DIV:
+	if ( (0 == y) )
+	    return 0;
+	*r = (-1 == y)? (int) (0u - (unsigned) x) : x / y;
+	break;
+    case IR_SHL:
+    case IR_SAR:
+    case IR_SHR:
+    case IR_MULHI: strength_apply(op, INTEGER, r, &x, y, 1); break;
+    default: return 0;
+    }
+    return 1;
+}
+
+static int
+foldLong(enum irOp op, long x, long y, long* r)
+{
+    switch(op){
+    case IR_ADD: *r = (long) ((unsigned long) x + (unsigned long) y); break;
+    case IR_SUB: *r = (long) ((unsigned long) x - (unsigned long) y); break;
+    case IR_MUL: *r = (long) ((unsigned long) x * (unsigned long) y); break;
+    case IR_DIV:
+	if ( (0 == y) )
+	    return 0;
+	*r = (-1 == y)? (long) (0ul - (unsigned long) x) : x / y;
+	break;
+    case IR_SHL:
+    case IR_SAR:
+    case IR_SHR:
+    case IR_MULHI: strength_apply(op, LONG, r, &x, y, 1); break;
+    default: return 0;
+    }
+    return 1;
+}
+
+static int
+foldFlt(enum irOp op, double x, double y, double* r)
+{
+    switch(op){
+    case IR_ADD: *r = x + y; break;
+    case IR_SUB: *r = x - y; break;
+    case IR_MUL: *r = x * y; break;
+    case IR_DIV: *r = x / y; break;
+    default: return 0;
+    }
+    return isfinite(*r);
+}
+
+// a, b: literals (b unused by Promote and Convert, whose
+// source type is a's); type: of the result
+// Returns: 1 if the value of (op a b) is known (put in *res)
+int
+peval_fold(enum irOp op, int type, const irOperand* a,
+	   const irOperand* b, irOperand* res)
+{
+    int i;
+    long l;
+    double f;
+
+    res->kind = (FLOAT == type)? OPND_FLT : OPND_INT;
+    res->type = type;
+
+    if ( (IR_PROMOTE == op) || (IR_CONVERT == op) ){
+	if ( (FLOAT == type) )
+	    res->val_flt = (FLOAT == a->type)? fltOf(a) :
+		(INTEGER == a->type)? (double) (int) intOf(a) :
+		(double) intOf(a);
+	else if ( (INTEGER == type) )
+	    res->val_int = (FLOAT == a->type)? fltToInt(fltOf(a)) :
+		(int) intOf(a);
+	else
+	    res->val_int = (FLOAT == a->type)? fltToLong(fltOf(a)) :
+		(INTEGER == a->type)? (long) (int) intOf(a) : intOf(a);
+	return (FLOAT != type) || isfinite(res->val_flt);
+    }
+
+    switch(type){
+    case INTEGER:
+	if ( !foldInt(op, (int) intOf(a), (int) intOf(b), &i) )
+	    return 0;
+	res->val_int = i;
+	return 1;
+    case LONG:
+	if ( !foldLong(op, intOf(a), intOf(b), &l) )
+	    return 0;
+	res->val_int = l;
+	return 1;
+    case FLOAT:
+	if ( !foldFlt(op, fltOf(a), fltOf(b), &f) )
+	    return 0;
+	res->val_flt = f;
+	return 1;
+    default:
+	return 0;
+    }
+}
+
+static void
+setKnown(int slot, const irOperand* val)
+{
+    grow(slot);
+    value[slot] = *val;
+    if ( (INTEGER == val->type) && (OPND_INT == val->kind) )
+	value[slot].val_int = (int) val->val_int; // int literals wrap
+}
+
+// slot takes a value only known at run time; its Declare, if
+// still deferred, is emitted
+static void
+setUnknown(int slot)
+{
+    grow(slot);
+    value[slot].kind = OPND_NONE;
+    if ( (NULL == decl[slot].name) )
+	return;
+    put(&decl[slot]);
+    decl[slot].name = NULL;
+}
+
+/***************************************************
+* Ranges
+*
+****************************************************/
+
+static range
+wholeType(int type)
+{
+    range r;
+
+    r.set = 0;
+    r.lo = (INTEGER == type)? INT_MIN : LONG_MIN;
+    r.hi = (INTEGER == type)? INT_MAX : LONG_MAX;
+    return r;
+}
+
+// o: an int or long literal, or slot
+static range
+rangeOf(const irOperand* o)
+{
+    range r;
+
+    if ( (OPND_INT == o->kind) ){
+	r.lo = r.hi = o->val_int;
+	r.set = 1;
+	return r;
+    }
+    if ( (OPND_SLOT == o->kind) && (o->slot < numSlots) &&
+	 ranges[o->slot].set )
+	return ranges[o->slot];
+    return wholeType(o->type);
+}
+
+// Returns: lo..hi as a range of type; the whole type if it
+//          does not fit (the result wraps)
+static range
+clip(__int128 lo, __int128 hi, int type)
+{
+    range r;
+
+    r = wholeType(type);
+    if ( (lo < r.lo) || (hi > r.hi) )
+	return r;
+    r.lo = (long) lo;
+    r.hi = (long) hi;
+    r.set = 1;
+    return r;
+}
+
+static range
+corners(__int128 x1, __int128 x2, __int128 x3, __int128 x4, int type)
+{
+    __int128 lo, hi;
+
+    lo = min(min(x1, x2), min(x3, x4));
+    hi = max(max(x1, x2), max(x3, x4));
+    return clip(lo, hi, type);
+}
+
+// Returns: the range of (op a b), of type (INTEGER, LONG)
+static range
+opRange(enum irOp op, int type, const irOperand* a, const irOperand* b)
+{
+    range x, y;
+    __int128 m;
+    int k, w;
+
+    x = rangeOf(a);
+    w = (INTEGER == type)? 32 : 64;
+    switch(op){
+    case IR_ASSIGN: case IR_PROMOTE:
+	return clip(x.lo, x.hi, type);
+    case IR_CONVERT:
+	return (FLOAT == a->type)? wholeType(type) : clip(x.lo, x.hi, type);
+    case IR_ADD:
+	y = rangeOf(b);
+	return clip((__int128) x.lo + y.lo, (__int128) x.hi + y.hi, type);
+    case IR_SUB:
+	y = rangeOf(b);
+	return clip((__int128) x.lo - y.hi, (__int128) x.hi - y.lo, type);
+    case IR_MUL:
+	y = rangeOf(b);
+	return corners((__int128) x.lo * y.lo, (__int128) x.lo * y.hi,
+		       (__int128) x.hi * y.lo, (__int128) x.hi * y.hi, type);
+    case IR_DIV:
+	y = rangeOf(b);
+	if ( (0 < y.lo) || (0 > y.hi) )
+	    return corners((__int128) x.lo / y.lo, (__int128) x.lo / y.hi,
+			   (__int128) x.hi / y.lo, (__int128) x.hi / y.hi, type);
+	m = max(-(__int128) x.lo, (__int128) x.hi); // |quotient| <= |x|
+	return clip(-m, m, type);
+    case IR_MULHI:
+	if ( (OPND_INT != b->kind) )
+	    break;
+	m = b->val_int;
+	return corners(((__int128) x.lo * m) >> w, ((__int128) x.hi * m) >> w,
+		       ((__int128) x.lo * m) >> w, ((__int128) x.hi * m) >> w,
+		       type);
+    case IR_SHL: case IR_SAR: case IR_SHR:
+	if ( (OPND_INT != b->kind) || (0 > b->val_int) || (w <= b->val_int) )
+	    break;
+	k = b->val_int;
+	if ( (IR_SHL == op) )
+	    return clip((__int128) x.lo << k, (__int128) x.hi << k, type);
+	if ( (IR_SAR == op) || (0 <= x.lo) )
+	    return clip(x.lo >> k, x.hi >> k, type);
+	if ( (0 < k) ) // logical shift of a negative: up to 2^(w-k) - 1
+	    return clip(0, (((__int128) 1) << (w - k)) - 1, type);
+	break;
+    default:
+	break;
+    }
+    return wholeType(type);
+}
+
+/***************************************************
+* Conversions waiting
+*
+****************************************************/
+
+static int
+isPending(int slot)
+{
+    return (slot < numSlots) && (OPND_SLOT == conv[slot].dest.kind);
+}
+
+// Returns: 1 if a conversion into slot may wait: a temp's does, but a
+//          variable's would not be stored ahead of a jump (store())
+static int
+mayWait(int slot)
+{
+    return (slot >= numSlots) || !isVar[slot];
+}
+
+// conversion c (of an int slot: c->a) waits until its dest is used
+static void
+setPending(const irInstr* c)
+{
+    int slot;
+
+    slot = c->dest.slot;
+    grow(slot);
+    conv[slot] = *c;
+    ranges[slot] = rangeOf(&c->a);
+    if ( (numPending == capPending) ){
+	capPending = (capPending)? 2 * capPending : 64;
+	if ( (NULL == (pending = realloc(pending,
+					 capPending * sizeof(int)))) )
+	    errExit(1, "...realloc()...");
+    }
+    pending[numPending++] = slot;
+}
+
+static void
+emitPending(int slot)
+{
+    put(&conv[slot]);
+    conv[slot].dest.kind = OPND_NONE;
+}
+
+static void markDirty(int slot);
+
+// slot is about to change: conversions of it are emitted first,
+// and its own is dropped (never used)
+static void
+changing(int slot)
+{
+    int i, n;
+
+    markDirty(slot);
+    for (n = i = 0; i < numPending; i++){
+	if ( !isPending(pending[i]) )
+	    continue;
+	if ( (slot == pending[i]) )
+	    conv[slot].dest.kind = OPND_NONE;
+	else if ( (slot == conv[pending[i]].a.slot) )
+	    emitPending(pending[i]);
+	else
+	    pending[n++] = pending[i];
+    }
+    numPending = n;
+}
+
+// at the end of a function: what waits is dead
+static void
+dropPending(void)
+{
+    int i;
+
+    for (i = 0; i < numPending; i++)
+	if ( isPending(pending[i]) )
+	    conv[pending[i]].dest.kind = OPND_NONE;
+    numPending = 0;
+}
+
+// o, an operand of type (LONG: Promote, FLOAT: Convert), is
+// that of an int
+// Returns: 1 if so (the int put in *res)
+static int
+intForm(const irOperand* o, int type, irOperand* res)
+{
+    if ( (OPND_INT == o->kind) && (LONG == type) &&
+	 (INT_MIN <= o->val_int) && (INT_MAX >= o->val_int) ){
+	*res = *o;
+	res->type = INTEGER;
+	return 1;
+    }
+    if ( (OPND_FLT == o->kind) && (FLOAT == type) &&
+	 (o->val_flt >= INT_MIN) && (o->val_flt <= INT_MAX) &&
+	 ((double) (int) o->val_flt == o->val_flt) &&
+	 !( (0.0 == o->val_flt) && signbit(o->val_flt) ) ){
+	res->kind = OPND_INT;
+	res->type = INTEGER;
+	res->val_int = (int) o->val_flt;
+	return 1;
+    }
+    if ( (OPND_SLOT == o->kind) && isPending(o->slot) &&
+	 (type == conv[o->slot].type) && (IR_ASSIGN != conv[o->slot].op) ){
+	*res = conv[o->slot].a;
+	return 1;
+    }
+    return 0;
+}
+
+static void setRange(const irInstr* ins);
+
+// ins: a long or float operation on ints converted
+// Returns: 1 if it was done as an int one, its dest the conversion
+//          of the result (waiting, unless a variable's)
+static int
+narrow(const irInstr* ins)
+{
+    irInstr op, c;
+    irOperand a, b;
+    range r, x, y;
+
+    if ( (IR_ADD != ins->op) && (IR_SUB != ins->op) &&
+	 (IR_MUL != ins->op) && (IR_DIV != ins->op) )
+	return 0;
+    if ( (INTEGER == ins->type) || ( (FLOAT == ins->type) &&
+				     (IR_DIV == ins->op) ) )
+	return 0;
+    if ( (OPND_SLOT != ins->a.kind) && (OPND_SLOT != ins->b.kind) )
+	return 0;
+    if ( !intForm(&ins->a, ins->type, &a) || !intForm(&ins->b, ins->type, &b) )
+	return 0;
+
+    r = opRange(ins->op, LONG, &a, &b); // exact: the operands are ints
+    if ( !r.set || (INT_MIN > r.lo) || (INT_MAX < r.hi) )
+	return 0;
+    x = rangeOf(&a);
+    y = rangeOf(&b);
+    if ( (FLOAT == ins->type) && (IR_MUL == ins->op) &&
+	 ( ( (0 >= x.lo) && (0 <= x.hi) && (0 > y.lo) ) ||
+	   ( (0 >= y.lo) && (0 <= y.hi) && (0 > x.lo) ) ) )
+	return 0; // 0 * -y is -0.0 in float
+
+    op = *ins;
+    op.type = INTEGER;
+    op.dest.type = INTEGER;
+    op.dest.slot = assignNewTemp();
+    op.a = a;
+    op.b = b;
+    grow(op.dest.slot);
+    ranges[op.dest.slot] = r;
+    put(&op);
+
+    changing(ins->dest.slot);
+    setUnknown(ins->dest.slot);
+    c = *ins;
+    c.op = (LONG == ins->type)? IR_PROMOTE : IR_CONVERT;
+    c.a = op.dest;
+    c.b.kind = OPND_NONE;
+    if ( !mayWait(ins->dest.slot) ){
+	setRange(&c);
+	put(&c);
+    }
+    else
+	setPending(&c);
+    return 1;
+}
+
+/***************************************************
+* Control flow
+*
+****************************************************/
+
+// slot is written: if a variable, store() and forget() see to it
+static void
+markDirty(int slot)
+{
+    if ( (slot >= numSlots) || !isVar[slot] || isDirty[slot] )
+	return;
+    isDirty[slot] = 1;
+    if ( (numDirty == capDirty) ){
+	capDirty = (capDirty)? 2 * capDirty : 64;
+	if ( (NULL == (dirty = realloc(dirty, capDirty * sizeof(int)))) )
+	    errExit(1, "...realloc()...");
+    }
+    dirty[numDirty++] = slot;
+}
+
+static void
+addVar(int slot)
+{
+    grow(slot);
+    if ( isVar[slot] )
+	return;
+    isVar[slot] = 1;
+    if ( (numVars == capVars) ){
+	capVars = (capVars)? 2 * capVars : 64;
+	if ( (NULL == (vars = realloc(vars, capVars * sizeof(int)))) )
+	    errExit(1, "...realloc()...");
+    }
+    vars[numVars++] = slot;
+    markDirty(slot);
+}
+
+// the variable in slot went out of scope: its value need not be
+// stored any more
+void
+peval_dead(int slot)
+{
+    if ( (slot < numSlots) )
+	isVar[slot] = 0;
+}
+
+// at the start and end of a function
+static void
+dropVars(void)
+{
+    int i;
+
+    for (i = 0; i < numVars; i++)
+	isVar[vars[i]] = 0;
+    for (i = 0; i < numDirty; i++)
+	isDirty[dirty[i]] = 0;
+    numVars = numDirty = 0;
+}
+
+static int
+isZero(const irOperand* v)
+{
+    if ( (OPND_FLT == v->kind) )
+	return (0.0 == v->val_flt) && !signbit(v->val_flt);
+    return (0 == v->val_int);
+}
+
+// ahead of a branch or jump: the variables known get their values
+// stored in their slots (those out of scope leave the list)
+static void
+store(void)
+{
+    irInstr a;
+    int i, n, s;
+
+    for (n = i = 0; i < numDirty; i++){
+	if ( !isVar[s = dirty[i]] ){
+	    isDirty[s] = 0;
+	    continue;
+	}
+	dirty[n++] = s;
+	if ( (OPND_NONE == value[s].kind) )
+	    continue;
+	if ( (NULL != decl[s].name) ){
+	    put(&decl[s]);
+	    decl[s].name = NULL;
+	    unsaved[s] = !isZero(&value[s]);
+	}
+	if ( !unsaved[s] )
+	    continue;
+	a.op = IR_ASSIGN;
+	a.type = value[s].type;
+	a.dest.kind = OPND_SLOT;
+	a.dest.type = a.type;
+	a.dest.slot = s;
+	a.a = value[s];
+	a.b.kind = OPND_NONE;
+	a.name = NULL;
+	put(&a);
+	unsaved[s] = 0;
+    }
+    numDirty = n;
+}
+
+// at a label: nothing is known of the variables (their values were
+// stored on every path here), and nothing waits
+// Note: after a Jump, the code up to the label is dead, but what
+//       follows may still read the variables declared there (the
+//       loop of "if 1 > 2 then int i; while i < n do ..."): their
+//       Declares are put, dead too, so that they are defined
+static void
+forget(void)
+{
+    int i, s;
+
+    for (i = 0; i < numDirty; i++){
+	s = dirty[i];
+	if ( isVar[s] && (NULL != decl[s].name) )
+	    put(&decl[s]);
+	value[s].kind = OPND_NONE;
+	ranges[s].set = 0;
+	decl[s].name = NULL;
+	unsaved[s] = 0;
+	isDirty[s] = 0;
+    }
+    numDirty = 0;
+    dropPending();
+}
+
+// Returns: 1 if (a rel b) holds, rel that of branch op; a, b are
+//          literals of type
+static int
+holds(enum irOp op, int type, const irOperand* a, const irOperand* b)
+{
+    double x, y;
+    long i, j;
+
+    if ( (FLOAT == type) ){
+	x = fltOf(a);
+	y = fltOf(b);
+	switch(op){
+	case IR_BEQ: return x == y;
+	case IR_BNE: return x != y;
+	case IR_BLT: return x < y;
+	case IR_BLE: return x <= y;
+	case IR_BGT: return x > y;
+	default: return x >= y;
+	}
+    }
+    i = intOf(a);
+    j = intOf(b);
+    if ( (INTEGER == type) ){
+	i = (int) i;
+	j = (int) j;
+    }
+    switch(op){
+    case IR_BEQ: return i == j;
+    case IR_BNE: return i != j;
+    case IR_BLT: return i < j;
+    case IR_BLE: return i <= j;
+    case IR_BGT: return i > j;
+    default: return i >= j;
+    }
+}
+
+// ins: a label, jump, or branch (known: of literal operands)
+static void
+flow(irInstr* ins, int known)
+{
+    if ( (IR_LABEL == ins->op) ){
+	if (fallsThrough)
+	    store();
+	forget();
+	put(ins);
+	return;
+    }
+
+    if ( known && (IR_JUMP != ins->op) ){
+	if ( !holds(ins->op, ins->type, &ins->a, &ins->b) )
+	    return; // never taken
+	ins->op = IR_JUMP;
+	ins->type = INVALID;
+	ins->a.kind = ins->b.kind = OPND_NONE;
+    }
+    store();
+    put(ins);
+}
+
+/***************************************************
+* Rewriting
+*
+****************************************************/
+
+// Returns: 1 if opnd is a literal (if it was a slot known, it is
+//          replaced by the value)
+int
+peval_value(irOperand* opnd)
+{
+    int type;
+
+    if ( (OPND_SLOT == opnd->kind) && enabled && (opnd->slot < numSlots) &&
+	 (OPND_NONE != value[opnd->slot].kind) ){
+	type = opnd->type;
+	*opnd = value[opnd->slot];
+	opnd->type = type;
+    }
+    return isLiteral(opnd);
+}
+
+// o: an operand read; if it is a copy waiting, its int is read
+static void
+readCopy(irOperand* o)
+{
+    if ( (OPND_SLOT == o->kind) && isPending(o->slot) &&
+	 (IR_ASSIGN == conv[o->slot].op) )
+	*o = conv[o->slot].a;
+}
+
+// o: an operand read; any conversion of it waiting is emitted
+static void
+use(irOperand* o)
+{
+    readCopy(o);
+    if ( (OPND_SLOT == o->kind) && isPending(o->slot) )
+	emitPending(o->slot);
+}
+
+// ins: a Promote/Convert; its operand, an int, or a conversion of
+// one, waiting
+// Returns: 1 if ins waits too (as the conversion of the int)
+static int
+compose(const irInstr* ins)
+{
+    irInstr c;
+
+    if ( !mayWait(ins->dest.slot) )
+	return 0;
+    c = *ins;
+    if ( (OPND_SLOT == ins->a.kind) && isPending(ins->a.slot) )
+	c.a = conv[ins->a.slot].a;
+    else if ( (OPND_SLOT != ins->a.kind) || (INTEGER != ins->a.type) )
+	return 0;
+
+    if ( (INTEGER == c.type) )
+	c.op = IR_ASSIGN;
+    else
+	c.op = (LONG == c.type)? IR_PROMOTE : IR_CONVERT;
+    changing(c.dest.slot);
+    setUnknown(c.dest.slot);
+    setPending(&c);
+    return 1;
+}
+
+// dest: written by ins, which is emitted (or waits)
+static void
+setRange(const irInstr* ins)
+{
+    int slot;
+
+    slot = ins->dest.slot;
+    if ( (FLOAT == ins->type) )
+	ranges[slot].set = 0;
+    else if ( (IR_DECLARE == ins->op) || (IR_READ == ins->op) ||
+	      (IR_PARAM == ins->op) || (IR_CALL == ins->op) )
+	ranges[slot] = wholeType(ins->type);
+    else
+	ranges[slot] = opRange(ins->op, ins->type, &ins->a, &ins->b);
+}
+
+// puts what is to be emitted for in
+static void
+rewrite(const irInstr* in)
+{
+    irInstr ins;
+    irOperand val;
+    int ka, kb, folded;
+
+    ins = *in;
+    if ( (IR_FUNCTION == ins.op) || (IR_END == ins.op) ){
+	dropPending();
+	dropVars();
+    }
+
+    ka = peval_value(&ins.a);
+    kb = peval_value(&ins.b);
+
+    if ( narrow(&ins) )
+	return;
+    if ( (IR_ASSIGN == ins.op) && (OPND_SLOT == ins.a.kind) &&
+	 isPending(ins.a.slot) && (IR_ASSIGN != conv[ins.a.slot].op) ){
+	ins.op = conv[ins.a.slot].op; // convert into the variable
+	ins.a = conv[ins.a.slot].a;
+    }
+    else if ( (IR_PROMOTE == ins.op) || (IR_CONVERT == ins.op) ){
+	readCopy(&ins.a);
+	if ( !ka && compose(&ins) )
+	    return;
+    }
+    use(&ins.a);
+    use(&ins.b);
+    if ( (IR_ARG == ins.op) ){
+	hold(&ins);
+	return;
+    }
+    if ( (IR_LABEL <= ins.op) ){
+	flow(&ins, ka && kb);
+	return;
+    }
+
+    folded = 0;
+    switch(ins.op){
+    case IR_DECLARE:
+	val.kind = (FLOAT == ins.type)? OPND_FLT : OPND_INT;
+	val.type = ins.type;
+	val.val_int = 0;
+	if ( (FLOAT == ins.type) )
+	    val.val_flt = 0.0;
+	changing(ins.dest.slot);
+	setKnown(ins.dest.slot, &val);
+	decl[ins.dest.slot] = ins;
+	addVar(ins.dest.slot);
+	unsaved[ins.dest.slot] = 0;
+	return;
+
+    case IR_ASSIGN:
+	if ( !ka )
+	    break;
+	val = ins.a;
+	folded = 1;
+	break;
+
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV:
+    case IR_SHL: case IR_SAR: case IR_SHR: case IR_MULHI:
+	if ( !ka || !kb )
+	    break;
+	// fall through
+    case IR_PROMOTE: case IR_CONVERT:
+	folded = ka && peval_fold(ins.op, ins.type, &ins.a, &ins.b, &val);
+	break;
+
+    default:
+	break;
+    }
+
+    // READ, PARAM, CALL, and whatever was not folded
+    if ( (OPND_SLOT == ins.dest.kind) ){
+	changing(ins.dest.slot);
+	if ( (IR_PARAM == ins.op) )
+	    addVar(ins.dest.slot);
+	if (folded){
+	    setKnown(ins.dest.slot, &val);
+	    unsaved[ins.dest.slot] = 1;
+	    return;
+	}
+	setUnknown(ins.dest.slot);
+	setRange(&ins);
+    }
+    if ( (IR_CALL == ins.op) )
+	putArgs();
+    put(&ins);
+}
+
+// ins: as codegen would emit it
+// Returns: the number of instructions to emit in its place (put in
+//          *res, valid until the next call): 0 - it is folded away,
+//          or waits
+int
+peval_instr(const irInstr* ins, const irInstr** res)
+{
+    numOut = 0;
+    if (enabled)
+	rewrite(ins);
+    else
+	put(ins);
+    *res = out;
+    return numOut;
+}
@@ -0,0 +1,30 @@
+/*******************************************************
+* peval.h -            header file for peval.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         const irInstr* res;
+*         n = peval_instr(&ins, &res); // what to emit for ins:
+*         for (i = 0; i < n; i++)      // none if folded away
+*             emit(&res[i]);
+*         if ( peval_value(&opnd) )    // opnd is a literal now
+*         ok = peval_fold(IR_ADD, INTEGER, &a, &b, &res);
+*         peval_dead(slot);            // its variable left scope
+*         peval_setEnabled(0);         // --no-fold
+********************************************************/
+
+#ifndef PEVAL_H_
+#define PEVAL_H_
+
+#include "ir.h"
+
+void peval_setEnabled(int on);
+int peval_enabled(void);
+int peval_instr(const irInstr* ins, const irInstr** res);
+int peval_value(irOperand* opnd);
+void peval_dead(int slot);
+int peval_fold(enum irOp op, int type, const irOperand* a,
+	       const irOperand* b, irOperand* res);
+
+#endif
@@ -0,0 +1,87 @@
+/*******************************************************
+* phase.c -            where compile time goes
+* Language:            Micro
+*
+* With --time-phases, the time from phase_start() to
+* phase_stop() is charged to the phase running: lex (the
+* lexer), parse (the parser, and generating IR from its
+* trees), peval (peval.c), sched (sched.c and slp.c),
+* pack (ir_packSlots() and frame.c), and emit (the
+* backends). The phases call each other - the parser
+* calls the lexer, say - so each one's time is its own,
+* without that of the phases it called.
+********************************************************/
+
+#include <time.h>
+#include "compiler.h"
+#include "phase.h"
+
+static int timing;              // between phase_start() and phase_stop()
+static enum phase current;
+static struct timespec since;   // when current began, or resumed
+static double spent[PHASE_NUM]; // ms
+
+static const char* phaseName[] = { "lex", "parse", "peval", "sched", "pack",
+				   "emit" };
+
+// charge the time since since to current
+static void
+charge(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    spent[current] += (now.tv_sec - since.tv_sec) * 1e3 +
+	(now.tv_nsec - since.tv_nsec) / 1e6;
+    since = now;
+}
+
+void
+phase_start(void)
+{
+    timing = 1;
+    current = PHASE_PARSE;
+    clock_gettime(CLOCK_MONOTONIC, &since);
+}
+
+// Returns: the phase that was running, for phase_leave()
+enum phase
+phase_enter(enum phase p)
+{
+    enum phase prev;
+
+    prev = current;
+    if (timing){
+	charge();
+	current = p;
+    }
+    return prev;
+}
+
+void
+phase_leave(enum phase prev)
+{
+    if (timing){
+	charge();
+	current = prev;
+    }
+}
+
+void
+phase_stop(void)
+{
+    if (timing)
+	charge();
+    timing = 0;
+}
+
+void
+phase_print(FILE* out)
+{
+    int i;
+
+    fprintf(out, "phases:");
+    for (i = 0; i < PHASE_NUM; i++)
+	fprintf(out, " %s %.3f ms%s", phaseName[i], spent[i],
+		(PHASE_NUM - 1 == i)? "\n" : ",");
+}
@@ -0,0 +1,30 @@
+/*******************************************************
+* phase.h -            header file for phase.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         phase_start();                  // --time-phases
+*         prev = phase_enter(PHASE_LEX);
+*         ... lex a token ...
+*         phase_leave(prev);
+*         phase_stop();                   // after backend_close()
+*         phase_print(stderr);
+* Nothing is timed unless phase_start() was called.
+********************************************************/
+
+#ifndef PHASE_H_
+#define PHASE_H_
+
+#include <stdio.h>
+
+enum phase{ PHASE_LEX, PHASE_PARSE, PHASE_PEVAL, PHASE_SCHED, PHASE_PACK,
+	    PHASE_EMIT, PHASE_NUM };
+
+void phase_start(void);
+enum phase phase_enter(enum phase p);
+void phase_leave(enum phase prev);
+void phase_stop(void);
+void phase_print(FILE* out);
+
+#endif
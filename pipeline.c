@@ -0,0 +1,136 @@
+/*******************************************************
+* pipeline.c -         lexer, parser, and backends on
+*                      three threads (--pipeline)
+* Language:            Micro
+*
+*   lexer thread --tokens--> parser (caller's thread)
+*                --irInstr--> output thread (backends)
+* Both links are SPSC rings (ring.c). Output is the same
+* as when running sequentially:
+*   - a lexer error travels as tok_ERROR, and is reported
+*     when the parser gets to it (lexer_raise());
+*   - before the parser exits on an error, the output
+*     thread writes out all instructions it was handed.
+* The lexer may read past END; it is never joined.
+* Note: the stages are unbalanced - the parser's thread
+*       does the most, and sched, pack, and the asm, obj,
+*       and c backends run after the parse either way (see
+*       tests/pipeline.sh for what it costs and saves)
+********************************************************/
+
+#include <pthread.h>
+#include "compiler.h"
+#include "pipeline.h"
+#include "backend.h"
+#include "ring.h"
+
+int pipelined;
+
+static spscRing tokens;
+static spscRing instrs;
+static pthread_t lexThread, outThread, parseThread;
+static int srcFd;
+
+static void
+lexerFailed(void)
+{
+    tokRecord rec;
+
+    rec.tok = tok_ERROR;
+    ring_push(&tokens, &rec);
+    pthread_exit(NULL);
+}
+
+static void*
+lexMain(void* arg)
+{
+    tokRecord rec;
+
+    lexer_deferErrors(lexerFailed);
+    do{
+	rec.tok = tokenize(srcFd, &rec);
+	ring_push(&tokens, &rec);
+    } while ( (tok_EOF != rec.tok) );
+
+    return NULL;
+}
+
+// a record with op == -1 ends the stream
+static void*
+outMain(void* arg)
+{
+    irInstr ins;
+
+    for (;;){
+	ring_pop(&instrs, &ins);
+	if ( (-1 == (int) ins.op) )
+	    break;
+	backend_dispatch(&ins);
+    }
+
+    return NULL;
+}
+
+// run by errExit(): let the output catch up with the parser
+static void
+drainOutput(void)
+{
+    if ( (pipelined) && pthread_equal(pthread_self(), parseThread) )
+	pipeline_finish();
+}
+
+void
+pipeline_start(int fd)
+{
+    int s;
+
+    srcFd = fd;
+    ring_init(&tokens, sizeof(tokRecord), PIPE_TOKENS);
+    ring_init(&instrs, sizeof(irInstr), PIPE_INSTRS);
+    parseThread = pthread_self();
+
+    if ( (0 != (s = pthread_create(&lexThread, NULL, lexMain, NULL)) ) ){
+	errno = s;
+	errExit(1, "...pthread_create()...");
+    }
+    pthread_detach(lexThread);
+    if ( (0 != (s = pthread_create(&outThread, NULL, outMain, NULL)) ) ){
+	errno = s;
+	errExit(1, "...pthread_create()...");
+    }
+
+    pipelined = 1;
+    errSetCleanup(drainOutput);
+}
+
+void
+pipeline_getToken(tokRecord* rec)
+{
+    ring_pop(&tokens, rec);
+}
+
+void
+pipeline_putInstr(const irInstr* ins)
+{
+    ring_push(&instrs, ins);
+}
+
+// Note: the token ring is left alone, as the lexer may still use it
+void
+pipeline_finish(void)
+{
+    irInstr end;
+    int s;
+
+    if ( !pipelined )
+	return;
+    pipelined = 0;
+
+    end.op = -1;
+    ring_push(&instrs, &end);
+    if ( (0 != (s = pthread_join(outThread, NULL)) ) ){
+	errno = s;
+	errExit(1, "...pthread_join()...");
+    }
+    ring_free(&instrs);
+}
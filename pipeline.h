@@ -0,0 +1,31 @@
+/*******************************************************
+* pipeline.h -         header file for pipeline.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         pipeline_start(fd);     // before codegen_TU()
+*         ... parse as usual ...
+*         pipeline_finish();      // after codegen_END()
+*         backend_close();
+* The calling thread parses; tokens come from a lexer
+* thread, and backends run on an output thread.
+********************************************************/
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include "lexer.h"
+#include "ir.h"
+
+#define PIPE_TOKENS 4096     // ring sizes (powers of 2)
+#define PIPE_INSTRS 4096
+
+extern int pipelined;
+
+void pipeline_start(int fd);
+void pipeline_getToken(tokRecord* rec);
+void pipeline_putInstr(const irInstr* ins);
+void pipeline_finish(void);
+
+#endif
@@ -0,0 +1,249 @@
+/*******************************************************
+* profile.c -          execution profiles, for profile-
+*                      guided compilation
+* Language:            Micro
+*
+* An instrumented run (--profile-gen=<file>, with --run
+* or --batch) counts how often each IR instruction runs
+* (batch.c), and writes the counts out summed up, as text:
+*   micro-profile 1
+*   source <hash of the source file>
+*   rows <rows run>
+*   function <name> <times entered>     ("begin": main)
+*   call <caller> <callee> <k> <times>  (k-th call of callee
+*                                        in caller, from 0)
+*   var <function> <name> <k> <times>   (accesses of the k-th
+*                                        variable name in it)
+* Its program is compiled without inlining, so that every
+* call shows. As each function is straight-line code, an
+* instruction runs as often as its function is entered,
+* or, once inlined, as its call site is reached: this is
+* what a compile with --profile-use=<file> weighs
+* instructions by (see ir_setWeight()). The var lines are
+* what those weights add up to, per variable.
+********************************************************/
+
+#include <stdint.h>
+#include "compiler.h"
+#include "profile.h"
+#include "arena.h"
+
+int profiled;
+
+// a count, keyed by two names and an ordinal
+typedef struct tally{
+    const char* a;
+    const char* b;
+    int k;
+    long n;
+} tally;
+
+typedef struct tallies{
+    tally* t;
+    int len, cap;
+} tallies;
+
+static tallies fcts;     // a: function; n: times entered
+static tallies sites;    // a: caller, b: callee, k: ordinal; n: times
+static tallies seen;     // a: caller, b: callee; n: sites handed out
+
+// Returns: the tally of (a, b, k); if there is none, a new one
+//          (n = 0) if add, else NULL
+static tally*
+find(tallies* ts, const char* a, const char* b, int k, int add)
+{
+    tally* p;
+    int i;
+
+    for (i = 0; i < ts->len; i++){
+	p = &ts->t[i];
+	if ( (p->k == k) && (0 == strcmp(p->a, a)) && (0 == strcmp(p->b, b)) )
+	    return p;
+    }
+    if ( !add )
+	return NULL;
+
+    if ( (ts->len == ts->cap) ){
+	ts->cap = (ts->cap)? 2 * ts->cap : 16;
+	if ( (NULL == (ts->t = realloc(ts->t, ts->cap * sizeof(tally)))) )
+	    errExit(1, "...realloc()...");
+    }
+    p = &ts->t[ts->len++];
+    p->a = a;
+    p->b = b;
+    p->k = k;
+    p->n = 0;
+    return p;
+}
+
+// FNV-1a, over the bytes of the source file
+unsigned long
+profile_hashSource(const char* srcName)
+{
+    unsigned char buf[65536];
+    uint64_t h;
+    ssize_t n, i;
+    int fd;
+
+    if ( (NULL == srcName) )
+	errExit(0, "profiles need a source file (not stdin)");
+    if ( (-1 == (fd = open(srcName, O_RDONLY)) ) )
+	errExit(1, "...open(%s)...", srcName);
+
+    h = 14695981039346656037ull;
+    while ( (0 < (n = read(fd, buf, sizeof(buf))) ) )
+	for (i = 0; i < n; i++)
+	    h = (h ^ buf[i]) * 1099511628211ull;
+    if ( (-1 == n) )
+	errExit(1, "...read(%s)...", srcName);
+    close(fd);
+
+    return (unsigned long) h;
+}
+
+/***************************************************
+* Writing (--profile-gen)
+*
+****************************************************/
+
+// one function: code[f] is its FUNCTION, code[end] its END;
+// acc: per slot, zeroed
+static void
+writeFunction(FILE* out, const irProgram* prog, const long* counts,
+	      int f, int end, long* acc, tallies* ord)
+{
+    const irInstr* ins;
+    const char* name;
+    int i;
+
+    name = prog->code[f].name;
+    fprintf(out, "function %s %ld\n", name, counts[f + 1]);
+
+    ord->len = 0;
+    for (i = f + 1; i < end; i++){
+	ins = &prog->code[i];
+	if ( (IR_CALL == ins->op) )
+	    fprintf(out, "call %s %s %ld %ld\n", name, ins->name,
+		    find(ord, ins->name, "", 0, 1)->n++, counts[i]);
+	if ( (IR_DECLARE == ins->op) )
+	    continue;
+	if ( (OPND_SLOT == ins->dest.kind) )
+	    acc[ins->dest.slot] += counts[i];
+	if ( (OPND_SLOT == ins->a.kind) )
+	    acc[ins->a.slot] += counts[i];
+	if ( (OPND_SLOT == ins->b.kind) )
+	    acc[ins->b.slot] += counts[i];
+    }
+
+    ord->len = 0;
+    for (i = f + 1; i < end; i++){
+	ins = &prog->code[i];
+	if ( (IR_DECLARE == ins->op) || (IR_PARAM == ins->op) )
+	    fprintf(out, "var %s %s %ld %ld\n", name, ins->name,
+		    find(ord, ins->name, "", 0, 1)->n++, acc[ins->dest.slot]);
+    }
+}
+
+// counts: per instruction of prog, the times it ran
+void
+profile_write(const char* file, const char* srcName,
+	      const irProgram* prog, const long* counts, long rows)
+{
+    FILE* out;
+    tallies ord;
+    long* acc;
+    int f, end;
+
+    if ( (NULL == (out = fopen(file, "w")) ) )
+	errExit(1, "...fopen(%s)...", file);
+    if ( (NULL == (acc = calloc(prog->numSlots + 1, sizeof(long))) ) )
+	errExit(1, "...calloc()...");
+    ord.t = NULL;
+    ord.len = ord.cap = 0;
+
+    fprintf(out, "micro-profile %d\n", PROFILE_VERSION);
+    fprintf(out, "source %016lx\n", profile_hashSource(srcName));
+    fprintf(out, "rows %ld\n", rows);
+    for (f = 0; f < prog->len; f = end + 1){
+	for (end = f; IR_END != prog->code[end].op; end++)
+	    ;
+	writeFunction(out, prog, counts, f, end, acc, &ord);
+    }
+
+    if ( (0 != fclose(out)) )
+	errExit(1, "...fclose(%s)...", file);
+    free(ord.t);
+    free(acc);
+}
+
+/***************************************************
+* Reading (--profile-use)
+*
+****************************************************/
+
+void
+profile_load(const char* file, const char* srcName)
+{
+    FILE* in;
+    char line[3 * MAX_ID_LEN + 64], a[MAX_ID_LEN + 1], b[MAX_ID_LEN + 1];
+    char key[16];
+    unsigned long hash;
+    long n;
+    int version, k, lineNo;
+
+    if ( (NULL == (in = fopen(file, "r")) ) )
+	errExit(1, "...fopen(%s)...", file);
+    if ( (NULL == fgets(line, sizeof(line), in)) ||
+	 (1 != sscanf(line, "micro-profile %d", &version)) ||
+	 (PROFILE_VERSION != version) )
+	errExit(0, "%s is not a profile (version %d)", file, PROFILE_VERSION);
+
+    for (lineNo = 2; NULL != fgets(line, sizeof(line), in); lineNo++){
+	if ( (1 != sscanf(line, "%15s", key)) )
+	    continue;
+	if ( (0 == strcmp(key, "source")) &&
+	     (1 == sscanf(line, "source %lx", &hash)) ){
+	    if ( (hash != profile_hashSource(srcName)) )
+		errExit(0, "profile %s was made from another version of %s",
+			file, srcName);
+	}
+	else if ( (0 == strcmp(key, "rows")) &&
+		  (1 == sscanf(line, "rows %ld", &n)) )
+	    ; // same as function begin
+	else if ( (0 == strcmp(key, "function")) && // %32s: MAX_ID_LEN
+		  (2 == sscanf(line, "function %32s %ld", a, &n)) )
+	    find(&fcts, arena_strdup(&compileArena, a), "", 0, 1)->n = n;
+	else if ( (0 == strcmp(key, "call")) &&
+		  (4 == sscanf(line, "call %32s %32s %d %ld", a, b, &k, &n)) )
+	    find(&sites, arena_strdup(&compileArena, a),
+		 arena_strdup(&compileArena, b), k, 1)->n = n;
+	else if ( (0 != strcmp(key, "var")) )
+	    errExit(0, "%s, line %d: invalid profile entry", file, lineNo);
+    }
+
+    fclose(in);
+    profiled = 1;
+}
+
+// Returns: times fct was entered in the profile (0 if never)
+long
+profile_entries(const char* fct)
+{
+    tally* p;
+
+    return (NULL == (p = find(&fcts, fct, "", 0, 0)))? 0 : p->n;
+}
+
+// the call sites of callee in caller are asked for in order
+// Returns: times the next one was reached in the profile (0 if never)
+long
+profile_callSite(const char* caller, const char* callee)
+{
+    tally *p, *s;
+
+    if ( (NULL == (s = find(&seen, caller, callee, 0, 0)) ) )
+	s = find(&seen, arena_strdup(&compileArena, caller),
+		 arena_strdup(&compileArena, callee), 0, 1);
+    p = find(&sites, caller, callee, s->n++, 0);
+    return (NULL == p)? 0 : p->n;
+}
@@ -0,0 +1,33 @@
+/*******************************************************
+* profile.h -          header file for profile.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         // instrumented run (--profile-gen=<file>)
+*         batch_setCounts(counts);  ... run ...
+*         profile_write(file, srcName, &irProg, counts, rows);
+*         // later compile (--profile-use=<file>)
+*         profile_load(file, srcName);  // before parsing
+*         n = profile_entries("f");     // times f was entered
+*         n = profile_callSite("begin", "f");  // next call of
+*                                       // f from the main program
+********************************************************/
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include "ir.h"
+
+#define PROFILE_VERSION 1
+
+extern int profiled;     // 1: a profile is loaded
+
+unsigned long profile_hashSource(const char* srcName);
+void profile_write(const char* file, const char* srcName,
+		   const irProgram* prog, const long* counts, long rows);
+void profile_load(const char* file, const char* srcName);
+long profile_entries(const char* fct);
+long profile_callSite(const char* caller, const char* callee);
+
+#endif
@@ -0,0 +1,76 @@
+/*******************************************************
+* ring.c -             lock-free single-producer/single-
+*                      consumer ring buffer
+* Language:            Micro
+*
+* head and tail only ever grow; element i lives in
+* buf[i & mask]. Each side owns one index, publishing it
+* with a release store, and reads the other's with an
+* acquire load - only when its cached copy says the ring
+* is full (producer) or empty (consumer).
+********************************************************/
+
+#include <sched.h>
+#include "compiler.h"
+#include "ring.h"
+
+#define RING_SPINS 64   // busy polls before yielding the CPU
+
+void
+ring_init(spscRing* r, size_t elemSize, size_t count)
+{
+    if ( (0 == count) || (0 != (count & (count - 1))) )
+	errExit(0, "ring size must be a power of 2 (%zu)", count);
+    if ( (NULL == (r->buf = malloc(elemSize * count)) ) )
+	errExit(1, "...malloc()...");
+
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    r->tailSeen = r->headSeen = 0;
+    r->mask = count - 1;
+    r->elemSize = elemSize;
+}
+
+static void
+backOff(int* spins)
+{
+    if ( (++*spins >= RING_SPINS) ){
+	sched_yield();
+	*spins = 0;
+    }
+}
+
+void
+ring_push(spscRing* r, const void* elem)
+{
+    size_t head;
+    int spins;
+
+    head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    for (spins = 0; head - r->tailSeen > r->mask; backOff(&spins))
+	r->tailSeen = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    memcpy(r->buf + (head & r->mask) * r->elemSize, elem, r->elemSize);
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+void
+ring_pop(spscRing* r, void* elem)
+{
+    size_t tail;
+    int spins;
+
+    tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    for (spins = 0; tail == r->headSeen; backOff(&spins))
+	r->headSeen = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    memcpy(elem, r->buf + (tail & r->mask) * r->elemSize, r->elemSize);
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+}
+
+void
+ring_free(spscRing* r)
+{
+    free(r->buf);
+    r->buf = NULL;
+}
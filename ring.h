@@ -0,0 +1,39 @@
+/*******************************************************
+* ring.h -             header file for ring.c
+* Language:            Micro
+*
+********************************************************
+* Usage (one producer thread, one consumer thread):
+*         spscRing r;
+*         ring_init(&r, sizeof(tokRecord), 4096);
+*         ring_push(&r, &rec);   // producer; waits if full
+*         ring_pop(&r, &rec);    // consumer; waits if empty
+********************************************************/
+
+#ifndef RING_H_
+#define RING_H_
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define RING_LINE 64     // keep the two sides on separate cache lines
+
+typedef struct spscRing{
+    // producer side
+    _Alignas(RING_LINE) _Atomic size_t head;  // next element to write
+    size_t tailSeen;                          // last tail it loaded
+    // consumer side
+    _Alignas(RING_LINE) _Atomic size_t tail;  // next element to read
+    size_t headSeen;                          // last head it loaded
+    // fixed after ring_init()
+    _Alignas(RING_LINE) size_t mask;          // count - 1; count a power of 2
+    size_t elemSize;
+    char* buf;
+} spscRing;
+
+void ring_init(spscRing* r, size_t elemSize, size_t count);
+void ring_push(spscRing* r, const void* elem);
+void ring_pop(spscRing* r, void* elem);
+void ring_free(spscRing* r);
+
+#endif
@@ -0,0 +1,530 @@
+/*******************************************************
+* rtio.c -             run-time I/O for Micro programs
+* Language:            Micro
+*
+* read() and write() of every execution path go through
+* here. Input is parsed straight out of a large buffer
+* filled by read(2), output is formatted into a buffer
+* flushed by write(2); neither scanf() nor printf() is
+* involved, and nothing is allocated.
+*
+* Output format: integers in decimal, floats as printf's
+* "%g" (6 significant digits)
+********************************************************/
+
+#include <limits.h>
+#include <math.h>
+#include "compiler.h"
+#include "rtio.h"
+
+#define RT_PREC 6  // significant digits of float output
+
+#define AVAIL(in) ((in)->len - (in)->pos)
+
+static rtOut* openOut;   // flushed before reporting a run-time error
+
+// output written so far goes out first, then the error message
+void
+rt_fail(const char* format, ...)
+{
+    va_list arglist;
+    char msg[MAX_ERR_LEN+1];
+
+    va_start(arglist, format);
+    vsnprintf(msg, MAX_ERR_LEN, format, arglist);
+    va_end(arglist);
+
+    if ( (NULL != openOut) )
+	rt_flush(openOut);
+    errExit(0, "run-time error: %s", msg);
+}
+
+/***************************************************
+* Input
+*
+****************************************************/
+
+void
+rt_openIn(rtIn* in, int fd, int rows)
+{
+    in->fd = fd;
+    in->rows = rows;
+    in->eof = 0;
+    in->line = 1;
+    in->pos = in->len = 0;
+}
+
+// make sure at least RT_MAXTOK bytes are buffered (unless at EOF)
+static void
+refill(rtIn* in)
+{
+    ssize_t numRead;
+
+    if ( (0 != in->pos) ){
+	memmove(in->buf, in->buf + in->pos, AVAIL(in));
+	in->len -= in->pos;
+	in->pos = 0;
+    }
+
+    while ( !in->eof && (in->len < RT_MAXTOK) ){
+	numRead = read(in->fd, in->buf + in->len, RT_BUFSIZE - in->len);
+	if ( (-1 == numRead) ){
+	    if ( (EINTR == errno) )
+		continue;
+	    errExit(1, "...run-time read()...");
+	}
+	if ( (0 == numRead) )
+	    in->eof = 1;
+	in->len += numRead;
+    }
+}
+
+static int
+peekChar(rtIn* in)
+{
+    if ( (0 == AVAIL(in)) ){
+	refill(in);
+	if ( (0 == AVAIL(in)) )
+	    return EOF;
+    }
+    return (unsigned char) in->buf[in->pos];
+}
+
+// in row mode, newlines are not white space
+static void
+skipSpace(rtIn* in)
+{
+    int c;
+
+    while ( (EOF != (c = peekChar(in))) ){
+	if ( ('\n' == c) ){
+	    if (in->rows)
+		return;
+	    in->line++;
+	}
+	else if ( !isspace(c) )
+	    return;
+	in->pos++;
+    }
+}
+
+// Returns: 1 if a row starts, 0 at end of input
+int
+rt_nextRow(rtIn* in, int skipEmpty)
+{
+    int c;
+
+    for (;;){
+	skipSpace(in);
+	if ( (EOF == (c = peekChar(in))) )
+	    return 0;
+	if ( ('\n' != c) || !skipEmpty )
+	    return 1;
+	in->pos++;
+	in->line++;
+    }
+}
+
+void
+rt_endRow(rtIn* in)
+{
+    int c;
+
+    skipSpace(in);
+    if ( ('\n' == (c = peekChar(in))) ){
+	in->pos++;
+	in->line++;
+    }
+    else if ( (EOF != c) )
+	rt_fail("too many values in input line %ld",
+		in->line);
+}
+
+// Returns: length of the next value (0 if none before end of row/input)
+//          with the whole value in the buffer from in->pos on
+static size_t
+nextValue(rtIn* in)
+{
+    size_t n;
+
+    skipSpace(in);
+    if ( (AVAIL(in) < RT_MAXTOK) )
+	refill(in);
+
+    for (n = 0; n < AVAIL(in); n++)
+	if ( isspace((unsigned char) in->buf[in->pos + n]) )
+	    break;
+    if ( (RT_MAXTOK <= n) )
+	rt_fail("input value too long, line %ld", in->line);
+
+    return n;
+}
+
+static void
+badValue(rtIn* in)
+{
+    rt_fail("invalid input value, line %ld", in->line);
+}
+
+// Returns: 0 - value read; -1 - no value left (EOF, or end of row)
+int
+rt_readLong(rtIn* in, long* val)
+{
+    const char* p;
+    const char* end;
+    unsigned long acc, limit;
+    size_t n;
+    int neg;
+
+    if ( (0 == (n = nextValue(in))) )
+	return -1;
+    p = in->buf + in->pos;
+    end = p + n;
+
+    neg = ('-' == *p);
+    if ( ('-' == *p) || ('+' == *p) )
+	p++;
+    if ( (p == end) )
+	badValue(in);
+
+    limit = (neg)? (unsigned long) LONG_MAX + 1 : (unsigned long) LONG_MAX;
+    for (acc = 0; p < end; p++){
+	if ( !isdigit((unsigned char) *p) )
+	    badValue(in);
+	if ( (acc > (limit - (*p - '0')) / 10) )
+	    rt_fail("input value out of range, line %ld",
+		    in->line);
+	acc = 10*acc + (*p - '0');
+    }
+
+    *val = (neg)? (long) (0ul - acc) : (long) acc;
+    in->pos += n;
+    return 0;
+}
+
+int
+rt_readInt(rtIn* in, int* val)
+{
+    long l;
+
+    if ( (-1 == rt_readLong(in, &l)) )
+	return -1;
+    if ( (l < INT_MIN) || (l > INT_MAX) )
+	rt_fail("input value out of range, line %ld",
+		in->line);
+    *val = (int) l;
+    return 0;
+}
+
+// Fast path: up to 15 significant digits and a decimal exponent of at
+// most 22 are exact doubles, so one multiplication or division rounds
+// correctly. Anything else (and inf/nan) is left to strtod().
+int
+rt_readFlt(rtIn* in, double* val)
+{
+    static const double pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const char* p;
+    const char* end;
+    char tok[RT_MAXTOK + 1];
+    char* stop;
+    unsigned long mant;
+    size_t n;
+    int neg, digits, exp10, e, eNeg, seen;
+
+    if ( (0 == (n = nextValue(in))) )
+	return -1;
+    p = in->buf + in->pos;
+    end = p + n;
+
+    neg = ('-' == *p);
+    if ( ('-' == *p) || ('+' == *p) )
+	p++;
+
+    mant = 0;
+    digits = exp10 = seen = 0;
+    for (; (p < end) && isdigit((unsigned char) *p); p++, seen = 1)
+	if ( (0 != mant) || ('0' != *p) ){
+	    if ( (digits++ < 19) )
+		mant = 10*mant + (*p - '0');
+	    else
+		exp10++;
+	}
+    if ( (p < end) && ('.' == *p) ){
+	for (p++; (p < end) && isdigit((unsigned char) *p); p++, seen = 1){
+	    if ( (0 == mant) && ('0' == *p) )
+		exp10--;
+	    else if ( (digits++ < 19) ){
+		mant = 10*mant + (*p - '0');
+		exp10--;
+	    }
+	}
+    }
+    if ( seen && (p < end) && (('e' == *p) || ('E' == *p)) ){
+	p++;
+	eNeg = (p < end) && ('-' == *p);
+	if ( (p < end) && (('-' == *p) || ('+' == *p)) )
+	    p++;
+	if ( (p == end) )
+	    badValue(in);
+	for (e = 0; (p < end) && isdigit((unsigned char) *p); p++)
+	    if ( (e < 100000) )
+		e = 10*e + (*p - '0');
+	exp10 += (eNeg)? -e : e;
+    }
+
+    if ( seen && (p == end) && (digits <= 15) &&
+	 (exp10 >= -22) && (exp10 <= 22) ){
+	*val = (exp10 < 0)? (double) mant / pow10[-exp10] :
+	    (double) mant * pow10[exp10];
+	if (neg)
+	    *val = -*val;
+    }
+    else{ // slow path
+	memcpy(tok, in->buf + in->pos, n);
+	tok[n] = '\0';
+	*val = strtod(tok, &stop);
+	if ( (stop != tok + n) )
+	    badValue(in);
+    }
+
+    in->pos += n;
+    return 0;
+}
+
+/***************************************************
+* Output
+*
+****************************************************/
+
+void
+rt_openOut(rtOut* out, int fd)
+{
+    out->fd = fd;
+    out->len = 0;
+    openOut = out;
+}
+
+void
+rt_flush(rtOut* out)
+{
+    size_t done;
+    ssize_t numWritten;
+
+    for (done = 0; done < out->len; done += numWritten){
+	numWritten = write(out->fd, out->buf + done, out->len - done);
+	if ( (-1 == numWritten) ){
+	    if ( (EINTR == errno) ){
+		numWritten = 0;
+		continue;
+	    }
+	    openOut = NULL;
+	    errExit(1, "...run-time write()...");
+	}
+    }
+    out->len = 0;
+}
+
+static char*
+reserve(rtOut* out, size_t n)
+{
+    if ( (out->len + n > RT_BUFSIZE) )
+	rt_flush(out);
+    return out->buf + out->len;
+}
+
+void
+rt_putc(rtOut* out, char c)
+{
+    *reserve(out, 1) = c;
+    out->len++;
+}
+
+void
+rt_writeLong(rtOut* out, long val)
+{
+    char tmp[24];
+    char* p;
+    unsigned long u;
+    int n;
+
+    p = reserve(out, sizeof(tmp));
+    u = (val < 0)? 0ul - (unsigned long) val : (unsigned long) val;
+    n = 0;
+    do{
+	tmp[n++] = '0' + u%10;
+	u /= 10;
+    } while ( (0 != u) );
+
+    if ( (val < 0) )
+	*p++ = '-';
+    while ( (n > 0) )
+	*p++ = tmp[--n];
+
+    out->len = p - out->buf;
+}
+
+// d[0..RT_PREC-1] = the RT_PREC significant digits of val (> 0),
+// rounded half-to-even like printf(); returns the decimal exponent
+static int
+sigDigits(double val, char* d)
+{
+    long double scaled;
+    unsigned long m;
+    int e, i;
+
+    e = (int) floor(log10(val));
+    for (;;){
+	// dividing by 10^k (exact up to k = 27) keeps decimal ties exact
+	if ( (RT_PREC - 1 - e < 0) )
+	    scaled = rintl((long double) val / powl(10.0L, e - RT_PREC + 1));
+	else
+	    scaled = rintl((long double) val * powl(10.0L, RT_PREC - 1 - e));
+	if ( (scaled >= powl(10.0L, RT_PREC)) )
+	    e++;    // log10() rounded down, or rounding carried
+	else if ( (scaled < powl(10.0L, RT_PREC - 1)) )
+	    e--;
+	else
+	    break;
+    }
+
+    m = (unsigned long) scaled;
+    for (i = RT_PREC - 1; i >= 0; i--, m /= 10)
+	d[i] = '0' + m%10;
+
+    return e;
+}
+
+void
+rt_writeFlt(rtOut* out, double val)
+{
+    char d[RT_PREC];
+    char* p;
+    int e, nd, i;
+
+    p = reserve(out, RT_PREC + 16);
+    if ( signbit(val) ){
+	*p++ = '-';
+	val = -val;
+    }
+
+    if ( isnan(val) || isinf(val) ){
+	memcpy(p, isnan(val)? "nan" : "inf", 3);
+	out->len = p + 3 - out->buf;
+	return;
+    }
+    if ( (0.0 == val) ){
+	*p++ = '0';
+	out->len = p - out->buf;
+	return;
+    }
+
+    e = sigDigits(val, d);
+    for (nd = RT_PREC; (nd > 1) && ('0' == d[nd - 1]); nd--)
+	;
+
+    if ( (e < -4) || (e >= RT_PREC) ){ // d.ddde+XX
+	*p++ = d[0];
+	if ( (nd > 1) ){
+	    *p++ = '.';
+	    for (i = 1; i < nd; i++)
+		*p++ = d[i];
+	}
+	*p++ = 'e';
+	*p++ = (e < 0)? '-' : '+';
+	if ( (e < 0) )
+	    e = -e;
+	if ( (e >= 100) )
+	    *p++ = '0' + e/100;
+	*p++ = '0' + (e/10)%10;
+	*p++ = '0' + e%10;
+    }
+    else if ( (e >= 0) ){           // ddd.ddd
+	for (i = 0; i <= e; i++)
+	    *p++ = (i < nd)? d[i] : '0';
+	if ( (nd > e + 1) ){
+	    *p++ = '.';
+	    for (i = e + 1; i < nd; i++)
+		*p++ = d[i];
+	}
+    }
+    else{                           // 0.000ddd
+	*p++ = '0';
+	*p++ = '.';
+	for (i = -1; i > e; i--)
+	    *p++ = '0';
+	for (i = 0; i < nd; i++)
+	    *p++ = d[i];
+    }
+
+    out->len = p - out->buf;
+}
+
+#ifdef RT_PROGRAM
+/***************************************************
+* Generated programs
+*
+* The C, assembly, and object backends' programs do
+* their read()s and write()s through these (rtsrc.sh
+* puts this file in the C they come with)
+****************************************************/
+
+static rtIn m_in;
+static rtOut m_out;
+
+void
+m_start(void)
+{
+    rt_openIn(&m_in, 0, 0);
+    rt_openOut(&m_out, 1);
+}
+
+int
+m_readi(void)
+{
+    int val;
+
+    if ( (-1 == rt_readInt(&m_in, &val)) )
+	rt_fail("read() past end of input");
+    return val;
+}
+
+long
+m_readl(void)
+{
+    long val;
+
+    if ( (-1 == rt_readLong(&m_in, &val)) )
+	rt_fail("read() past end of input");
+    return val;
+}
+
+double
+m_readf(void)
+{
+    double val;
+
+    if ( (-1 == rt_readFlt(&m_in, &val)) )
+	rt_fail("read() past end of input");
+    return val;
+}
+
+void
+m_writei(int val) { rt_writeLong(&m_out, val); }
+
+void
+m_writel(long val) { rt_writeLong(&m_out, val); }
+
+void
+m_writef(double val) { rt_writeFlt(&m_out, val); }
+
+void
+m_putc(int c) { rt_putc(&m_out, c); }
+
+void
+m_flush(void) { rt_flush(&m_out); }
+
+void
+m_divzero(void) { rt_fail("division by zero"); }
+#endif
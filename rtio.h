@@ -0,0 +1,66 @@
+/*******************************************************
+* rtio.h -             header file for rtio.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         rtIn in; rtOut out;
+*         rt_openIn(&in, 0, 0); rt_openOut(&out, 1);
+*         if ( (0 == rt_readLong(&in, &l)) ) ...
+*         rt_writeLong(&out, l); rt_putc(&out, '\n');
+*         rt_flush(&out);
+* Both buffers live inside the structs: nothing is
+* allocated while a program runs.
+********************************************************/
+
+#ifndef RTIO_H_
+#define RTIO_H_
+
+#define RT_BUFSIZE 65536
+#define RT_MAXTOK 64     // longest number we guarantee to see whole
+
+typedef struct rtIn{
+    int fd;
+    int rows;        // 1: values of one row must be on one line
+    int eof;         // read() returned 0
+    long line;       // for error messages
+    size_t pos;
+    size_t len;
+    char buf[RT_BUFSIZE];
+} rtIn;
+
+typedef struct rtOut{
+    int fd;
+    size_t len;
+    char buf[RT_BUFSIZE];
+} rtOut;
+
+void rt_openIn(rtIn* in, int fd, int rows);
+void rt_openOut(rtOut* out, int fd);
+
+int rt_nextRow(rtIn* in, int skipEmpty);
+void rt_endRow(rtIn* in);
+int rt_readInt(rtIn* in, int* val);
+int rt_readLong(rtIn* in, long* val);
+int rt_readFlt(rtIn* in, double* val);
+
+void rt_putc(rtOut* out, char c);
+void rt_writeLong(rtOut* out, long val);
+void rt_writeFlt(rtOut* out, double val);
+void rt_flush(rtOut* out);
+void rt_fail(const char* format, ...);
+
+#ifdef RT_PROGRAM  // what generated programs call, on stdin/stdout
+void m_start(void);
+int m_readi(void);
+long m_readl(void);
+double m_readf(void);
+void m_writei(int val);
+void m_writel(long val);
+void m_writef(double val);
+void m_putc(int c);
+void m_flush(void);
+void m_divzero(void);
+#endif
+
+#endif
@@ -0,0 +1,20 @@
+#!/bin/sh
+# rtsrc.sh - make rtsrc.c.inc: the run-time support generated programs
+# need (rtio.c, with RT_PROGRAM, and errExit() of error.c), as the lines
+# of one C source, which emitc.c puts in front of a program, and the rt
+# backend writes for assembly and object output
+#
+# usage: sh rtsrc.sh > rtsrc.c.inc   (after changing any of the files)
+
+cd "$(dirname "$0")" || exit 1
+echo "/* generated by rtsrc.sh from compiler.h, error.h, ename.c.inc,"
+echo "   error.c, rtio.h, and rtio.c: do not edit */"
+echo "static const char* rtSource[] = {"
+{
+    echo "#define RT_PROGRAM"
+    for f in compiler.h error.h ename.c.inc error.c rtio.h rtio.c; do
+	grep -v '^#include "' "$f"
+    done
+} | sed -e 's/\\/\\\\/g' -e 's/"/\\"/g' -e 's/	/\\t/g' \
+	-e 's/^/    "/' -e 's/$/",/'
+echo "    NULL };"
@@ -0,0 +1,908 @@
+/*******************************************************
+* sched.c -            instruction scheduling
+* Language:            Micro
+*
+* The IR comes in the order Expression() and Term()
+* produce it: a+b+c+d is ((a+b)+c)+d, three Adds each
+* waiting for the one before, and a Div or Convert
+* comes right before its use, which then waits for it.
+* Two passes work on each stretch of straight-line code
+* (as in slp.c):
+*
+* sched_rebalance() (before slp_vectorize()) rebuilds
+* the trees of int or long Adds and Subs, or of Muls,
+* whose inner temps are used once, in the tree: their
+* leaves are combined two at a time, the two ready
+* first (by the latencies below), which gives a balanced
+* tree where they are ready at once. Literals are folded
+* into one. A tree is rebuilt only if its value is ready
+* sooner that way, and it has SCHED_LEAVES leaves at most
+* (rebuilt, all its temps would be live at once).
+* Integers wrap, so the value is the same; float trees
+* are left as written, as rounding depends on the order,
+* unless --fast-math.
+*
+* sched_list() (after it) lists each stretch anew from
+* its DAG (as in slp.c), cycle by cycle, for a machine
+* issuing SCHED_WIDTH instructions a cycle with the
+* latencies of a recent x86-64 (each value also passes
+* through its slot in memory: SCHED_FORWARD): of those
+* whose operands are ready, the one with the longest
+* path to the end of the stretch first, so that a Div
+* starts as soon as it may, and chains interleave.
+********************************************************/
+
+#include "compiler.h"
+#include "sched.h"
+
+static int enabled = 1;
+static int fastMath;
+
+void
+sched_setEnabled(int on) { enabled = on; }
+
+void
+sched_setFastMath(int on) { fastMath = on; }
+
+static irInstr* code;       // of the program scheduled
+static int from, to;        // the stretch at hand
+static int stretch;         // its number, for stamp[]
+static int* stamp;          // per slot: the stretch the below are of
+
+static irInstr* out;        // the program scheduled
+static long* outWeight;
+static char* dead;          // per instruction of out: 1 if dropped
+static int outLen, outCap;
+
+typedef struct queue{       // by key (the least first), then index
+    int* at;
+    int len;
+    const int* key;
+} queue;
+
+/***************************************************
+* Helpers
+*
+****************************************************/
+
+// Returns: cycles from the start of ins until its result can be used
+static int
+latency(const irInstr* ins)
+{
+    enum irOp op;
+    int flt;
+
+    op = (ir_isVector(ins->op))? ins->op - IR_VASSIGN + IR_ASSIGN : ins->op;
+    flt = (FLOAT == ins->type);
+    switch(op){
+    case IR_ADD: case IR_SUB: return (flt)? 4 : 1;      // addsd, addl
+    case IR_MUL: return (flt)? 4 : 3;                   // mulsd, imull
+    case IR_DIV: return (flt)? 14 : (LONG == ins->type)? 40 : 26;
+    case IR_MULHI: return 4;
+    case IR_CONVERT: return 4;                          // cvtsi2sd
+    case IR_READ: case IR_WRITE: case IR_WRITELN: return 20; // calls
+    default: return 1;      // Assign, Promote, shifts, Declare
+    }
+}
+
+static int
+endsStretch(enum irOp op)
+{
+    switch(op){
+    case IR_FUNCTION: case IR_END: case IR_PARAM: case IR_RETURN:
+    case IR_ARG: case IR_CALL: case IR_LABEL: case IR_JUMP:
+    case IR_BEQ: case IR_BNE: case IR_BLT: case IR_BLE: case IR_BGT:
+    case IR_BGE:
+	return 1;
+    default:
+	return 0;
+    }
+}
+
+static long
+weightOf(const irProgram* prog, int i)
+{
+    return (NULL != prog->weight)? prog->weight[i] : 0;
+}
+
+static void
+emit(const irInstr* ins, long weight)
+{
+    if ( (outLen == outCap) ){
+	outCap = (outCap)? 2*outCap : 1024;
+	out = realloc(out, outCap * sizeof(irInstr));
+	outWeight = realloc(outWeight, outCap * sizeof(long));
+	dead = realloc(dead, outCap);
+	if ( (NULL == out) || (NULL == outWeight) || (NULL == dead) )
+	    errExit(1, "...realloc()...");
+    }
+    out[outLen] = *ins;
+    outWeight[outLen] = weight;
+    dead[outLen++] = 0;
+}
+
+// the program becomes out[0..outLen), less what is dead
+static void
+replace(irProgram* prog)
+{
+    int i, n;
+
+    for (n = i = 0; i < outLen; i++)
+	if ( !dead[i] ){
+	    outWeight[n] = outWeight[i];
+	    out[n++] = out[i];
+	}
+    if ( (NULL == prog->weight) ){
+	free(outWeight);
+	outWeight = NULL;
+    }
+    free(prog->code);
+    free(prog->weight);
+    prog->code = out;
+    prog->weight = outWeight;
+    prog->len = n;
+    prog->cap = outCap;
+    free(dead);
+    out = NULL;
+    outWeight = NULL;
+    dead = NULL;
+    outLen = outCap = 0;
+}
+
+static int
+before(const queue* q, int x, int y)
+{
+    return (q->key[x] < q->key[y]) || ( (q->key[x] == q->key[y]) && (x < y) );
+}
+
+static void
+qpush(queue* q, int x)
+{
+    int j, t;
+
+    for (j = q->len++, q->at[j] = x;
+	 (0 < j) && before(q, q->at[j], q->at[(j-1)/2]); j = (j-1)/2){
+	t = q->at[j];
+	q->at[j] = q->at[(j-1)/2];
+	q->at[(j-1)/2] = t;
+    }
+}
+
+static int
+qpop(queue* q)
+{
+    int x, j, c, t;
+
+    x = q->at[0];
+    q->at[0] = q->at[--q->len];
+    for (j = 0; (c = 2*j + 1) < q->len; j = c){
+	if ( (c + 1 < q->len) && before(q, q->at[c + 1], q->at[c]) )
+	    c++;
+	if ( !before(q, q->at[c], q->at[j]) )
+	    break;
+	t = q->at[j];
+	q->at[j] = q->at[c];
+	q->at[c] = t;
+    }
+    return x;
+}
+
+/***************************************************
+* Rebalancing
+*
+****************************************************/
+
+typedef struct leaf{
+    irOperand opnd;
+    int sign;               // Adds and Subs: -1 if subtracted
+    int reader;             // the instruction of the tree reading it
+} leaf;
+
+static int* defs;           // per slot: times written in the program
+static int* uses;           // per slot: times read
+static int* defAt;          // per slot: its (last) writer
+static int* useAt;          // per slot: its (last) reader
+static int* writePos;       // per slot: last writer in the stretch so far
+static int* readyAt;        // per slot: the cycle its value is ready in
+static int* outPos;         // per instruction: its copy in out
+static int* nodeTime;       // per instruction of a tree: its cycle
+static int* carry;          // per instruction: the variable its value
+			    // ends up in, in the stretch (or -1)
+
+static leaf* leaves;        // of the tree at hand
+static int* leafTime;       // per leaf: the cycle it is ready in
+static int numLeaves;
+static int* inner;          // the inner nodes of the tree at hand
+static int numInner;
+static int* work;           // nodes to visit, with their signs
+static int capTree;
+static queue byTime;        // of leaves
+static irInstr* seq;        // the tree rebuilt
+static int seqLen;
+
+// makes room for n nodes of a tree
+static void
+reserve(int n)
+{
+    if ( (n < capTree) )
+	return;
+    capTree = (capTree)? 2*capTree : 64;
+    if ( (n >= capTree) )
+	capTree = n + 1;
+    leaves = realloc(leaves, capTree * sizeof(leaf));
+    leafTime = realloc(leafTime, capTree * sizeof(int));
+    inner = realloc(inner, capTree * sizeof(int));
+    work = realloc(work, 2 * capTree * sizeof(int));
+    byTime.at = realloc(byTime.at, capTree * sizeof(int));
+    seq = realloc(seq, capTree * sizeof(irInstr));
+    if ( (NULL == leaves) || (NULL == leafTime) || (NULL == inner) ||
+	 (NULL == work) || (NULL == byTime.at) || (NULL == seq) )
+	errExit(1, "...realloc()...");
+    byTime.key = leafTime;
+}
+
+// Returns: IR_ADD for Adds and Subs, IR_MUL for Muls that may be
+//          rebalanced; 0 for other instructions
+static int
+treeClass(const irInstr* ins)
+{
+    if ( (OPND_SLOT != ins->dest.kind) || (OPND_NONE == ins->a.kind) ||
+	 (OPND_NONE == ins->b.kind) || (ins->a.type != ins->type) ||
+	 (ins->b.type != ins->type) )
+	return 0;
+    if ( (INTEGER != ins->type) && (LONG != ins->type) &&
+	 ( (FLOAT != ins->type) || !fastMath ) )
+	return 0;
+    switch(ins->op){
+    case IR_ADD: case IR_SUB: return IR_ADD;
+    case IR_MUL: return IR_MUL;
+    default: return 0;
+    }
+}
+
+// Returns: the index of the instruction defining operand o of
+//          code[j], if it is an inner node of the same tree; or -1
+static int
+innerDef(const irOperand* o, int j)
+{
+    int d;
+
+    if ( (OPND_SLOT != o->kind) || (1 != defs[o->slot]) ||
+	 (1 != uses[o->slot]) )
+	return -1;
+    d = defAt[o->slot];
+    if ( (d < from) || (d >= j) || (code[d].type != code[j].type) ||
+	 (treeClass(&code[d]) != treeClass(&code[j])) )
+	return -1;
+    return d;
+}
+
+// Returns: 1 if code[i] is an inner node of a tree (not its root)
+static int
+isInner(int i)
+{
+    int u;
+
+    u = useAt[code[i].dest.slot];
+    if ( (u <= i) || (u >= to) )
+	return 0;
+    return (innerDef(&code[u].a, u) == i) || (innerDef(&code[u].b, u) == i);
+}
+
+// Returns: the cycle operand o is ready in
+static int
+readyOf(const irOperand* o)
+{
+    if ( (OPND_SLOT != o->kind) )
+	return 0;
+    if ( (stretch != stamp[o->slot]) ){
+	stamp[o->slot] = stretch;
+	writePos[o->slot] = -1;
+	readyAt[o->slot] = 0;
+    }
+    return readyAt[o->slot];
+}
+
+// Returns: the cycle leaf o of the tree of root is ready in
+// Note:    the variable the tree's value ends up in (s := s + ...)
+//          is taken to be ready last: in a loop, the iteration
+//          before computed it last, so it is added last
+static int
+leafReady(const irOperand* o, int root)
+{
+    if ( (OPND_SLOT == o->kind) && (o->slot == carry[root]) )
+	return readyOf(o) + SCHED_CARRIED;
+    return readyOf(o);
+}
+
+static void
+addLeaf(const irOperand* o, int sign, int reader)
+{
+    leaves[numLeaves].opnd = *o;
+    leaves[numLeaves].sign = sign;
+    leaves[numLeaves++].reader = reader;
+}
+
+// the leaves (and inner nodes) of the tree with root code[root]
+// Note: walked with a stack of its own, as trees may be deep
+static void
+collect(int root)
+{
+    const irOperand* o[2];
+    int n, j, k, sign, d;
+
+    numLeaves = numInner = 0;
+    reserve(2);
+    work[0] = root;
+    work[1] = 1;
+    for (n = 1; 0 < n; ){
+	reserve(numLeaves + numInner + n + 2);
+	n--;
+	j = work[2*n];
+	sign = work[2*n + 1];
+	if ( (j != root) )
+	    inner[numInner++] = j;
+	o[0] = &code[j].a; o[1] = &code[j].b;
+	for (k = 0; k < 2; k++){
+	    if ( (1 == k) && (IR_SUB == code[j].op) )
+		sign = -sign;
+	    if ( (-1 == (d = innerDef(o[k], j))) ){
+		addLeaf(o[k], sign, j);
+		continue;
+	    }
+	    work[2*n] = d;
+	    work[2*n + 1] = sign;
+	    n++;
+	}
+    }
+}
+
+// Returns: 1 if no leaf is written after the tree read it (and
+//          before its root); sets the leaves' times
+static int
+timeLeaves(int root)
+{
+    int k, s;
+
+    for (k = 0; k < numLeaves; k++){
+	leafTime[k] = leafReady(&leaves[k].opnd, root);
+	s = leaves[k].opnd.slot;
+	if ( (OPND_SLOT == leaves[k].opnd.kind) &&
+	     (writePos[s] > leaves[k].reader) )
+	    return 0;
+    }
+    return 1;
+}
+
+static int
+byIndex(const void* x, const void* y)
+{
+    return *(const int*) x - *(const int*) y;
+}
+
+// Returns: the cycle the tree of root is ready in, as it is
+static int
+treeTime(int root)
+{
+    const irOperand* o[2];
+    int j, k, m, d, t, u;
+
+    qsort(inner, numInner, sizeof(int), byIndex);
+    inner[numInner] = root;
+    for (k = 0; k <= numInner; k++){
+	j = inner[k];
+	o[0] = &code[j].a; o[1] = &code[j].b;
+	for (t = m = 0; m < 2; m++){
+	    d = innerDef(o[m], j);
+	    u = (-1 != d)? nodeTime[d] : leafReady(o[m], root);
+	    if ( (u > t) )
+		t = u;
+	}
+	nodeTime[j] = t + latency(&code[j]) + SCHED_FORWARD;
+    }
+    return nodeTime[root];
+}
+
+// Returns: v as a value of type (int wraps)
+static long
+wrap(unsigned long v, int type)
+{
+    return (INTEGER == type)? (long) (int) (unsigned) v : (long) v;
+}
+
+// the literal leaves become one, the last (none if it is 0 in a sum,
+// or 1 in a product, of other leaves)
+static void
+foldLiterals(int cls, int type)
+{
+    unsigned long acc;
+    double facc;
+    int k, n, lits;
+    leaf* l;
+
+    acc = (IR_ADD == cls)? 0 : 1;
+    facc = (IR_ADD == cls)? 0.0 : 1.0;
+    for (lits = n = k = 0; k < numLeaves; k++){
+	l = &leaves[k];
+	if ( (OPND_INT == l->opnd.kind) ){
+	    if ( (IR_MUL == cls) )
+		acc *= (unsigned long) l->opnd.val_int;
+	    else if ( (0 < l->sign) )
+		acc += (unsigned long) l->opnd.val_int;
+	    else
+		acc -= (unsigned long) l->opnd.val_int;
+	    lits++;
+	}
+	else if ( (OPND_FLT == l->opnd.kind) ){
+	    facc = (IR_MUL == cls)? facc * l->opnd.val_flt :
+		facc + l->sign * l->opnd.val_flt;
+	    lits++;
+	}
+	else{
+	    leafTime[n] = leafTime[k];
+	    leaves[n++] = *l;
+	}
+    }
+    numLeaves = n;
+    if ( (0 == lits) )
+	return;
+    if ( (0 < n) && (FLOAT == type) && (facc == ((IR_ADD == cls)? 0 : 1)) )
+	return;
+    if ( (0 < n) && (FLOAT != type) &&
+	 (wrap(acc, type) == ((IR_ADD == cls)? 0 : 1)) )
+	return;
+
+    l = &leaves[numLeaves];
+    l->sign = 1;
+    l->reader = -1;
+    l->opnd.type = type;
+    if ( (FLOAT == type) ){
+	l->opnd.kind = OPND_FLT;
+	l->opnd.val_flt = facc;
+    }
+    else{
+	l->opnd.kind = OPND_INT;
+	l->opnd.val_int = wrap(acc, type);
+    }
+    leafTime[numLeaves++] = 0;
+}
+
+// the tree of root at rebuilt into seq[], its temps numbered from
+// prog->numSlots on (the last instruction writes at's dest)
+// Returns: the cycle its value is ready in
+static int
+rebuild(const irProgram* prog, const irInstr* at, int cls)
+{
+    irInstr* ins;
+    int x, y, lat;
+
+    seqLen = byTime.len = 0;
+    for (x = 0; x < numLeaves; x++)
+	qpush(&byTime, x);
+    lat = latency(at) + SCHED_FORWARD;
+
+    // the pair ready first takes the place of its first leaf
+    while ( (1 < byTime.len) ){
+	x = qpop(&byTime);
+	y = qpop(&byTime);
+	ins = &seq[seqLen];
+	*ins = *at;
+	ins->dest.slot = prog->numSlots + seqLen++;
+	ins->op = cls;
+	ins->a = leaves[x].opnd;
+	ins->b = leaves[y].opnd;
+	if ( (IR_ADD == cls) && (leaves[x].sign != leaves[y].sign) ){
+	    ins->op = IR_SUB;  // -x + y: y - x
+	    if ( (0 > leaves[x].sign) ){
+		ins->a = leaves[y].opnd;
+		ins->b = leaves[x].opnd;
+	    }
+	    leaves[x].sign = 1;
+	}
+	if ( (leafTime[y] > leafTime[x]) )
+	    leafTime[x] = leafTime[y];
+	leafTime[x] += lat;
+	leaves[x].opnd = ins->dest;
+	qpush(&byTime, x);
+    }
+
+    x = byTime.at[0];
+    if ( (0 == seqLen) || (0 > leaves[x].sign) ){
+	ins = &seq[seqLen++];
+	*ins = *at;
+	ins->op = IR_ASSIGN;
+	ins->a = leaves[x].opnd;
+	ins->b.kind = OPND_NONE;
+	leafTime[x] += 1;
+	if ( (0 > leaves[x].sign) ){  // -x: 0 - x
+	    ins->op = IR_SUB;
+	    ins->b = ins->a;
+	    ins->a.kind = (FLOAT == at->type)? OPND_FLT : OPND_INT;
+	    if ( (FLOAT == at->type) )
+		ins->a.val_flt = 0.0;
+	    else
+		ins->a.val_int = 0;
+	    leafTime[x] += lat - 1;
+	}
+    }
+    seq[seqLen - 1].dest = at->dest;
+    return leafTime[x];
+}
+
+// code[i] is the root of a tree: emit it rebuilt, if it is ready
+// sooner that way; a tree of more than SCHED_LEAVES is not, as
+// its temps would all be live at once
+// Returns: 1 if it was (*t: the cycle it is ready in now)
+static int
+rebalance(irProgram* prog, int i, int* t)
+{
+    int cls, k, u, v;
+
+    cls = treeClass(&code[i]);
+    collect(i);
+    if ( (0 == numInner) || (SCHED_LEAVES < numLeaves) || !timeLeaves(i) )
+	return 0;
+    u = treeTime(i);
+    foldLiterals(cls, code[i].type);
+    if ( (u <= (v = rebuild(prog, &code[i], cls))) )
+	return 0;
+
+    for (k = 0; k < numInner; k++)
+	dead[outPos[inner[k]]] = 1;
+    for (k = 0; k < seqLen; k++)
+	emit(&seq[k], weightOf(prog, i));
+    prog->numSlots += seqLen - 1;
+    *t = (SCHED_CARRIED <= v)? v - SCHED_CARRIED : v;
+    return 1;
+}
+
+// the slots' uses and definitions, in the whole program
+static void
+countSlots(const irProgram* prog)
+{
+    const irInstr* ins;
+    int i;
+
+    for (i = 0; i <= prog->numSlots; i++)
+	defAt[i] = useAt[i] = -1;
+    for (i = 0; i < prog->len; i++){
+	ins = &prog->code[i];
+	if ( (OPND_SLOT == ins->dest.kind) ){
+	    defs[ins->dest.slot]++;
+	    defAt[ins->dest.slot] = i;
+	}
+	if ( (OPND_SLOT == ins->a.kind) ){
+	    uses[ins->a.slot]++;
+	    useAt[ins->a.slot] = i;
+	}
+	if ( (OPND_SLOT == ins->b.kind) ){
+	    uses[ins->b.slot]++;
+	    useAt[ins->b.slot] = i;
+	}
+    }
+}
+
+// where the values of the instructions end up: following temps
+// used once, in the same stretch (part: per instruction, its stretch)
+static void
+carryValues(const irProgram* prog, int* part)
+{
+    const irInstr* ins;
+    int i, s, u;
+
+    for (u = i = 0; i < prog->len; i++)
+	part[i] = (u += endsStretch(prog->code[i].op));
+    for (i = prog->len - 1; i >= 0; i--){
+	ins = &prog->code[i];
+	carry[i] = -1;
+	if ( (OPND_SLOT != ins->dest.kind) )
+	    continue;
+	s = ins->dest.slot;
+	carry[i] = s;
+	if ( (1 != defs[s]) || (1 != uses[s]) || (useAt[s] <= i) ||
+	     (part[useAt[s]] != part[i]) )
+	    continue;
+	carry[i] = carry[useAt[s]];
+    }
+}
+
+void
+sched_rebalance(irProgram* prog)
+{
+    const irInstr* ins;
+    int i, n, numSlots, t, u;
+
+    if ( !enabled || (0 == prog->len) || (0 != prog->lanes) )
+	return;
+
+    code = prog->code;
+    n = prog->len;
+    numSlots = prog->numSlots + 1;
+    defs = calloc(numSlots, sizeof(int));
+    uses = calloc(numSlots, sizeof(int));
+    defAt = malloc(numSlots * sizeof(int));
+    useAt = malloc(numSlots * sizeof(int));
+    stamp = calloc(numSlots, sizeof(int));
+    writePos = malloc(numSlots * sizeof(int));
+    readyAt = malloc(numSlots * sizeof(int));
+    outPos = malloc(n * sizeof(int));
+    nodeTime = malloc(n * sizeof(int));
+    carry = malloc(n * sizeof(int));
+    if ( (NULL == defs) || (NULL == uses) || (NULL == defAt) ||
+	 (NULL == useAt) || (NULL == stamp) || (NULL == writePos) ||
+	 (NULL == readyAt) || (NULL == outPos) || (NULL == nodeTime) ||
+	 (NULL == carry) )
+	errExit(1, "...malloc()...");
+    countSlots(prog);
+    carryValues(prog, nodeTime);
+    stretch = 0;
+
+    for (i = 0; i < n; ){
+	if ( endsStretch(code[i].op) ){
+	    emit(&code[i], weightOf(prog, i));
+	    i++;
+	    continue;
+	}
+	for (from = i, to = i; (to < n) && !endsStretch(code[to].op); to++)
+	    ;
+	for (stretch++; i < to; i++){
+	    ins = &code[i];
+	    t = readyOf(&ins->a);
+	    if ( (t < (u = readyOf(&ins->b))) )
+		t = u;
+	    t += latency(ins) + SCHED_FORWARD;
+	    if ( (OPND_SLOT == ins->dest.kind) )
+		readyOf(&ins->dest);
+	    if ( (0 == treeClass(ins)) || isInner(i) ||
+		 !rebalance(prog, i, &t) ){
+		outPos[i] = outLen;
+		emit(ins, weightOf(prog, i));
+	    }
+	    if ( (OPND_SLOT == ins->dest.kind) ){
+		readyAt[ins->dest.slot] = t;
+		writePos[ins->dest.slot] = i;
+	    }
+	}
+    }
+    replace(prog);
+
+    free(defs);
+    free(uses);
+    free(defAt);
+    free(useAt);
+    free(stamp);
+    free(writePos);
+    free(readyAt);
+    free(outPos);
+    free(nodeTime);
+    free(carry);
+    free(leaves);
+    free(leafTime);
+    free(inner);
+    free(work);
+    free(byTime.at);
+    free(seq);
+    leaves = NULL;
+    leafTime = inner = work = byTime.at = NULL;
+    seq = NULL;
+    capTree = 0;
+}
+
+/***************************************************
+* Listing
+*
+****************************************************/
+
+static int* edgeHead;       // per instruction: its first successor edge
+static int* edgeTo;
+static int* edgeLat;        // cycles from the start of one to the other's
+static int* edgeNext;
+static int numEdges, capEdges;
+static int* need;           // per instruction: predecessors not listed
+static int* earliest;       // per instruction: cycle it may start in
+static int* urgency;        // per instruction: - cycles to the end
+			    // of the stretch, at least
+static queue waiting;       // by earliest
+static queue ready;         // of those that may start, by urgency
+
+static int* writer;         // per slot: last writer in the stretch
+static int* readHead;       // per slot: its readers since (readers[])
+static int* readers;        // reader, next: a list per slot
+static int* readNext;
+static int numReaders;
+
+static void
+addEdge(int i, int j, int lat)
+{
+    if ( (numEdges == capEdges) ){
+	capEdges = (capEdges)? 2*capEdges : 1024;
+	edgeTo = realloc(edgeTo, capEdges * sizeof(int));
+	edgeLat = realloc(edgeLat, capEdges * sizeof(int));
+	edgeNext = realloc(edgeNext, capEdges * sizeof(int));
+	if ( (NULL == edgeTo) || (NULL == edgeLat) || (NULL == edgeNext) )
+	    errExit(1, "...realloc()...");
+    }
+    edgeTo[numEdges] = j;
+    edgeLat[numEdges] = lat;
+    edgeNext[numEdges] = edgeHead[i];
+    edgeHead[i] = numEdges++;
+    need[j]++;
+}
+
+static void
+touch(int s)
+{
+    if ( (stretch != stamp[s]) ){
+	stamp[s] = stretch;
+	writer[s] = -1;
+	readHead[s] = -1;
+    }
+}
+
+static void
+useSlot(int i, int s)
+{
+    touch(s);
+    if ( (-1 != writer[s]) )
+	addEdge(writer[s], i, latency(&code[writer[s]]) + SCHED_FORWARD);
+    readers[numReaders] = i;
+    readNext[numReaders] = readHead[s];
+    readHead[s] = numReaders++;
+}
+
+static void
+defSlot(int i, int s)
+{
+    int r;
+
+    touch(s);
+    if ( (-1 != writer[s]) )
+	addEdge(writer[s], i, 0);
+    for (r = readHead[s]; -1 != r; r = readNext[r])
+	if ( (i != readers[r]) )
+	    addEdge(readers[r], i, 0);
+    readHead[s] = -1;
+    writer[s] = i;
+}
+
+// the DAG of code[from..to), and how urgent its instructions are;
+// lanes: of its vector instructions
+static void
+buildDeps(int lanes)
+{
+    const irInstr* ins;
+    int i, k, n, e, effect;
+
+    stretch++;
+    numEdges = numReaders = 0;
+    for (i = from; i < to; i++){
+	edgeHead[i] = -1;
+	need[i] = earliest[i] = 0;
+    }
+
+    for (effect = -1, i = from; i < to; i++){
+	ins = &code[i];
+	n = (ir_isVector(ins->op))? lanes : 1;
+	for (k = 0; k < n; k++){
+	    if ( (OPND_SLOT == ins->a.kind) )
+		useSlot(i, ins->a.slot + k);
+	    if ( (OPND_SLOT == ins->b.kind) )
+		useSlot(i, ins->b.slot + k);
+	}
+	for (k = 0; k < n; k++)
+	    if ( (OPND_SLOT == ins->dest.kind) )
+		defSlot(i, ins->dest.slot + k);
+	// Declares stay in order, too: the profile counts variables
+	// of the same name by it
+	if ( (IR_READ == ins->op) || (IR_WRITE == ins->op) ||
+	     (IR_WRITELN == ins->op) || (IR_DIV == ins->op) ||
+	     (IR_DECLARE == ins->op) ){
+	    if ( (-1 != effect) )
+		addEdge(effect, i, 0);
+	    effect = i;
+	}
+    }
+
+    // edges lead forward: the last instruction's urgency is known first
+    for (i = to - 1; i >= from; i--){
+	urgency[i] = -latency(&code[i]);
+	for (e = edgeHead[i]; -1 != e; e = edgeNext[e])
+	    if ( (urgency[i] > urgency[edgeTo[e]] - edgeLat[e]) )
+		urgency[i] = urgency[edgeTo[e]] - edgeLat[e];
+    }
+}
+
+// list code[from..to) anew
+static void
+list(const irProgram* prog)
+{
+    int i, e, k, t, left;
+
+    buildDeps(prog->lanes);
+    waiting.len = ready.len = 0;
+    for (i = from; i < to; i++)
+	if ( (0 == need[i]) )
+	    qpush(&waiting, i);
+
+    for (t = 0, left = to - from; 0 < left; t++){
+	while ( (0 < waiting.len) && (earliest[waiting.at[0]] <= t) )
+	    qpush(&ready, qpop(&waiting));
+	if ( (0 == ready.len) ){
+	    t = earliest[waiting.at[0]] - 1;
+	    continue;
+	}
+	for (k = 0; (k < SCHED_WIDTH) && (0 < ready.len); k++, left--){
+	    i = qpop(&ready);
+	    emit(&code[i], weightOf(prog, i));
+	    for (e = edgeHead[i]; -1 != e; e = edgeNext[e]){
+		if ( (earliest[edgeTo[e]] < t + edgeLat[e]) )
+		    earliest[edgeTo[e]] = t + edgeLat[e];
+		if ( (0 == --need[edgeTo[e]]) )
+		    qpush(&waiting, edgeTo[e]);
+	    }
+	}
+    }
+}
+
+void
+sched_list(irProgram* prog)
+{
+    int i, n, numSlots, lanes;
+
+    if ( !enabled || (0 == prog->len) )
+	return;
+
+    code = prog->code;
+    n = prog->len;
+    numSlots = prog->numSlots + 1;
+    lanes = (prog->lanes)? prog->lanes : 1;
+    stamp = calloc(numSlots, sizeof(int));
+    writer = malloc(numSlots * sizeof(int));
+    readHead = malloc(numSlots * sizeof(int));
+    readers = malloc(2 * lanes * n * sizeof(int));
+    readNext = malloc(2 * lanes * n * sizeof(int));
+    edgeHead = malloc(n * sizeof(int));
+    need = malloc(n * sizeof(int));
+    earliest = malloc(n * sizeof(int));
+    urgency = malloc(n * sizeof(int));
+    waiting.at = malloc(n * sizeof(int));
+    ready.at = malloc(n * sizeof(int));
+    if ( (NULL == stamp) || (NULL == writer) || (NULL == readHead) ||
+	 (NULL == readers) || (NULL == readNext) || (NULL == edgeHead) ||
+	 (NULL == need) || (NULL == earliest) || (NULL == urgency) ||
+	 (NULL == waiting.at) || (NULL == ready.at) )
+	errExit(1, "...malloc()...");
+    waiting.key = earliest;
+    ready.key = urgency;
+    stretch = 0;
+
+    for (i = 0; i < n; ){
+	if ( endsStretch(code[i].op) ){
+	    emit(&code[i], weightOf(prog, i));
+	    i++;
+	    continue;
+	}
+	for (from = i; (i < n) && !endsStretch(code[i].op); i++)
+	    ;
+	to = i;
+	list(prog);
+    }
+    replace(prog);
+
+    free(stamp);
+    free(writer);
+    free(readHead);
+    free(readers);
+    free(readNext);
+    free(edgeHead);
+    free(need);
+    free(earliest);
+    free(urgency);
+    free(waiting.at);
+    free(ready.at);
+    free(edgeTo);
+    free(edgeLat);
+    free(edgeNext);
+    edgeTo = edgeLat = edgeNext = NULL;
+    capEdges = 0;
+}
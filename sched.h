@@ -0,0 +1,29 @@
+/*******************************************************
+* sched.h -            header file for sched.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         sched_setFastMath(1);       // --fast-math
+*         sched_setEnabled(0);        // --no-sched
+*         sched_rebalance(&irProg);   // before slp_vectorize()
+*         sched_list(&irProg);        // after it, before
+*                                     // ir_packSlots()
+********************************************************/
+
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include "ir.h"
+
+#define SCHED_WIDTH 4        // instructions issued per cycle
+#define SCHED_FORWARD 4      // cycles from a store to a load of it
+#define SCHED_CARRIED 1000   // a sum's own variable is ready last
+#define SCHED_LEAVES 256     // larger trees are left as written
+
+void sched_setEnabled(int on);
+void sched_setFastMath(int on);
+void sched_rebalance(irProgram* prog);
+void sched_list(irProgram* prog);
+
+#endif
@@ -0,0 +1,601 @@
+/*******************************************************
+* slp.c -              superword-level parallelism
+* Language:            Micro
+*
+* Programs often compute many values the same way, one
+* after the other:
+*     x1 := a1*b1 + c1; x2 := a2*b2 + c2; ...
+* Within each stretch of straight-line code (between
+* labels, jumps, branches, calls, and the bounds of
+* functions), lanes (SLP_LANES; with --avx2, 4) such
+* Assigns, Adds, Subs, or Muls - of the same op and
+* type, independent of each other, each operand a slot,
+* or the same literal in all of them - are packed into
+* one VASSIGN ... VMUL (see ir.h), as by Larsen and
+* Amarasinghe ("Exploiting Superword Level Parallelism
+* with Multimedia Instruction Sets").
+*
+* The k-th slots of a pack's dest, and of each operand
+* that is a slot, are lane k of a group: the slots of
+* a group are numbered in a row (renumbered here, and
+* kept so by ir_packSlots()), so that a vector op can
+* load and store them at once. A slot is in one group
+* at most, in one lane: a pack that would need another
+* layout of its slots is not made. In the example, the
+* Muls' dests are the group the Adds read.
+*
+* The stretch is then scheduled anew: its dependences
+* (on the slots read and written, and the order of the
+* read()s, write()s, and Divs, which may fail) form a
+* DAG, and its instructions are listed as they become
+* ready, a pack once all of its members are, in their
+* original order where there is a choice. Should a pack
+* be all there is left to be ready (it would have to
+* run both before and after something else), it is
+* dropped, its members left as they were.
+*
+* Long Mul has no vector form (before AVX-512), and Div
+* is left alone. The pass runs on the recorded program,
+* before ir_packSlots(): temps have a slot each yet.
+********************************************************/
+
+#include "compiler.h"
+#include "slp.h"
+
+static int enabled = 1;
+static int lanes = SLP_LANES;
+
+void
+slp_setEnabled(int on) { enabled = on; }
+
+void
+slp_setLanes(int n) { lanes = n; }
+
+static irInstr* code;       // of the program vectorized
+static int* group;          // per slot: its group (0: none)
+static int* lane;           // per slot: its lane in its group
+static int numGroups;
+static int* undo;           // slots grouped for the pack being made
+static int numUndo;
+
+static int* packOf;         // per instruction: its pack (-1: none)
+static int* member;         // pack p: member[p*lanes + k], in order
+static int* ready;          // per pack: members ready to be scheduled
+static int numPacks, capPacks;
+
+/***************************************************
+* Packs
+*
+****************************************************/
+
+// Returns: 1 if ins may be a member of a pack
+static int
+isCandidate(const irInstr* ins)
+{
+    if ( (IR_ASSIGN != ins->op) && (IR_ADD != ins->op) &&
+	 (IR_SUB != ins->op) && (IR_MUL != ins->op) )
+	return 0;
+    if ( (IR_MUL == ins->op) && (LONG == ins->type) )
+	return 0;
+    return (OPND_SLOT == ins->dest.kind) && (ins->a.type == ins->type) &&
+	( (IR_ASSIGN == ins->op) || (ins->b.type == ins->type) );
+}
+
+// Returns: 1 if x and y are both slots (or missing), or the same
+//          literal
+static int
+sameOperand(const irOperand* x, const irOperand* y)
+{
+    if ( (x->kind != y->kind) )
+	return 0;
+    switch(x->kind){
+    case OPND_INT: return (x->type == y->type) && (x->val_int == y->val_int);
+    case OPND_FLT: return 0 == memcmp(&x->val_flt, &y->val_flt,
+				      sizeof(double));
+    default: return 1;
+    }
+}
+
+static int
+isIsomorphic(const irInstr* x, const irInstr* y)
+{
+    return (x->op == y->op) && (x->type == y->type) &&
+	sameOperand(&x->a, &y->a) && sameOperand(&x->b, &y->b);
+}
+
+static int
+reads(const irInstr* ins, int s)
+{
+    return ( (OPND_SLOT == ins->a.kind) && (s == ins->a.slot) ) ||
+	( (OPND_SLOT == ins->b.kind) && (s == ins->b.slot) );
+}
+
+// Returns: 1 if ins neither reads nor writes what the members m[0..n)
+//          of a pack write, nor writes what they read
+static int
+isIndependent(const int* m, int n, const irInstr* ins)
+{
+    const irInstr* y;
+    int k;
+
+    for (k = 0; k < n; k++){
+	y = &code[m[k]];
+	if ( reads(ins, y->dest.slot) || reads(y, ins->dest.slot) ||
+	     (ins->dest.slot == y->dest.slot) )
+	    return 0;
+    }
+    return 1;
+}
+
+// t: the slots of one operand of a pack, by lane
+// Returns: 1 if they are a group, or are made one now
+static int
+isGroup(const int* t)
+{
+    int g, j, k;
+
+    if ( (0 != (g = group[t[0]])) ){
+	if ( (0 != lane[t[0]]) )
+	    return 0;
+	for (k = 1; k < lanes; k++)
+	    if ( (g != group[t[k]]) || (k != lane[t[k]]) )
+		return 0;
+	return 1;
+    }
+    for (k = 0; k < lanes; k++){
+	if ( (0 != group[t[k]]) )
+	    return 0;
+	for (j = 0; j < k; j++)
+	    if ( (t[j] == t[k]) )
+		return 0;
+    }
+
+    numGroups++;
+    for (k = 0; k < lanes; k++){
+	group[t[k]] = numGroups;
+	lane[t[k]] = k;
+	undo[numUndo++] = t[k];
+    }
+    return 1;
+}
+
+// Returns: 1 if the dest and slot operands of the members m[] of
+//          a pack are (now) groups; if not, nothing is grouped
+static int
+layOut(const int* m)
+{
+    int t[3][SLP_AVX2_LANES];
+    int j, k, saved, ok;
+
+    for (k = 0; k < lanes; k++){
+	t[0][k] = code[m[k]].dest.slot;
+	t[1][k] = code[m[k]].a.slot;
+	t[2][k] = code[m[k]].b.slot;
+    }
+    saved = numGroups;
+    numUndo = 0;
+    ok = isGroup(t[0]);
+    if ( ok && (OPND_SLOT == code[m[0]].a.kind) )
+	ok = isGroup(t[1]);
+    if ( ok && (OPND_SLOT == code[m[0]].b.kind) )
+	ok = isGroup(t[2]);
+    if (ok)
+	return 1;
+
+    for (j = 0; j < numUndo; j++)
+	group[undo[j]] = 0;
+    numGroups = saved;
+    return 0;
+}
+
+// pack what can be packed of code[from..to)
+// Returns: the number of packs made
+static int
+formPacks(int from, int to)
+{
+    int m[SLP_AVX2_LANES];
+    int i, j, n, k, made;
+
+    for (made = 0, i = from; i < to; i++){
+	if ( (-1 != packOf[i]) || !isCandidate(&code[i]) )
+	    continue;
+	m[0] = i;
+	for (n = 1, j = i + 1; (j < to) && (j < i + SLP_WINDOW) && (n < lanes);
+	     j++)
+	    if ( (-1 == packOf[j]) && isIsomorphic(&code[i], &code[j]) &&
+		 isIndependent(m, n, &code[j]) )
+		m[n++] = j;
+	if ( (n < lanes) || !layOut(m) )
+	    continue;
+
+	if ( (numPacks == capPacks) ){
+	    capPacks = (capPacks)? 2*capPacks : 64;
+	    member = realloc(member, capPacks * lanes * sizeof(int));
+	    ready = realloc(ready, capPacks * sizeof(int));
+	    if ( (NULL == member) || (NULL == ready) )
+		errExit(1, "...realloc()...");
+	}
+	for (k = 0; k < lanes; k++){
+	    member[numPacks*lanes + k] = m[k];
+	    packOf[m[k]] = numPacks;
+	}
+	ready[numPacks++] = 0;
+	made++;
+    }
+
+    return made;
+}
+
+/***************************************************
+* Scheduling
+*
+****************************************************/
+
+static int* edgeHead;       // per instruction: its first successor edge
+static int* edgeTo;
+static int* edgeNext;
+static int numEdges, capEdges;
+static int* need;           // per instruction: predecessors not listed
+static char* done;          // per instruction: 1 once listed
+
+static int* writer;         // per slot: last writer in the stretch
+static int* readHead;       // per slot: its readers since (readers[])
+static int* stamp;          // per slot: stretch writer, readHead are of
+static int* readers;        // reader, next: a list per slot
+static int* readNext;
+static int numReaders;
+static int stretch;
+
+static int* heap;           // of instructions (a pack: its first
+static int heapLen;         // member) ready, the first in code first
+
+static irInstr* out;        // the program vectorized
+static long* outWeight;
+static int outLen;
+
+static void
+addEdge(int from, int to)
+{
+    if ( (numEdges == capEdges) ){
+	capEdges = (capEdges)? 2*capEdges : 1024;
+	edgeTo = realloc(edgeTo, capEdges * sizeof(int));
+	edgeNext = realloc(edgeNext, capEdges * sizeof(int));
+	if ( (NULL == edgeTo) || (NULL == edgeNext) )
+	    errExit(1, "...realloc()...");
+    }
+    edgeTo[numEdges] = to;
+    edgeNext[numEdges] = edgeHead[from];
+    edgeHead[from] = numEdges++;
+    need[to]++;
+}
+
+static void
+touch(int s)
+{
+    if ( (stretch != stamp[s]) ){
+	stamp[s] = stretch;
+	writer[s] = -1;
+	readHead[s] = -1;
+    }
+}
+
+static void
+useSlot(int i, int s)
+{
+    touch(s);
+    if ( (-1 != writer[s]) )
+	addEdge(writer[s], i);
+    readers[numReaders] = i;
+    readNext[numReaders] = readHead[s];
+    readHead[s] = numReaders++;
+}
+
+static void
+defSlot(int i, int s)
+{
+    int r;
+
+    touch(s);
+    if ( (-1 != writer[s]) )
+	addEdge(writer[s], i);
+    for (r = readHead[s]; -1 != r; r = readNext[r])
+	if ( (i != readers[r]) )
+	    addEdge(readers[r], i);
+    readHead[s] = -1;
+    writer[s] = i;
+}
+
+// the DAG of code[from..to)
+static void
+buildDeps(int from, int to)
+{
+    const irInstr* ins;
+    int i, effect;
+
+    stretch++;
+    numEdges = numReaders = 0;
+    for (i = from; i < to; i++){
+	edgeHead[i] = -1;
+	need[i] = 0;
+	done[i] = 0;
+    }
+
+    for (effect = -1, i = from; i < to; i++){
+	ins = &code[i];
+	if ( (OPND_SLOT == ins->a.kind) )
+	    useSlot(i, ins->a.slot);
+	if ( (OPND_SLOT == ins->b.kind) )
+	    useSlot(i, ins->b.slot);
+	if ( (OPND_SLOT == ins->dest.kind) )
+	    defSlot(i, ins->dest.slot);
+	if ( (IR_READ == ins->op) || (IR_WRITE == ins->op) ||
+	     (IR_WRITELN == ins->op) || (IR_DIV == ins->op) ){
+	    if ( (-1 != effect) )
+		addEdge(effect, i);
+	    effect = i;
+	}
+    }
+}
+
+static void
+push(int i)
+{
+    int j, t;
+
+    for (j = heapLen++, heap[j] = i; (0 < j) && (heap[j] < heap[(j-1)/2]);
+	 j = (j-1)/2){
+	t = heap[j];
+	heap[j] = heap[(j-1)/2];
+	heap[(j-1)/2] = t;
+    }
+}
+
+static int
+pop(void)
+{
+    int i, j, c, t;
+
+    i = heap[0];
+    heap[0] = heap[--heapLen];
+    for (j = 0; (c = 2*j + 1) < heapLen; j = c){
+	if ( (c + 1 < heapLen) && (heap[c + 1] < heap[c]) )
+	    c++;
+	if ( (heap[j] <= heap[c]) )
+	    break;
+	t = heap[j];
+	heap[j] = heap[c];
+	heap[c] = t;
+    }
+    return i;
+}
+
+// code[i] has no predecessors left
+static void
+release(int i)
+{
+    int p;
+
+    if ( (-1 == (p = packOf[i])) )
+	push(i);
+    else if ( (lanes == ++ready[p]) )
+	push(member[p*lanes]);
+}
+
+// code[i] is listed: its successors may be ready
+static void
+listed(int i)
+{
+    int e;
+
+    done[i] = 1;
+    for (e = edgeHead[i]; -1 != e; e = edgeNext[e])
+	if ( (0 == --need[edgeTo[e]]) )
+	    release(edgeTo[e]);
+}
+
+static void
+emit(const irInstr* ins, long weight)
+{
+    out[outLen] = *ins;
+    if ( (NULL != outWeight) )
+	outWeight[outLen] = weight;
+    outLen++;
+}
+
+// list code[i]; or, if it is the first member of a pack, the pack
+static void
+list(const irProgram* prog, int i)
+{
+    irInstr v;
+    long w;
+    int k, p;
+
+    if ( (-1 == (p = packOf[i])) ){
+	emit(&code[i], (NULL != prog->weight)? prog->weight[i] : 0);
+	listed(i);
+	return;
+    }
+
+    v = code[i];
+    v.op = code[i].op - IR_ASSIGN + IR_VASSIGN;
+    for (w = 0, k = 0; k < lanes; k++)
+	if ( (NULL != prog->weight) )
+	    w += prog->weight[member[p*lanes + k]];
+    emit(&v, w);
+    for (k = 0; k < lanes; k++)
+	listed(member[p*lanes + k]);
+}
+
+// the members of pack p are on their own again
+static void
+drop(int p)
+{
+    int k, i;
+
+    for (k = 0; k < lanes; k++){
+	i = member[p*lanes + k];
+	packOf[i] = -1;
+	if ( (0 == need[i]) )
+	    push(i);
+    }
+}
+
+// list code[from..to), packs made
+static void
+schedule(const irProgram* prog, int from, int to)
+{
+    int i, low, left;
+
+    buildDeps(from, to);
+    heapLen = 0;
+    for (i = from; i < to; i++)
+	if ( (0 == need[i]) )
+	    release(i);
+
+    for (low = from, left = to - from; 0 < left; ){
+	while ( (0 < heapLen) ){
+	    i = pop();
+	    left -= (-1 == packOf[i])? 1 : lanes;
+	    list(prog, i);
+	}
+	if ( (0 == left) )
+	    break;
+	// the first instruction not listed has all its predecessors
+	// listed: it waits for its pack
+	while (done[low])
+	    low++;
+	drop(packOf[low]);
+    }
+}
+
+/***************************************************
+* The pass
+*
+****************************************************/
+
+static int
+endsStretch(enum irOp op)
+{
+    switch(op){
+    case IR_FUNCTION: case IR_END: case IR_PARAM: case IR_RETURN:
+    case IR_ARG: case IR_CALL: case IR_LABEL: case IR_JUMP:
+    case IR_BEQ: case IR_BNE: case IR_BLT: case IR_BLE: case IR_BGT:
+    case IR_BGE:
+	return 1;
+    default:
+	return 0;
+    }
+}
+
+// slots of groups are numbered anew, in a row, past the others
+static void
+renumber(irProgram* prog)
+{
+    irOperand* o[3];
+    int i, j, s;
+
+    for (i = 0; i < prog->len; i++){
+	o[0] = &prog->code[i].dest; o[1] = &prog->code[i].a;
+	o[2] = &prog->code[i].b;
+	for (j = 0; j < 3; j++){
+	    if ( (OPND_SLOT != o[j]->kind) || (0 == group[s = o[j]->slot]) )
+		continue;
+	    o[j]->slot = prog->numSlots + (group[s] - 1)*lanes + lane[s];
+	}
+    }
+    prog->numSlots += numGroups * lanes;
+}
+
+// copy code[from..to) as it is
+static void
+copy(const irProgram* prog, int from, int to)
+{
+    int i;
+
+    for (i = from; i < to; i++)
+	emit(&code[i], (NULL != prog->weight)? prog->weight[i] : 0);
+}
+
+void
+slp_vectorize(irProgram* prog)
+{
+    int i, from, n, numSlots, vectors;
+
+    if ( !enabled || (0 == prog->len) )
+	return;
+
+    code = prog->code;
+    n = prog->len;
+    numSlots = prog->numSlots + 1;
+    group = calloc(numSlots, sizeof(int));
+    lane = calloc(numSlots, sizeof(int));
+    stamp = calloc(numSlots, sizeof(int));
+    writer = malloc(numSlots * sizeof(int));
+    readHead = malloc(numSlots * sizeof(int));
+    undo = malloc(3 * lanes * sizeof(int));
+    packOf = malloc(n * sizeof(int));
+    edgeHead = malloc(n * sizeof(int));
+    need = malloc(n * sizeof(int));
+    done = malloc(n);
+    heap = malloc(n * sizeof(int));
+    readers = malloc(2 * n * sizeof(int));
+    readNext = malloc(2 * n * sizeof(int));
+    out = malloc(n * sizeof(irInstr));
+    outWeight = (NULL != prog->weight)? malloc(n * sizeof(long)) : NULL;
+    if ( (NULL == group) || (NULL == lane) || (NULL == stamp) ||
+	 (NULL == writer) || (NULL == readHead) || (NULL == undo) ||
+	 (NULL == packOf) || (NULL == edgeHead) || (NULL == need) ||
+	 (NULL == done) || (NULL == heap) || (NULL == readers) ||
+	 (NULL == readNext) || (NULL == out) ||
+	 ( (NULL != prog->weight) && (NULL == outWeight) ) )
+	errExit(1, "...malloc()...");
+    for (i = 0; i < n; i++)
+	packOf[i] = -1;
+    numGroups = numPacks = outLen = stretch = 0;
+
+    for (i = 0; i < n; ){
+	if ( endsStretch(code[i].op) ){
+	    copy(prog, i, i + 1);
+	    i++;
+	    continue;
+	}
+	for (from = i; (i < n) && !endsStretch(code[i].op); i++)
+	    ;
+	if ( (0 == formPacks(from, i)) )
+	    copy(prog, from, i);
+	else
+	    schedule(prog, from, i);
+    }
+
+    for (vectors = 0, i = 0; i < outLen; i++)
+	vectors += ir_isVector(out[i].op);
+    free(prog->code);
+    free(prog->weight);
+    prog->code = out;
+    prog->weight = outWeight;
+    prog->len = outLen;
+    prog->cap = n;
+    prog->lanes = (vectors)? lanes : 0;
+    if ( (0 != numGroups) )
+	renumber(prog);
+
+    free(group);
+    free(lane);
+    free(stamp);
+    free(writer);
+    free(readHead);
+    free(undo);
+    free(packOf);
+    free(edgeHead);
+    free(need);
+    free(done);
+    free(heap);
+    free(readers);
+    free(readNext);
+    free(member);
+    free(ready);
+    free(edgeTo);
+    free(edgeNext);
+    member = ready = edgeTo = edgeNext = NULL;
+    capPacks = capEdges = 0;
+}
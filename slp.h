@@ -0,0 +1,25 @@
+/*******************************************************
+* slp.h -              header file for slp.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         slp_setLanes(4);            // --avx2
+*         slp_setEnabled(0);          // --no-slp
+*         slp_vectorize(&irProg);     // before ir_packSlots()
+********************************************************/
+
+#ifndef SLP_H_
+#define SLP_H_
+
+#include "ir.h"
+
+#define SLP_LANES 2          // default: SSE2, 2 x 64 bit
+#define SLP_AVX2_LANES 4     // --avx2: 4 x 64 bit
+#define SLP_WINDOW 64        // instructions searched for a pack
+
+void slp_setEnabled(int on);
+void slp_setLanes(int n);
+void slp_vectorize(irProgram* prog);
+
+#endif
@@ -0,0 +1,302 @@
+/*******************************************************
+* strength.c -         strength reduction of integer
+*                      multiplication and division by
+*                      constants
+* Language:            Micro
+*
+* x * c becomes shifts and adds/subtracts, when that
+* takes at most 2 instructions. x / c becomes shifts
+* (c = +-2^k), or a multiply-high by a "magic" number
+* and shifts (Warren, Hacker's Delight, ch. 10), with the
+* rounding toward zero of IR_DIV. All of it is exact in
+* wrapping (two's complement) arithmetic of 32 (int) or
+* 64 (long) bits; new opcodes:
+*   Shl   d, x, k    d = x << k
+*   Sar   d, x, k    d = x >> k, arithmetic
+*   Shr   d, x, k    d = x >> k, logical
+*   MulHi d, x, m    d = high half of the double-width
+*                        signed product x * m
+* Division by 0 is left alone (it fails at run time), as
+* is division by -1 (the IR_DIV semantics apply).
+* The new opcodes are defined here once: strength_apply()
+* evaluates them (peval.c, batch.c), strength_cExpr()
+* gives them as C (emitc.c).
+********************************************************/
+
+#include "compiler.h"
+#include "strength.h"
+
+typedef struct seqBuilder{
+    irInstr* seq;
+    int len;
+    int type;
+} seqBuilder;
+
+static irOperand
+slotOpnd(int type, int slot)
+{
+    irOperand o;
+
+    o.kind = OPND_SLOT;
+    o.type = type;
+    o.slot = slot;
+    return o;
+}
+
+static irOperand
+litOpnd(int type, long val)
+{
+    irOperand o;
+
+    o.kind = OPND_INT;
+    o.type = type;
+    o.val_int = val;
+    return o;
+}
+
+// Returns: the dest of the new instruction (a fresh temporary)
+static irOperand
+add(seqBuilder* sb, enum irOp op, irOperand a, irOperand b)
+{
+    irInstr* ins;
+
+    ins = &sb->seq[sb->len++];
+    ins->op = op;
+    ins->type = sb->type;
+    ins->dest = slotOpnd(sb->type, sb->len);
+    ins->a = a;
+    ins->b = b;
+    ins->name = NULL;
+
+    return ins->dest;
+}
+
+// Returns: k if u == 2^k; -1 otherwise
+static int
+log2Exact(unsigned long u)
+{
+    int k;
+
+    if ( (0 == u) || (0 != (u & (u - 1))) )
+	return -1;
+    for (k = 0; 1ul != u; k++)
+	u >>= 1;
+    return k;
+}
+
+static int
+reduceMul(seqBuilder* sb, long c, unsigned long mask)
+{
+    irOperand x, t, zero;
+    unsigned long u;
+    int k;
+
+    x = slotOpnd(sb->type, STRENGTH_X);
+    zero = litOpnd(sb->type, 0);
+    u = ((0 > c)? 0ul - (unsigned long) c : (unsigned long) c) & mask;
+
+    if ( (0 == c) )
+	add(sb, IR_ASSIGN, zero, zero);
+    else if ( (1 == c) )
+	add(sb, IR_ASSIGN, x, zero);
+    else if ( (0 <= (k = log2Exact(u))) ){
+	t = add(sb, IR_SHL, x, litOpnd(sb->type, k));
+	if ( (0 > c) )
+	    add(sb, IR_SUB, zero, t);
+    }
+    else if ( (0 < c) && (0 <= (k = log2Exact(u - 1))) ){
+	t = add(sb, IR_SHL, x, litOpnd(sb->type, k));
+	add(sb, IR_ADD, t, x);
+    }
+    else if ( (0 < c) && (0 <= (k = log2Exact(u + 1))) ){
+	t = add(sb, IR_SHL, x, litOpnd(sb->type, k));
+	add(sb, IR_SUB, t, x);
+    }
+    else
+	return 0; // imul is as good
+
+    // ASSIGN takes its value from a only
+    sb->seq[sb->len - 1].b.kind = (IR_ASSIGN == sb->seq[sb->len - 1].op)?
+	OPND_NONE : sb->seq[sb->len - 1].b.kind;
+    return sb->len;
+}
+
+// Hacker's Delight, figure 10-1, for n-bit words (n = 32, 64);
+// d not in { -1, 0, 1 }, |d| not a power of 2
+static void
+magic(long d, int n, long* m, int* s)
+{
+    unsigned long mask, two, ad, anc, t, q1, r1, q2, r2, delta;
+    int p;
+
+    mask = (64 == n)? ~0ul : (1ul << n) - 1;
+    two = 1ul << (n - 1);
+    ad = ((0 > d)? 0ul - (unsigned long) d : (unsigned long) d) & mask;
+    t = two + (((unsigned long) d & mask) >> (n - 1));
+    anc = t - 1 - t % ad;
+    p = n - 1;
+    q1 = two / anc;
+    r1 = two - q1 * anc;
+    q2 = two / ad;
+    r2 = two - q2 * ad;
+    do{
+	p++;
+	q1 = (2 * q1) & mask;
+	r1 = (2 * r1) & mask;
+	if ( (r1 >= anc) ){
+	    q1 = (q1 + 1) & mask;
+	    r1 = (r1 - anc) & mask;
+	}
+	q2 = (2 * q2) & mask;
+	r2 = (2 * r2) & mask;
+	if ( (r2 >= ad) ){
+	    q2 = (q2 + 1) & mask;
+	    r2 = (r2 - ad) & mask;
+	}
+	delta = (ad - r2) & mask;
+    } while ( (q1 < delta) || ( (q1 == delta) && (0 == r1) ) );
+
+    t = (q2 + 1) & mask;
+    if ( (0 > d) )
+	t = (0 - t) & mask;
+    *m = (64 == n)? (long) t : (long) (int) (unsigned) t;
+    *s = p - n;
+}
+
+static int
+reduceDiv(seqBuilder* sb, long d, int n)
+{
+    irOperand x, q, t, zero;
+    unsigned long u;
+    long m;
+    int k, s;
+
+    x = slotOpnd(sb->type, STRENGTH_X);
+    zero = litOpnd(sb->type, 0);
+    u = (0 > d)? 0ul - (unsigned long) d : (unsigned long) d;
+    if ( (32 == n) )
+	u &= 0xfffffffful;
+
+    if ( (0 == d) || (-1 == d) )
+	return 0;
+    if ( (1 == d) ){
+	add(sb, IR_ASSIGN, x, zero);
+	sb->seq[0].b.kind = OPND_NONE;
+	return sb->len;
+    }
+
+    if ( (0 <= (k = log2Exact(u))) ){
+	// round toward 0: add 2^k - 1 to negative x first
+	t = add(sb, IR_SAR, x, litOpnd(sb->type, n - 1));
+	t = add(sb, IR_SHR, t, litOpnd(sb->type, n - k));
+	t = add(sb, IR_ADD, x, t);
+	q = add(sb, IR_SAR, t, litOpnd(sb->type, k));
+	if ( (0 > d) )
+	    add(sb, IR_SUB, zero, q);
+	return sb->len;
+    }
+
+    magic(d, n, &m, &s);
+    q = add(sb, IR_MULHI, x, litOpnd(sb->type, m));
+    if ( (0 < d) && (0 > m) )
+	q = add(sb, IR_ADD, q, x);
+    else if ( (0 > d) && (0 < m) )
+	q = add(sb, IR_SUB, q, x);
+    if ( (0 != s) )
+	q = add(sb, IR_SAR, q, litOpnd(sb->type, s));
+    t = add(sb, IR_SHR, q, litOpnd(sb->type, n - 1)); // 1 if q < 0
+    add(sb, IR_ADD, q, t);
+
+    return sb->len;
+}
+
+// op: IR_MUL (c either operand) or IR_DIV (c the divisor);
+// type: INTEGER or LONG; c: the constant, in type's range
+int
+strength_reduce(enum irOp op, int type, long c, irInstr* seq)
+{
+    seqBuilder sb;
+
+    if ( (INTEGER != type) && (LONG != type) )
+	return 0;
+
+    sb.seq = seq;
+    sb.len = 0;
+    sb.type = type;
+    if ( (INTEGER == type) )
+	c = (int) c;
+
+    if ( (IR_MUL == op) )
+	return reduceMul(&sb, c, (INTEGER == type)? 0xfffffffful : ~0ul);
+    if ( (IR_DIV == op) )
+	return reduceDiv(&sb, c, (INTEGER == type)? 32 : 64);
+    return 0;
+}
+
+// the new opcodes, Shl to MulHi, as C: int, then long
+static const char* cExpr[][2] = {
+    { "(int) ((unsigned) %s << %ld)",
+      "(long) ((unsigned long) %s << %ld)" },
+    { "%s >> %ld", "%s >> %ld" },
+    { "(int) ((unsigned) %s >> %ld)",
+      "(long) ((unsigned long) %s >> %ld)" },
+    { "(int) (((long) %s * %ldL) >> 32)",
+      "(long) (((__int128) %s * (%ldL)) >> 64)" }
+};
+
+// op: Shl, Sar, Shr or MulHi; type: INTEGER or LONG; d, x: n
+// values of type; b: the literal operand
+void
+strength_apply(enum irOp op, int type, void* d, const void* x, long b, int n)
+{
+    const int* xi = x;
+    const long* xl = x;
+    int* di = d;
+    long* dl = d;
+    int i, k;
+
+    k = (int) b;
+    if ( (INTEGER == type) ){
+	switch(op){
+	case IR_SHL:
+	    for (i = 0; i < n; i++) di[i] = (int) ((unsigned) xi[i] << k);
+	    break;
+	case IR_SAR:
+	    for (i = 0; i < n; i++) di[i] = xi[i] >> k;
+	    break;
+	case IR_SHR:
+	    for (i = 0; i < n; i++) di[i] = (int) ((unsigned) xi[i] >> k);
+	    break;
+	default:
+	    for (i = 0; i < n; i++) di[i] = (int) (((long) xi[i] * b) >> 32);
+	    break;
+	}
+    }
+    else{
+	switch(op){
+	case IR_SHL:
+	    for (i = 0; i < n; i++)
+		dl[i] = (long) ((unsigned long) xl[i] << k);
+	    break;
+	case IR_SAR:
+	    for (i = 0; i < n; i++) dl[i] = xl[i] >> k;
+	    break;
+	case IR_SHR:
+	    for (i = 0; i < n; i++)
+		dl[i] = (long) ((unsigned long) xl[i] >> k);
+	    break;
+	default:
+	    for (i = 0; i < n; i++)
+		dl[i] = (long) (((__int128) xl[i] * b) >> 64);
+	    break;
+	}
+    }
+}
+
+// Returns: a format of x (%s) and the literal b (%ld) - the C
+//          expression of op of type
+const char*
+strength_cExpr(enum irOp op, int type)
+{
+    return cExpr[op - IR_SHL][LONG == type];
+}
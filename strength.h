@@ -0,0 +1,33 @@
+/*******************************************************
+* strength.h -         header file for strength.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         irInstr seq[STRENGTH_MAX];
+*         n = strength_reduce(IR_DIV, INTEGER, 7, seq);
+*         // n == 0: leave the Div alone; otherwise emit
+*         // seq[0..n-1], with the operands renamed (below)
+* Operands of seq: slot STRENGTH_X is the non-constant
+* operand; slot k > 0 is the k-th temporary of the
+* sequence, and the last instruction's dest is the
+* result (it is always a temporary).
+*         strength_apply(IR_SAR, INTEGER, d, x, 3, n);
+*         // d[i] = x[i] >> 3, for i < n
+*         fprintf(out, strength_cExpr(IR_SAR, INTEGER), "x", 3L);
+********************************************************/
+
+#ifndef STRENGTH_H_
+#define STRENGTH_H_
+
+#include "ir.h"
+
+#define STRENGTH_MAX 6     // longest sequence produced
+#define STRENGTH_X -1
+
+int strength_reduce(enum irOp op, int type, long c, irInstr* seq);
+void strength_apply(enum irOp op, int type, void* d, const void* x, long b,
+		    int n);
+const char* strength_cExpr(enum irOp op, int type);
+
+#endif
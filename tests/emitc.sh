@@ -0,0 +1,50 @@
+#!/bin/sh
+# emitc.sh - compile every micro_*.mic sample with --emit=c and cc, run
+# it, and compare what it prints, and its exit status, with --run
+#
+# usage: tests/emitc.sh [micro]   (default: ./micro; CC: the C compiler)
+#
+# A sample's input is micro_N.in next to it, if there is one. A sample
+# that does not compile must fail the same way with --run.
+
+MICRO=${1:-./micro}
+CC=${CC:-cc}
+DIR=$(dirname "$0")/..
+TMP=${TMPDIR:-/tmp}/micro-emitc.$$
+fail=0
+num=0
+
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+for src in "$DIR"/micro_*.mic; do
+    name=$(basename "$src" .mic)
+    in="$DIR/$name.in"
+    [ -f "$in" ] || in=/dev/null
+    num=$((num + 1))
+
+    $MICRO --emit=none --run="$in" "$src" > "$TMP/want" 2>&1
+    echo "exit $?" >> "$TMP/want"
+
+    if $MICRO --emit=c "$src" > "$TMP/p.c" 2> "$TMP/err"; then
+	if ! $CC -O2 -o "$TMP/p" "$TMP/p.c" -lm 2> "$TMP/err"; then
+	    echo "FAIL $name: cc"
+	    cat "$TMP/err"
+	    fail=1
+	    continue
+	fi
+	"$TMP/p" < "$in" > "$TMP/got" 2>&1
+	echo "exit $?" >> "$TMP/got"
+    else
+	{ cat "$TMP/err"; echo "exit 1"; } > "$TMP/got"
+    fi
+
+    if ! cmp -s "$TMP/want" "$TMP/got"; then
+	echo "FAIL $name"
+	diff "$TMP/want" "$TMP/got" | head -10
+	fail=1
+    fi
+done
+
+[ $fail -eq 0 ] && echo "emitc: $num samples passed"
+exit $fail
@@ -0,0 +1,185 @@
+#!/bin/sh
+# growth.sh - compile sources written to defeat the compiler, at sizes
+# n, 2n, 4n, and 8n, fit how the time of each phase of the compile
+# (--time-phases: lex, parse, peval, sched, pack, emit) grows with n,
+# and fail if one grows faster than n log n
+#
+# usage: tests/growth.sh [micro [kind ...]]   (default: ./micro, all kinds)
+#
+# kinds: coll  names that share a hash chain under h = c + 31 * h
+#              (n < 2^15, as names are MAX_ID_LEN long at most)
+#        comm  runs of comment lines
+#        paren nested parentheses
+#        chain a + a + ... + a
+#        block nested begin ... end
+#        nest  nested while loops
+#        sib   while loops side by side, in one loop
+#        ifs   if statements in one loop
+
+MICRO=${1:-./micro}
+[ $# -gt 0 ] && shift
+KINDS=${*:-"coll comm paren chain block nest sib ifs"}
+TMP=${TMPDIR:-/tmp}/micro-growth.$$
+SLACK=0.25     # exponent allowed above that of n log n (timing noise)
+FLOOR=20       # ms; a phase faster at 8n is too fast to fit
+fail=0
+
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+# gen kind n: the source, on stdout
+gen()
+{
+    awk -v kind="$1" -v n="$2" 'BEGIN {
+	print "begin"
+	if (kind == "coll") {            # "Aa" and "BB" hash alike
+	    for (k = 0; 2 ^ k < n; k++)
+		;
+	    for (i = 0; i < n; i++) {
+		name = "v"
+		b = i
+		for (j = 0; j < k; j++) {
+		    name = name ((b % 2)? "Aa" : "BB")
+		    b = int(b / 2)
+		}
+		printf "int %s := %d;\n", name, i % 7
+		if (i % 64 == 0)
+		    printf "write(%s);\n", name
+	    }
+	} else if (kind == "comm") {
+	    for (i = 0; i < n; i++)
+		print "-- a comment line"
+	    print "write(1);"
+	} else if (kind == "paren") {
+	    printf "int a;\nread(a);\nwrite("
+	    for (i = 0; i < n; i++)
+		printf "("
+	    printf "a"
+	    for (i = 0; i < n; i++)
+		printf ")"
+	    print ");"
+	} else if (kind == "chain") {
+	    printf "int a;\nread(a);\nwrite(a"
+	    for (i = 0; i < n; i++)
+		printf " + a"
+	    print ");"
+	} else if (kind == "block") {
+	    print "int a;\nread(a);"
+	    for (i = 0; i < n; i++)
+		print "begin"
+	    print "write(a);"
+	    for (i = 0; i < n; i++)
+		print "end"
+	} else if (kind == "nest") {
+	    print "int a;\nint s := 0;\nread(a);"
+	    for (i = 0; i < n; i++)
+		printf "int i%d := 0;\n", i
+	    for (i = 0; i < n; i++)
+		printf "while i%d < 1 do\n", i
+	    print "s := s + a * 3;"
+	    for (i = n - 1; i >= 0; i--)
+		printf "i%d := i%d + 1;\nend;\n", i, i
+	    print "write(s);"
+	} else if (kind == "sib" || kind == "ifs") {
+	    print "int a;\nint s := 0;\nint k := 0;\nread(a);"
+	    print "while k < 1 do"
+	    for (i = 0; i < n; i++)
+		if (kind == "sib")
+		    printf "begin int i := 0; while i < 1 do " \
+			"s := s + a * %d; i := i + 1; end; end;\n", i + 2
+		else
+		    printf "if s > %d then s := s + a * %d; end;\n", i, i + 2
+	    print "k := k + 1;\nend;\nwrite(s);"
+	}
+	print "end"
+    }'
+}
+
+# base kind: the smallest n
+base()
+{
+    case $1 in
+    coll) echo 4000 ;;
+    comm) echo 500000 ;;
+    paren|block) echo 500 ;;
+    chain) echo 25000 ;;
+    nest) echo 500 ;;
+    sib) echo 2500 ;;
+    ifs) echo 10000 ;;
+    *) echo 0 ;;
+    esac
+}
+
+# phases src: per phase, the best of three times of compiling src to
+# assembly, in ms: lex parse peval sched pack emit
+phases()
+{
+    for r in 1 2 3; do
+	$MICRO --time-phases --emit=asm:/dev/null "$1" 2>&1 > /dev/null |
+	    grep '^phases:' || echo "error" > "$TMP/err"
+    done | awk '{
+	for (k = 0; k < 6; k++)
+	    if (NR == 1 || $(3 + 3 * k) < best[k])
+		best[k] = $(3 + 3 * k)
+    } END {
+	for (k = 0; k < 6; k++)
+	    printf " %s", best[k]
+	print ""
+    }'
+}
+
+for kind in $KINDS; do
+    n=$(base "$kind")
+    if [ "$n" -eq 0 ]; then
+	echo "growth: unknown kind $kind"
+	fail=1
+	continue
+    fi
+    rm -f "$TMP/err"
+    : > "$TMP/points"
+    for k in 1 2 4 8; do
+	gen "$kind" $((n * k)) > "$TMP/src.mic"
+	echo "$((n * k))$(phases "$TMP/src.mic")" >> "$TMP/points"
+    done
+    if [ -f "$TMP/err" ]; then
+	echo "FAIL $kind: does not compile"
+	fail=1
+	continue
+    fi
+
+    # per phase, least squares of log t on log n; n log n over n..8n
+    # grows with the exponent of (8n log 8n) / (n log n)
+    awk -v kind="$kind" -v slack="$SLACK" -v floor="$FLOOR" '{
+	n[NR] = $1
+	for (p = 1; p <= 6; p++)
+	    t[NR, p] = $(p + 1)
+    } END {
+	split("lex parse peval sched pack emit", name)
+	r = n[NR] / n[1]
+	allowed = log(r * log(n[NR]) / log(n[1])) / log(r) + slack
+	for (p = 1; p <= 6; p++) {
+	    sx = sy = sxx = sxy = 0
+	    times = ""
+	    for (i = 1; i <= NR; i++) {
+		x = log(n[i]); y = log(t[i, p] + 1)
+		sx += x; sy += y; sxx += x * x; sxy += x * y
+		times = times sprintf(" %.0f", t[i, p])
+	    }
+	    if (t[NR, p] < floor) {
+		printf "ok   %-5s %-5s n=%d..%d ms:%s (too fast to fit)\n",
+		    kind, name[p], n[1], n[NR], times
+		continue
+	    }
+	    slope = (NR * sxy - sx * sy) / (NR * sxx - sx * sx)
+	    printf "%s %-5s %-5s n=%d..%d ms:%s grows as n^%.2f " \
+		"(n log n: n^%.2f)\n", (slope > allowed)? "FAIL" : "ok  ",
+		kind, name[p], n[1], n[NR], times, slope, allowed - slack
+	    if (slope > allowed)
+		bad = 1
+	}
+	exit bad
+    }' "$TMP/points" || fail=1
+done
+
+[ $fail -eq 0 ] && echo "growth: all within n log n"
+exit $fail
@@ -0,0 +1,15 @@
+-- the other module of link.mic
+long twice(long v) begin
+    if v > 1000 then v := v - 1; end;
+    return v + v;
+end
+
+export long scale(long v, int k) begin
+    return twice(v) * k + 1;
+end
+
+export float mean(float a, float b) begin
+    float m := (a + b) / 2.0;
+    if m < 0.0 then m := 0.0 - m; end;
+    return m;
+end
@@ -0,0 +1,71 @@
+#!/bin/sh
+# pipeline.sh - compile sources to assembly with and without --pipeline,
+# check that the output is the same, and report the best of three wall
+# times of each, with the share of the serial compile (--time-phases)
+# each thread of --pipeline would do
+#
+# usage: tests/pipeline.sh [micro [source ...]]
+#        (default: ./micro; a generated source of 80000 ifs in a loop)
+#
+# The lexer thread lexes; the parser's thread parses and runs peval;
+# with --emit=asm, the output thread only hands instructions on, as
+# sched, pack, and emit need the whole program: they run after the
+# parse, on one thread, either way.
+
+MICRO=${1:-./micro}
+[ $# -gt 0 ] && shift
+TMP=${TMPDIR:-/tmp}/micro-pipeline.$$
+fail=0
+
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+if [ $# -eq 0 ]; then
+    awk 'BEGIN {
+	print "begin\nint a;\nint s := 0;\nint k := 0;\nread(a);"
+	print "while k < 1 do"
+	for (i = 0; i < 80000; i++)
+	    printf "if s > %d then s := s + a * %d; end;\n", i, i + 2
+	print "k := k + 1;\nend;\nwrite(s);\nend"
+    }' > "$TMP/ifs.mic"
+    set -- "$TMP/ifs.mic"
+fi
+
+# ms opt src: the best of three wall times of compiling src, in ms
+ms()
+{
+    best=
+    for r in 1 2 3; do
+	t0=$(date +%s%N)
+	$MICRO $1 --emit=asm "$2" > /dev/null 2>&1
+	t1=$(date +%s%N)
+	t=$(( (t1 - t0) / 1000000 ))
+	[ -z "$best" ] || [ "$t" -lt "$best" ] && best=$t
+    done
+    echo "$best"
+}
+
+for src in "$@"; do
+    name=$(basename "$src" .mic)
+    $MICRO --emit=asm "$src" > "$TMP/want" 2>&1
+    $MICRO --pipeline --emit=asm "$src" > "$TMP/got" 2>&1
+    if ! cmp -s "$TMP/want" "$TMP/got"; then
+	echo "FAIL $name: --pipeline changes the output"
+	fail=1
+	continue
+    fi
+
+    serial=$(ms "" "$src")
+    piped=$(ms --pipeline "$src")
+    $MICRO --time-phases --emit=asm:/dev/null "$src" 2>&1 |
+	grep '^phases:' | awk -v name="$name" -v s="$serial" -v p="$piped" '{
+	    lex = $3; parse = $6 + $9; after = $12 + $15 + $18
+	    all = lex + parse + after
+	    printf "%s: serial %d ms, --pipeline %d ms (%+.0f%%); " \
+		"lexer %.0f%%, parser %.0f%%, after the parse %.0f%%\n",
+		name, s, p, (s > 0)? 100 * (p - s) / s : 0,
+		100 * lex / all, 100 * parse / all, 100 * after / all
+	}'
+done
+
+exit $fail
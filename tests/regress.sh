@@ -0,0 +1,125 @@
+#!/bin/sh
+# regress.sh - run each tests/<name>.mic on <name>.in, in every mode
+# and through every native backend, and compare with <name>.out
+#
+# usage: tests/regress.sh [micro]   (default: ./micro; CC: the C compiler)
+#
+# A test that does not compile expects what micro reports in <name>.out.
+# <name>.flags, if there is one, lists more option sets to run it with,
+# one per line, for the passes it is there to test. A test with a
+# <name>.mod is a module: both compile to units, which are linked. One
+# with a <name>.pre uses it as a prelude, precompiled. One with a
+# <name>.train is compiled with the profile of a run on that input.
+# One with <name>.rows in place of <name>.in runs once per row of it;
+# --batch, given the rows BATCH_ROWS times over and more, must print
+# the same, as many times.
+
+MICRO=${1:-./micro}
+CC=${CC:-cc}
+DIR=$(dirname "$0")
+TMP=${TMPDIR:-/tmp}/micro-regress.$$
+fail=0
+
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+# the run-time support the native backends' programs call; it must be
+# what rtsrc.sh makes of the sources now
+if ! sh "$DIR/../rtsrc.sh" | cmp -s - "$DIR/../rtsrc.c.inc"; then
+    echo "FAIL rtsrc.c.inc is out of date: run rtsrc.sh"
+    fail=1
+fi
+printf 'begin\nend\n' | $MICRO --emit=rt > "$TMP/rt.c" &&
+    $CC -O2 -c -o "$TMP/rt.o" "$TMP/rt.c" || exit 1
+
+check()
+{
+    if ! cmp -s "$1" "$TMP/got"; then
+	echo "FAIL $2"
+	fail=1
+    fi
+}
+
+# build options emit...: compile the test with options, for micro's
+# --emit (and --run) arguments emit...
+build()
+{
+    o=$1
+    shift
+    if [ -f "$pre" ]; then
+	$MICRO $o --precompile="$TMP/g.glb" "$pre" || return 1
+	o="$o --use-globals=$TMP/g.glb"
+    fi
+    if [ -f "$train" ]; then
+	$MICRO $o --emit=none --run="$train" --profile-gen="$TMP/p.prof" \
+	    "$src" > /dev/null || return 1
+	o="$o --profile-use=$TMP/p.prof"
+    fi
+    if [ -f "$mod" ]; then
+	$MICRO $o --compile="$TMP/m.u" "$mod" &&
+	    $MICRO $o --compile="$TMP/p.u" "$src" &&
+	    $MICRO $o --link "$@" "$TMP/m.u" "$TMP/p.u"
+    else
+	$MICRO $o "$@" "$src"
+    fi
+}
+
+# run command...: command on the test's input; once per row, if it has
+# rows, stopping at the first that fails
+run()
+{
+    if [ -f "$rows" ]; then
+	while read -r row; do
+	    echo "$row" | "$@" || return 1
+	done < "$rows"
+    else
+	"$@" < "$in"
+    fi
+}
+
+for src in "$DIR"/*.mic; do
+    name=$(basename "$src" .mic)
+    in="$DIR/$name.in"
+    out="$DIR/$name.out"
+    mod="$DIR/$name.mod"
+    pre="$DIR/$name.pre"
+    train="$DIR/$name.train"
+    rows="$DIR/$name.rows"
+    if [ -f "$rows" ]; then  # 40 times over: more than BATCH_ROWS (1024)
+	for f in "$rows" "$out"; do
+	    awk '{ l[NR] = $0 } END { for (i = 0; i < 40; i++)
+		for (j = 1; j <= NR; j++) print l[j] }' "$f" \
+		> "$TMP/$(basename "$f")"
+	done
+    fi
+    [ -f "$in" ] || in=/dev/null
+    flags="$DIR/$name.flags"
+    [ -f "$flags" ] || flags=/dev/null
+
+    { printf '\n--no-fold\n--no-inline\n--no-sched --no-slp\n'; cat "$flags"; } \
+	> "$TMP/opts"
+    while read -r opts <&3; do
+	run build "$opts" --emit=none --run > "$TMP/got" 2>&1
+	check "$out" "$name --run $opts"
+
+	if [ -f "$rows" ]; then
+	    build "$opts" --emit=none --batch="$TMP/$name.rows" > "$TMP/got" 2>&1
+	    check "$TMP/$name.out" "$name --batch $opts"
+	fi
+
+	build "$opts" --emit=c > "$TMP/p.c" 2> "$TMP/got" &&
+	    $CC -O2 -o "$TMP/c" "$TMP/p.c" -lm && run "$TMP/c" > "$TMP/got" 2>&1
+	check "$out" "$name --emit=c $opts"
+
+	build "$opts" --emit=asm > "$TMP/p.s" 2> "$TMP/got" &&
+	    $CC -o "$TMP/asm" "$TMP/p.s" "$TMP/rt.o" -lm && run "$TMP/asm" > "$TMP/got" 2>&1
+	check "$out" "$name --emit=asm $opts"
+
+	build "$opts" --emit=obj:"$TMP/p.o" 2> "$TMP/got" &&
+	    $CC -o "$TMP/obj" "$TMP/p.o" "$TMP/rt.o" -lm && run "$TMP/obj" > "$TMP/got" 2>&1
+	check "$out" "$name --emit=obj $opts"
+    done 3< "$TMP/opts"
+done
+
+[ 0 = "$fail" ] && echo "regress: all passed"
+exit $fail
@@ -0,0 +1,21 @@
+#!/bin/sh
+# strength.sh - verify the sequences of strength.c (tests/strength_check.c)
+#
+# usage: tests/strength.sh [-a]
+#        -a: also run every int x through the Mul and Div of one
+#            constant of each form a sequence takes (about a minute
+#            each); without it, sampled x for thousands of constants
+
+CC=${CC:-cc}
+DIR=$(dirname "$0")
+BIN=${TMPDIR:-/tmp}/strength_check.$$
+
+trap 'rm -f "$BIN"' EXIT
+$CC -O3 -o "$BIN" "$DIR/strength_check.c" "$DIR/../strength.c" || exit 1
+"$BIN" || exit 1
+if [ "-a" = "$1" ]; then
+    # +-2^k, magic numbers with and without the add, negative ones,
+    # shift and add/sub multiplies, and the ends of the int range
+    "$BIN" -a 2 -8 3 5 7 -7 10 641 1000000007 2147483647 -2147483648 ||
+	exit 1
+fi
@@ -0,0 +1,250 @@
+/*******************************************************
+* strength_check.c -   verifies strength.c against the
+*                      Mul and Div it replaces
+* Language:            Micro
+*
+* Runs each sequence strength_reduce() produces on many
+* values of x, with the semantics of batch.c (wrapping
+* arithmetic of the type's width), and compares it with
+* x * c and x / c (rounding toward zero). Blocks of
+* CHECK_BLOCK values go through one instruction at a
+* time, as in batch.c, so that a sweep of the whole int
+* range takes seconds per constant.
+*
+* Usage:
+*         strength_check          every constant of the
+*                                 sample below, int and
+*                                 long, on sampled x
+*         strength_check -a c ... each int constant c, on
+*                                 every int x (2^32)
+* Exits with 1 at the first mismatch, which it prints.
+********************************************************/
+
+#include <limits.h>
+#include "../compiler.h"
+#include "../strength.h"
+
+#define CHECK_BLOCK 4096
+#define CHECK_NEAR 1024        // constants -CHECK_NEAR..CHECK_NEAR
+#define CHECK_RANDOM 512       // and as many random ones, per type
+
+static long x[CHECK_BLOCK];
+static long val[STRENGTH_MAX + 1][CHECK_BLOCK];
+static long lit[2][CHECK_BLOCK];
+static long want[CHECK_BLOCK];
+static unsigned long numChecked;
+
+static unsigned long
+xorshift(void)
+{
+    static unsigned long s = 88172645463325252ul;
+
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+// Returns: v wrapped to type
+static long
+wrap(unsigned long v, int type)
+{
+    return (INTEGER == type)? (long) (int) (unsigned) v : (long) v;
+}
+
+// Returns: the values of operand o of the sequence, for x[0..n)
+static const long*
+column(const irOperand* o, int which, int n)
+{
+    int i;
+
+    if ( (OPND_INT == o->kind) ){
+	for (i = 0; i < n; i++)
+	    lit[which][i] = o->val_int;
+	return lit[which];
+    }
+    return (STRENGTH_X == o->slot)? x : val[o->slot];
+}
+
+// runs seq[0..len) on x[0..n)
+// Returns: the values of its result
+static const long*
+run(const irInstr* seq, int len, int type, int n)
+{
+    const irInstr* ins;
+    const long *a, *b;
+    long* d;
+    int i, j, k;
+
+    for (j = 0; j < len; j++){
+	ins = &seq[j];
+	a = column(&ins->a, 0, n);
+	b = column(&ins->b, 1, n);
+	d = val[ins->dest.slot];
+	k = (int) ins->b.val_int;
+	switch(ins->op){
+	case IR_ASSIGN:
+	    for (i = 0; i < n; i++)
+		d[i] = a[i];
+	    break;
+	case IR_ADD:
+	    for (i = 0; i < n; i++)
+		d[i] = wrap((unsigned long) a[i] + (unsigned long) b[i], type);
+	    break;
+	case IR_SUB:
+	    for (i = 0; i < n; i++)
+		d[i] = wrap((unsigned long) a[i] - (unsigned long) b[i], type);
+	    break;
+	case IR_MUL:
+	    for (i = 0; i < n; i++)
+		d[i] = wrap((unsigned long) a[i] * (unsigned long) b[i], type);
+	    break;
+	case IR_SHL:
+	    for (i = 0; i < n; i++)
+		d[i] = wrap((unsigned long) a[i] << k, type);
+	    break;
+	case IR_SAR:
+	    for (i = 0; i < n; i++)
+		d[i] = a[i] >> k;
+	    break;
+	case IR_SHR:
+	    for (i = 0; i < n; i++)
+		d[i] = (INTEGER == type)? (long) (int) ((unsigned) a[i] >> k) :
+		    (long) ((unsigned long) a[i] >> k);
+	    break;
+	case IR_MULHI:
+	    for (i = 0; i < n; i++)
+		d[i] = (INTEGER == type)? (long) (int) ((a[i] * b[i]) >> 32) :
+		    (long) (((__int128) a[i] * b[i]) >> 64);
+	    break;
+	default:
+	    fprintf(stderr, "strength_check: unexpected op %d\n", ins->op);
+	    exit(1);
+	}
+    }
+    return val[seq[len - 1].dest.slot];
+}
+
+// checks x * c or x / c (op) for x[0..n)
+static void
+check(enum irOp op, int type, long c, int n)
+{
+    irInstr seq[STRENGTH_MAX];
+    const long* got;
+    int i, len;
+
+    if ( (0 == (len = strength_reduce(op, type, c, seq))) )
+	return;
+    for (i = 0; i < n; i++)
+	if ( (IR_MUL == op) )
+	    want[i] = wrap((unsigned long) x[i] * (unsigned long) c, type);
+	else
+	    want[i] = (INTEGER == type)? (int) x[i] / (int) c : x[i] / c;
+
+    got = run(seq, len, type, n);
+    for (i = 0; i < n; i++){
+	if ( (got[i] == want[i]) )
+	    continue;
+	printf("FAIL %s %s: %ld %s %ld is %ld, not %ld\n",
+	       (INTEGER == type)? "int" : "long",
+	       (IR_MUL == op)? "Mul" : "Div", x[i],
+	       (IR_MUL == op)? "*" : "/", c, got[i], want[i]);
+	exit(1);
+    }
+    numChecked += n;
+}
+
+static void
+checkBoth(int type, long c, int n)
+{
+    check(IR_MUL, type, c, n);
+    check(IR_DIV, type, c, n);
+}
+
+// x[0..n): values around 0, the type's ends, and the multiples of c
+// next to them, and random ones
+static int
+sample(int type, long c)
+{
+    long lo, hi, m;
+    int n, i;
+
+    lo = (INTEGER == type)? INT_MIN : LONG_MIN;
+    hi = (INTEGER == type)? INT_MAX : LONG_MAX;
+    n = 0;
+    for (i = -256; i < 256; i++)
+	x[n++] = i;
+    for (i = 0; i < 256; i++){
+	x[n++] = lo + i;
+	x[n++] = hi - i;
+    }
+    if ( (0 != c) && (-1 != c) ){
+	m = (hi / c) * c;
+	for (i = -64; i < 64; i++){
+	    x[n++] = wrap((unsigned long) m + i, type);
+	    x[n++] = wrap((unsigned long) -m + i, type);
+	    x[n++] = wrap((unsigned long) c * (i / 2) + i % 2, type);
+	}
+    }
+    while ( (n < CHECK_BLOCK) )
+	x[n++] = wrap(xorshift() >> (xorshift() % 64), type);
+    return n;
+}
+
+// the constants: near 0, +-2^k (+-1), the ends, and random ones
+static void
+sweep(int type)
+{
+    long c, p;
+    int k, w, i;
+
+    w = (INTEGER == type)? 32 : 64;
+    for (c = -CHECK_NEAR; c <= CHECK_NEAR; c++)
+	checkBoth(type, c, sample(type, c));
+    for (k = 1; k < w; k++){
+	p = wrap(1ul << k, type);
+	for (i = -1; i <= 1; i++){
+	    checkBoth(type, wrap((unsigned long) p + i, type),
+		      sample(type, wrap((unsigned long) p + i, type)));
+	    checkBoth(type, wrap(-(unsigned long) p + i, type),
+		      sample(type, wrap(-(unsigned long) p + i, type)));
+	}
+    }
+    for (i = 0; i < CHECK_RANDOM; i++){
+	c = wrap(xorshift() >> (xorshift() % w), type);
+	checkBoth(type, c, sample(type, c));
+    }
+}
+
+// every int x, for c
+static void
+exhaust(long c)
+{
+    long v;
+    int n;
+
+    for (v = INT_MIN; v <= INT_MAX; ){
+	for (n = 0; (n < CHECK_BLOCK) && (v <= INT_MAX); n++)
+	    x[n] = v++;
+	checkBoth(INTEGER, c, n);
+    }
+}
+
+int
+main(int argc, char* argv[])
+{
+    int i;
+
+    if ( (1 < argc) && (0 == strcmp("-a", argv[1])) ){
+	for (i = 2; i < argc; i++){
+	    exhaust((int) strtol(argv[i], NULL, 0));
+	    printf("strength_check: x op %s, every int x: ok\n", argv[i]);
+	}
+	return 0;
+    }
+
+    sweep(INTEGER);
+    sweep(LONG);
+    printf("strength_check: %lu values checked: ok\n", numChecked);
+    return 0;
+}
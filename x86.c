@@ -0,0 +1,627 @@
+/*******************************************************
+* x86.c -              x86-64 instruction selection
+* Language:            Micro
+*
+* Lowers the recorded IR to x86-64 instructions, once for
+* both native backends: emitasm.c prints them, emitobj.c
+* encodes them.
+* The slots live in one frame in .bss, which frame.c lays
+* out by cache lines: slot N is at -frame[N](%rbx), %rbx
+* being the frame's top, aligned to FRAME_LINE; those in
+* its first two lines (the hottest) take a one-byte
+* displacement.
+* int uses 32 bit, long 64 bit registers;
+* float uses SSE2 scalar doubles. Values pass through
+* %rax/%rcx/%rdx and %xmm0/%xmm1 only.
+* A vector op (slp.c) loads its lanes, slots in a row,
+* at once, from the lowest address (its last lane's):
+* with 2 lanes to %xmm0/%xmm1 (SSE2), with 4 to %ymm0/
+* %ymm1 (AVX2, ending each run of them with vzeroupper).
+* An int lane is 64 bit wide, of which the low 32 are
+* used: paddq and pmuludq leave them as addl and imull.
+* Each user function is a local subroutine working in
+* the frame, where each of its slots has its own place
+* (there is no recursion, see ir.h): the caller stores
+* the arguments into its PARAM slots, and it returns its
+* value in %rax or %xmm0.
+* read()/write(), and run-time errors, call the m_*()
+* routines of rtio.c (see --emit=rt in emitc.c), so the
+* program reads, prints, and fails like --run.
+* Labels are numbered for the whole program; float
+* branches compare with ucomisd, which leaves NaN
+* (unordered) out of all but <>.
+********************************************************/
+
+#include "compiler.h"
+#include "x86.h"
+
+const char* x86_extern[XE_NUM] = { "m_start", "m_readi", "m_readl",
+    "m_readf", "m_writei", "m_writel", "m_writef", "m_putc", "m_flush",
+    "m_divzero" };
+
+static void (*put)(const xIns* ins);
+static const irProgram* prog;
+static const int* frame;   // per slot: its offset below %rbx
+static int* linked;        // per CALL and FUNCTION: see ir_linkCalls()
+static int* fctLabel;      // per FUNCTION (code index): its label
+static int numLabels;
+static int labelBase;      // label N of the function selected
+static int divZero;
+
+/***************************************************
+* Operands
+*
+****************************************************/
+
+static xOpnd
+opnd(int kind, long n)
+{
+    xOpnd o;
+
+    o.kind = kind;
+    o.n = n;
+    o.f = 0.0;
+    return o;
+}
+
+static xOpnd reg(int r) { return opnd(XO_REG, r); }
+static xOpnd xmm(int r) { return opnd(XO_XMM, r); }
+static xOpnd imm(long n) { return opnd(XO_IMM, n); }
+static xOpnd slot(int s) { return opnd(XO_SLOT, frame[s]); }
+static xOpnd label(int l) { return opnd(XO_LABEL, l); }
+
+static xOpnd
+flt(double x)
+{
+    xOpnd o;
+
+    o = opnd(XO_FLT, 0);
+    o.f = x;
+    return o;
+}
+
+// an IR operand: a slot, an immediate (an int literal, as its type
+// has it), or a float literal
+static xOpnd
+irOpnd(const irOperand* o)
+{
+    switch(o->kind){
+    case OPND_SLOT:
+	return slot(o->slot);
+    case OPND_INT:
+	return imm((INTEGER == o->type)? (long) (int) o->val_int : o->val_int);
+    case OPND_FLT:
+	return flt(o->val_flt);
+    default:
+	errExit(0, "invalid operand in x86 backend");
+    }
+}
+
+static double
+fltOfLit(const irOperand* o)
+{
+    return (OPND_FLT == o->kind)? o->val_flt : (double) o->val_int;
+}
+
+// the lanes of a vector operand, from its last one
+static xOpnd
+lanes(const irOperand* o)
+{
+    return slot(o->slot + prog->lanes - 1);
+}
+
+static int
+newLabel(void) { return numLabels++; }
+
+/***************************************************
+* Instructions
+*
+****************************************************/
+
+static void
+emit(enum xOp op, int w, xOpnd d, xOpnd s)
+{
+    xIns ins;
+
+    ins.op = op;
+    ins.w = w;
+    ins.cc = XC_E;
+    ins.d = d;
+    ins.s = s;
+    ins.name = NULL;
+    put(&ins);
+}
+
+static void
+emit1(enum xOp op, int w, xOpnd d) { emit(op, w, d, opnd(XO_NONE, 0)); }
+
+static void
+emit0(enum xOp op) { emit1(op, 0, opnd(XO_NONE, 0)); }
+
+static void
+jcc(enum xCond cc, int l)
+{
+    xIns ins;
+
+    ins.op = X_JCC;
+    ins.w = 0;
+    ins.cc = cc;
+    ins.d = label(l);
+    ins.s = opnd(XO_NONE, 0);
+    ins.name = NULL;
+    put(&ins);
+}
+
+static void
+place(int l) { emit1(X_LABEL, 0, label(l)); }
+
+static void
+call(int ext) { emit1(X_CALL, 0, opnd(XO_EXT, ext)); }
+
+static int
+isWideImm(const irOperand* o)
+{
+    return (OPND_INT == o->kind) && (LONG == o->type) &&
+	( (o->val_int < -2147483648L) || (o->val_int > 2147483647L) );
+}
+
+// integer operand -> register r (32 bit for int)
+static void
+loadGPR(const irOperand* o, int r)
+{
+    emit(X_MOV, (INTEGER != o->type), reg(r), irOpnd(o));
+}
+
+// second operand of a two-operand instruction: wide immediates are
+// moved to %rcx first
+static xOpnd
+srcGPR(const irOperand* o)
+{
+    if ( isWideImm(o) ){
+	loadGPR(o, X_RCX);
+	return reg(X_RCX);
+    }
+    return irOpnd(o);
+}
+
+static void
+loadXMM(const irOperand* o) { emit(X_MOVSD, 0, xmm(0), irOpnd(o)); }
+
+static void
+storeResult(const irInstr* ins)
+{
+    if ( (FLOAT == ins->type) )
+	emit(X_MOVSD, 0, slot(ins->dest.slot), xmm(0));
+    else
+	emit(X_MOV, (LONG == ins->type), slot(ins->dest.slot), reg(X_RAX));
+}
+
+static void
+selectArith(const irInstr* ins)
+{
+    static const enum xOp fltOps[] = { X_ADDSD, X_SUBSD, X_MULSD, X_DIVSD };
+    static const enum xOp intOps[] = { X_ADD, X_SUB, X_IMUL };
+    int w, l;
+
+    w = (LONG == ins->type);
+    if ( (FLOAT == ins->type) ){
+	loadXMM(&ins->a);
+	emit(fltOps[ins->op - IR_ADD], 0, xmm(0), irOpnd(&ins->b));
+    }
+    else if ( (IR_DIV != ins->op) ){
+	loadGPR(&ins->a, X_RAX);
+	emit(intOps[ins->op - IR_ADD], w, reg(X_RAX), srcGPR(&ins->b));
+    }
+    else{ // checked division; x / -1 is a (wrapping) negation
+	l = newLabel();
+	newLabel();
+	loadGPR(&ins->a, X_RAX);
+	loadGPR(&ins->b, X_RCX);
+	emit(X_TEST, w, reg(X_RCX), reg(X_RCX));
+	jcc(XC_E, divZero);
+	emit(X_CMP, w, reg(X_RCX), imm(-1));
+	jcc(XC_NE, l);
+	emit1(X_NEG, w, reg(X_RAX));
+	emit1(X_JMP, 0, label(l + 1));
+	place(l);
+	emit1(X_CDQ, w, opnd(XO_NONE, 0));
+	emit1(X_IDIV, w, reg(X_RCX));
+	place(l + 1);
+    }
+
+    storeResult(ins);
+}
+
+// literal o -> every lane of %xmm<r> (%ymm<r> with AVX2)
+static void
+broadcast(const irOperand* o, int r, int avx)
+{
+    if ( (FLOAT == o->type) ){
+	if (avx)
+	    emit(X_BROADCASTSD, 1, xmm(r), flt(fltOfLit(o)));
+	else{
+	    emit(X_MOVSD, 0, xmm(r), flt(fltOfLit(o)));
+	    emit(X_UNPCKLPD, 0, xmm(r), xmm(r));
+	}
+	return;
+    }
+
+    loadGPR(o, X_RAX);
+    emit(X_MOVQ, avx, xmm(r), reg(X_RAX));
+    if (avx)
+	emit(X_PBROADCASTQ, 1, xmm(r), xmm(r));
+    else
+	emit(X_PUNPCKLQDQ, 0, xmm(r), xmm(r));
+}
+
+// last: 1 if the next instruction is not a vector op
+static void
+selectVector(const irInstr* ins, int last)
+{
+    static const enum xOp fltOps[] = { X_ADDPD, X_SUBPD, X_MULPD };
+    static const enum xOp intOps[] = { X_PADDQ, X_PSUBQ, X_PMULUDQ };
+    enum xOp mov, op;
+    int avx;
+
+    avx = (4 == prog->lanes);
+    mov = (FLOAT == ins->type)? X_MOVUPD : X_MOVDQU;
+
+    if ( (OPND_SLOT == ins->a.kind) )
+	emit(mov, avx, xmm(0), lanes(&ins->a));
+    else
+	broadcast(&ins->a, 0, avx);
+
+    if ( (IR_VASSIGN != ins->op) ){
+	op = (FLOAT == ins->type)? fltOps[ins->op - IR_VADD] :
+	    intOps[ins->op - IR_VADD];
+	if ( (OPND_SLOT != ins->b.kind) )
+	    broadcast(&ins->b, 1, avx);
+	else if ( !avx ) // SSE2 wants memory aligned
+	    emit(mov, 0, xmm(1), lanes(&ins->b));
+	emit(op, avx, xmm(0), (avx && (OPND_SLOT == ins->b.kind))?
+	     lanes(&ins->b) : xmm(1));
+    }
+
+    emit(mov, avx, lanes(&ins->dest), xmm(0));
+    if ( avx && last )
+	emit0(X_VZEROUPPER);
+}
+
+// the operations of strength.c: b is a literal
+static void
+selectShift(const irInstr* ins)
+{
+    static const enum xOp ops[] = { X_SHL, X_SAR, X_SHR };
+    int w;
+
+    w = (LONG == ins->type);
+    loadGPR(&ins->a, X_RAX);
+    if ( (IR_MULHI != ins->op) )
+	emit(ops[ins->op - IR_SHL], w, reg(X_RAX), imm(ins->b.val_int));
+    else{ // high half lands in %edx / %rdx
+	loadGPR(&ins->b, X_RCX);
+	emit1(X_IMUL1, w, reg(X_RCX));
+	emit(X_MOV, w, reg(X_RAX), reg(X_RDX));
+    }
+
+    storeResult(ins);
+}
+
+// float -> int/long: cvttsd2si yields the "integer indefinite" value,
+// i.e. the minimum of the type, when out of range - as in batch.c
+static void
+selectConvert(const irInstr* ins)
+{
+    int from, to;
+
+    from = ins->a.type;
+    to = ins->type;
+
+    if ( (LONG == to) && (INTEGER == from) ){
+	if ( (OPND_INT == ins->a.kind) )
+	    emit(X_MOV, 1, reg(X_RAX), irOpnd(&ins->a));
+	else
+	    emit(X_MOVSX, 1, reg(X_RAX), irOpnd(&ins->a));
+    }
+    else if ( (FLOAT == to) ){
+	if ( (OPND_SLOT == ins->a.kind) )
+	    emit(X_CVTSI2SD, (LONG == from), xmm(0), irOpnd(&ins->a));
+	else{
+	    loadGPR(&ins->a, X_RAX);
+	    emit(X_CVTSI2SD, (LONG == from), xmm(0), reg(X_RAX));
+	}
+    }
+    else if ( (FLOAT == from) ){
+	loadXMM(&ins->a);
+	emit(X_CVTTSD2SI, (LONG == to), reg(X_RAX), xmm(0));
+    }
+    else
+	loadGPR(&ins->a, X_RAX);
+
+    storeResult(ins);
+}
+
+static int
+typeIndex(int type)
+{
+    return (INTEGER == type)? 0 : (LONG == type)? 1 : 2;
+}
+
+// m_readi() etc. fail themselves past the end of input
+static void
+selectRead(const irInstr* ins)
+{
+    call(XE_READI + typeIndex(ins->type));
+    storeResult(ins);
+}
+
+static void
+selectWrite(const irInstr* ins, int sep)
+{
+    if (sep){
+	emit(X_MOV, 0, reg(X_RDI), imm(' '));
+	call(XE_PUTC);
+    }
+
+    if ( (FLOAT == ins->type) )
+	loadXMM(&ins->a);
+    else
+	loadGPR(&ins->a, X_RDI);
+    call(XE_WRITEI + typeIndex(ins->type));
+}
+
+// labels 0..N of the function starting at code[from]
+static void
+newFunctionLabels(int from)
+{
+    long maxLabel;
+    int i;
+
+    maxLabel = 0;
+    for (i = from; (i < prog->len) && (IR_END != prog->code[i].op); i++)
+	if ( (IR_LABEL == prog->code[i].op) )
+	    maxLabel = max(maxLabel, prog->code[i].dest.val_int);
+    labelBase = numLabels;
+    numLabels += maxLabel + 1;
+}
+
+// %rbx is the top of the frame (see frame.c), which main() sets, and
+// saves below the return address
+static void
+selectPrologue(int from)
+{
+    xIns ins;
+
+    fctLabel[from] = newLabel();
+    ins.op = X_FUNCTION;
+    ins.w = (INVALID == prog->code[from].type);
+    ins.cc = XC_E;
+    ins.d = label(fctLabel[from]);
+    ins.s = opnd(XO_NONE, 0);
+    ins.name = prog->code[from].name;
+    put(&ins);
+
+    if ( !ins.w ){ // entered with %rsp 8 off 16 byte alignment
+	emit(X_SUB, 1, reg(X_RSP), imm(8));
+	return;
+    }
+    emit1(X_PUSH, 1, reg(X_RBX));
+    emit(X_LEA, 1, reg(X_RBX), opnd(XO_FRAME, prog->frameSize));
+    call(XE_START);
+}
+
+// copy the ARGs before code[at] into the callee's PARAM slots
+static void
+selectCall(int at, int numArgs)
+{
+    const irInstr* ins;
+    const irInstr* arg;
+    const irInstr* param;
+    int f;
+
+    ins = &prog->code[at];
+    if ( (0 > (f = linked[at])) || (-1 == fctLabel[f]) )
+	errExit(0, "call of undefined function (%s)", ins->name);
+
+    param = &prog->code[f + 1];
+    for (arg = ins - numArgs; arg < ins; arg++, param++){
+	if ( (FLOAT == param->type) ){
+	    loadXMM(&arg->a);
+	    emit(X_MOVSD, 0, slot(param->dest.slot), xmm(0));
+	    continue;
+	}
+	loadGPR(&arg->a, X_RAX);
+	emit(X_MOV, (LONG == param->type), slot(param->dest.slot), reg(X_RAX));
+    }
+
+    emit1(X_CALL, 0, label(fctLabel[f]));
+    storeResult(ins);
+}
+
+// branch to label N (ins->dest) of the function if a rel b
+static void
+selectBranch(const irInstr* ins)
+{
+    static const enum xCond intCC[] = { XC_E, XC_NE, XC_L, XC_LE, XC_G,
+					XC_GE };
+    const irOperand* x;
+    const irOperand* y;
+    int l, skip;
+
+    l = labelBase + ins->dest.val_int;
+    if ( (FLOAT != ins->type) ){
+	loadGPR(&ins->a, X_RAX);
+	emit(X_CMP, (LONG == ins->type), reg(X_RAX), srcGPR(&ins->b));
+	jcc(intCC[ins->op - IR_BEQ], l);
+	return;
+    }
+
+    // a < b is b > a: ja and jae are false for unordered operands
+    x = &ins->a;
+    y = &ins->b;
+    if ( (IR_BLT == ins->op) || (IR_BLE == ins->op) ){
+	x = &ins->b;
+	y = &ins->a;
+    }
+    loadXMM(x);
+    emit(X_UCOMISD, 0, xmm(0), irOpnd(y));
+    switch(ins->op){
+    case IR_BEQ:
+	skip = newLabel();
+	jcc(XC_P, skip);
+	jcc(XC_E, l);
+	place(skip);
+	break;
+    case IR_BNE:
+	jcc(XC_P, l);
+	jcc(XC_NE, l);
+	break;
+    case IR_BLT:
+    case IR_BGT:
+	jcc(XC_A, l);
+	break;
+    default:
+	jcc(XC_AE, l);
+	break;
+    }
+}
+
+static void
+selectEpilogue(void)
+{
+    call(XE_FLUSH);
+    emit(X_XOR, 0, reg(X_RAX), reg(X_RAX));
+    emit1(X_POP, 1, reg(X_RBX));
+    emit0(X_RET);
+
+    // m_divzero() flushes what was written, reports, and exits
+    place(divZero);
+    call(XE_DIVZERO);
+    emit0(X_END);
+}
+
+void
+x86_select(const irProgram* p, void (*putIns)(const xIns* ins))
+{
+    const irInstr* ins;
+    xIns clear;
+    int i, w, numArgs;
+
+    put = putIns;
+    prog = p;
+    frame = prog->frame;
+    linked = ir_linkCalls(prog);
+    if ( (NULL == (fctLabel = malloc((prog->len + 1) * sizeof(int)))) )
+	errExit(1, "...malloc()...");
+    for (i = 0; i < prog->len; i++)
+	fctLabel[i] = -1;
+    numLabels = 0;
+    divZero = newLabel();
+    numArgs = w = 0;
+
+    for (i = 0; i < prog->len; i++){
+	ins = &prog->code[i];
+	switch(ins->op){
+	case IR_FUNCTION:
+	    if ( (INVALID != ins->type) && (-1 == linked[i]) ){
+		while ( (IR_END != prog->code[i].op) ) // all inlined
+		    i++;
+		break;
+	    }
+	    selectPrologue(i);
+	    newFunctionLabels(i);
+	    break;
+	case IR_END:
+	    if ( (INVALID == ins->type) )
+		selectEpilogue();
+	    break;
+	case IR_DECLARE: // each time it runs (in a loop, too)
+	    clear.op = X_MOV;
+	    clear.w = (INTEGER != ins->type);
+	    clear.cc = XC_E;
+	    clear.d = slot(ins->dest.slot);
+	    clear.s = imm(0);
+	    clear.name = ins->name;
+	    put(&clear);
+	    break;
+	case IR_PARAM:   // see selectCall()
+	    break;
+	case IR_LABEL:
+	    place(labelBase + ins->dest.val_int);
+	    break;
+	case IR_JUMP:
+	    emit1(X_JMP, 0, label(labelBase + ins->dest.val_int));
+	    break;
+	case IR_BEQ:
+	case IR_BNE:
+	case IR_BLT:
+	case IR_BLE:
+	case IR_BGT:
+	case IR_BGE:
+	    selectBranch(ins);
+	    break;
+	case IR_RETURN:
+	    if ( (FLOAT == ins->type) )
+		loadXMM(&ins->a);
+	    else
+		loadGPR(&ins->a, X_RAX);
+	    emit(X_ADD, 1, reg(X_RSP), imm(8));
+	    emit0(X_RET);
+	    break;
+	case IR_ARG:
+	    numArgs++;
+	    break;
+	case IR_CALL:
+	    selectCall(i, numArgs);
+	    numArgs = 0;
+	    break;
+	case IR_ASSIGN:
+	    if ( (FLOAT == ins->type) )
+		loadXMM(&ins->a);
+	    else
+		loadGPR(&ins->a, X_RAX);
+	    storeResult(ins);
+	    break;
+	case IR_ADD:
+	case IR_SUB:
+	case IR_MUL:
+	case IR_DIV:
+	    selectArith(ins);
+	    break;
+	case IR_SHL:
+	case IR_SAR:
+	case IR_SHR:
+	case IR_MULHI:
+	    selectShift(ins);
+	    break;
+	case IR_PROMOTE:
+	case IR_CONVERT:
+	    selectConvert(ins);
+	    break;
+	case IR_VASSIGN:
+	case IR_VADD:
+	case IR_VSUB:
+	case IR_VMUL:
+	    selectVector(ins, (i + 1 == prog->len) ||
+			 !ir_isVector(prog->code[i + 1].op));
+	    break;
+	case IR_READ:
+	    selectRead(ins);
+	    break;
+	case IR_WRITE:
+	    selectWrite(ins, (0 != w++));
+	    break;
+	case IR_WRITELN:
+	    emit(X_MOV, 0, reg(X_RDI), imm('\n'));
+	    call(XE_PUTC);
+	    w = 0;
+	    break;
+	default:
+	    errExit(0, "invalid IR instruction (%d) in x86 backend", ins->op);
+	    break;
+	}
+    }
+
+    free(fctLabel);
+    free(linked);
+}
@@ -0,0 +1,63 @@
+/*******************************************************
+* x86.h -              header file for x86.c
+* Language:            Micro
+*
+********************************************************
+* Usage:
+*         x86_select(&irProg, put);  // put(&ins), for each
+*                                    // instruction, in order
+* The assembly backend (emitasm.c) prints what put()
+* gets, the object backend (emitobj.c) encodes it.
+********************************************************/
+
+#ifndef X86_H_
+#define X86_H_
+
+#include "ir.h"
+
+enum { X_RAX, X_RCX, X_RDX, X_RBX, X_RSP, X_RBP, X_RSI, X_RDI };
+
+enum xOp{
+    // integer: w - 1 for 64 bit operands; one operand: d
+    X_MOV, X_MOVSX, X_LEA, X_ADD, X_SUB, X_CMP, X_XOR, X_TEST, X_IMUL,
+    X_IMUL1, X_NEG, X_IDIV, X_CDQ, X_SHL, X_SAR, X_SHR, X_PUSH, X_POP,
+    X_CALL, X_RET, X_JMP, X_JCC,
+    // scalar double; w - 1: the integer operand is 64 bit
+    X_MOVSD, X_ADDSD, X_SUBSD, X_MULSD, X_DIVSD, X_UCOMISD, X_CVTSI2SD,
+    X_CVTTSD2SI,
+    // vector; w - 1: AVX2 (VEX, %ymm)
+    X_MOVQ, X_UNPCKLPD, X_PUNPCKLQDQ, X_BROADCASTSD, X_PBROADCASTQ,
+    X_MOVUPD, X_MOVDQU, X_ADDPD, X_SUBPD, X_MULPD, X_PADDQ, X_PSUBQ,
+    X_PMULUDQ, X_VZEROUPPER,
+    // not instructions: d - the label; X_FUNCTION: w - 1 for main()
+    X_LABEL, X_FUNCTION, X_END
+};
+
+// X_JCC: the condition
+enum xCond{ XC_E, XC_NE, XC_L, XC_LE, XC_G, XC_GE, XC_A, XC_AE, XC_P };
+
+// functions of the run-time support called (rtio.c: m_*())
+enum { XE_START, XE_READI, XE_READL, XE_READF, XE_WRITEI, XE_WRITEL,
+       XE_WRITEF, XE_PUTC, XE_FLUSH, XE_DIVZERO, XE_NUM };
+extern const char* x86_extern[XE_NUM];
+
+typedef struct xOpnd{
+    enum { XO_NONE, XO_REG, XO_XMM, XO_IMM, XO_SLOT, XO_FLT, XO_FRAME,
+	   XO_LABEL, XO_EXT } kind;
+    long n;      // register; immediate; offset below %rbx (slot, or
+		 // the frame's size: its top); label; function
+    double f;    // XO_FLT: a float literal, in .rodata
+} xOpnd;
+
+typedef struct xIns{
+    enum xOp op;
+    int w;
+    enum xCond cc;
+    xOpnd d, s;        // AT&T order: s, d
+    const char* name;  // X_FUNCTION: the function; X_MOV: the
+		       // variable a Declare clears
+} xIns;
+
+void x86_select(const irProgram* prog, void (*put)(const xIns* ins));
+
+#endif